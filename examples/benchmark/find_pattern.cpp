@@ -0,0 +1,258 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include "find_pattern.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <locale>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/detail/parallel_for.hpp>
+#include <hadesmem/detail/pattern_search.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/find_pattern.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+#include "main.hpp"
+
+namespace
+{
+// Patterns are taken from the back half of the buffer so that scanning for
+// them has to walk most of it, and roughly one in four bytes is a wildcard.
+std::vector<std::wstring>
+  GenerateSyntheticPatterns(std::vector<std::uint8_t> const& buffer,
+                            std::size_t num_patterns)
+{
+  std::mt19937 engine{0x1337};
+  std::vector<std::wstring> patterns;
+  for (std::size_t i = 0; i < num_patterns; ++i)
+  {
+    std::size_t const len = 8 + engine() % 17;
+    std::size_t const half = buffer.size() / 2;
+    std::size_t const offset = half + engine() % (half - len);
+
+    std::wostringstream data;
+    data.imbue(std::locale::classic());
+    data << std::hex;
+    for (std::size_t j = 0; j < len; ++j)
+    {
+      if (j)
+      {
+        data << L' ';
+      }
+
+      // Never use a wildcard for the first byte, same as real patterns.
+      if (j && engine() % 4 == 0)
+      {
+        data << L"??";
+      }
+      else
+      {
+        data << static_cast<std::uint32_t>(buffer[offset + j]);
+      }
+    }
+
+    patterns.emplace_back(data.str());
+  }
+
+  return patterns;
+}
+}
+
+void BenchmarkFindPatternMulti(std::size_t buffer_size,
+                               std::size_t num_patterns)
+{
+  std::wcout << L"\nFindPattern (multi-pattern, " << (buffer_size >> 20)
+             << L" MB, " << num_patterns << L" patterns):\n";
+
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  auto buffer = GenerateRandomBuffer(buffer_size, 0xDEADBEEF);
+  auto const patterns = GenerateSyntheticPatterns(buffer, num_patterns);
+
+  std::vector<void*> single_results;
+  double const single_ms = TimeMilliseconds([&]()
+                                            {
+    for (auto const& pattern : patterns)
+    {
+      single_results.push_back(
+        hadesmem::Find(process,
+                       buffer.data(),
+                       buffer.size(),
+                       pattern,
+                       hadesmem::PatternFlags::kRelativeAddress,
+                       0U));
+    }
+  });
+  WriteTiming(L"Per-pattern", single_ms);
+
+  std::vector<std::size_t> multi_results;
+  double const multi_ms = TimeMilliseconds([&]()
+                                           {
+    std::vector<hadesmem::CompiledPattern> compiled;
+    std::vector<hadesmem::detail::PackedPattern> packed;
+    compiled.reserve(patterns.size());
+    for (auto const& pattern : patterns)
+    {
+      compiled.emplace_back(pattern);
+      packed.push_back(compiled.back().GetPacked());
+    }
+
+    auto const haystack =
+      hadesmem::ReadVector<std::uint8_t>(process, buffer.data(), buffer.size());
+    hadesmem::detail::MultiPatternScanner const scanner{packed};
+    std::vector<std::size_t> const min_offsets(packed.size());
+    scanner.Scan(haystack.data(),
+                 haystack.data() + haystack.size(),
+                 min_offsets,
+                 multi_results);
+  });
+  WriteTiming(L"Multi-pattern", multi_ms);
+
+  for (std::size_t i = 0; i < patterns.size(); ++i)
+  {
+    if (reinterpret_cast<std::size_t>(single_results[i]) != multi_results[i])
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error() << hadesmem::ErrorString("Result mismatch."));
+    }
+  }
+}
+
+void BenchmarkFindPatternCompiled(std::size_t num_scans)
+{
+  std::wcout << L"\nFindPattern (compiled pattern, " << num_scans
+             << L" scans):\n";
+
+  hadesmem::Process const process{::GetCurrentProcessId()};
+
+  // Repeatedly scanning a small region (e.g. re-resolving a pointer every
+  // frame) is dominated by per-call overhead rather than the search itself.
+  std::wstring const data = L"48 89 5C 24 ?? 57 48 83 EC 20 8B F9";
+  hadesmem::CompiledPattern const compiled{data};
+  auto buffer = GenerateRandomBuffer(0x1000, 0xDEADBEEF);
+  std::size_t const expected = buffer.size() - compiled.GetSize();
+  for (std::size_t i = 0; i < compiled.GetSize(); ++i)
+  {
+    buffer[expected + i] = compiled.GetPacked().values[i];
+  }
+
+  auto const check_result = [&](void* result)
+  {
+    if (reinterpret_cast<std::size_t>(result) != expected)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error() << hadesmem::ErrorString("Result mismatch."));
+    }
+  };
+
+  void* string_result = nullptr;
+  double const string_ms = TimeMilliseconds([&]()
+                                            {
+    for (std::size_t i = 0; i < num_scans; ++i)
+    {
+      string_result = hadesmem::Find(process,
+                                     buffer.data(),
+                                     buffer.size(),
+                                     data,
+                                     hadesmem::PatternFlags::kRelativeAddress,
+                                     0U);
+    }
+  });
+  check_result(string_result);
+  WriteTiming(L"String", string_ms);
+
+  void* compiled_result = nullptr;
+  double const compiled_ms = TimeMilliseconds([&]()
+                                              {
+    for (std::size_t i = 0; i < num_scans; ++i)
+    {
+      compiled_result =
+        hadesmem::Find(process,
+                       buffer.data(),
+                       buffer.size(),
+                       compiled,
+                       hadesmem::PatternFlags::kRelativeAddress,
+                       0U);
+    }
+  });
+  check_result(compiled_result);
+  WriteTiming(L"Compiled", compiled_ms);
+}
+
+void BenchmarkFindPatternParallel(std::size_t buffer_size,
+                                  std::size_t num_patterns)
+{
+  std::size_t const num_threads = hadesmem::detail::GetHardwareThreadCount();
+  std::wcout << L"\nFindPattern (parallel, " << (buffer_size >> 20) << L" MB, "
+             << num_patterns << L" patterns, " << num_threads
+             << L" threads):\n";
+
+  auto const buffer = GenerateRandomBuffer(buffer_size, 0xDEADBEEF);
+  auto const patterns = GenerateSyntheticPatterns(buffer, num_patterns);
+  std::vector<hadesmem::CompiledPattern> compiled;
+  std::vector<hadesmem::detail::PackedPattern> packed;
+  compiled.reserve(patterns.size());
+  for (auto const& pattern : patterns)
+  {
+    compiled.emplace_back(pattern);
+    packed.push_back(compiled.back().GetPacked());
+  }
+
+  std::uint8_t const* const h_beg = buffer.data();
+  std::uint8_t const* const h_end = buffer.data() + buffer.size();
+
+  // Scan for the pattern furthest into the buffer, so both versions have to
+  // walk most of it.
+  std::vector<std::size_t> serial_results;
+  std::vector<std::size_t> const min_offsets(packed.size());
+  hadesmem::detail::MultiPatternScanner const scanner{packed};
+  scanner.Scan(h_beg, h_end, min_offsets, serial_results, 1);
+  auto const& last = compiled[static_cast<std::size_t>(
+    std::max_element(std::begin(serial_results), std::end(serial_results)) -
+    std::begin(serial_results))];
+
+  std::uint8_t const* single_serial = nullptr;
+  double const single_serial_ms = TimeMilliseconds([&]()
+                                                   {
+    single_serial = hadesmem::detail::FindRawLocal(h_beg, h_end, last, 1);
+  });
+  WriteTiming(L"Single (serial)", single_serial_ms);
+
+  std::uint8_t const* single_parallel = nullptr;
+  double const single_parallel_ms = TimeMilliseconds([&]()
+                                                     {
+    single_parallel =
+      hadesmem::detail::FindRawLocal(h_beg, h_end, last, num_threads);
+  });
+  WriteTiming(L"Single (parallel)", single_parallel_ms);
+
+  double const multi_serial_ms = TimeMilliseconds([&]()
+                                                  {
+    scanner.Scan(h_beg, h_end, min_offsets, serial_results, 1);
+  });
+  WriteTiming(L"Multi (serial)", multi_serial_ms);
+
+  std::vector<std::size_t> parallel_results;
+  double const multi_parallel_ms = TimeMilliseconds([&]()
+                                                    {
+    scanner.Scan(h_beg, h_end, min_offsets, parallel_results, num_threads);
+  });
+  WriteTiming(L"Multi (parallel)", multi_parallel_ms);
+
+  if (single_serial != single_parallel || serial_results != parallel_results)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error() << hadesmem::ErrorString("Result mismatch."));
+  }
+}
@@ -0,0 +1,14 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+
+void BenchmarkFindPatternMulti(std::size_t buffer_size,
+                               std::size_t num_patterns);
+
+void BenchmarkFindPatternCompiled(std::size_t num_scans);
+
+void BenchmarkFindPatternParallel(std::size_t buffer_size,
+                                  std::size_t num_patterns);
@@ -0,0 +1,126 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include "main.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <tclap/CmdLine.h>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/error.hpp>
+
+#include "find_pattern.hpp"
+#include "pattern_search.hpp"
+#include "region_cache.hpp"
+
+std::vector<std::uint8_t> GenerateRandomBuffer(std::size_t size,
+                                               std::uint32_t seed)
+{
+  std::mt19937 engine{seed};
+  std::vector<std::uint8_t> buffer(size);
+  for (auto& b : buffer)
+  {
+    b = static_cast<std::uint8_t>(engine());
+  }
+  return buffer;
+}
+
+void WriteTiming(std::wstring const& name, double milliseconds)
+{
+  std::wcout << name << L": " << std::fixed << std::setprecision(2)
+             << milliseconds << L" ms\n";
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    std::cout << "HadesMem Benchmark [" << HADESMEM_VERSION_STRING << "]\n";
+
+    TCLAP::CmdLine cmd{"Benchmarks", ' ', HADESMEM_VERSION_STRING};
+    TCLAP::ValueArg<std::string> benchmark_arg{"",
+                                               "benchmark",
+                                               "Benchmark to run (default all)",
+                                               false,
+                                               "",
+                                               "string",
+                                               cmd};
+    TCLAP::ValueArg<std::size_t> size_arg{"",
+                                          "size-mb",
+                                          "Size of synthetic buffers (MB)",
+                                          false,
+                                          64,
+                                          "size_t",
+                                          cmd};
+    TCLAP::ValueArg<std::size_t> patterns_arg{"",
+                                              "patterns",
+                                              "Number of patterns to scan for",
+                                              false,
+                                              300,
+                                              "size_t",
+                                              cmd};
+    cmd.parse(argc, argv);
+
+    std::string const benchmark = benchmark_arg.getValue();
+    std::size_t const buffer_size = size_arg.getValue() * (1UL << 20);
+    std::size_t const num_patterns = patterns_arg.getValue();
+
+    bool ran_benchmark = false;
+
+    if (benchmark.empty() || benchmark == "find-pattern-multi")
+    {
+      BenchmarkFindPatternMulti(buffer_size, num_patterns);
+      ran_benchmark = true;
+    }
+
+    if (benchmark.empty() || benchmark == "find-pattern-kernel")
+    {
+      BenchmarkFindPatternKernel(buffer_size);
+      ran_benchmark = true;
+    }
+
+    if (benchmark.empty() || benchmark == "find-pattern-compiled")
+    {
+      BenchmarkFindPatternCompiled(100000);
+      ran_benchmark = true;
+    }
+
+    if (benchmark.empty() || benchmark == "find-pattern-parallel")
+    {
+      BenchmarkFindPatternParallel(buffer_size, num_patterns);
+      ran_benchmark = true;
+    }
+
+    if (benchmark.empty() || benchmark == "region-cache")
+    {
+      BenchmarkRegionCache(1000000);
+      ran_benchmark = true;
+    }
+
+    if (!ran_benchmark)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error() << hadesmem::ErrorString("Unknown benchmark."));
+    }
+
+    return 0;
+  }
+  catch (...)
+  {
+    std::cerr << "\nError!\n"
+              << boost::current_exception_diagnostic_information() << '\n';
+
+    return 1;
+  }
+}
@@ -0,0 +1,23 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+std::vector<std::uint8_t> GenerateRandomBuffer(std::size_t size,
+                                               std::uint32_t seed);
+
+void WriteTiming(std::wstring const& name, double milliseconds);
+
+template <typename Func> double TimeMilliseconds(Func func)
+{
+  auto const start = std::chrono::high_resolution_clock::now();
+  func();
+  auto const end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
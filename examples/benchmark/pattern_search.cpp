@@ -0,0 +1,103 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include "pattern_search.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/pattern_search.hpp>
+
+#include "main.hpp"
+
+// Only uses the search kernels on an in-memory buffer (no windows.h, no
+// Process), so this one can be built and run on any x86/x64 target.
+void BenchmarkFindPatternKernel(std::size_t buffer_size)
+{
+  std::wcout << L"\nFindPattern (search kernel, " << (buffer_size >> 20)
+             << L" MB):\n";
+
+  // Typical x64 function prologue (48 89 5C 24 ?? 57 48 83 EC 20 8B F9),
+  // planted at the very end of the buffer so every kernel has to scan all of
+  // it.
+  std::vector<std::uint8_t> const values = {
+    0x48, 0x89, 0x5C, 0x24, 0x00, 0x57, 0x48, 0x83, 0xEC, 0x20, 0x8B, 0xF9};
+  std::vector<std::uint8_t> const masks = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  hadesmem::detail::PackedPattern pattern{
+    values.data(), masks.data(), values.size(), 0, 0};
+  hadesmem::detail::SelectPatternAnchors(masks.data(),
+                                         values.data(),
+                                         values.size(),
+                                         pattern.anchor_first,
+                                         pattern.anchor_second);
+  auto buffer = GenerateRandomBuffer(buffer_size, 0xDEADBEEF);
+  std::size_t const expected = buffer.size() - pattern.size;
+  std::copy(std::begin(values), std::end(values), buffer.begin() + expected);
+
+  std::uint8_t const* const h_beg = buffer.data();
+  std::uint8_t const* const h_end = buffer.data() + buffer.size();
+  auto const check_result = [&](std::uint8_t const* result)
+  {
+    if (result != h_beg + expected)
+    {
+      throw std::runtime_error("Result mismatch.");
+    }
+  };
+
+  // Byte-at-a-time search over the old (value, wildcard) representation.
+  std::vector<std::pair<std::uint8_t, bool>> needle;
+  for (std::size_t i = 0; i < pattern.size; ++i)
+  {
+    needle.emplace_back(pattern.values[i], !pattern.masks[i]);
+  }
+
+  std::uint8_t const* search_result = nullptr;
+  double const search_ms = TimeMilliseconds([&]()
+                                            {
+    search_result = std::search(
+      h_beg,
+      h_end,
+      std::begin(needle),
+      std::end(needle),
+      [](std::uint8_t h_cur, std::pair<std::uint8_t, bool> const& n_cur)
+      {
+        return n_cur.second || h_cur == n_cur.first;
+      });
+  });
+  check_result(search_result);
+  WriteTiming(L"std::search", search_ms);
+
+  struct KernelInfo
+  {
+    hadesmem::detail::SimdLevel level;
+    wchar_t const* name;
+  };
+  KernelInfo const kernels[] = {
+    {hadesmem::detail::SimdLevel::kScalar, L"Scalar"},
+    {hadesmem::detail::SimdLevel::kSse2, L"SSE2"},
+    {hadesmem::detail::SimdLevel::kAvx2, L"AVX2"}};
+  for (auto const& kernel : kernels)
+  {
+    if (kernel.level > hadesmem::detail::GetSimdLevel())
+    {
+      std::wcout << kernel.name << L": Unsupported\n";
+      continue;
+    }
+
+    std::uint8_t const* kernel_result = nullptr;
+    double const kernel_ms = TimeMilliseconds([&]()
+                                              {
+      kernel_result =
+        hadesmem::detail::FindPacked(h_beg, h_end, pattern, kernel.level);
+    });
+    check_result(kernel_result);
+    WriteTiming(kernel.name, kernel_ms);
+  }
+}
@@ -0,0 +1,180 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include "region_cache.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/detail/region_cache.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+#include "main.hpp"
+
+namespace
+{
+// Stands in for VirtualQueryEx over a synthetic address space, so the number
+// of queries can be counted exactly.
+class MockAddressSpace
+{
+public:
+  explicit MockAddressSpace(std::size_t num_regions)
+  {
+    std::mt19937 engine{0xC0FFEE};
+    std::uintptr_t cur = kBase;
+    for (std::size_t i = 0; i < num_regions; ++i)
+    {
+      std::uintptr_t const size = (1 + engine() % 16) * kPageSize;
+      region_ends_.push_back(cur + size);
+      cur += size;
+    }
+  }
+
+  MEMORY_BASIC_INFORMATION Query(void const* address)
+  {
+    ++num_queries_;
+
+    auto const address_num = reinterpret_cast<std::uintptr_t>(address);
+    auto const iter = std::upper_bound(
+      std::begin(region_ends_), std::end(region_ends_), address_num);
+    if (address_num < kBase || iter == std::end(region_ends_))
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error() << hadesmem::ErrorString("Invalid mock address."));
+    }
+
+    std::uintptr_t const page = address_num & ~(kPageSize - 1);
+    MEMORY_BASIC_INFORMATION mbi{};
+    mbi.BaseAddress = reinterpret_cast<void*>(page);
+    mbi.RegionSize = *iter - page;
+    mbi.State = MEM_COMMIT;
+    mbi.Protect = PAGE_READONLY;
+    return mbi;
+  }
+
+  std::uintptr_t GetBase() const
+  {
+    return kBase;
+  }
+
+  std::uintptr_t GetEnd() const
+  {
+    return region_ends_.back();
+  }
+
+  std::size_t GetNumQueries() const
+  {
+    return num_queries_;
+  }
+
+private:
+  static std::uintptr_t const kBase = 0x10000;
+  static std::uintptr_t const kPageSize = 0x1000;
+
+  std::vector<std::uintptr_t> region_ends_;
+  std::size_t num_queries_{};
+};
+
+// Mostly short sequential runs of small reads (like walking relocations or
+// thunks) with the occasional jump elsewhere (like following an RVA).
+std::vector<std::uintptr_t> GenerateReadAddresses(std::uintptr_t beg,
+                                                  std::uintptr_t end,
+                                                  std::size_t num_reads)
+{
+  std::mt19937 engine{0xBADF00D};
+  std::vector<std::uintptr_t> addresses;
+  addresses.reserve(num_reads);
+  std::uintptr_t cur = beg;
+  for (std::size_t i = 0; i < num_reads; ++i)
+  {
+    if (engine() % 64 == 0 || cur + 4 > end)
+    {
+      cur = beg + engine() % (end - beg - 4);
+    }
+
+    addresses.push_back(cur);
+    cur += 4;
+  }
+
+  return addresses;
+}
+
+std::size_t CountMockQueries(std::size_t num_reads,
+                             hadesmem::detail::RegionCache* cache)
+{
+  MockAddressSpace space{256};
+  auto const addresses =
+    GenerateReadAddresses(space.GetBase(), space.GetEnd(), num_reads);
+  for (auto const address : addresses)
+  {
+    hadesmem::detail::QueryCached(cache,
+                                  reinterpret_cast<void const*>(address),
+                                  0,
+                                  [&](void const* query_address)
+                                  {
+      return space.Query(query_address);
+    });
+  }
+
+  return space.GetNumQueries();
+}
+}
+
+void BenchmarkRegionCache(std::size_t num_reads)
+{
+  std::wcout << L"\nRegion cache (" << num_reads << L" small reads):\n";
+
+  hadesmem::detail::RegionCache cache{0, 0x1000};
+  std::wcout << L"Mock queries (uncached): "
+             << CountMockQueries(num_reads, nullptr) << L'\n';
+  std::wcout << L"Mock queries (cached): "
+             << CountMockQueries(num_reads, &cache) << L'\n';
+
+  // The same access pattern against a real buffer in this process.
+  auto const buffer = GenerateRandomBuffer(256 * 8 * 0x1000, 0xDEADBEEF);
+  auto const real_addresses =
+    GenerateReadAddresses(reinterpret_cast<std::uintptr_t>(buffer.data()),
+                          reinterpret_cast<std::uintptr_t>(buffer.data()) +
+                            buffer.size(),
+                          num_reads);
+  hadesmem::Process process{::GetCurrentProcessId()};
+  auto const read_all = [&]() -> std::uint32_t
+  {
+    std::uint32_t total = 0;
+    for (auto const address : real_addresses)
+    {
+      total += hadesmem::Read<std::uint32_t>(
+        process, reinterpret_cast<void*>(address));
+    }
+    return total;
+  };
+
+  std::uint32_t uncached_total = 0;
+  double const uncached_ms = TimeMilliseconds([&]()
+                                              {
+    uncached_total = read_all();
+  });
+  WriteTiming(L"Read (uncached)", uncached_ms);
+
+  process.EnableRegionCache();
+  std::uint32_t cached_total = 0;
+  double const cached_ms = TimeMilliseconds([&]()
+                                            {
+    cached_total = read_all();
+  });
+  WriteTiming(L"Read (cached)", cached_ms);
+
+  if (uncached_total != cached_total)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      hadesmem::Error() << hadesmem::ErrorString("Result mismatch."));
+  }
+}
@@ -0,0 +1,8 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+
+void BenchmarkRegionCache(std::size_t num_reads);
@@ -3,8 +3,8 @@
 
 #include "imports.hpp"
 
-#include <iostream>
 #include <iterator>
+#include <ostream>
 
 #include <hadesmem/pelib/bound_import_desc.hpp>
 #include <hadesmem/pelib/bound_import_desc_list.hpp>
@@ -38,7 +38,7 @@ void DumpBoundImports(hadesmem::Process const& process,
                       hadesmem::PeFile const& pe_file,
                       bool has_new_bound_imports_any)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   if (!HasBoundImportDir(process, pe_file))
   {
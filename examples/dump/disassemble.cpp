@@ -5,9 +5,9 @@
 
 #include <cstddef>
 #include <cstdint>
-#include <iostream>
 #include <iterator>
 #include <memory>
+#include <ostream>
 #include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
@@ -45,7 +45,7 @@ void DisassembleEp(hadesmem::Process const& process,
     return;
   }
 
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   ud_t ud_obj;
   ud_init(&ud_obj);
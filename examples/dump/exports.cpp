@@ -3,8 +3,8 @@
 
 #include "exports.hpp"
 
-#include <iostream>
 #include <memory>
+#include <ostream>
 #include <set>
 
 #include <hadesmem/detail/str_conv.hpp>
@@ -32,7 +32,7 @@ void DumpExports(hadesmem::Process const& process,
     return;
   }
 
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
   WriteNormal(out, L"Export Dir:", 1);
@@ -3,13 +3,21 @@
 
 #include "filesystem.hpp"
 
+#include <atomic>
+#include <cstddef>
+#include <exception>
 #include <fstream>
 #include <iostream>
-#include <iterator>
 #include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/parallel_for.hpp>
+#include <hadesmem/detail/scope_warden.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/pelib/nt_headers.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
@@ -17,10 +25,14 @@
 
 #include "main.hpp"
 #include "print.hpp"
+#include "record.hpp"
+#include "warning.hpp"
 
 void DumpFile(std::wstring const& path)
 {
-  std::wostream& out = std::wcout;
+  ScopedRecordBuffer const record_buffer;
+
+  std::wostream& out = GetOutputStream();
 
   SetCurrentFilePath(path);
 
@@ -103,9 +115,44 @@ void DumpFile(std::wstring const& path)
   DumpPeFile(process, pe_file, path);
 }
 
-void DumpDir(std::wstring const& path)
+namespace
+{
+// Reports the errors which are expected when sweeping a directory (files
+// which are locked, etc.). Returns false for anything else.
+bool HandleSweepError(std::wostream& out, hadesmem::Error const& e)
+{
+  auto const last_error_ptr =
+    boost::get_error_info<hadesmem::ErrorCodeWinLast>(e);
+  if (last_error_ptr && *last_error_ptr == ERROR_SHARING_VIOLATION)
+  {
+    WriteNewline(out);
+    WriteNormal(out, L"Sharing violation.", 0);
+    return true;
+  }
+
+  if (last_error_ptr && *last_error_ptr == ERROR_ACCESS_DENIED)
+  {
+    WriteNewline(out);
+    WriteNormal(out, L"Access denied.", 0);
+    return true;
+  }
+
+  if (last_error_ptr && *last_error_ptr == ERROR_FILE_NOT_FOUND)
+  {
+    WriteNewline(out);
+    WriteNormal(out, L"File not found.", 0);
+    return true;
+  }
+
+  return false;
+}
+
+// Calls dump_file for each file in the tree, in the order FindFirstFileW and
+// FindNextFileW return them.
+template <typename DumpFileFunc>
+void WalkDir(std::wstring const& path, DumpFileFunc const& dump_file)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
   WriteNormal(out, L"Entering dir: \"" + path + L"\".", 0);
@@ -164,36 +211,18 @@ void DumpDir(std::wstring const& path)
         }
         else
         {
-          DumpDir(cur_path);
+          WalkDir(cur_path, dump_file);
         }
       }
       else
       {
-        DumpFile(cur_path);
+        dump_file(cur_path);
       }
     }
     catch (hadesmem::Error const& e)
     {
-      auto const last_error_ptr =
-        boost::get_error_info<hadesmem::ErrorCodeWinLast>(e);
-      if (last_error_ptr && *last_error_ptr == ERROR_SHARING_VIOLATION)
-      {
-        WriteNewline(out);
-        WriteNormal(out, L"Sharing violation.", 0);
-        continue;
-      }
-
-      if (last_error_ptr && *last_error_ptr == ERROR_ACCESS_DENIED)
-      {
-        WriteNewline(out);
-        WriteNormal(out, L"Access denied.", 0);
-        continue;
-      }
-
-      if (last_error_ptr && *last_error_ptr == ERROR_FILE_NOT_FOUND)
+      if (HandleSweepError(out, e))
       {
-        WriteNewline(out);
-        WriteNormal(out, L"File not found.", 0);
         continue;
       }
 
@@ -210,3 +239,177 @@ void DumpDir(std::wstring const& path)
     hadesmem::Error() << hadesmem::ErrorString("FindNextFile failed.")
                       << hadesmem::ErrorCodeWinLast(last_error));
 }
+
+struct SweepFile
+{
+  std::wstring path;
+  // Output from walking the tree which comes before this file.
+  std::wstring listing;
+  std::vector<char> listing_records;
+  std::wstring output;
+  std::vector<char> records;
+  std::vector<std::wstring> warned;
+  bool done;
+};
+
+// The tree is walked up front (which is cheap compared to dumping the files)
+// with its output buffered, so it can be attached to the file which follows
+// it. The files are then handed out one at a time to whichever thread is free
+// next, which keeps every thread busy no matter how uneven the files are.
+// Each file is dumped to its own buffer, and the buffers are written out in
+// the order the files were found as soon as everything before them is done,
+// so the output is exactly what a serial sweep would produce (as is the
+// warned list, which is reported in the same order).
+//
+// If a file fails with an unexpected error, the files after it aren't started
+// and the error is rethrown once the files before it are written out, which
+// is where a serial sweep would have stopped too.
+void DumpDirParallel(std::wstring const& path, std::size_t num_threads)
+{
+  std::vector<SweepFile> files;
+  std::wostringstream listing;
+  std::vector<char> listing_records;
+  std::exception_ptr walk_error;
+  SetOutputStream(&listing);
+  SetRecordBuffer(&listing_records);
+  try
+  {
+    WalkDir(path,
+            [&](std::wstring const& file_path)
+            {
+      files.push_back(
+        SweepFile{file_path, listing.str(), std::move(listing_records)});
+      listing.str(std::wstring());
+      listing_records.clear();
+    });
+  }
+  catch (...)
+  {
+    // Dump what was found before the error, then report it.
+    walk_error = std::current_exception();
+  }
+  SetOutputStream(nullptr);
+  SetRecordBuffer(nullptr);
+
+  std::mutex flush_mutex;
+  std::size_t next_flush = 0;
+  std::atomic<std::size_t> first_failed(files.size());
+  auto const flush = [&]()
+  {
+    while (next_flush < files.size() && files[next_flush].done &&
+           next_flush <= first_failed)
+    {
+      SweepFile& file = files[next_flush++];
+      std::wcout << file.listing << file.output;
+      WriteRecords(file.listing_records);
+      WriteRecords(file.records);
+      std::wstring().swap(file.listing);
+      std::vector<char>().swap(file.listing_records);
+      std::wstring().swap(file.output);
+      std::vector<char>().swap(file.records);
+      for (auto const& warned_path : file.warned)
+      {
+        ReportWarned(warned_path);
+      }
+    }
+  };
+
+  try
+  {
+    hadesmem::detail::ParallelFor(
+      files.size(),
+      num_threads,
+      [&](std::size_t i)
+      {
+        if (i > first_failed)
+        {
+          return;
+        }
+
+        SweepFile& file = files[i];
+        std::wostringstream output;
+        SetOutputStream(&output);
+        if (GetOutputFormat() != OutputFormat::kText)
+        {
+          file.records.reserve(kRecordBufferReserve);
+        }
+        SetRecordBuffer(&file.records);
+        SetDeferredWarnings(&file.warned);
+        auto const reset_output = [&]()
+        {
+          SetOutputStream(nullptr);
+          SetRecordBuffer(nullptr);
+          SetDeferredWarnings(nullptr);
+        };
+        auto scope_reset_output =
+          hadesmem::detail::MakeScopeWarden(reset_output);
+
+        std::exception_ptr error;
+        try
+        {
+          try
+          {
+            DumpFile(file.path);
+          }
+          catch (hadesmem::Error const& e)
+          {
+            if (!HandleSweepError(output, e))
+            {
+              throw;
+            }
+          }
+        }
+        catch (...)
+        {
+          error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(flush_mutex);
+        if (error && i < first_failed)
+        {
+          first_failed = i;
+        }
+        file.output = output.str();
+        file.done = true;
+        flush();
+
+        if (error)
+        {
+          std::rethrow_exception(error);
+        }
+      });
+  }
+  catch (...)
+  {
+    if (first_failed < files.size())
+    {
+      SetCurrentFilePath(files[first_failed].path);
+    }
+
+    throw;
+  }
+
+  std::wcout << listing.str();
+  WriteRecords(listing_records);
+
+  if (walk_error)
+  {
+    std::rethrow_exception(walk_error);
+  }
+}
+}
+
+void DumpDir(std::wstring const& path, std::size_t num_threads)
+{
+  if (num_threads > 1)
+  {
+    DumpDirParallel(path, num_threads);
+  }
+  else
+  {
+    WalkDir(path, [](std::wstring const& file_path)
+            {
+      DumpFile(file_path);
+    });
+  }
+}
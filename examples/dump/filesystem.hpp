@@ -3,8 +3,11 @@
 
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 void DumpFile(std::wstring const& path);
 
-void DumpDir(std::wstring const& path);
+// Files are dumped on up to num_threads threads, with the output (and warned
+// list) kept in the same order as dumping them one at a time.
+void DumpDir(std::wstring const& path, std::size_t num_threads = 1);
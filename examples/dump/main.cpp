@@ -9,11 +9,14 @@
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
 #include <time.h>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
@@ -23,6 +26,7 @@
 #include <hadesmem/config.hpp>
 #include <hadesmem/debug_privilege.hpp>
 #include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/parallel_for.hpp>
 #include <hadesmem/detail/self_path.hpp>
 #include <hadesmem/detail/str_conv.hpp>
 #include <hadesmem/error.hpp>
@@ -47,6 +51,7 @@
 #include "imports.hpp"
 #include "memory.hpp"
 #include "print.hpp"
+#include "record.hpp"
 #include "relocations.hpp"
 #include "sections.hpp"
 #include "strings.hpp"
@@ -56,10 +61,23 @@
 namespace
 {
 std::wstring g_current_file_path;
+std::mutex g_current_file_path_mutex;
+
+std::wostream*& GetOutputStreamPtr()
+{
+#if defined(HADESMEM_GCC) || defined(HADESMEM_CLANG)
+  static thread_local std::wostream* out = nullptr;
+#elif defined(HADESMEM_MSVC) || defined(HADESMEM_INTEL)
+  static __declspec(thread) std::wostream* out = nullptr;
+#else
+#error "[HadesMem] Unsupported compiler."
+#endif
+  return out;
+}
 
 void DumpRegions(hadesmem::Process const& process)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
   WriteNormal(out, L"Regions:", 0);
@@ -84,7 +102,7 @@ void DumpRegions(hadesmem::Process const& process)
 
 void DumpModules(hadesmem::Process const& process)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
   WriteNormal(out, L"Modules:", 0);
@@ -99,7 +117,7 @@ void DumpModules(hadesmem::Process const& process)
     WriteNamedNormal(out, L"Name", module.GetName(), 1);
     WriteNamedNormal(out, L"Path", module.GetPath(), 1);
 
-    hadesmem::PeFile const pe_file(
+    hadesmem::PeFile pe_file(
       process, module.GetHandle(), hadesmem::PeFileType::Image, 0);
 
     try
@@ -114,13 +132,20 @@ void DumpModules(hadesmem::Process const& process)
       continue;
     }
 
+    // Reading a remote module a structure at a time is very slow for large
+    // modules, so copy the whole thing over first.
+    if (process.GetId() != ::GetCurrentProcessId())
+    {
+      pe_file.TakeSnapshot();
+    }
+
     DumpPeFile(process, pe_file, module.GetPath());
   }
 }
 
 void DumpThreadEntry(hadesmem::ThreadEntry const& thread_entry)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
   WriteNamedHex(out, L"Usage", thread_entry.GetUsage(), 1);
@@ -133,7 +158,7 @@ void DumpThreadEntry(hadesmem::ThreadEntry const& thread_entry)
 
 void DumpThreads(DWORD pid)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
   WriteNormal(out, L"Threads:", 0);
@@ -147,7 +172,7 @@ void DumpThreads(DWORD pid)
 
 void DumpProcessEntry(hadesmem::ProcessEntry const& process_entry)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
   WriteNamedHex(out, L"ID", process_entry.GetId(), 0);
@@ -198,7 +223,7 @@ void DumpProcessEntry(hadesmem::ProcessEntry const& process_entry)
 
 void DumpProcesses()
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
   WriteNormal(out, L"Processes:", 0);
@@ -215,7 +240,11 @@ void DumpPeFile(hadesmem::Process const& process,
                 hadesmem::PeFile const& pe_file,
                 std::wstring const& path)
 {
-  std::wostream& out = std::wcout;
+  ScopedRecordBuffer const record_buffer;
+
+  std::wostream& out = GetOutputStream();
+
+  WriteFilePath(out, path);
 
   ClearWarnForCurrentFile();
 
@@ -251,16 +280,28 @@ void DumpPeFile(hadesmem::Process const& process,
 
 void SetCurrentFilePath(std::wstring const& path)
 {
+  std::lock_guard<std::mutex> lock(g_current_file_path_mutex);
   g_current_file_path = path;
 }
 
+std::wostream& GetOutputStream()
+{
+  std::wostream* const out = GetOutputStreamPtr();
+  return out ? *out : std::wcout;
+}
+
+void SetOutputStream(std::wostream* out)
+{
+  GetOutputStreamPtr() = out;
+}
+
 void HandleLongOrUnprintableString(std::wstring const& name,
                                    std::wstring const& description,
                                    std::size_t tabs,
                                    WarningType warning_type,
                                    std::string value)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   auto const unprintable = FindFirstUnprintableClassicLocale(value);
   std::size_t const kMaxNameLength = 1024;
@@ -325,8 +366,6 @@ int main(int argc, char* argv[])
 {
   try
   {
-    std::cout << "HadesMem Dumper [" << HADESMEM_VERSION_STRING << "]\n";
-
     TCLAP::CmdLine cmd("PE file format dumper", ' ', HADESMEM_VERSION_STRING);
     TCLAP::ValueArg<DWORD> pid_arg(
       "", "pid", "Target process id", false, 0, "DWORD");
@@ -359,8 +398,73 @@ int main(int argc, char* argv[])
                                          -1,
                                          "int",
                                          cmd);
+    TCLAP::ValueArg<unsigned int> jobs_arg(
+      "",
+      "jobs",
+      "Number of threads to dump files in a directory with (0 to use one per "
+      "hardware thread)",
+      false,
+      1,
+      "unsigned int",
+      cmd);
+    TCLAP::ValueArg<std::string> format_arg(
+      "",
+      "format",
+      "Output format (text, json for JSON Lines, or binary)",
+      false,
+      "text",
+      "string",
+      cmd);
+    TCLAP::ValueArg<unsigned int> strings_min_length_arg(
+      "",
+      "strings-min-length",
+      "Minimum length (in characters) of dumped strings",
+      false,
+      3,
+      "unsigned int",
+      cmd);
+    TCLAP::MultiArg<std::string> strings_section_arg(
+      "",
+      "strings-section",
+      "Only dump strings in the named section (may be given more than once)",
+      false,
+      "string",
+      cmd);
     cmd.parse(argc, argv);
 
+    std::string const format = format_arg.getValue();
+    if (format == "text")
+    {
+      SetOutputFormat(OutputFormat::kText);
+    }
+    else if (format == "json")
+    {
+      SetOutputFormat(OutputFormat::kJsonLines);
+    }
+    else if (format == "binary")
+    {
+      SetOutputFormat(OutputFormat::kBinary);
+    }
+    else
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error() << hadesmem::ErrorString("Unknown output format."));
+    }
+
+    // Anything which isn't part of the dump goes to stderr for the structured
+    // formats, so stdout only has records on it (written untranslated).
+    bool const text_output = GetOutputFormat() == OutputFormat::kText;
+    if (!text_output && ::_setmode(::_fileno(stdout), _O_BINARY) == -1)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error() << hadesmem::ErrorString(
+          "Failed to switch stdout to binary mode."));
+    }
+    std::ostream& info_out = text_output ? std::cout : std::cerr;
+    std::wostream& info_wout = text_output ? std::wcout : std::wcerr;
+
+    info_out << "HadesMem Dumper [" << HADESMEM_VERSION_STRING << "]\n";
+
     SetWarningsEnabled(warned_arg.getValue());
     SetDynamicWarningsEnabled(warned_file_dynamic_arg.getValue());
     if (warned_file_arg.isSet())
@@ -376,6 +480,13 @@ int main(int argc, char* argv[])
           "Please specify a file path for dynamic warnings."));
     }
 
+    SetStringsMinLength(strings_min_length_arg.getValue());
+    SetStringsSections(strings_section_arg.getValue());
+
+    std::size_t const jobs =
+      jobs_arg.getValue() ? jobs_arg.getValue()
+                          : hadesmem::detail::GetHardwareThreadCount();
+
     int const warned_type = warned_type_arg.getValue();
     switch (warned_type)
     {
@@ -398,11 +509,11 @@ int main(int argc, char* argv[])
     {
       hadesmem::GetSeDebugPrivilege();
 
-      std::wcout << "\nAcquired SeDebugPrivilege.\n";
+      info_wout << "\nAcquired SeDebugPrivilege.\n";
     }
     catch (std::exception const& /*e*/)
     {
-      std::wcout << "\nFailed to acquire SeDebugPrivilege.\n";
+      info_wout << "\nFailed to acquire SeDebugPrivilege.\n";
     }
 
     if (pid_arg.isSet())
@@ -441,7 +552,7 @@ int main(int argc, char* argv[])
         hadesmem::detail::MultiByteToWideChar(path_arg.getValue());
       if (hadesmem::detail::IsDirectory(path))
       {
-        DumpDir(path);
+        DumpDir(path, jobs);
       }
       else
       {
@@ -454,11 +565,12 @@ int main(int argc, char* argv[])
 
       DumpProcesses();
 
-      std::wcout << "\nFiles:\n";
+      WriteNewline(std::wcout);
+      WriteNormal(std::wcout, L"Files:", 0);
 
       std::wstring const self_path = hadesmem::detail::GetSelfPath();
       std::wstring const root_path = hadesmem::detail::GetRootPath(self_path);
-      DumpDir(root_path);
+      DumpDir(root_path, jobs);
     }
 
     if (GetWarningsEnabled())
@@ -491,6 +603,7 @@ int main(int argc, char* argv[])
     std::cerr << "\nError!\n"
               << boost::current_exception_diagnostic_information() << '\n';
 
+    std::lock_guard<std::mutex> lock(g_current_file_path_mutex);
     if (!g_current_file_path.empty())
     {
       std::wcerr << "\nCurrent file: " << g_current_file_path << "\n";
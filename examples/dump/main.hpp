@@ -26,6 +26,13 @@ void DumpPeFile(hadesmem::Process const& process,
 
 void SetCurrentFilePath(std::wstring const& path);
 
+// Where the dumpers write to on the current thread. Defaults to std::wcout,
+// but can be redirected (e.g. to buffer a file's output when dumping files in
+// parallel). Pass nullptr to go back to the default.
+std::wostream& GetOutputStream();
+
+void SetOutputStream(std::wostream* out);
+
 void HandleLongOrUnprintableString(std::wstring const& name,
                                    std::wstring const& description,
                                    std::size_t tabs,
@@ -5,8 +5,8 @@
 
 #include <cstdint>
 #include <fstream>
-#include <iostream>
 #include <limits>
+#include <ostream>
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/str_conv.hpp>
@@ -50,7 +50,7 @@ std::uint64_t RoundUp(std::uint64_t n, std::uint64_t m)
 
 void DumpMemory(hadesmem::Process const& process)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
   WriteNormal(out, "Dumping image memory to disk.", 0);
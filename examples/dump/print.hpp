@@ -4,11 +4,11 @@
 #pragma once
 
 #include <cstddef>
-#include <iomanip>
-#include <locale>
+#include <ios>
 #include <ostream>
 #include <string>
-#include <vector>
+
+#include "record.hpp"
 
 template <typename CharT> class StreamFlagSaver
 {
@@ -35,64 +35,117 @@ private:
   CharT fill_;
 };
 
-template <typename T>
+template <typename N, typename T>
 inline void WriteNamedHex(std::wostream& out,
-                          std::wstring const& name,
+                          N const& name,
                           T const& num,
                           std::size_t tabs)
 {
-  StreamFlagSaver<wchar_t> flags(out);
-  out << std::wstring(tabs, '\t') << name << ": 0x" << std::hex
-      << std::setw(sizeof(num) * 2) << std::setfill(L'0') << num << '\n';
+  Record record{};
+  record.type = RecordType::kNamedHex;
+  record.tabs = tabs;
+  record.name = MakeRecordString(name);
+  SetRecordNum(record, num);
+  EmitRecord(out, record);
 }
 
-template <typename T>
+template <typename N, typename T, typename S>
 inline void WriteNamedHexSuffix(std::wostream& out,
-                                std::wstring const& name,
+                                N const& name,
                                 T const& num,
-                                std::wstring const& suffix,
+                                S const& suffix,
                                 std::size_t tabs)
 {
-  StreamFlagSaver<wchar_t> flags(out);
-  out << std::wstring(tabs, '\t') << name << ": 0x" << std::hex
-      << std::setw(sizeof(num) * 2) << std::setfill(L'0') << num << L" ("
-      << suffix << L")" << '\n';
+  Record record{};
+  record.type = RecordType::kNamedHexSuffix;
+  record.tabs = tabs;
+  record.name = MakeRecordString(name);
+  record.value = MakeRecordString(suffix);
+  SetRecordNum(record, num);
+  EmitRecord(out, record);
 }
 
-template <typename C>
+template <typename N, typename C>
 inline void WriteNamedHexContainer(std::wostream& out,
-                                   std::wstring const& name,
+                                   N const& name,
                                    C const& c,
                                    std::size_t tabs)
 {
-  StreamFlagSaver<wchar_t> flags(out);
-  out << std::wstring(tabs, '\t') << name << ": " << std::hex
-      << std::setw(sizeof(typename C::value_type) * 2) << std::setfill(L'0');
-  for (auto const& e : c)
-  {
-    out << " 0x" << e;
-  }
-  out << '\n';
+  Record record{};
+  record.type = RecordType::kNamedHexList;
+  record.tabs = tabs;
+  record.name = MakeRecordString(name);
+  SetRecordList(record, c);
+  EmitRecord(out, record);
 }
 
-template <typename T>
+template <typename N, typename T>
 inline void WriteNamedNormal(std::wostream& out,
-                             std::wstring const& name,
+                             N const& name,
                              T const& t,
                              std::size_t tabs)
 {
-  StreamFlagSaver<wchar_t> flags(out);
-  out << std::wstring(tabs, '\t') << name << ": " << t << '\n';
+  Record record{};
+  record.type = RecordType::kNamedText;
+  record.tabs = tabs;
+  record.name = MakeRecordString(name);
+  record.value = MakeRecordString(t);
+  EmitRecord(out, record);
+}
+
+template <typename N>
+inline void WriteNamedNormal(std::wostream& out,
+                             N const& name,
+                             bool b,
+                             std::size_t tabs)
+{
+  Record record{};
+  record.type = RecordType::kNamedBool;
+  record.tabs = tabs;
+  record.name = MakeRecordString(name);
+  record.value_bool = b;
+  EmitRecord(out, record);
+}
+
+// The string is borrowed rather than copied, so it can point straight into
+// the data being dumped.
+template <typename N, typename T>
+inline void WriteNamedStringAt(std::wostream& out,
+                               N const& name,
+                               T const& offset,
+                               RecordString const& str,
+                               std::size_t tabs)
+{
+  Record record{};
+  record.type = RecordType::kString;
+  record.tabs = tabs;
+  record.name = MakeRecordString(name);
+  record.value = str;
+  SetRecordNum(record, offset);
+  EmitRecord(out, record);
 }
 
 template <typename T>
 inline void WriteNormal(std::wostream& out, T const& t, std::size_t tabs)
 {
-  StreamFlagSaver<wchar_t> flags(out);
-  out << std::wstring(tabs, '\t') << t << '\n';
+  Record record{};
+  record.type = RecordType::kText;
+  record.tabs = tabs;
+  record.value = MakeRecordString(t);
+  EmitRecord(out, record);
 }
 
 inline void WriteNewline(std::wostream& out)
 {
-  out << L'\n';
+  Record record{};
+  record.type = RecordType::kNewline;
+  EmitRecord(out, record);
+}
+
+inline void WriteFilePath(std::wostream& out, std::wstring const& path)
+{
+  Record record{};
+  record.type = RecordType::kFile;
+  record.value = MakeRecordString(path);
+  EmitRecord(out, record);
 }
@@ -0,0 +1,110 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include "record.hpp"
+
+#include <cstdio>
+#include <ostream>
+#include <vector>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+
+#include "main.hpp"
+
+namespace
+{
+OutputFormat g_output_format = OutputFormat::kText;
+
+std::vector<char>*& GetRecordBufferPtr()
+{
+#if defined(HADESMEM_GCC) || defined(HADESMEM_CLANG)
+  static thread_local std::vector<char>* buffer = nullptr;
+#elif defined(HADESMEM_MSVC) || defined(HADESMEM_INTEL)
+  static __declspec(thread) std::vector<char>* buffer = nullptr;
+#else
+#error "[HadesMem] Unsupported compiler."
+#endif
+  return buffer;
+}
+
+void AppendRecord(std::vector<char>& buffer, Record const& record)
+{
+  if (g_output_format == OutputFormat::kJsonLines)
+  {
+    AppendRecordJson(buffer, record);
+  }
+  else
+  {
+    HADESMEM_DETAIL_ASSERT(g_output_format == OutputFormat::kBinary);
+    AppendRecordBinary(buffer, record);
+  }
+}
+}
+
+OutputFormat GetOutputFormat()
+{
+  return g_output_format;
+}
+
+void SetOutputFormat(OutputFormat format)
+{
+  g_output_format = format;
+}
+
+void EmitRecord(std::wostream& out, Record const& record)
+{
+  if (g_output_format == OutputFormat::kText || &out != &GetOutputStream())
+  {
+    WriteRecordText(out, record);
+    return;
+  }
+
+  if (std::vector<char>* const buffer = GetRecordBufferPtr())
+  {
+    AppendRecord(*buffer, record);
+    return;
+  }
+
+  std::vector<char> buffer;
+  AppendRecord(buffer, record);
+  WriteRecords(buffer);
+}
+
+std::vector<char>* GetRecordBuffer()
+{
+  return GetRecordBufferPtr();
+}
+
+void SetRecordBuffer(std::vector<char>* buffer)
+{
+  GetRecordBufferPtr() = buffer;
+}
+
+void WriteRecords(std::vector<char> const& buffer)
+{
+  if (!buffer.empty())
+  {
+    std::fwrite(buffer.data(), 1, buffer.size(), stdout);
+  }
+}
+
+ScopedRecordBuffer::ScopedRecordBuffer()
+  : buffer_(),
+    active_(g_output_format != OutputFormat::kText && !GetRecordBufferPtr())
+{
+  if (active_)
+  {
+    buffer_.reserve(kRecordBufferReserve);
+    SetRecordBuffer(&buffer_);
+  }
+}
+
+ScopedRecordBuffer::~ScopedRecordBuffer()
+{
+  if (active_)
+  {
+    SetRecordBuffer(nullptr);
+    WriteRecords(buffer_);
+  }
+}
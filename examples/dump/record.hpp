@@ -0,0 +1,223 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <hadesmem/detail/static_assert.hpp>
+
+// Everything the dumper prints goes through the Write* functions in
+// print.hpp, which describe each line as a Record rather than formatting it
+// themselves. The record is then handed to whichever consumer the output
+// format selects: the text printer (the original human readable output),
+// JSON Lines, or a compact binary format. Records only borrow the caller's
+// strings, so nothing is allocated per field when emitting the structured
+// formats.
+//
+// JSON Lines (one object per line, strings are UTF-8, newlines are skipped):
+//   {"type":"file","path":"..."}
+//   {"type":"text","depth":1,"value":"..."}
+//   {"type":"field","depth":2,"name":"...","value":"..."}
+//   {"type":"field","depth":3,"name":"...","value":true}
+//   {"type":"hex","depth":2,"name":"...","value":"0x0010"}
+//   {"type":"hex","depth":2,"name":"...","value":"0x0010","note":"..."}
+//   {"type":"hex_list","depth":2,"name":"...","value":["0x0000",...]}
+//   {"type":"string","depth":2,"name":"...","offset":"0x00000400",
+//    "length":5,"value":"..."}
+//
+// Binary (all integers little endian, str is a u32 byte count followed by
+// that many bytes of UTF-8, num is a u8 width in bytes followed by a u64):
+//   u8 type (RecordType), u8 depth, followed by
+//   kNewline:        nothing
+//   kText:           str value
+//   kNamedText:      str name, str value
+//   kNamedBool:      str name, u8 value
+//   kNamedHex:       str name, num value
+//   kNamedHexSuffix: str name, num value, str suffix
+//   kNamedHexList:   str name, u8 width, u32 count, count * u64 values
+//   kFile:           str path
+//   kString:         str name, num offset, str value
+// Unlike JSON Lines the binary format keeps everything the text printer
+// needs, so it can be rendered back to the text output.
+
+enum class OutputFormat
+{
+  kText,
+  kJsonLines,
+  kBinary
+};
+
+enum class RecordType : std::uint8_t
+{
+  kNewline,
+  kText,
+  kNamedText,
+  kNamedBool,
+  kNamedHex,
+  kNamedHexSuffix,
+  kNamedHexList,
+  kFile,
+  kString
+};
+
+// A string borrowed from the caller. Narrow strings are treated the same way
+// the text printer treats them (each char widened on its own). Wide strings
+// don't need to be aligned, so they can point straight into a file.
+struct RecordString
+{
+  void const* data;
+  std::size_t size;
+  bool wide;
+};
+
+struct Record
+{
+  RecordType type;
+  std::size_t tabs;
+  RecordString name;
+  RecordString value;
+  bool value_bool;
+  // Width in bytes (of the original type) of num or each element of list.
+  std::size_t width;
+  std::uint64_t num;
+  // Whether num (or each element of list) is a char or wchar_t, which the text
+  // printer streams as a character rather than a number.
+  bool character;
+  // Elements of width bytes each.
+  void const* list;
+  std::size_t list_size;
+};
+
+inline RecordString MakeRecordString(wchar_t const* s)
+{
+  return RecordString{s, std::char_traits<wchar_t>::length(s), true};
+}
+
+inline RecordString MakeRecordString(std::wstring const& s)
+{
+  return RecordString{s.data(), s.size(), true};
+}
+
+inline RecordString MakeRecordString(char const* s)
+{
+  return RecordString{s, std::strlen(s), false};
+}
+
+inline RecordString MakeRecordString(std::string const& s)
+{
+  return RecordString{s.data(), s.size(), false};
+}
+
+template <typename T>
+std::uint64_t ToRecordNumImpl(T num, std::true_type /*is_integral*/)
+{
+  // Go through the unsigned type of the same size so negative numbers come
+  // out the same as they would being streamed in hex.
+  return static_cast<typename std::make_unsigned<T>::type>(num);
+}
+
+template <typename T>
+std::uint64_t ToRecordNumImpl(T num, std::false_type /*is_integral*/)
+{
+  typedef typename std::underlying_type<T>::type Underlying;
+  return ToRecordNumImpl(static_cast<Underlying>(num), std::true_type{});
+}
+
+template <typename T> std::uint64_t ToRecordNum(T num)
+{
+  return ToRecordNumImpl(num, std::is_integral<T>{});
+}
+
+inline std::uint64_t ToRecordNum(bool num)
+{
+  return num;
+}
+
+// Promoted to int when streamed, unlike the other small types.
+inline std::uint64_t ToRecordNum(signed char num)
+{
+  return static_cast<unsigned int>(num);
+}
+
+template <typename T>
+struct IsRecordChar
+  : std::integral_constant<bool,
+                           std::is_same<T, char>::value ||
+                             std::is_same<T, wchar_t>::value>
+{
+};
+
+template <typename T> void SetRecordNum(Record& record, T num)
+{
+  record.width = sizeof(num);
+  record.num = ToRecordNum(num);
+  record.character = IsRecordChar<T>::value;
+}
+
+template <typename C> void SetRecordList(Record& record, C const& c)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(
+    std::is_integral<typename C::value_type>::value);
+
+  record.width = sizeof(typename C::value_type);
+  record.list = c.data();
+  record.list_size = c.size();
+  record.character = IsRecordChar<typename C::value_type>::value;
+}
+
+// The consumers for each output format (see the top of this file for the
+// layout of the structured ones).
+void WriteRecordText(std::wostream& out, Record const& record);
+
+void AppendRecordJson(std::vector<char>& buffer, Record const& record);
+
+void AppendRecordBinary(std::vector<char>& buffer, Record const& record);
+
+OutputFormat GetOutputFormat();
+
+void SetOutputFormat(OutputFormat format);
+
+// Hands a record to the consumer for the current output format. Records
+// written anywhere other than GetOutputStream() (e.g. the warned file) are
+// always printed as text.
+void EmitRecord(std::wostream& out, Record const& record);
+
+// Enough for the records of most files, so per-file buffers rarely grow.
+std::size_t const kRecordBufferReserve = 64 * 1024;
+
+// Encoded records for the structured formats are appended to this buffer on
+// the current thread (pass nullptr to stop). Without one they are written to
+// stdout as they are emitted.
+std::vector<char>* GetRecordBuffer();
+
+void SetRecordBuffer(std::vector<char>* buffer);
+
+// Writes encoded records to stdout.
+void WriteRecords(std::vector<char> const& buffer);
+
+// Collects the structured records for one file in a preallocated buffer which
+// is written to stdout in one go at the end of the scope. Does nothing when
+// the output is text, or when a buffer is already set (e.g. by the parallel
+// sweep, which does its own buffering).
+class ScopedRecordBuffer
+{
+public:
+  ScopedRecordBuffer();
+
+  ScopedRecordBuffer(ScopedRecordBuffer const&) = delete;
+
+  ScopedRecordBuffer& operator=(ScopedRecordBuffer const&) = delete;
+
+  ~ScopedRecordBuffer();
+
+private:
+  std::vector<char> buffer_;
+  bool active_;
+};
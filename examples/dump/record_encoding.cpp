@@ -0,0 +1,461 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include "record.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <ios>
+#include <locale>
+#include <ostream>
+
+#include <hadesmem/detail/assert.hpp>
+
+#include "print.hpp"
+
+namespace
+{
+std::uint64_t GetRecordListElement(Record const& record, std::size_t i)
+{
+  HADESMEM_DETAIL_ASSERT(record.width <= sizeof(std::uint64_t));
+  std::uint64_t num = 0;
+  std::memcpy(&num,
+              static_cast<char const*>(record.list) + i * record.width,
+              record.width);
+  return num;
+}
+
+wchar_t GetWideChar(RecordString const& s, std::size_t i)
+{
+  wchar_t c;
+  std::memcpy(&c, static_cast<char const*>(s.data) + i * sizeof(c), sizeof(c));
+  return c;
+}
+
+// Calls func with each code point in the string. Narrow strings are widened
+// a char at a time, the same as the text printer does. Invalid UTF-16 is
+// replaced with U+FFFD.
+template <typename Func>
+void ForEachCodePoint(RecordString const& s, Func const& func)
+{
+  if (!s.wide)
+  {
+    auto const str = static_cast<unsigned char const*>(s.data);
+    std::for_each(str, str + s.size, func);
+    return;
+  }
+
+  for (std::size_t i = 0; i < s.size; ++i)
+  {
+    auto c = static_cast<std::uint32_t>(GetWideChar(s, i));
+    if (sizeof(wchar_t) == 2 && c >= 0xD800 && c <= 0xDBFF && i + 1 < s.size)
+    {
+      auto const low = static_cast<std::uint32_t>(GetWideChar(s, i + 1));
+      if (low >= 0xDC00 && low <= 0xDFFF)
+      {
+        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+        ++i;
+      }
+    }
+
+    if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF)
+    {
+      c = 0xFFFD;
+    }
+
+    func(c);
+  }
+}
+
+void AppendUtf8(std::vector<char>& buffer, std::uint32_t c)
+{
+  if (c < 0x80)
+  {
+    buffer.push_back(static_cast<char>(c));
+  }
+  else if (c < 0x800)
+  {
+    buffer.push_back(static_cast<char>(0xC0 | (c >> 6)));
+    buffer.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+  }
+  else if (c < 0x10000)
+  {
+    buffer.push_back(static_cast<char>(0xE0 | (c >> 12)));
+    buffer.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+    buffer.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+  }
+  else
+  {
+    buffer.push_back(static_cast<char>(0xF0 | (c >> 18)));
+    buffer.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+    buffer.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+    buffer.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+  }
+}
+
+void AppendLiteral(std::vector<char>& buffer, char const* s)
+{
+  buffer.insert(std::end(buffer), s, s + std::strlen(s));
+}
+
+void AppendHex(std::vector<char>& buffer,
+               std::uint64_t num,
+               std::size_t digits)
+{
+  char const* const kHexDigits = "0123456789abcdef";
+  std::size_t const old_size = buffer.size();
+  buffer.resize(old_size + digits);
+  for (std::size_t i = 0; i < digits; ++i, num >>= 4)
+  {
+    buffer[old_size + digits - i - 1] = kHexDigits[num & 0xF];
+  }
+}
+
+void AppendDecimal(std::vector<char>& buffer, std::uint64_t num)
+{
+  char digits[20];
+  std::size_t n = 0;
+  do
+  {
+    digits[n++] = static_cast<char>('0' + num % 10);
+    num /= 10;
+  } while (num);
+  std::reverse(digits, digits + n);
+  buffer.insert(std::end(buffer), digits, digits + n);
+}
+
+void AppendJsonString(std::vector<char>& buffer, RecordString const& s)
+{
+  buffer.push_back('"');
+  ForEachCodePoint(s,
+                   [&](std::uint32_t c)
+                   {
+    if (c == '"' || c == '\\')
+    {
+      buffer.push_back('\\');
+      buffer.push_back(static_cast<char>(c));
+    }
+    else if (c < 0x20)
+    {
+      AppendLiteral(buffer, "\\u");
+      AppendHex(buffer, c, 4);
+    }
+    else
+    {
+      AppendUtf8(buffer, c);
+    }
+  });
+  buffer.push_back('"');
+}
+
+void AppendJsonHex(std::vector<char>& buffer,
+                   std::uint64_t num,
+                   std::size_t width)
+{
+  AppendLiteral(buffer, "\"0x");
+  AppendHex(buffer, num, width * 2);
+  buffer.push_back('"');
+}
+
+template <typename T> void AppendBinaryInt(std::vector<char>& buffer, T num)
+{
+  for (std::size_t i = 0; i < sizeof(T); ++i)
+  {
+    buffer.push_back(static_cast<char>((num >> (i * 8)) & 0xFF));
+  }
+}
+
+void AppendBinaryString(std::vector<char>& buffer, RecordString const& s)
+{
+  // The size isn't known until the string has been converted, so patch it in
+  // afterwards.
+  std::size_t const size_offset = buffer.size();
+  AppendBinaryInt<std::uint32_t>(buffer, 0);
+  ForEachCodePoint(s,
+                   [&](std::uint32_t c)
+                   {
+    AppendUtf8(buffer, c);
+  });
+  auto const size = static_cast<std::uint32_t>(buffer.size() - size_offset -
+                                               sizeof(std::uint32_t));
+  for (std::size_t i = 0; i < sizeof(size); ++i)
+  {
+    buffer[size_offset + i] = static_cast<char>((size >> (i * 8)) & 0xFF);
+  }
+}
+
+void WriteTextString(std::wostream& out, RecordString const& s)
+{
+  if (s.wide)
+  {
+    for (std::size_t i = 0; i < s.size; ++i)
+    {
+      out.put(GetWideChar(s, i));
+    }
+  }
+  else
+  {
+    // Widened and written a chunk at a time, the same way inserting a char
+    // const* does it.
+    auto const str = static_cast<char const*>(s.data);
+    auto const& ctype = std::use_facet<std::ctype<wchar_t>>(out.getloc());
+    std::size_t const kChunkSize = 64;
+    wchar_t buf[kChunkSize];
+    for (std::size_t i = 0; i < s.size; i += kChunkSize)
+    {
+      std::size_t const n = (std::min)(s.size - i, kChunkSize);
+      ctype.widen(str + i, str + i + n, buf);
+      out.write(buf, static_cast<std::streamsize>(n));
+    }
+  }
+}
+
+// Characters are streamed as characters rather than numbers, the same as
+// they always were. Anything else (including BYTE, which is promoted to int
+// when it's streamed) is a number.
+void WriteTextNum(std::wostream& out, Record const& record, std::uint64_t num)
+{
+  if (!record.character)
+  {
+    out << num;
+  }
+  else if (record.width == sizeof(char))
+  {
+    out << static_cast<char>(num);
+  }
+  else
+  {
+    out << static_cast<wchar_t>(num);
+  }
+}
+}
+
+void AppendRecordJson(std::vector<char>& buffer, Record const& record)
+{
+  char const* type = nullptr;
+  switch (record.type)
+  {
+  case RecordType::kNewline:
+    // Only there for the layout of the text output.
+    return;
+
+  case RecordType::kFile:
+    AppendLiteral(buffer, "{\"type\":\"file\",\"path\":");
+    AppendJsonString(buffer, record.value);
+    AppendLiteral(buffer, "}\n");
+    return;
+
+  case RecordType::kText:
+    type = "text";
+    break;
+
+  case RecordType::kNamedText:
+  case RecordType::kNamedBool:
+    type = "field";
+    break;
+
+  case RecordType::kNamedHex:
+  case RecordType::kNamedHexSuffix:
+    type = "hex";
+    break;
+
+  case RecordType::kNamedHexList:
+    type = "hex_list";
+    break;
+
+  case RecordType::kString:
+    type = "string";
+    break;
+  }
+  HADESMEM_DETAIL_ASSERT(type);
+
+  AppendLiteral(buffer, "{\"type\":\"");
+  AppendLiteral(buffer, type);
+  AppendLiteral(buffer, "\",\"depth\":");
+  AppendDecimal(buffer, record.tabs);
+  if (record.type != RecordType::kText)
+  {
+    AppendLiteral(buffer, ",\"name\":");
+    AppendJsonString(buffer, record.name);
+  }
+  if (record.type == RecordType::kString)
+  {
+    AppendLiteral(buffer, ",\"offset\":");
+    AppendJsonHex(buffer, record.num, record.width);
+    AppendLiteral(buffer, ",\"length\":");
+    AppendDecimal(buffer, record.value.size);
+  }
+  AppendLiteral(buffer, ",\"value\":");
+
+  switch (record.type)
+  {
+  case RecordType::kText:
+  case RecordType::kNamedText:
+  case RecordType::kString:
+    AppendJsonString(buffer, record.value);
+    break;
+
+  case RecordType::kNamedBool:
+    AppendLiteral(buffer, record.value_bool ? "true" : "false");
+    break;
+
+  case RecordType::kNamedHex:
+    AppendJsonHex(buffer, record.num, record.width);
+    break;
+
+  case RecordType::kNamedHexSuffix:
+    AppendJsonHex(buffer, record.num, record.width);
+    AppendLiteral(buffer, ",\"note\":");
+    AppendJsonString(buffer, record.value);
+    break;
+
+  case RecordType::kNamedHexList:
+    buffer.push_back('[');
+    for (std::size_t i = 0; i < record.list_size; ++i)
+    {
+      if (i)
+      {
+        buffer.push_back(',');
+      }
+      AppendJsonHex(buffer, GetRecordListElement(record, i), record.width);
+    }
+    buffer.push_back(']');
+    break;
+
+  default:
+    HADESMEM_DETAIL_ASSERT(false);
+    break;
+  }
+
+  AppendLiteral(buffer, "}\n");
+}
+
+void AppendRecordBinary(std::vector<char>& buffer, Record const& record)
+{
+  buffer.push_back(static_cast<char>(record.type));
+  buffer.push_back(
+    static_cast<char>((std::min)(record.tabs, static_cast<std::size_t>(0xFF))));
+
+  switch (record.type)
+  {
+  case RecordType::kNewline:
+    break;
+
+  case RecordType::kText:
+  case RecordType::kFile:
+    AppendBinaryString(buffer, record.value);
+    break;
+
+  case RecordType::kNamedText:
+    AppendBinaryString(buffer, record.name);
+    AppendBinaryString(buffer, record.value);
+    break;
+
+  case RecordType::kNamedBool:
+    AppendBinaryString(buffer, record.name);
+    buffer.push_back(static_cast<char>(record.value_bool ? 1 : 0));
+    break;
+
+  case RecordType::kNamedHex:
+  case RecordType::kNamedHexSuffix:
+    AppendBinaryString(buffer, record.name);
+    buffer.push_back(static_cast<char>(record.width));
+    AppendBinaryInt(buffer, record.num);
+    if (record.type == RecordType::kNamedHexSuffix)
+    {
+      AppendBinaryString(buffer, record.value);
+    }
+    break;
+
+  case RecordType::kNamedHexList:
+    AppendBinaryString(buffer, record.name);
+    buffer.push_back(static_cast<char>(record.width));
+    AppendBinaryInt(buffer, static_cast<std::uint32_t>(record.list_size));
+    for (std::size_t i = 0; i < record.list_size; ++i)
+    {
+      AppendBinaryInt(buffer, GetRecordListElement(record, i));
+    }
+    break;
+
+  case RecordType::kString:
+    AppendBinaryString(buffer, record.name);
+    buffer.push_back(static_cast<char>(record.width));
+    AppendBinaryInt(buffer, record.num);
+    AppendBinaryString(buffer, record.value);
+    break;
+  }
+}
+
+void WriteRecordText(std::wostream& out, Record const& record)
+{
+  StreamFlagSaver<wchar_t> flags(out);
+
+  if (record.type == RecordType::kFile)
+  {
+    // The path is already printed by whoever is dumping the file.
+    return;
+  }
+
+  if (record.type == RecordType::kNewline)
+  {
+    out << L'\n';
+    return;
+  }
+
+  for (std::size_t i = 0; i < record.tabs; ++i)
+  {
+    out << L'\t';
+  }
+
+  if (record.type != RecordType::kText)
+  {
+    WriteTextString(out, record.name);
+    out << L": ";
+  }
+
+  switch (record.type)
+  {
+  case RecordType::kText:
+  case RecordType::kNamedText:
+  // The offset is left out so the text output stays the way it always was.
+  case RecordType::kString:
+    WriteTextString(out, record.value);
+    break;
+
+  case RecordType::kNamedBool:
+    out << record.value_bool;
+    break;
+
+  case RecordType::kNamedHex:
+  case RecordType::kNamedHexSuffix:
+    out << L"0x" << std::hex
+        << std::setw(static_cast<int>(record.width * 2)) << std::setfill(L'0');
+    WriteTextNum(out, record, record.num);
+    if (record.type == RecordType::kNamedHexSuffix)
+    {
+      out << L" (";
+      WriteTextString(out, record.value);
+      out << L")";
+    }
+    break;
+
+  case RecordType::kNamedHexList:
+    // The width only ever applied to the first separator, but keep the output
+    // the same as it always was.
+    out << std::hex << std::setw(static_cast<int>(record.width * 2))
+        << std::setfill(L'0');
+    for (std::size_t i = 0; i < record.list_size; ++i)
+    {
+      out << " 0x";
+      WriteTextNum(out, record, GetRecordListElement(record, i));
+    }
+    break;
+
+  default:
+    HADESMEM_DETAIL_ASSERT(false);
+    break;
+  }
+
+  out << L'\n';
+}
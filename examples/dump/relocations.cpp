@@ -3,7 +3,7 @@
 
 #include "relocations.hpp"
 
-#include <iostream>
+#include <ostream>
 
 #include <hadesmem/pelib/nt_headers.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
@@ -41,7 +41,7 @@ void DumpRelocations(hadesmem::Process const& process,
     return;
   }
 
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
 
@@ -3,8 +3,8 @@
 
 #include "sections.hpp"
 
-#include <iostream>
 #include <iterator>
+#include <ostream>
 
 #include <hadesmem/pelib/nt_headers.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
@@ -21,7 +21,7 @@ void DumpSections(hadesmem::Process const& process,
 {
   hadesmem::SectionList sections(process, pe_file);
 
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   if (std::begin(sections) != std::end(sections))
   {
@@ -3,18 +3,22 @@
 
 #include "strings.hpp"
 
-#include <cctype>
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
-#include <iostream>
+#include <deque>
+#include <exception>
 #include <iterator>
-#include <memory>
-#include <sstream>
+#include <ostream>
 #include <string>
 #include <vector>
 
-#include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/detail/printable_runs.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/local_buffer.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/pelib/section.hpp>
+#include <hadesmem/pelib/section_list.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/read.hpp>
 
@@ -24,49 +28,139 @@
 
 namespace
 {
-void DumpStringsImpl(hadesmem::Process const& /*process*/,
-                     hadesmem::PeFile const& pe_file,
-                     void* beg,
-                     void* end,
-                     bool wide)
+// Wide strings are handed to the records as they are in the file.
+HADESMEM_DETAIL_STATIC_ASSERT(sizeof(wchar_t) == 2);
+
+std::size_t g_strings_min_length = 3;
+
+std::vector<std::string> g_strings_sections;
+
+// A range of the file to look for strings in. Offsets are file offsets for
+// data files and RVAs for images.
+struct StringRange
+{
+  std::uint8_t const* data;
+  std::size_t size;
+  DWORD offset;
+};
+
+bool IsStringSection(hadesmem::Section const& section)
+{
+  return g_strings_sections.empty() ||
+         std::find(std::begin(g_strings_sections),
+                   std::end(g_strings_sections),
+                   section.GetName()) != std::end(g_strings_sections);
+}
+
+// Images are used in place when they have been snapshotted, otherwise each
+// section is read into storage. Even in our own process an image is read
+// rather than used in place, as its pages can be guarded or inaccessible.
+// Storage is a deque so that the ranges already handed out stay valid as it
+// grows.
+void GetImageStringRanges(hadesmem::Process const& process,
+                          hadesmem::PeFile const& pe_file,
+                          std::vector<StringRange>& ranges,
+                          std::deque<std::vector<std::uint8_t>>& storage)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
-  if (pe_file.GetType() != hadesmem::PeFileType::Data)
+  auto const base = static_cast<std::uint8_t*>(pe_file.GetBase());
+  hadesmem::SectionList const sections(process, pe_file);
+  for (auto const& section : sections)
   {
-    WriteNormal(out,
-                L"WARNING! Skipping string dump (Image file type is currently "
-                L"unsupported).",
-                2);
-    WarnForCurrentFile(WarningType::kUnsupported);
-    return;
+    if (!IsStringSection(section))
+    {
+      continue;
+    }
+
+    DWORD const rva = section.GetVirtualAddress();
+    std::size_t const size = section.GetVirtualSize()
+                               ? section.GetVirtualSize()
+                               : section.GetSizeOfRawData();
+    if (!size)
+    {
+      continue;
+    }
+
+    hadesmem::LocalBuffer const buffer =
+      hadesmem::detail::GetPeFileLocalBuffer(process, pe_file, base + rva);
+    if (buffer.GetSize() >= size)
+    {
+      ranges.push_back(StringRange{
+        static_cast<std::uint8_t const*>(buffer.GetBase()), size, rva});
+      continue;
+    }
+
+    try
+    {
+      storage.emplace_back(
+        hadesmem::ReadVector<std::uint8_t>(process, base + rva, size));
+      ranges.push_back(StringRange{storage.back().data(), size, rva});
+    }
+    catch (std::exception const& /*e*/)
+    {
+      WriteNormal(out, L"WARNING! Failed to read section for strings.", 1);
+      WarnForCurrentFile(WarningType::kUnsupported);
+    }
   }
+}
 
-  std::size_t const kMinStringLen = 3;
+void GetDataStringRanges(hadesmem::Process const& process,
+                         hadesmem::PeFile const& pe_file,
+                         std::vector<StringRange>& ranges)
+{
+  auto const file_beg = static_cast<std::uint8_t const*>(pe_file.GetBase());
+  std::size_t const file_size = pe_file.GetSize();
+  if (g_strings_sections.empty())
+  {
+    ranges.push_back(StringRange{file_beg, file_size, 0});
+    return;
+  }
 
-  std::string buf;
-  std::locale const& loc = std::locale::classic();
-  auto const step = wide ? 2 : 1;
-  for (std::uint8_t* current = static_cast<std::uint8_t*>(beg);
-       (current + step - 1) < end;
-       current += (wide ? 2 : 1))
+  hadesmem::SectionList const sections(process, pe_file);
+  for (auto const& section : sections)
   {
-    bool const is_print = (wide ? *(current + 1) == 0 : true) &&
-                          std::isprint(static_cast<char>(*current), loc);
-    if (is_print)
+    DWORD const ptr = section.GetPointerToRawData();
+    if (!IsStringSection(section) || ptr >= file_size)
     {
-      buf += static_cast<char>(*current);
+      continue;
     }
 
-    if (!is_print || current + (wide ? 2 : 1) == end)
-    {
-      if (buf.size() >= kMinStringLen)
-      {
-        WriteNamedNormal(out, L"String", buf.c_str(), 2);
-      }
+    std::size_t const size =
+      (std::min)(static_cast<std::size_t>(section.GetSizeOfRawData()),
+                 file_size - ptr);
+    ranges.push_back(StringRange{file_beg + ptr, size, ptr});
+  }
+}
 
-      buf.clear();
+void DumpStringsImpl(std::vector<StringRange> const& ranges,
+                     bool wide,
+                     std::size_t skip)
+{
+  std::wostream& out = GetOutputStream();
+
+  for (auto const& range : ranges)
+  {
+    if (range.size <= skip)
+    {
+      continue;
     }
+
+    std::uint8_t const* const data = range.data + skip;
+    DWORD const offset = range.offset + static_cast<DWORD>(skip);
+    hadesmem::detail::FindPrintableRuns(
+      data,
+      range.size - skip,
+      wide,
+      g_strings_min_length,
+      [&](std::size_t run_offset, std::size_t length)
+      {
+      WriteNamedStringAt(out,
+                         L"String",
+                         static_cast<DWORD>(offset + run_offset),
+                         RecordString{data + run_offset, length, wide},
+                         2);
+    });
   }
 }
 }
@@ -74,23 +168,51 @@ void DumpStringsImpl(hadesmem::Process const& /*process*/,
 void DumpStrings(hadesmem::Process const& process,
                  hadesmem::PeFile const& pe_file)
 {
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
-  std::uint8_t* const file_beg = static_cast<std::uint8_t*>(pe_file.GetBase());
-  void* const file_end = file_beg + pe_file.GetSize();
+  std::vector<StringRange> ranges;
+  std::deque<std::vector<std::uint8_t>> storage;
+  if (pe_file.GetType() == hadesmem::PeFileType::Data)
+  {
+    GetDataStringRanges(process, pe_file, ranges);
+  }
+  else
+  {
+    GetImageStringRanges(process, pe_file, ranges, storage);
+  }
 
   WriteNewline(out);
   WriteNormal(out, L"Narrow Strings:", 1);
   WriteNewline(out);
-  DumpStringsImpl(process, pe_file, file_beg, file_end, false);
+  DumpStringsImpl(ranges, false, 0);
 
   WriteNewline(out);
   WriteNormal(out, L"Wide Strings (Pass 1):", 1);
   WriteNewline(out);
-  DumpStringsImpl(process, pe_file, file_beg, file_end, true);
+  DumpStringsImpl(ranges, true, 0);
 
   WriteNewline(out);
   WriteNormal(out, L"Wide Strings (Pass 2):", 1);
   WriteNewline(out);
-  DumpStringsImpl(process, pe_file, file_beg + 1, file_end, true);
+  DumpStringsImpl(ranges, true, 1);
+}
+
+std::size_t GetStringsMinLength()
+{
+  return g_strings_min_length;
+}
+
+void SetStringsMinLength(std::size_t min_length)
+{
+  g_strings_min_length = min_length;
+}
+
+std::vector<std::string> const& GetStringsSections()
+{
+  return g_strings_sections;
+}
+
+void SetStringsSections(std::vector<std::string> const& sections)
+{
+  g_strings_sections = sections;
 }
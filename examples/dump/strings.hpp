@@ -3,6 +3,10 @@
 
 #pragma once
 
+#include <cstddef>
+#include <string>
+#include <vector>
+
 namespace hadesmem
 {
 class Process;
@@ -11,3 +15,14 @@ class PeFile;
 
 void DumpStrings(hadesmem::Process const& process,
                  hadesmem::PeFile const& pe_file);
+
+// Runs of printable characters shorter than this aren't dumped.
+std::size_t GetStringsMinLength();
+
+void SetStringsMinLength(std::size_t min_length);
+
+// Only strings in sections with these names are dumped (everything is dumped
+// when empty, which for data files includes the headers and any overlay).
+std::vector<std::string> const& GetStringsSections();
+
+void SetStringsSections(std::vector<std::string> const& sections);
@@ -3,9 +3,9 @@
 
 #include "tls.hpp"
 
-#include <iostream>
 #include <iterator>
 #include <memory>
+#include <ostream>
 #include <vector>
 
 #include <hadesmem/pelib/tls_dir.hpp>
@@ -28,7 +28,7 @@ void DumpTls(hadesmem::Process const& process, hadesmem::PeFile const& pe_file)
     return;
   }
 
-  std::wostream& out = std::wcout;
+  std::wostream& out = GetOutputStream();
 
   WriteNewline(out);
   WriteNormal(out, L"TLS:", 1);
@@ -5,9 +5,11 @@
 
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include <hadesmem/config.hpp>
 #include <hadesmem/detail/filesystem.hpp>
 #include <hadesmem/error.hpp>
 
@@ -17,54 +19,102 @@ namespace
 {
 // Record all modules (on disk) which cause a warning when dumped, to make it
 // easier to isolate files which require further investigation.
-bool g_warned = false;
 bool g_warned_enabled = false;
 bool g_warned_dynamic = false;
 std::vector<std::wstring> g_all_warned;
 std::wstring g_warned_file_path;
 WarningType g_warned_type = WarningType::kAll;
+// Guards the warned list and the warned file.
+std::mutex g_warned_mutex;
+
+// Files can be dumped on multiple threads at once, so the state for the file
+// currently being dumped is per-thread.
+bool& GetWarnedForCurrentFile()
+{
+#if defined(HADESMEM_GCC) || defined(HADESMEM_CLANG)
+  static thread_local bool warned = false;
+#elif defined(HADESMEM_MSVC) || defined(HADESMEM_INTEL)
+  static __declspec(thread) bool warned = false;
+#else
+#error "[HadesMem] Unsupported compiler."
+#endif
+  return warned;
+}
+
+std::vector<std::wstring>*& GetDeferredWarnings()
+{
+#if defined(HADESMEM_GCC) || defined(HADESMEM_CLANG)
+  static thread_local std::vector<std::wstring>* paths = nullptr;
+#elif defined(HADESMEM_MSVC) || defined(HADESMEM_INTEL)
+  static __declspec(thread) std::vector<std::wstring>* paths = nullptr;
+#else
+#error "[HadesMem] Unsupported compiler."
+#endif
+  return paths;
+}
 }
 
 void WarnForCurrentFile(WarningType warned_type)
 {
   if (warned_type == g_warned_type || g_warned_type == WarningType::kAll)
   {
-    g_warned = true;
+    GetWarnedForCurrentFile() = true;
   }
 }
 
 void ClearWarnForCurrentFile()
 {
-  g_warned = false;
+  GetWarnedForCurrentFile() = false;
 }
 
 void HandleWarnings(std::wstring const& path)
 {
-  if (g_warned_enabled && g_warned)
+  if (g_warned_enabled && GetWarnedForCurrentFile())
   {
-    if (g_warned_dynamic)
+    if (std::vector<std::wstring>* const deferred = GetDeferredWarnings())
     {
-      std::unique_ptr<std::wfstream> warned_file_ptr(
-        hadesmem::detail::OpenFile<wchar_t>(g_warned_file_path,
-                                            std::ios::out | std::ios::app));
-      std::wfstream& warned_file = *warned_file_ptr;
-      if (!warned_file)
-      {
-        HADESMEM_DETAIL_THROW_EXCEPTION(
-          hadesmem::Error()
-          << hadesmem::ErrorString("Failed to open warned file for output."));
-      }
-      warned_file << path << '\n';
+      deferred->push_back(path);
     }
     else
     {
-      g_all_warned.push_back(path);
+      ReportWarned(path);
+    }
+  }
+}
+
+void ReportWarned(std::wstring const& path)
+{
+  std::lock_guard<std::mutex> lock(g_warned_mutex);
+
+  if (g_warned_dynamic)
+  {
+    std::unique_ptr<std::wfstream> warned_file_ptr(
+      hadesmem::detail::OpenFile<wchar_t>(g_warned_file_path,
+                                          std::ios::out | std::ios::app));
+    std::wfstream& warned_file = *warned_file_ptr;
+    if (!warned_file)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        hadesmem::Error()
+        << hadesmem::ErrorString("Failed to open warned file for output."));
     }
+    warned_file << path << '\n';
+  }
+  else
+  {
+    g_all_warned.push_back(path);
   }
 }
 
+void SetDeferredWarnings(std::vector<std::wstring>* paths)
+{
+  GetDeferredWarnings() = paths;
+}
+
 void DumpWarned(std::wostream& out)
 {
+  std::lock_guard<std::mutex> lock(g_warned_mutex);
+
   if (!g_all_warned.empty())
   {
     WriteNewline(out);
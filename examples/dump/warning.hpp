@@ -5,6 +5,7 @@
 
 #include <iosfwd>
 #include <string>
+#include <vector>
 
 enum class WarningType : int
 {
@@ -19,6 +20,15 @@ void ClearWarnForCurrentFile();
 
 void HandleWarnings(std::wstring const& path);
 
+// Adds a file to the warned list (or warned file) unconditionally.
+void ReportWarned(std::wstring const& path);
+
+// Collect the files warned about on the current thread in 'paths' rather than
+// reporting them straight away (pass nullptr to stop). The caller reports them
+// later with ReportWarned, which lets the parallel sweep keep the warned list
+// in the same order as a serial run.
+void SetDeferredWarnings(std::vector<std::wstring>* paths);
+
 void DumpWarned(std::wostream& out);
 
 bool GetWarningsEnabled();
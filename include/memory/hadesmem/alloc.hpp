@@ -18,13 +18,29 @@ namespace hadesmem
 {
 namespace detail
 {
+inline void InvalidateRegionCache(Process const& process,
+                                  PVOID address,
+                                  SIZE_T size)
+{
+  if (RegionCache* const cache = process.GetRegionCache())
+  {
+    cache->Invalidate(address, size);
+  }
+}
+
 inline PVOID TryAlloc(Process const& process, SIZE_T size, PVOID base = nullptr)
 {
-  return ::VirtualAllocEx(process.GetHandle(),
-                          base,
-                          size,
-                          MEM_COMMIT | MEM_RESERVE,
-                          PAGE_EXECUTE_READWRITE);
+  PVOID const address = ::VirtualAllocEx(process.GetHandle(),
+                                         base,
+                                         size,
+                                         MEM_COMMIT | MEM_RESERVE,
+                                         PAGE_EXECUTE_READWRITE);
+  if (address)
+  {
+    InvalidateRegionCache(process, address, size);
+  }
+
+  return address;
 }
 }
 
@@ -43,6 +59,8 @@ inline PVOID Alloc(Process const& process, SIZE_T size, PVOID base = nullptr)
                                     << ErrorCodeWinLast{last_error});
   }
 
+  detail::InvalidateRegionCache(process, address, size);
+
   return address;
 }
 
@@ -55,6 +73,10 @@ inline void Free(Process const& process, LPVOID address)
                                     << ErrorString{"VirtualFreeEx failed."}
                                     << ErrorCodeWinLast{last_error});
   }
+
+  // The size of the allocation isn't known here, and it could span any number
+  // of regions, so just start again.
+  process.InvalidateRegionCache();
 }
 
 class Allocator
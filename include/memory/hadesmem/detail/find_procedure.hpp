@@ -3,18 +3,16 @@
 
 #pragma once
 
-#include <algorithm>
 #include <string>
 
 #include <windows.h>
 
-#include <hadesmem/pelib/export_list.hpp>
 #include <hadesmem/detail/alias_cast.hpp>
 #include <hadesmem/detail/static_assert.hpp>
 #include <hadesmem/detail/str_conv.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/module.hpp>
-#include <hadesmem/pelib/export.hpp>
+#include <hadesmem/pelib/export_index.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
 #include <hadesmem/process.hpp>
 
@@ -22,69 +20,86 @@ namespace hadesmem
 {
 namespace detail
 {
-inline FARPROC GetProcAddressFromExport(Process const& process,
-                                        Export const& e);
-
-template <typename Pred>
-inline FARPROC GetProcAddressInternalFromPred(Process const& process,
-                                              HMODULE module,
-                                              Pred pred)
-{
-  HADESMEM_DETAIL_STATIC_ASSERT(sizeof(FARPROC) == sizeof(void*));
+inline FARPROC GetProcAddressInternal(Process const& process,
+                                      HMODULE module,
+                                      std::string const& name);
 
-  PeFile const pe_file{process, module, PeFileType::Image, 0};
+inline FARPROC
+  GetProcAddressInternal(Process const& process, HMODULE module, WORD ordinal);
 
-  ExportList const exports{process, pe_file};
-  auto const iter = std::find_if(std::begin(exports), std::end(exports), pred);
-  if (iter != std::end(exports))
+inline FARPROC GetProcAddressFromExport(Process const& process,
+                                        PeFile const& pe_file,
+                                        ExportIndexEntry const& e)
+{
+  if (e.forwarded)
   {
-    return GetProcAddressFromExport(process, *iter);
+    ExportForwarder const forwarder{
+      ParseExportForwarder(GetExportForwarder(process, pe_file, e))};
+    Module const forwarder_module{process,
+                                  MultiByteToWideChar(forwarder.module)};
+    if (forwarder.by_ordinal)
+    {
+      return GetProcAddressInternal(
+        process, forwarder_module.GetHandle(), forwarder.ordinal);
+    }
+    else
+    {
+      return GetProcAddressInternal(
+        process, forwarder_module.GetHandle(), forwarder.function);
+    }
   }
 
-  return nullptr;
+  return AliasCast<FARPROC>(GetExportVa(process, pe_file, e));
 }
 
 inline FARPROC GetProcAddressInternal(Process const& process,
-                                      HMODULE module,
+                                      ExportIndex const& export_index,
                                       std::string const& name)
 {
-  auto const pred = [&](Export const& e)
-  {
-    return e.ByName() && e.GetName() == name;
-  };
-  return GetProcAddressInternalFromPred(process, module, pred);
+  HADESMEM_DETAIL_STATIC_ASSERT(sizeof(FARPROC) == sizeof(void*));
+
+  ExportIndexEntry const* const e = export_index.Find(name);
+  return e ? GetProcAddressFromExport(process, export_index.GetPeFile(), *e)
+           : nullptr;
 }
 
-inline FARPROC
-  GetProcAddressInternal(Process const& process, HMODULE module, WORD ordinal)
+inline FARPROC GetProcAddressInternal(Process const& process,
+                                      ExportIndex const& export_index,
+                                      WORD ordinal)
 {
-  auto const pred = [&](Export const& e)
-  {
-    return e.ByOrdinal() && e.GetProcedureNumber() == ordinal;
-  };
-  return GetProcAddressInternalFromPred(process, module, pred);
+  HADESMEM_DETAIL_STATIC_ASSERT(sizeof(FARPROC) == sizeof(void*));
+
+  // Only exports without a name are found by ordinal (i.e. Export::ByOrdinal).
+  ExportIndexEntry const* const e = export_index.Find(ordinal);
+  return e && !e->by_name
+           ? GetProcAddressFromExport(process, export_index.GetPeFile(), *e)
+           : nullptr;
 }
 
-inline FARPROC GetProcAddressFromExport(Process const& process, Export const& e)
+inline FARPROC GetProcAddressInternal(Process const& process,
+                                      HMODULE module,
+                                      std::string const& name)
 {
-  if (e.IsForwarded())
+  PeFile const pe_file{process, module, PeFileType::Image, 0};
+
+  // A one-off lookup only needs to read a handful of names if the name table
+  // is sorted (as it should be). Otherwise fall back to the full index.
+  ExportIndexEntry e{};
+  if (FindExportByNameSorted(process, pe_file, name, e))
   {
-    std::string const forwarder_module_name{e.GetForwarderModule()};
-    Module const forwarder_module{process,
-                                  MultiByteToWideChar(forwarder_module_name)};
-    if (e.IsForwardedByOrdinal())
-    {
-      return GetProcAddressInternal(
-        process, forwarder_module.GetHandle(), e.GetForwarderOrdinal());
-    }
-    else
-    {
-      return GetProcAddressInternal(
-        process, forwarder_module.GetHandle(), e.GetForwarderFunction());
-    }
+    return GetProcAddressFromExport(process, pe_file, e);
   }
 
-  return AliasCast<FARPROC>(e.GetVa());
+  ExportIndex const export_index{process, pe_file};
+  return GetProcAddressInternal(process, export_index, name);
+}
+
+inline FARPROC
+  GetProcAddressInternal(Process const& process, HMODULE module, WORD ordinal)
+{
+  PeFile const pe_file{process, module, PeFileType::Image, 0};
+  ExportIndex const export_index{process, pe_file};
+  return GetProcAddressInternal(process, export_index, ordinal);
 }
 }
 }
@@ -0,0 +1,551 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// Not warning_disable_prefix.hpp, as that needs config.hpp (and so
+// windows.h), and nothing else here does.
+#if defined(_MSC_VER)
+#pragma warning(push, 1)
+#elif defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#endif // #if defined(_MSC_VER)
+#include <udis86.h>
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#elif defined(__clang__)
+#pragma clang diagnostic pop
+#endif // #if defined(_MSC_VER)
+
+#include <hadesmem/detail/assert.hpp>
+
+// Moves whole instructions from one address to another (e.g. the start of a
+// function to a detour trampoline), fixing up everything which is relative to
+// the instruction pointer. Works entirely on buffers, so nothing here needs a
+// process.
+//
+// Relative branches (short ones included) are re-encoded in their rel32 forms,
+// or as absolute jumps through memory if even that won't reach. LOOP, JCXZ and
+// friends only have a rel8 form, so they branch to a jump to their original
+// target instead. RIP-relative memory operands get a new displacement. If that
+// won't reach, LEA and indirect JMP/CALL are rewritten to absolute forms, and
+// anything else is an error (so put the destination near the source).
+// Branches to an instruction which is itself being moved go to the copy of it.
+//
+// Only depends on udis86 and the standard library (errors are thrown as
+// std::runtime_error), so it can be built and tested anywhere.
+
+namespace hadesmem
+{
+namespace detail
+{
+// The most any one instruction (or a jump back to the source) can grow to.
+std::size_t const kMaxRelocatedInstructionSize = 32;
+
+struct RelocatedCode
+{
+  std::vector<std::uint8_t> code;
+  // Always a whole number of instructions.
+  std::size_t source_size;
+};
+
+enum class RelativeBranchType
+{
+  kJmp,
+  kCall,
+  kJcc,
+  kLoop
+};
+
+struct RelativeBranchRule
+{
+  ud_mnemonic_code mnemonic;
+  RelativeBranchType type;
+  // The condition (low nibble of the opcode) for a Jcc.
+  std::uint8_t condition;
+};
+
+inline RelativeBranchRule const*
+  FindRelativeBranchRule(ud_mnemonic_code mnemonic)
+{
+  static RelativeBranchRule const rules[] = {
+    {UD_Ijmp, RelativeBranchType::kJmp, 0x0},
+    {UD_Icall, RelativeBranchType::kCall, 0x0},
+    {UD_Ijo, RelativeBranchType::kJcc, 0x0},
+    {UD_Ijno, RelativeBranchType::kJcc, 0x1},
+    {UD_Ijb, RelativeBranchType::kJcc, 0x2},
+    {UD_Ijae, RelativeBranchType::kJcc, 0x3},
+    {UD_Ijz, RelativeBranchType::kJcc, 0x4},
+    {UD_Ijnz, RelativeBranchType::kJcc, 0x5},
+    {UD_Ijbe, RelativeBranchType::kJcc, 0x6},
+    {UD_Ija, RelativeBranchType::kJcc, 0x7},
+    {UD_Ijs, RelativeBranchType::kJcc, 0x8},
+    {UD_Ijns, RelativeBranchType::kJcc, 0x9},
+    {UD_Ijp, RelativeBranchType::kJcc, 0xA},
+    {UD_Ijnp, RelativeBranchType::kJcc, 0xB},
+    {UD_Ijl, RelativeBranchType::kJcc, 0xC},
+    {UD_Ijge, RelativeBranchType::kJcc, 0xD},
+    {UD_Ijle, RelativeBranchType::kJcc, 0xE},
+    {UD_Ijg, RelativeBranchType::kJcc, 0xF},
+    {UD_Iloop, RelativeBranchType::kLoop, 0x0},
+    {UD_Iloope, RelativeBranchType::kLoop, 0x0},
+    {UD_Iloopne, RelativeBranchType::kLoop, 0x0},
+    {UD_Ijcxz, RelativeBranchType::kLoop, 0x0},
+    {UD_Ijecxz, RelativeBranchType::kLoop, 0x0},
+    {UD_Ijrcxz, RelativeBranchType::kLoop, 0x0},
+  };
+
+  for (auto const& rule : rules)
+  {
+    if (rule.mnemonic == mnemonic)
+    {
+      return &rule;
+    }
+  }
+
+  return nullptr;
+}
+
+// What needs fixing up in a decoded instruction.
+struct RelocatableInstruction
+{
+  std::size_t offset;
+  std::size_t length;
+  ud_mnemonic_code mnemonic;
+  // Set for relative branches.
+  RelativeBranchRule const* branch;
+  // Set for RIP-relative memory operands.
+  bool rip_relative;
+  std::size_t disp_offset;
+  // Set for a RIP-relative LEA to a 32 or 64-bit register, with the register
+  // number and size in bits.
+  bool lea;
+  std::uint8_t lea_reg;
+  std::uint8_t lea_reg_size;
+  // Where the branch or memory operand points.
+  std::uint64_t target;
+};
+
+inline RelocatableInstruction DecodeRelocatableInstruction(ud_t const& ud_obj,
+                                                           std::size_t offset,
+                                                           std::uint8_t mode)
+{
+  RelocatableInstruction insn{};
+  insn.offset = offset;
+  insn.length = ud_insn_len(&ud_obj);
+  insn.mnemonic = ud_insn_mnemonic(&ud_obj);
+
+  std::uint64_t const next = ud_insn_off(&ud_obj) + insn.length;
+  std::size_t imm_size = 0;
+  for (unsigned int i = 0; ud_insn_opr(&ud_obj, i); ++i)
+  {
+    ud_operand_t const* const op = ud_insn_opr(&ud_obj, i);
+    if (op->type == UD_OP_IMM)
+    {
+      imm_size += op->size / 8;
+    }
+  }
+
+  ud_operand_t const* const op = ud_insn_opr(&ud_obj, 0);
+  if (op && op->type == UD_OP_JIMM)
+  {
+    insn.branch = FindRelativeBranchRule(insn.mnemonic);
+    if (!insn.branch)
+    {
+      throw std::runtime_error("Unsupported relative branch.");
+    }
+
+    std::int64_t disp = 0;
+    switch (op->size)
+    {
+    case 8:
+      disp = op->lval.sbyte;
+      break;
+    case 32:
+      disp = op->lval.sdword;
+      break;
+    default:
+      // 16-bit branches truncate the instruction pointer, so they can't be
+      // moved anywhere useful.
+      throw std::runtime_error("Unsupported relative branch size.");
+    }
+
+    insn.target = next + disp;
+  }
+
+  for (unsigned int i = 0; ud_insn_opr(&ud_obj, i); ++i)
+  {
+    ud_operand_t const* const mem_op = ud_insn_opr(&ud_obj, i);
+    if (mem_op->type != UD_OP_MEM || mem_op->base != UD_R_RIP)
+    {
+      continue;
+    }
+
+    // The displacement is always a dword, and the only thing which can come
+    // after it is an immediate. Check we've found it rather than trusting
+    // that (e.g. 3DNow! puts its opcode there).
+    std::int32_t const disp = mem_op->lval.sdword;
+    std::int32_t encoded_disp = 0;
+    if (insn.length >= imm_size + sizeof(disp))
+    {
+      insn.disp_offset = insn.length - imm_size - sizeof(disp);
+      std::memcpy(&encoded_disp,
+                  ud_insn_ptr(&ud_obj) + insn.disp_offset,
+                  sizeof(encoded_disp));
+    }
+    if (encoded_disp != disp || insn.disp_offset == 0)
+    {
+      throw std::runtime_error("Failed to find RIP-relative displacement.");
+    }
+
+    insn.rip_relative = true;
+    insn.target = next + disp;
+
+    if (insn.mnemonic == UD_Ilea && op->type == UD_OP_REG)
+    {
+      if (op->base >= UD_R_RAX && op->base <= UD_R_R15)
+      {
+        insn.lea = true;
+        insn.lea_reg = static_cast<std::uint8_t>(op->base - UD_R_RAX);
+        insn.lea_reg_size = 64;
+      }
+      else if (op->base >= UD_R_EAX && op->base <= UD_R_R15D)
+      {
+        insn.lea = true;
+        insn.lea_reg = static_cast<std::uint8_t>(op->base - UD_R_EAX);
+        insn.lea_reg_size = 32;
+      }
+    }
+
+    break;
+  }
+
+  if (mode == 32)
+  {
+    insn.target &= 0xFFFFFFFF;
+  }
+
+  return insn;
+}
+
+inline bool IsRel32InRange(std::uint64_t next,
+                           std::uint64_t target,
+                           std::uint8_t mode)
+{
+  // Everything is in range when the address space wraps at 4GB.
+  if (mode == 32)
+  {
+    return true;
+  }
+
+  auto const rel = static_cast<std::int64_t>(target - next);
+  return rel >= (std::numeric_limits<std::int32_t>::min)() &&
+         rel <= (std::numeric_limits<std::int32_t>::max)();
+}
+
+inline void AppendUInt(std::vector<std::uint8_t>& code,
+                       std::uint64_t value,
+                       std::size_t size)
+{
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    code.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+  }
+}
+
+inline void AppendRel32(std::vector<std::uint8_t>& code,
+                        std::uint64_t code_address,
+                        std::uint64_t target)
+{
+  std::uint64_t const next = code_address + code.size() + sizeof(std::int32_t);
+  AppendUInt(code, target - next, sizeof(std::int32_t));
+}
+
+// JMP QWORD PTR [RIP+0], followed by the target.
+std::size_t const kAbsoluteJumpSize = 14;
+
+inline void AppendAbsoluteJump(std::vector<std::uint8_t>& code,
+                               std::uint64_t target)
+{
+  std::uint8_t const jmp[] = {0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+  code.insert(std::end(code), std::begin(jmp), std::end(jmp));
+  AppendUInt(code, target, sizeof(target));
+}
+
+inline std::size_t GetJumpSize(std::uint64_t address,
+                               std::uint64_t target,
+                               std::uint8_t mode)
+{
+  return IsRel32InRange(address + 5, target, mode) ? 5 : kAbsoluteJumpSize;
+}
+
+inline void AppendJump(std::vector<std::uint8_t>& code,
+                       std::uint64_t code_address,
+                       std::uint64_t target,
+                       std::uint8_t mode)
+{
+  if (GetJumpSize(code_address + code.size(), target, mode) == 5)
+  {
+    code.push_back(0xE9);
+    AppendRel32(code, code_address, target);
+  }
+  else
+  {
+    AppendAbsoluteJump(code, target);
+  }
+}
+
+// Jumps through a pointer anywhere in the address space, leaving everything
+// (flags included) as it was. x64 only.
+//   PUSH RAX
+//   MOV RAX, <pointer>
+//   MOV RAX, [RAX]
+//   XCHG [RSP], RAX
+//   RET
+std::size_t const kIndirectJumpThunkSize = 19;
+
+inline void AppendIndirectJumpThunk(std::vector<std::uint8_t>& code,
+                                    std::uint64_t pointer)
+{
+  code.push_back(0x50);
+  code.push_back(0x48);
+  code.push_back(0xB8);
+  AppendUInt(code, pointer, sizeof(pointer));
+  std::uint8_t const tail[] = {0x48, 0x8B, 0x00, 0x48, 0x87, 0x04, 0x24, 0xC3};
+  code.insert(std::end(code), std::begin(tail), std::end(tail));
+}
+
+inline void AppendRelativeBranch(std::vector<std::uint8_t>& code,
+                                 std::uint64_t code_address,
+                                 std::uint8_t const* raw,
+                                 RelocatableInstruction const& insn,
+                                 std::uint64_t target,
+                                 std::uint8_t mode)
+{
+  std::uint64_t const address = code_address + code.size();
+  switch (insn.branch->type)
+  {
+  case RelativeBranchType::kJmp:
+    AppendJump(code, code_address, target, mode);
+    break;
+
+  case RelativeBranchType::kCall:
+    if (IsRel32InRange(address + 5, target, mode))
+    {
+      code.push_back(0xE8);
+      AppendRel32(code, code_address, target);
+    }
+    else
+    {
+      // CALL QWORD PTR [RIP+2], JMP SHORT past the target, then the target.
+      std::uint8_t const call[] = {
+        0xFF, 0x15, 0x02, 0x00, 0x00, 0x00, 0xEB, 0x08};
+      code.insert(std::end(code), std::begin(call), std::end(call));
+      AppendUInt(code, target, sizeof(target));
+    }
+    break;
+
+  case RelativeBranchType::kJcc:
+    if (IsRel32InRange(address + 6, target, mode))
+    {
+      code.push_back(0x0F);
+      code.push_back(static_cast<std::uint8_t>(0x80 | insn.branch->condition));
+      AppendRel32(code, code_address, target);
+    }
+    else
+    {
+      // The opposite condition skips an absolute jump.
+      code.push_back(
+        static_cast<std::uint8_t>(0x70 | (insn.branch->condition ^ 1)));
+      code.push_back(static_cast<std::uint8_t>(kAbsoluteJumpSize));
+      AppendAbsoluteJump(code, target);
+    }
+    break;
+
+  case RelativeBranchType::kLoop:
+  {
+    // Keep the prefixes (the address size prefix picks the counter), but
+    // branch over a JMP SHORT to a jump to the real target.
+    code.insert(std::end(code), raw, raw + insn.length - 1);
+    code.push_back(0x02);
+    code.push_back(0xEB);
+    std::size_t const jump_size =
+      GetJumpSize(code_address + code.size() + 1, target, mode);
+    code.push_back(static_cast<std::uint8_t>(jump_size));
+    AppendJump(code, code_address, target, mode);
+    break;
+  }
+  }
+}
+
+inline void AppendRipRelative(std::vector<std::uint8_t>& code,
+                              std::uint64_t code_address,
+                              std::uint8_t const* raw,
+                              RelocatableInstruction const& insn,
+                              std::uint8_t mode)
+{
+  std::uint64_t const address = code_address + code.size();
+  if (IsRel32InRange(address + insn.length, insn.target, mode))
+  {
+    std::size_t const disp_pos = code.size() + insn.disp_offset;
+    code.insert(std::end(code), raw, raw + insn.length);
+    auto const disp = static_cast<std::uint32_t>(
+      insn.target - (address + insn.length));
+    std::memcpy(&code[disp_pos], &disp, sizeof(disp));
+  }
+  else if (insn.lea)
+  {
+    // MOV reg, imm.
+    std::uint8_t const reg = insn.lea_reg;
+    std::uint8_t const rex = static_cast<std::uint8_t>(
+      (insn.lea_reg_size == 64 ? 0x48 : 0x40) | (reg >> 3));
+    if (rex != 0x40)
+    {
+      code.push_back(rex);
+    }
+    code.push_back(static_cast<std::uint8_t>(0xB8 | (reg & 7)));
+    AppendUInt(code, insn.target, insn.lea_reg_size / 8);
+  }
+  else if (insn.mnemonic == UD_Ijmp)
+  {
+    AppendIndirectJumpThunk(code, insn.target);
+  }
+  else if (insn.mnemonic == UD_Icall)
+  {
+    // CALL the thunk, which returns to a JMP SHORT past it.
+    std::uint8_t const call[] = {
+      0xE8, 0x02, 0x00, 0x00, 0x00, 0xEB, kIndirectJumpThunkSize};
+    code.insert(std::end(code), std::begin(call), std::end(call));
+    AppendIndirectJumpThunk(code, insn.target);
+  }
+  else
+  {
+    throw std::runtime_error("RIP-relative operand out of range.");
+  }
+}
+
+// Relocates the instructions at the start of the source (which is at
+// source_address) until at least min_size bytes are covered, for running at
+// destination_address. Mode is 32 or 64, as for udis86.
+inline RelocatedCode RelocateInstructions(void const* source,
+                                          std::size_t size,
+                                          std::uint64_t source_address,
+                                          std::uint64_t destination_address,
+                                          std::size_t min_size,
+                                          std::uint8_t mode)
+{
+  if (mode != 32 && mode != 64)
+  {
+    throw std::runtime_error("Unsupported mode.");
+  }
+
+  auto const raw = static_cast<std::uint8_t const*>(source);
+
+  ud_t ud_obj;
+  ud_init(&ud_obj);
+  ud_set_input_buffer(&ud_obj, raw, size);
+  ud_set_pc(&ud_obj, source_address);
+  ud_set_mode(&ud_obj, mode);
+
+  RelocatedCode relocated{};
+  std::vector<RelocatableInstruction> insns;
+  while (relocated.source_size < min_size)
+  {
+    std::size_t const len = ud_decode(&ud_obj);
+    if (len == 0 || ud_obj.error || ud_obj.mnemonic == UD_Iinvalid)
+    {
+      throw std::runtime_error("Disassembly failed.");
+    }
+
+    insns.push_back(
+      DecodeRelocatableInstruction(ud_obj, relocated.source_size, mode));
+    relocated.source_size += len;
+  }
+
+  // Branches to something we're moving need to know where it's going, which
+  // isn't known until everything before it is laid out. Their size doesn't
+  // depend on it though (they're always near), so lay everything out once
+  // with them branching to themselves, then again for real.
+  std::vector<std::size_t> offsets(insns.size());
+  bool has_internal_branch = false;
+  auto const get_internal_target = [&](RelocatableInstruction const& insn,
+                                       bool resolve) -> std::uint64_t
+  {
+    std::uint64_t source_offset = insn.target - source_address;
+    if (mode == 32)
+    {
+      source_offset &= 0xFFFFFFFF;
+    }
+    if (source_offset >= relocated.source_size)
+    {
+      return insn.target;
+    }
+
+    has_internal_branch = true;
+    if (!resolve)
+    {
+      return destination_address + relocated.code.size();
+    }
+
+    for (std::size_t i = 0; i < insns.size(); ++i)
+    {
+      if (insns[i].offset == source_offset)
+      {
+        return destination_address + offsets[i];
+      }
+    }
+
+    throw std::runtime_error("Branch into the middle of an instruction.");
+  };
+
+  auto const lay_out = [&](bool resolve)
+  {
+    relocated.code.clear();
+    for (std::size_t i = 0; i < insns.size(); ++i)
+    {
+      RelocatableInstruction const& insn = insns[i];
+      HADESMEM_DETAIL_ASSERT(!resolve ||
+                             offsets[i] == relocated.code.size());
+      offsets[i] = relocated.code.size();
+      std::uint8_t const* const insn_raw = raw + insn.offset;
+      if (insn.branch)
+      {
+        AppendRelativeBranch(relocated.code,
+                             destination_address,
+                             insn_raw,
+                             insn,
+                             get_internal_target(insn, resolve),
+                             mode);
+      }
+      else if (insn.rip_relative)
+      {
+        AppendRipRelative(
+          relocated.code, destination_address, insn_raw, insn, mode);
+      }
+      else
+      {
+        relocated.code.insert(
+          std::end(relocated.code), insn_raw, insn_raw + insn.length);
+      }
+    }
+  };
+
+  lay_out(false);
+  if (has_internal_branch)
+  {
+    lay_out(true);
+  }
+
+  return relocated;
+}
+}
+}
@@ -0,0 +1,94 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+inline std::size_t GetHardwareThreadCount() HADESMEM_DETAIL_NOEXCEPT
+{
+  // hardware_concurrency is allowed to return zero if it can't tell.
+  return (std::max)(std::thread::hardware_concurrency(), 1U);
+}
+
+// Calls func(i) for every i in [0, count) using up to num_threads threads
+// (including the calling thread). Indexes are handed out in ascending order
+// to whichever thread is free next, so uneven tasks still balance out. If
+// any calls throw, the exception from the lowest index is rethrown once every
+// thread has finished.
+template <typename Func>
+void ParallelFor(std::size_t count, std::size_t num_threads, Func func)
+{
+  num_threads = (std::min)(num_threads, count);
+  if (num_threads <= 1)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      func(i);
+    }
+
+    return;
+  }
+
+  std::atomic<std::size_t> next{0};
+  std::vector<std::exception_ptr> errors(count);
+  auto const worker = [&]()
+  {
+    for (std::size_t i = next++; i < count; i = next++)
+    {
+      try
+      {
+        func(i);
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  try
+  {
+    for (std::size_t i = 1; i < num_threads; ++i)
+    {
+      threads.emplace_back(worker);
+    }
+  }
+  catch (std::system_error const&)
+  {
+    // Running with fewer threads than requested is still correct.
+    HADESMEM_DETAIL_ASSERT(threads.size() < num_threads - 1);
+  }
+
+  worker();
+
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  for (auto const& error : errors)
+  {
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+}
+}
+}
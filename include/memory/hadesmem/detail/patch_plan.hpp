@@ -0,0 +1,173 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <udis86.h>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+// Where the jump to a detour goes. Usually that's over the start of the
+// target, but if there's padding in front of it (e.g. an MSVC hot-patchable
+// function, or just alignment between functions) the jump can go there
+// instead, with only a JMP SHORT to it at the target. That means moving two
+// bytes worth of instructions to the trampoline rather than five or more, or
+// none at all if they don't do anything (e.g. MOV EDI, EDI).
+struct PatchPlan
+{
+  // Bytes of padding in front of the target which the jump goes in, or zero
+  // if it goes at the target itself.
+  std::size_t padding_size;
+  // Bytes overwritten at the target.
+  std::size_t patch_size;
+  // Whether the instructions overwritten at the target have to be moved to
+  // the trampoline, rather than just skipped.
+  bool relocate;
+};
+
+std::size_t const kJmpShortSize = 2;
+
+// The udis86 mode for code in this process.
+inline std::uint8_t GetNativeCodeMode() HADESMEM_DETAIL_NOEXCEPT
+{
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  return 64;
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+  return 32;
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+}
+
+// First byte of the instruction after any prefixes. udis86 doesn't keep it.
+inline std::uint8_t GetOpcodeByte(ud_t const& ud_obj, std::uint8_t mode)
+{
+  std::uint8_t const* const insn = ud_insn_ptr(&ud_obj);
+  std::size_t const len = ud_insn_len(&ud_obj);
+  for (std::size_t i = 0; i < len; ++i)
+  {
+    switch (insn[i])
+    {
+    case 0x26:
+    case 0x2E:
+    case 0x36:
+    case 0x3E:
+    case 0x64:
+    case 0x65:
+    case 0x66:
+    case 0x67:
+    case 0xF0:
+    case 0xF2:
+    case 0xF3:
+      continue;
+    default:
+      if (mode == 64 && (insn[i] & 0xF0) == 0x40)
+      {
+        continue;
+      }
+      return insn[i];
+    }
+  }
+
+  return 0;
+}
+
+inline bool IsNoOpInstruction(ud_t const& ud_obj, std::uint8_t mode)
+{
+  // Includes XCHG AX, AX (66 90) and the long NOPs (0F 1F /0), which udis86
+  // decodes as NOP too. So is XCHG EAX, EAX (87 C0), but that clears the top
+  // of RAX on x64.
+  if (ud_insn_mnemonic(&ud_obj) == UD_Inop)
+  {
+    return mode != 64 || ud_obj.pfx_opr ||
+           GetOpcodeByte(ud_obj, mode) != 0x87;
+  }
+
+  // MOV EDI, EDI and friends. Not 32-bit registers on x64 though, as writing
+  // to them clears the top half.
+  ud_operand_t const* const dst = ud_insn_opr(&ud_obj, 0);
+  ud_operand_t const* const src = ud_insn_opr(&ud_obj, 1);
+  return ud_insn_mnemonic(&ud_obj) == UD_Imov && dst && src &&
+         dst->type == UD_OP_REG && src->type == UD_OP_REG &&
+         dst->base == src->base && dst->base >= UD_R_AL &&
+         dst->base <= UD_R_R15 &&
+         (mode != 64 || dst->base < UD_R_EAX || dst->base > UD_R_R15D);
+}
+
+// Whether the first size bytes of the code are whole instructions which
+// don't do anything.
+inline bool IsNoOpCode(std::uint8_t const* code,
+                       std::size_t code_size,
+                       std::size_t size,
+                       std::uint8_t mode)
+{
+  ud_t ud_obj;
+  ud_init(&ud_obj);
+  ud_set_input_buffer(&ud_obj, code, code_size);
+  ud_set_mode(&ud_obj, mode);
+
+  std::size_t offset = 0;
+  while (offset < size)
+  {
+    std::size_t const len = ud_decode(&ud_obj);
+    if (len == 0 || ud_obj.error || !IsNoOpInstruction(ud_obj, mode))
+    {
+      return false;
+    }
+
+    offset += len;
+  }
+
+  return offset == size;
+}
+
+// The code is whatever could be read from in front of the target (which may
+// be nothing), followed by the start of the target. Jump size is the size of
+// the jump to the detour, and mode is 32 or 64, as for udis86.
+inline PatchPlan PlanDetourPatch(void const* code,
+                                 std::size_t size,
+                                 std::size_t target_offset,
+                                 std::size_t jump_size,
+                                 std::uint8_t mode)
+{
+  HADESMEM_DETAIL_ASSERT(target_offset <= size);
+
+  auto const raw = static_cast<std::uint8_t const*>(code);
+  std::uint8_t const* const target = raw + target_offset;
+  std::size_t const target_size = size - target_offset;
+
+  PatchPlan const in_place{
+    0, jump_size, !IsNoOpCode(target, target_size, jump_size, mode)};
+  // The JMP SHORT has to be smaller than the jump and able to reach it.
+  if (jump_size <= kJmpShortSize || jump_size + kJmpShortSize > 128 ||
+      target_offset < jump_size || target_size < kJmpShortSize)
+  {
+    return in_place;
+  }
+
+  // Int3 is always padding. NOPs could be code which falls through to the
+  // target, unless they're in front of a hot-patchable function.
+  bool const hot_patchable =
+    IsNoOpCode(target, target_size, kJmpShortSize, mode);
+  for (std::size_t i = target_offset - jump_size; i < target_offset; ++i)
+  {
+    if (raw[i] != 0xCC && (raw[i] != 0x90 || !hot_patchable))
+    {
+      return in_place;
+    }
+  }
+
+  return PatchPlan{jump_size, kJmpShortSize, !hot_patchable};
+}
+}
+}
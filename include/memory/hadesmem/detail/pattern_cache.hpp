@@ -0,0 +1,250 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/error.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+// FNV-1a. Only used to detect changes, so it doesn't need to be strong.
+std::uint64_t const kFnvOffsetBasis = 0xCBF29CE484222325ULL;
+
+inline std::uint64_t HashBytes(std::uint64_t hash,
+                               void const* data,
+                               std::size_t size) HADESMEM_DETAIL_NOEXCEPT
+{
+  auto const bytes = static_cast<std::uint8_t const*>(data);
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= 0x100000001B3ULL;
+  }
+
+  return hash;
+}
+
+template <typename T>
+inline std::uint64_t HashPod(std::uint64_t hash,
+                             T const& data) HADESMEM_DETAIL_NOEXCEPT
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_pod<T>::value);
+  return HashBytes(hash, &data, sizeof(data));
+}
+
+inline std::uint64_t HashString(std::uint64_t hash,
+                                std::wstring const& data)
+  HADESMEM_DETAIL_NOEXCEPT
+{
+  // Hash the length too, so adjacent strings can't run into each other.
+  hash = HashPod(hash, static_cast<std::uint64_t>(data.size()));
+  return HashBytes(hash, data.data(), data.size() * sizeof(wchar_t));
+}
+
+struct PatternCacheEntry
+{
+  std::wstring name;
+  std::uint32_t flags;
+  bool matched;
+  // RVA of the result if it is relative, otherwise the offset of the result
+  // from the module base (so the entry is still valid if the module moves).
+  std::uint64_t offset;
+};
+
+struct PatternCacheModule
+{
+  // Identifies the exact build of the module.
+  std::uint32_t time_date_stamp;
+  std::uint32_t check_sum;
+  std::uint32_t size_of_image;
+  // Identifies the pattern definitions the results were generated from.
+  std::uint64_t definitions_hash;
+  std::vector<PatternCacheEntry> entries;
+};
+
+// Keyed by module name, as given in the pattern file.
+using PatternCache = std::map<std::wstring, PatternCacheModule>;
+
+std::uint32_t const kPatternCacheMagic = 0x43504D48; // 'HMPC'
+std::uint32_t const kPatternCacheVersion = 1;
+
+template <typename T>
+inline bool ReadPatternCachePod(std::istream& in, T& data)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_pod<T>::value);
+  return !!in.read(reinterpret_cast<char*>(&data), sizeof(data));
+}
+
+inline bool ReadPatternCacheString(std::istream& in, std::wstring& data)
+{
+  std::uint32_t size = 0;
+  // Reject anything absurd up front rather than trying to allocate it.
+  if (!ReadPatternCachePod(in, size) || size > 0x10000)
+  {
+    return false;
+  }
+
+  data.resize(size);
+  return !size || !!in.read(reinterpret_cast<char*>(&data[0]),
+                            size * sizeof(wchar_t));
+}
+
+template <typename T>
+inline void WritePatternCachePod(std::ostream& out, T const& data)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_pod<T>::value);
+  out.write(reinterpret_cast<char const*>(&data), sizeof(data));
+}
+
+inline void WritePatternCacheString(std::ostream& out,
+                                    std::wstring const& data)
+{
+  WritePatternCachePod(out, static_cast<std::uint32_t>(data.size()));
+  out.write(reinterpret_cast<char const*>(data.data()),
+            data.size() * sizeof(wchar_t));
+}
+
+// A missing, truncated or otherwise invalid cache file is treated as empty,
+// so the worst case is always just a full rescan.
+inline PatternCache ReadPatternCache(std::wstring const& path)
+{
+  auto const file = OpenFile<char>(path, std::ios::in | std::ios::binary);
+  std::istream& in = *file;
+  if (!in)
+  {
+    return PatternCache{};
+  }
+
+  std::uint32_t magic = 0;
+  std::uint32_t version = 0;
+  std::uint32_t pointer_size = 0;
+  std::uint32_t num_modules = 0;
+  if (!ReadPatternCachePod(in, magic) || magic != kPatternCacheMagic ||
+      !ReadPatternCachePod(in, version) || version != kPatternCacheVersion ||
+      !ReadPatternCachePod(in, pointer_size) ||
+      pointer_size != sizeof(void*) || !ReadPatternCachePod(in, num_modules))
+  {
+    return PatternCache{};
+  }
+
+  PatternCache cache;
+  for (std::uint32_t i = 0; i < num_modules; ++i)
+  {
+    std::wstring name;
+    PatternCacheModule module;
+    std::uint32_t num_entries = 0;
+    if (!ReadPatternCacheString(in, name) ||
+        !ReadPatternCachePod(in, module.time_date_stamp) ||
+        !ReadPatternCachePod(in, module.check_sum) ||
+        !ReadPatternCachePod(in, module.size_of_image) ||
+        !ReadPatternCachePod(in, module.definitions_hash) ||
+        !ReadPatternCachePod(in, num_entries))
+    {
+      return PatternCache{};
+    }
+
+    for (std::uint32_t j = 0; j < num_entries; ++j)
+    {
+      PatternCacheEntry entry;
+      std::uint8_t matched = 0;
+      if (!ReadPatternCacheString(in, entry.name) ||
+          !ReadPatternCachePod(in, entry.flags) ||
+          !ReadPatternCachePod(in, matched) ||
+          !ReadPatternCachePod(in, entry.offset))
+      {
+        return PatternCache{};
+      }
+
+      entry.matched = !!matched;
+      module.entries.emplace_back(std::move(entry));
+    }
+
+    cache[name] = std::move(module);
+  }
+
+  return cache;
+}
+
+inline void WritePatternCacheStream(std::ostream& out,
+                                    PatternCache const& cache)
+{
+  WritePatternCachePod(out, kPatternCacheMagic);
+  WritePatternCachePod(out, kPatternCacheVersion);
+  WritePatternCachePod(out, static_cast<std::uint32_t>(sizeof(void*)));
+  WritePatternCachePod(out, static_cast<std::uint32_t>(cache.size()));
+  for (auto const& module_pair : cache)
+  {
+    auto const& module = module_pair.second;
+    WritePatternCacheString(out, module_pair.first);
+    WritePatternCachePod(out, module.time_date_stamp);
+    WritePatternCachePod(out, module.check_sum);
+    WritePatternCachePod(out, module.size_of_image);
+    WritePatternCachePod(out, module.definitions_hash);
+    WritePatternCachePod(out,
+                         static_cast<std::uint32_t>(module.entries.size()));
+    for (auto const& entry : module.entries)
+    {
+      WritePatternCacheString(out, entry.name);
+      WritePatternCachePod(out, entry.flags);
+      WritePatternCachePod(out, static_cast<std::uint8_t>(entry.matched));
+      WritePatternCachePod(out, entry.offset);
+    }
+  }
+}
+
+// Written to a temporary file which then replaces the cache, so a failed
+// write never leaves a truncated cache behind.
+inline void WritePatternCache(std::wstring const& path,
+                              PatternCache const& cache)
+{
+  std::wstring const temp_path = path + L".tmp";
+  {
+    auto const file = OpenFile<char>(
+      temp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!*file)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Could not open pattern cache file."});
+    }
+
+    WritePatternCacheStream(*file, cache);
+    file->close();
+    if (!*file)
+    {
+      ::DeleteFileW(temp_path.c_str());
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Could not write pattern cache file."});
+    }
+  }
+
+  if (!::MoveFileExW(
+        temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+  {
+    DWORD const last_error = ::GetLastError();
+    ::DeleteFileW(temp_path.c_str());
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"Could not replace pattern cache file."}
+              << ErrorCodeWinLast{last_error});
+  }
+}
+}
+}
+}
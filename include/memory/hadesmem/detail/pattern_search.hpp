@@ -0,0 +1,340 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+#include <hadesmem/detail/assert.hpp>
+
+// Checks the compiler directly rather than including config.hpp (which pulls
+// in windows.h), so the kernels can be built and tested on any x86/x64
+// target.
+#if defined(__GNUC__)
+#include <cpuid.h>
+#else // #if defined(__GNUC__)
+#include <intrin.h>
+#endif // #if defined(__GNUC__)
+#include <emmintrin.h>
+#include <immintrin.h>
+
+// GCC and Clang refuse to emit SSE2/AVX2 instructions from a function unless
+// it is explicitly targeted (MSVC and ICC allow the intrinsics anywhere). The
+// vectorized paths are only ever called after checking for support at
+// runtime.
+#if defined(__GNUC__)
+#define HADESMEM_DETAIL_TARGET_SSE2 __attribute__((target("sse2")))
+#define HADESMEM_DETAIL_TARGET_AVX2 __attribute__((target("avx2")))
+#else // #if defined(__GNUC__)
+#define HADESMEM_DETAIL_TARGET_SSE2
+#define HADESMEM_DETAIL_TARGET_AVX2
+#endif // #if defined(__GNUC__)
+
+namespace hadesmem
+{
+namespace detail
+{
+enum class SimdLevel
+{
+  kScalar,
+  kSse2,
+  kAvx2
+};
+
+inline void Cpuid(int info[4], int function, int subfunction)
+{
+#if defined(__GNUC__)
+  __cpuid_count(function, subfunction, info[0], info[1], info[2], info[3]);
+#else  // #if defined(__GNUC__)
+  __cpuidex(info, function, subfunction);
+#endif // #if defined(__GNUC__)
+}
+
+inline std::uint64_t GetXcr0()
+{
+#if defined(__GNUC__)
+  std::uint32_t eax = 0;
+  std::uint32_t edx = 0;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<std::uint64_t>(edx) << 32) | eax;
+#else  // #if defined(__GNUC__)
+  return _xgetbv(0);
+#endif // #if defined(__GNUC__)
+}
+
+inline SimdLevel DetectSimdLevel()
+{
+  int info[4] = {};
+  Cpuid(info, 0, 0);
+  int const max_function = info[0];
+
+  Cpuid(info, 1, 0);
+  bool const has_sse2 = !!(info[3] & (1 << 26));
+  bool const has_osxsave = !!(info[2] & (1 << 27));
+  bool const has_avx = !!(info[2] & (1 << 28));
+
+  // AVX2 also requires the OS to save the YMM registers on a context switch.
+  if (has_osxsave && has_avx && max_function >= 7 &&
+      (GetXcr0() & 0x6) == 0x6)
+  {
+    Cpuid(info, 7, 0);
+    if (!!(info[1] & (1 << 5)))
+    {
+      return SimdLevel::kAvx2;
+    }
+  }
+
+  return has_sse2 ? SimdLevel::kSse2 : SimdLevel::kScalar;
+}
+
+inline SimdLevel GetSimdLevel()
+{
+  // Racing to initialize this is harmless, every thread gets the same value.
+  static SimdLevel const level = DetectSimdLevel();
+  return level;
+}
+
+inline unsigned long CountTrailingZeros(std::uint32_t value)
+{
+  HADESMEM_DETAIL_ASSERT(value != 0);
+
+#if defined(__GNUC__)
+  return static_cast<unsigned long>(__builtin_ctz(value));
+#else  // #if defined(__GNUC__)
+  unsigned long index = 0;
+  _BitScanForward(&index, value);
+  return index;
+#endif // #if defined(__GNUC__)
+}
+
+// Rough ranking of how common a byte value is in x86/x64 code and data
+// sections (higher is more common). Anything not listed is considered rare,
+// which is all that matters when picking anchors to filter on.
+inline std::size_t GetByteFrequency(std::uint8_t value)
+{
+  static std::uint8_t const kCommonBytes[] = {
+    0x00, 0xFF, 0xCC, 0x8B, 0x48, 0x89, 0x24, 0x44, 0x0F, 0xE8, 0x4C,
+    0x85, 0x83, 0x01, 0xC3, 0x90, 0x74, 0x08, 0x10, 0x8D, 0x45, 0x75,
+    0xC0, 0x04, 0x20, 0x40, 0x5C, 0x54, 0x4D, 0x41, 0x02, 0x84};
+  auto const beg = std::begin(kCommonBytes);
+  auto const end = std::end(kCommonBytes);
+  auto const iter = std::find(beg, end, value);
+  return static_cast<std::size_t>(std::distance(iter, end));
+}
+
+// Non-owning view of a pattern in packed form, as consumed by the search
+// kernels. Wildcard bytes have a mask (and value) of zero, so a position
+// matches if (haystack & mask) == value for every byte. The anchors are the
+// offsets of the two rarest non-wildcard bytes (the same offset if there is
+// only one), or the size of the pattern if it is all wildcards.
+struct PackedPattern
+{
+  std::uint8_t const* values;
+  std::uint8_t const* masks;
+  std::size_t size;
+  std::size_t anchor_first;
+  std::size_t anchor_second;
+};
+
+inline void SelectPatternAnchors(std::uint8_t const* masks,
+                                 std::uint8_t const* values,
+                                 std::size_t size,
+                                 std::size_t& anchor_first,
+                                 std::size_t& anchor_second)
+{
+  anchor_first = size;
+  anchor_second = size;
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    if (!masks[i])
+    {
+      continue;
+    }
+
+    std::size_t const frequency = GetByteFrequency(values[i]);
+    if (anchor_first == size ||
+        frequency < GetByteFrequency(values[anchor_first]))
+    {
+      anchor_second = anchor_first;
+      anchor_first = i;
+    }
+    else if (anchor_second == size ||
+             frequency < GetByteFrequency(values[anchor_second]))
+    {
+      anchor_second = i;
+    }
+  }
+
+  if (anchor_second == size)
+  {
+    anchor_second = anchor_first;
+  }
+}
+
+inline bool VerifyPackedPattern(std::uint8_t const* h_cur,
+                                PackedPattern const& pattern)
+{
+  for (std::size_t i = 0; i < pattern.size; ++i)
+  {
+    if ((h_cur[i] & pattern.masks[i]) != pattern.values[i])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Searches [h_beg + pos, h_beg + last] for match starting positions, where
+// last is the last position at which the whole pattern still fits.
+inline std::uint8_t const* FindPackedScalar(std::uint8_t const* h_beg,
+                                            std::size_t pos,
+                                            std::size_t last,
+                                            PackedPattern const& pattern)
+{
+  std::uint8_t const value_first = pattern.values[pattern.anchor_first];
+  std::uint8_t const value_second = pattern.values[pattern.anchor_second];
+  while (pos <= last)
+  {
+    // memchr is already vectorized by the CRT, so use it to skip to the next
+    // occurrence of the first anchor.
+    auto const first = static_cast<std::uint8_t const*>(
+      std::memchr(h_beg + pos + pattern.anchor_first,
+                  value_first,
+                  last - pos + 1));
+    if (!first)
+    {
+      return nullptr;
+    }
+
+    pos = static_cast<std::size_t>(first - h_beg) - pattern.anchor_first;
+    if (h_beg[pos + pattern.anchor_second] == value_second &&
+        VerifyPackedPattern(h_beg + pos, pattern))
+    {
+      return h_beg + pos;
+    }
+
+    ++pos;
+  }
+
+  return nullptr;
+}
+
+HADESMEM_DETAIL_TARGET_SSE2 inline std::uint8_t const*
+  FindPackedSse2(std::uint8_t const* h_beg,
+                 std::size_t last,
+                 PackedPattern const& pattern)
+{
+  __m128i const first =
+    _mm_set1_epi8(static_cast<char>(pattern.values[pattern.anchor_first]));
+  __m128i const second =
+    _mm_set1_epi8(static_cast<char>(pattern.values[pattern.anchor_second]));
+
+  std::size_t pos = 0;
+  for (; pos + 15 <= last; pos += 16)
+  {
+    __m128i const block_first = _mm_loadu_si128(
+      reinterpret_cast<__m128i const*>(h_beg + pos + pattern.anchor_first));
+    __m128i const block_second = _mm_loadu_si128(
+      reinterpret_cast<__m128i const*>(h_beg + pos + pattern.anchor_second));
+    __m128i const eq = _mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                     _mm_cmpeq_epi8(second, block_second));
+    auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(eq));
+    while (mask)
+    {
+      std::size_t const cur = pos + CountTrailingZeros(mask);
+      if (VerifyPackedPattern(h_beg + cur, pattern))
+      {
+        return h_beg + cur;
+      }
+
+      mask &= mask - 1;
+    }
+  }
+
+  return FindPackedScalar(h_beg, pos, last, pattern);
+}
+
+HADESMEM_DETAIL_TARGET_AVX2 inline std::uint8_t const*
+  FindPackedAvx2(std::uint8_t const* h_beg,
+                 std::size_t last,
+                 PackedPattern const& pattern)
+{
+  __m256i const first =
+    _mm256_set1_epi8(static_cast<char>(pattern.values[pattern.anchor_first]));
+  __m256i const second =
+    _mm256_set1_epi8(static_cast<char>(pattern.values[pattern.anchor_second]));
+
+  std::size_t pos = 0;
+  for (; pos + 31 <= last; pos += 32)
+  {
+    __m256i const block_first = _mm256_loadu_si256(
+      reinterpret_cast<__m256i const*>(h_beg + pos + pattern.anchor_first));
+    __m256i const block_second = _mm256_loadu_si256(
+      reinterpret_cast<__m256i const*>(h_beg + pos + pattern.anchor_second));
+    __m256i const eq =
+      _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                       _mm256_cmpeq_epi8(second, block_second));
+    auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(eq));
+    while (mask)
+    {
+      std::size_t const cur = pos + CountTrailingZeros(mask);
+      if (VerifyPackedPattern(h_beg + cur, pattern))
+      {
+        return h_beg + cur;
+      }
+
+      mask &= mask - 1;
+    }
+  }
+
+  return FindPackedScalar(h_beg, pos, last, pattern);
+}
+
+// Finds the first match of the pattern in [h_beg, h_end). Candidates are
+// filtered on the two anchor bytes (16 or 32 positions at a time when
+// vectorized) and only then verified against the full pattern.
+inline std::uint8_t const* FindPacked(std::uint8_t const* h_beg,
+                                      std::uint8_t const* h_end,
+                                      PackedPattern const& pattern,
+                                      SimdLevel level)
+{
+  HADESMEM_DETAIL_ASSERT(h_beg <= h_end);
+  HADESMEM_DETAIL_ASSERT(pattern.size != 0);
+
+  std::size_t const h_size = static_cast<std::size_t>(h_end - h_beg);
+  if (pattern.size > h_size)
+  {
+    return nullptr;
+  }
+
+  // A pattern made up entirely of wildcards matches anywhere.
+  if (pattern.anchor_first == pattern.size)
+  {
+    return h_beg;
+  }
+
+  std::size_t const last = h_size - pattern.size;
+  switch (level)
+  {
+  case SimdLevel::kAvx2:
+    return FindPackedAvx2(h_beg, last, pattern);
+  case SimdLevel::kSse2:
+    return FindPackedSse2(h_beg, last, pattern);
+  default:
+    return FindPackedScalar(h_beg, 0, last, pattern);
+  }
+}
+
+inline std::uint8_t const* FindPacked(std::uint8_t const* h_beg,
+                                      std::uint8_t const* h_end,
+                                      PackedPattern const& pattern)
+{
+  return FindPacked(h_beg, h_end, pattern, GetSimdLevel());
+}
+}
+}
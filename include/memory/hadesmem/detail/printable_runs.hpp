@@ -0,0 +1,276 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/pattern_search.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+// Same set of characters std::isprint accepts in the classic locale.
+inline bool IsPrintableChar(std::uint32_t c) HADESMEM_DETAIL_NOEXCEPT
+{
+  return c >= 0x20 && c <= 0x7E;
+}
+
+// Turns per-character masks into runs of printable characters. The kernels
+// feed it up to 32 characters at a time, so a run is only ever looked at
+// where it starts or ends rather than once per character.
+template <typename Func> class PrintableRunTracker
+{
+public:
+  PrintableRunTracker(std::size_t min_length,
+                      std::size_t char_size,
+                      Func& func) HADESMEM_DETAIL_NOEXCEPT
+    : min_length_(min_length),
+      char_size_(char_size),
+      func_(&func),
+      pos_(0),
+      run_beg_(0),
+      in_run_(false)
+  {
+  }
+
+  PrintableRunTracker(PrintableRunTracker const&) = delete;
+
+  PrintableRunTracker& operator=(PrintableRunTracker const&) = delete;
+
+  // Bit i of mask is set if the character at GetPos() + i is printable.
+  void Feed(std::uint32_t mask, std::size_t count)
+  {
+    HADESMEM_DETAIL_ASSERT(count && count <= 32);
+
+    std::uint32_t const all =
+      count == 32 ? 0xFFFFFFFF : ((static_cast<std::uint32_t>(1) << count) - 1);
+    mask &= all;
+
+    std::uint32_t remaining = all;
+    for (;;)
+    {
+      std::uint32_t const edges = (in_run_ ? ~mask : mask) & remaining;
+      if (!edges)
+      {
+        break;
+      }
+
+      unsigned long const bit = CountTrailingZeros(edges);
+      if (in_run_)
+      {
+        EndRun(pos_ + bit);
+      }
+      else
+      {
+        run_beg_ = pos_ + bit;
+        in_run_ = true;
+      }
+
+      // Carry on from just past the edge (2 << 31 wraps to 0, which clears
+      // everything as it should).
+      remaining &= ~((static_cast<std::uint32_t>(2) << bit) - 1);
+    }
+
+    pos_ += count;
+  }
+
+  void Finish()
+  {
+    if (in_run_)
+    {
+      EndRun(pos_);
+    }
+  }
+
+  std::size_t GetPos() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return pos_;
+  }
+
+private:
+  void EndRun(std::size_t end)
+  {
+    in_run_ = false;
+    if (end - run_beg_ >= min_length_)
+    {
+      (*func_)(run_beg_ * char_size_, end - run_beg_);
+    }
+  }
+
+  std::size_t min_length_;
+  std::size_t char_size_;
+  Func* func_;
+  std::size_t pos_;
+  std::size_t run_beg_;
+  bool in_run_;
+};
+
+template <typename Func>
+void FeedPrintableScalar(std::uint8_t const* beg,
+                         std::size_t count,
+                         bool wide,
+                         PrintableRunTracker<Func>& tracker)
+{
+  while (tracker.GetPos() < count)
+  {
+    std::size_t const pos = tracker.GetPos();
+    std::size_t const n =
+      count - pos < 32 ? count - pos : static_cast<std::size_t>(32);
+    std::uint32_t mask = 0;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      std::uint32_t const c =
+        wide ? static_cast<std::uint32_t>(beg[(pos + i) * 2] |
+                                          (beg[(pos + i) * 2 + 1] << 8))
+             : beg[pos + i];
+      mask |= static_cast<std::uint32_t>(IsPrintableChar(c)) << i;
+    }
+    tracker.Feed(mask, n);
+  }
+}
+
+// Narrow characters are printable if (c - 0x20) <= 0x5E as an unsigned byte.
+// Wide characters fit in a signed 16-bit compare, anything with the top bit
+// set is negative and so out of range anyway. The wide masks are packed down
+// to one byte per character so both produce a bit per character.
+template <typename Func>
+HADESMEM_DETAIL_TARGET_SSE2 void
+  FeedPrintableSse2(std::uint8_t const* beg,
+                    std::size_t count,
+                    bool wide,
+                    PrintableRunTracker<Func>& tracker)
+{
+  __m128i const bias = _mm_set1_epi8(0x20);
+  __m128i const range = _mm_set1_epi8(0x5E);
+  __m128i const wide_lo = _mm_set1_epi16(0x1F);
+  __m128i const wide_hi = _mm_set1_epi16(0x7F);
+
+  auto const get_mask = [&](std::uint8_t const* p) -> std::uint32_t
+  {
+    if (wide)
+    {
+      __m128i const a =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+      __m128i const b =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + 16));
+      __m128i const ok_a = _mm_and_si128(_mm_cmpgt_epi16(a, wide_lo),
+                                         _mm_cmplt_epi16(a, wide_hi));
+      __m128i const ok_b = _mm_and_si128(_mm_cmpgt_epi16(b, wide_lo),
+                                         _mm_cmplt_epi16(b, wide_hi));
+      return static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_packs_epi16(ok_a, ok_b)));
+    }
+
+    __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+    __m128i const t = _mm_sub_epi8(v, bias);
+    return static_cast<std::uint32_t>(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(t, range), t)));
+  };
+
+  std::size_t const char_size = wide ? 2 : 1;
+  while (count - tracker.GetPos() >= 32)
+  {
+    std::uint8_t const* const p = beg + tracker.GetPos() * char_size;
+    std::uint32_t const lo = get_mask(p);
+    std::uint32_t const hi = get_mask(p + 16 * char_size);
+    tracker.Feed(lo | (hi << 16), 32);
+  }
+}
+
+template <typename Func>
+HADESMEM_DETAIL_TARGET_AVX2 void
+  FeedPrintableAvx2(std::uint8_t const* beg,
+                    std::size_t count,
+                    bool wide,
+                    PrintableRunTracker<Func>& tracker)
+{
+  __m256i const bias = _mm256_set1_epi8(0x20);
+  __m256i const range = _mm256_set1_epi8(0x5E);
+  __m256i const wide_lo = _mm256_set1_epi16(0x1F);
+  __m256i const wide_hi = _mm256_set1_epi16(0x7E);
+
+  std::size_t const char_size = wide ? 2 : 1;
+  while (count - tracker.GetPos() >= 32)
+  {
+    std::uint8_t const* const p = beg + tracker.GetPos() * char_size;
+    std::uint32_t mask = 0;
+    if (wide)
+    {
+      __m256i const a =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+      __m256i const b =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + 32));
+      __m256i const ok_a = _mm256_andnot_si256(
+        _mm256_cmpgt_epi16(a, wide_hi), _mm256_cmpgt_epi16(a, wide_lo));
+      __m256i const ok_b = _mm256_andnot_si256(
+        _mm256_cmpgt_epi16(b, wide_hi), _mm256_cmpgt_epi16(b, wide_lo));
+      // Packing works within each 128-bit lane, so put the quadwords back
+      // in order afterwards.
+      __m256i const packed = _mm256_permute4x64_epi64(
+        _mm256_packs_epi16(ok_a, ok_b), 0xD8);
+      mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(packed));
+    }
+    else
+    {
+      __m256i const v =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+      __m256i const t = _mm256_sub_epi8(v, bias);
+      mask = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(t, range), t)));
+    }
+    tracker.Feed(mask, 32);
+  }
+}
+
+// Calls func(offset, length) for each run of at least min_length printable
+// characters in [beg, beg + size), where offset is in bytes from beg and
+// length is in characters. Wide characters are UTF-16LE code units at even
+// offsets from beg (a trailing odd byte is ignored), so strings at the other
+// alignment need a second call starting at beg + 1. Only characters in the
+// printable ASCII range count, for both widths.
+template <typename Func>
+void FindPrintableRuns(void const* beg,
+                       std::size_t size,
+                       bool wide,
+                       std::size_t min_length,
+                       Func func,
+                       SimdLevel level)
+{
+  auto const p = static_cast<std::uint8_t const*>(beg);
+  std::size_t const char_size = wide ? 2 : 1;
+  std::size_t const count = size / char_size;
+  PrintableRunTracker<Func> tracker(
+    min_length ? min_length : 1, char_size, func);
+
+  switch (level)
+  {
+  case SimdLevel::kAvx2:
+    FeedPrintableAvx2(p, count, wide, tracker);
+    break;
+  case SimdLevel::kSse2:
+    FeedPrintableSse2(p, count, wide, tracker);
+    break;
+  case SimdLevel::kScalar:
+    break;
+  }
+
+  FeedPrintableScalar(p, count, wide, tracker);
+  tracker.Finish();
+}
+
+template <typename Func>
+void FindPrintableRuns(void const* beg,
+                       std::size_t size,
+                       bool wide,
+                       std::size_t min_length,
+                       Func func)
+{
+  FindPrintableRuns(beg, size, wide, min_length, func, GetSimdLevel());
+}
+}
+}
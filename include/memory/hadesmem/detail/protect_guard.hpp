@@ -56,17 +56,19 @@ public:
     can_read_or_write_ =
       (type_ == ProtectGuardType::kRead) ? CanRead(mbi_) : CanWrite(mbi_);
 
+    // The protection is put back when the guard is done with it, so the
+    // region cache (if any) is left alone unless that fails.
     if (!can_read_or_write_)
     {
       try
       {
-        old_protect_ = Protect(process, mbi_, PAGE_EXECUTE_READWRITE);
+        old_protect_ = ProtectUncached(process, mbi_, PAGE_EXECUTE_READWRITE);
       }
       catch (...)
       {
         // Try and fall back to PAGE_READWRITE because we might not be allowed
         // to set EXECUTE.
-        old_protect_ = Protect(process, mbi_, PAGE_READWRITE);
+        old_protect_ = ProtectUncached(process, mbi_, PAGE_READWRITE);
       }
     }
   }
@@ -120,7 +122,19 @@ public:
 
     if (!can_read_or_write_)
     {
-      Protect(*process_, mbi_, old_protect_);
+      try
+      {
+        ProtectUncached(*process_, mbi_, old_protect_);
+      }
+      catch (...)
+      {
+        if (RegionCache* const cache = process_->GetRegionCache())
+        {
+          cache->Invalidate(mbi_.BaseAddress, mbi_.RegionSize);
+        }
+
+        throw;
+      }
     }
 
     old_protect_ = 0;
@@ -13,9 +13,11 @@ namespace hadesmem
 {
 namespace detail
 {
-inline DWORD Protect(Process const& process,
-                     MEMORY_BASIC_INFORMATION const& mbi,
-                     DWORD protect)
+// Leaves the region cache alone, so it's only for callers which put the
+// protection back the way it was afterwards.
+inline DWORD ProtectUncached(Process const& process,
+                             MEMORY_BASIC_INFORMATION const& mbi,
+                             DWORD protect)
 {
   DWORD old_protect = 0;
   if (!::VirtualProtectEx(process.GetHandle(),
@@ -32,5 +34,19 @@ inline DWORD Protect(Process const& process,
 
   return old_protect;
 }
+
+inline DWORD Protect(Process const& process,
+                     MEMORY_BASIC_INFORMATION const& mbi,
+                     DWORD protect)
+{
+  DWORD const old_protect = ProtectUncached(process, mbi, protect);
+
+  if (RegionCache* const cache = process.GetRegionCache())
+  {
+    cache->Invalidate(mbi.BaseAddress, mbi.RegionSize);
+  }
+
+  return old_protect;
+}
 }
 }
@@ -6,6 +6,7 @@
 #include <windows.h>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/region_cache.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
 
@@ -13,7 +14,8 @@ namespace hadesmem
 {
 namespace detail
 {
-inline MEMORY_BASIC_INFORMATION Query(Process const& process, LPCVOID address)
+inline MEMORY_BASIC_INFORMATION QueryUncached(Process const& process,
+                                              LPCVOID address)
 {
   MEMORY_BASIC_INFORMATION mbi{};
   if (::VirtualQueryEx(process.GetHandle(), address, &mbi, sizeof(mbi)) !=
@@ -28,6 +30,23 @@ inline MEMORY_BASIC_INFORMATION Query(Process const& process, LPCVOID address)
   return mbi;
 }
 
+inline MEMORY_BASIC_INFORMATION Query(Process const& process, LPCVOID address)
+{
+  RegionCache* const cache = process.GetRegionCache();
+  if (!cache)
+  {
+    return QueryUncached(process, address);
+  }
+
+  return QueryCached(cache,
+                     address,
+                     ::GetTickCount64(),
+                     [&](void const* query_address)
+                     {
+    return QueryUncached(process, query_address);
+  });
+}
+
 inline bool
   CanRead(MEMORY_BASIC_INFORMATION const& mbi) HADESMEM_DETAIL_NOEXCEPT
 {
@@ -0,0 +1,193 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/srw_lock.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+// Sorted, non-overlapping map of the results of previous VirtualQueryEx calls,
+// so repeated accesses to the same region don't need to query it again.
+// Nothing here talks to the OS, the caller supplies both the query results and
+// the current time (in whatever units the TTL is in).
+//
+// Entries are dropped when they are older than the TTL (zero means they only
+// go away when invalidated), when the range they cover is invalidated, or
+// when the whole cache is invalidated (which also bumps the epoch, so anything
+// derived from the region layout can tell it may be out of date).
+class RegionCache
+{
+public:
+  explicit RegionCache(std::uint64_t ttl,
+                       std::uintptr_t page_size) HADESMEM_DETAIL_NOEXCEPT
+    : ttl_{ttl},
+      page_size_{page_size}
+  {
+    HADESMEM_DETAIL_ASSERT(page_size_ && !(page_size_ & (page_size_ - 1)));
+  }
+
+  RegionCache(RegionCache const& other) = delete;
+
+  RegionCache& operator=(RegionCache const& other) = delete;
+
+  std::uint64_t GetTtl() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return ttl_;
+  }
+
+  std::uint64_t GetEpoch() const
+  {
+    AcquireSRWLock const lock{&lock_, SRWLockType::Shared};
+    return epoch_;
+  }
+
+  // On a hit the result is adjusted to look exactly like VirtualQueryEx would
+  // for the given address (i.e. BaseAddress is the page containing the
+  // address and RegionSize runs from there to the end of the region).
+  bool Lookup(void const* address,
+              std::uint64_t now,
+              MEMORY_BASIC_INFORMATION& mbi) const
+  {
+    auto const address_num = reinterpret_cast<std::uintptr_t>(address);
+
+    AcquireSRWLock const lock{&lock_, SRWLockType::Shared};
+
+    auto iter = regions_.upper_bound(address_num);
+    if (iter == std::begin(regions_))
+    {
+      return false;
+    }
+
+    --iter;
+    Entry const& entry = iter->second;
+    auto const region_beg = iter->first;
+    auto const region_end = region_beg + entry.mbi.RegionSize;
+    if (address_num >= region_end || IsExpired(entry, now))
+    {
+      return false;
+    }
+
+    std::uintptr_t const page_beg = address_num & ~(page_size_ - 1);
+    mbi = entry.mbi;
+    mbi.BaseAddress = reinterpret_cast<void*>(page_beg);
+    mbi.RegionSize = region_end - page_beg;
+    return true;
+  }
+
+  void Insert(MEMORY_BASIC_INFORMATION const& mbi, std::uint64_t now)
+  {
+    if (!mbi.RegionSize)
+    {
+      return;
+    }
+
+    auto const region_beg = reinterpret_cast<std::uintptr_t>(mbi.BaseAddress);
+
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+
+    EraseOverlapping(region_beg, mbi.RegionSize);
+    regions_[region_beg] = Entry{mbi, now};
+  }
+
+  void Invalidate(void const* address, std::size_t size)
+  {
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+
+    EraseOverlapping(reinterpret_cast<std::uintptr_t>(address), size);
+  }
+
+  void Invalidate()
+  {
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+
+    regions_.clear();
+    ++epoch_;
+  }
+
+  std::size_t GetSize() const
+  {
+    AcquireSRWLock const lock{&lock_, SRWLockType::Shared};
+    return regions_.size();
+  }
+
+private:
+  struct Entry
+  {
+    MEMORY_BASIC_INFORMATION mbi;
+    std::uint64_t time;
+  };
+
+  bool IsExpired(Entry const& entry,
+                 std::uint64_t now) const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return ttl_ && (now < entry.time || now - entry.time >= ttl_);
+  }
+
+  // Caller must hold the lock exclusively.
+  void EraseOverlapping(std::uintptr_t beg, std::size_t size)
+  {
+    if (!size)
+    {
+      return;
+    }
+
+    std::uintptr_t const end = beg + size;
+    auto iter = regions_.upper_bound(beg);
+    if (iter != std::begin(regions_))
+    {
+      auto const prev = std::prev(iter);
+      if (prev->first + prev->second.mbi.RegionSize > beg)
+      {
+        iter = prev;
+      }
+    }
+
+    while (iter != std::end(regions_) && iter->first < end)
+    {
+      iter = regions_.erase(iter);
+    }
+  }
+
+  std::uint64_t ttl_;
+  std::uintptr_t page_size_;
+  std::uint64_t epoch_{};
+  std::map<std::uintptr_t, Entry> regions_;
+  mutable SRWLOCK lock_ = SRWLOCK_INIT;
+};
+
+// Query through the cache (if any). QueryFunc does the real query and must
+// return the same thing VirtualQueryEx would (throwing on failure).
+template <typename QueryFunc>
+MEMORY_BASIC_INFORMATION QueryCached(RegionCache* cache,
+                                     void const* address,
+                                     std::uint64_t now,
+                                     QueryFunc query)
+{
+  MEMORY_BASIC_INFORMATION mbi{};
+  if (cache && cache->Lookup(address, now, mbi))
+  {
+    return mbi;
+  }
+
+  mbi = query(address);
+  if (cache)
+  {
+    cache->Insert(mbi, now);
+  }
+
+  return mbi;
+}
+}
+}
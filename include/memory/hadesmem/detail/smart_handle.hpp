@@ -195,6 +195,23 @@ struct FilePolicy
 
 using SmartFileHandle = SmartHandleImpl<FilePolicy>;
 
+struct MapViewPolicy
+{
+  using HandleT = PVOID;
+
+  static HADESMEM_DETAIL_CONSTEXPR HandleT GetInvalid() HADESMEM_DETAIL_NOEXCEPT
+  {
+    return nullptr;
+  }
+
+  static bool Cleanup(HandleT handle)
+  {
+    return ::UnmapViewOfFile(handle) != 0;
+  }
+};
+
+using SmartMapViewHandle = SmartHandleImpl<MapViewPolicy>;
+
 struct FindPolicy
 {
   using HandleT = HANDLE;
@@ -0,0 +1,785 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/alloc.hpp>
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/detail/srw_lock.hpp>
+#include <hadesmem/detail/trace.hpp>
+#include <hadesmem/detail/winapi.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+
+namespace hadesmem
+{
+namespace detail
+{
+struct FreeRegion
+{
+  std::uintptr_t base;
+  std::uintptr_t size;
+};
+
+// Where to try to put a block of the given size and alignment so that it lies
+// entirely within both [range_beg, range_last] and one of the free regions.
+// Each region gives at most one candidate in each direction, as close to the
+// address as it can be. Candidates at or after the address come first
+// (closest first), followed by those before it (closest first).
+inline std::vector<std::uintptr_t>
+  GetNearAllocationCandidates(std::vector<FreeRegion> const& free_regions,
+                              std::uintptr_t near_address,
+                              std::uintptr_t range_beg,
+                              std::uintptr_t range_last,
+                              std::uintptr_t size,
+                              std::uintptr_t alignment)
+{
+  HADESMEM_DETAIL_ASSERT(size);
+  HADESMEM_DETAIL_ASSERT(alignment && !(alignment & (alignment - 1)));
+
+  std::uintptr_t const max_address =
+    (std::numeric_limits<std::uintptr_t>::max)();
+  std::vector<std::uintptr_t> forward;
+  std::vector<std::uintptr_t> backward;
+  for (auto const& region : free_regions)
+  {
+    if (!region.size)
+    {
+      continue;
+    }
+
+    std::uintptr_t const region_last =
+      region.size - 1 > max_address - region.base
+        ? max_address
+        : region.base + (region.size - 1);
+    std::uintptr_t const beg = (std::max)(region.base, range_beg);
+    std::uintptr_t const last = (std::min)(region_last, range_last);
+    if (beg > last || last - beg < size - 1)
+    {
+      continue;
+    }
+
+    std::uintptr_t const forward_beg = (std::max)(beg, near_address);
+    if (forward_beg <= last && forward_beg <= max_address - (alignment - 1))
+    {
+      std::uintptr_t const base =
+        (forward_beg + (alignment - 1)) & ~(alignment - 1);
+      if (base <= last && last - base >= size - 1)
+      {
+        forward.push_back(base);
+      }
+    }
+
+    if (beg < near_address)
+    {
+      std::uintptr_t const base =
+        (std::min)(last - (size - 1), near_address - 1) & ~(alignment - 1);
+      if (base >= beg)
+      {
+        backward.push_back(base);
+      }
+    }
+  }
+
+  std::sort(std::begin(forward), std::end(forward));
+  std::sort(std::begin(backward),
+            std::end(backward),
+            std::greater<std::uintptr_t>());
+  forward.insert(std::end(forward), std::begin(backward), std::end(backward));
+  return forward;
+}
+
+// Hands out small, slot aligned blocks (trampolines, and on x64 the pointers
+// that far jumps and calls go through) from larger slabs, so a hook doesn't
+// cost an allocation of its own, and on x64 the search for memory within
+// range of the target only has to be done once per slab rather than once per
+// jump. Slabs are reserved up front but only committed as far as they have
+// been used, freed blocks are reused, and slabs are kept until they are
+// trimmed or the arena goes away.
+//
+// Nothing here talks to the OS. The address space supplies the memory:
+//   std::uintptr_t TryReserve(std::uintptr_t address, std::size_t size);
+//   std::uintptr_t Reserve(std::size_t size);
+//   void Commit(std::uintptr_t address, std::size_t size);
+//   void Release(std::uintptr_t address);
+//   std::uintptr_t GetMinimumAddress() const;
+//   std::uintptr_t GetMaximumAddress() const;
+//   std::vector<FreeRegion> GetFreeRegions(std::uintptr_t beg,
+//                                          std::uintptr_t last);
+// TryReserve returns zero if the range isn't free, Reserve (anywhere) and
+// Commit throw on failure, and the maximum address is the last usable byte.
+// GetFreeRegions returns the free regions overlapping [beg, last] (in any
+// order, and they may run past either end).
+template <typename AddressSpace> class TrampolineArena
+{
+public:
+  explicit TrampolineArena(AddressSpace const& address_space,
+                           std::uintptr_t slab_size,
+                           std::uintptr_t page_size,
+                           std::uintptr_t slot_size,
+                           std::uintptr_t max_distance)
+    : address_space_(address_space),
+      slab_size_{slab_size},
+      page_size_{page_size},
+      slot_size_{slot_size},
+      max_distance_{max_distance}
+  {
+    HADESMEM_DETAIL_ASSERT(IsPowerOfTwo(slab_size_));
+    HADESMEM_DETAIL_ASSERT(IsPowerOfTwo(page_size_));
+    HADESMEM_DETAIL_ASSERT(IsPowerOfTwo(slot_size_));
+    HADESMEM_DETAIL_ASSERT(page_size_ <= slab_size_);
+    HADESMEM_DETAIL_ASSERT(slot_size_ <= page_size_);
+  }
+
+  TrampolineArena(TrampolineArena const& other) = delete;
+
+  TrampolineArena& operator=(TrampolineArena const& other) = delete;
+
+  ~TrampolineArena()
+  {
+    for (auto const& slab : slabs_)
+    {
+      ReleaseUnchecked(slab.first);
+    }
+  }
+
+  // Anywhere in the address space.
+  std::uintptr_t Allocate(std::size_t size)
+  {
+    std::size_t const num_slots = GetNumSlots(size);
+    std::uintptr_t const max_address =
+      (std::numeric_limits<std::uintptr_t>::max)();
+
+    for (auto& slab : slabs_)
+    {
+      if (std::uintptr_t const address =
+            AllocateInSlab(slab, num_slots, 0, max_address))
+      {
+        return address;
+      }
+    }
+
+    auto const slab = AddSlab(address_space_.Reserve(slab_size_));
+    std::uintptr_t const address =
+      AllocateInSlab(*slab, num_slots, 0, max_address);
+    HADESMEM_DETAIL_ASSERT(address);
+    return address;
+  }
+
+  // The whole block ends up within the maximum distance of the address (in
+  // either direction). Throws if there's nowhere in range to put it.
+  std::uintptr_t AllocateNear(std::uintptr_t near_address, std::size_t size)
+  {
+    std::size_t const num_slots = GetNumSlots(size);
+
+    std::uintptr_t const range_beg = (std::max)(
+      near_address > max_distance_ ? near_address - max_distance_ : 0,
+      address_space_.GetMinimumAddress());
+    std::uintptr_t const max_address = address_space_.GetMaximumAddress();
+    std::uintptr_t const range_last =
+      near_address <= max_address - (std::min)(max_distance_, max_address)
+        ? near_address + max_distance_
+        : max_address;
+
+    // Look forwards first (existing slabs, then new ones), and only then
+    // backwards. This is because there is a bug in Steam's overlay (last
+    // checked and confirmed in SteamOverlayRender64.dll v2.50.25.37) where
+    // negative displacements are not correctly sign-extended when cast to
+    // 64-bits, resulting in a crash when they attempt to resolve the jump.
+
+    // .text:0000000180082956                 cmp     al, 0FFh
+    // .text:0000000180082958                 jnz     short loc_180082971
+    // .text:000000018008295A                 cmp     byte ptr [r13+1], 25h
+    // .text:000000018008295F                 jnz     short loc_180082971
+    // ; Notice how the displacement is not being sign extended.
+    // .text:0000000180082961                 mov     eax, [r13+2]
+    // .text:0000000180082965                 lea     rcx, [rax+r13]
+    // .text:0000000180082969                 mov     r13, [rcx+6]
+
+    std::uintptr_t const forward_beg = (std::max)(range_beg, near_address);
+    if (forward_beg <= range_last)
+    {
+      if (std::uintptr_t const address =
+            AllocateInSlabs(num_slots, forward_beg, range_last))
+      {
+        return address;
+      }
+    }
+
+    // New slabs are only tried in free regions which can hold all of one,
+    // so this is a single walk of the region map and (unless something else
+    // gets there first) a single reservation, rather than a reservation
+    // attempt at every slab in range.
+    std::vector<std::uintptr_t> const candidates =
+      GetNearAllocationCandidates(
+        address_space_.GetFreeRegions(range_beg, range_last),
+        near_address,
+        range_beg,
+        range_last,
+        slab_size_,
+        slab_size_);
+    auto candidate = std::begin(candidates);
+    for (; candidate != std::end(candidates) && *candidate >= near_address;
+         ++candidate)
+    {
+      if (std::uintptr_t const address =
+            TryAddSlab(num_slots, *candidate, range_beg, range_last))
+      {
+        return address;
+      }
+    }
+
+    HADESMEM_DETAIL_TRACE_A(
+      "WARNING! Failed to find a viable trampoline slot in forward scan, "
+      "falling back to backward scan. This may cause incompatibilty with some "
+      "other overlays.");
+
+    if (std::uintptr_t const address =
+          AllocateInSlabs(num_slots, range_beg, range_last))
+    {
+      return address;
+    }
+
+    for (; candidate != std::end(candidates); ++candidate)
+    {
+      if (std::uintptr_t const address =
+            TryAddSlab(num_slots, *candidate, range_beg, range_last))
+      {
+        return address;
+      }
+    }
+
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"Failed to find trampoline memory block."});
+  }
+
+  void Free(std::uintptr_t address, std::size_t size) HADESMEM_DETAIL_NOEXCEPT
+  {
+    auto iter = slabs_.upper_bound(address);
+    if (iter == std::begin(slabs_))
+    {
+      HADESMEM_DETAIL_ASSERT(false);
+      return;
+    }
+
+    --iter;
+    Slab& slab = iter->second;
+    HADESMEM_DETAIL_ASSERT(size);
+    auto const num_slots =
+      static_cast<std::size_t>((size + slot_size_ - 1) / slot_size_);
+    std::size_t const first_slot =
+      static_cast<std::size_t>((address - iter->first) / slot_size_);
+    if (first_slot + num_slots > slab.used.size())
+    {
+      HADESMEM_DETAIL_ASSERT(false);
+      return;
+    }
+
+    for (std::size_t i = first_slot; i < first_slot + num_slots; ++i)
+    {
+      HADESMEM_DETAIL_ASSERT(slab.used[i]);
+      slab.used[i] = false;
+    }
+    slab.num_used -= num_slots;
+    slab.first_free = (std::min)(slab.first_free, first_slot);
+  }
+
+  // Gives back any slabs which are no longer in use.
+  void Trim() HADESMEM_DETAIL_NOEXCEPT
+  {
+    for (auto iter = std::begin(slabs_); iter != std::end(slabs_);)
+    {
+      if (!iter->second.num_used)
+      {
+        ReleaseUnchecked(iter->first);
+        iter = slabs_.erase(iter);
+      }
+      else
+      {
+        ++iter;
+      }
+    }
+  }
+
+  std::size_t GetNumberOfSlabs() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return slabs_.size();
+  }
+
+  std::size_t GetNumberOfUsedSlots() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    std::size_t num_used = 0;
+    for (auto const& slab : slabs_)
+    {
+      num_used += slab.second.num_used;
+    }
+    return num_used;
+  }
+
+  std::uintptr_t GetCommittedSize() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    std::uintptr_t committed = 0;
+    for (auto const& slab : slabs_)
+    {
+      committed += slab.second.committed;
+    }
+    return committed;
+  }
+
+private:
+  struct Slab
+  {
+    std::vector<bool> used;
+    std::size_t num_used;
+    // Everything before this is known to be used.
+    std::size_t first_free;
+    std::uintptr_t committed;
+  };
+
+  using SlabMap = std::map<std::uintptr_t, Slab>;
+
+  static bool IsPowerOfTwo(std::uintptr_t value) HADESMEM_DETAIL_NOEXCEPT
+  {
+    return value && !(value & (value - 1));
+  }
+
+  std::size_t GetNumSlots(std::size_t size) const
+  {
+    if (!size || size > slab_size_)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid trampoline size."});
+    }
+
+    return static_cast<std::size_t>((size + slot_size_ - 1) / slot_size_);
+  }
+
+  typename SlabMap::iterator AddSlab(std::uintptr_t base)
+  {
+    HADESMEM_DETAIL_ASSERT(base && !(base & (slab_size_ - 1)));
+
+    Slab slab{};
+    slab.used.resize(static_cast<std::size_t>(slab_size_ / slot_size_));
+    return slabs_.insert(std::make_pair(base, std::move(slab))).first;
+  }
+
+  void ReleaseUnchecked(std::uintptr_t base) HADESMEM_DETAIL_NOEXCEPT
+  {
+    try
+    {
+      address_space_.Release(base);
+    }
+    catch (...)
+    {
+      // WARNING: Slab is leaked if 'Release' fails.
+      HADESMEM_DETAIL_TRACE_A(
+        boost::current_exception_diagnostic_information().c_str());
+      HADESMEM_DETAIL_ASSERT(false);
+    }
+  }
+
+  // Lowest free run of slots which lies entirely within [range_beg,
+  // range_last], or zero if there isn't one.
+  std::uintptr_t AllocateInSlab(typename SlabMap::value_type& slab_entry,
+                                std::size_t num_slots,
+                                std::uintptr_t range_beg,
+                                std::uintptr_t range_last)
+  {
+    std::uintptr_t const base = slab_entry.first;
+    Slab& slab = slab_entry.second;
+    std::size_t const slab_slots = slab.used.size();
+    if (slab.num_used + num_slots > slab_slots || range_last < base ||
+        (range_beg > base && range_beg - base >= slab_size_))
+    {
+      return 0;
+    }
+
+    std::size_t const first_slot = (std::max)(
+      slab.first_free,
+      range_beg > base ? static_cast<std::size_t>(
+                           (range_beg - base + slot_size_ - 1) / slot_size_)
+                       : 0);
+    // Runs can start in any slot which starts within the range.
+    std::size_t const end_slot =
+      range_last - base >= slab_size_
+        ? slab_slots
+        : static_cast<std::size_t>((range_last - base) / slot_size_ + 1);
+
+    std::size_t run = 0;
+    for (std::size_t i = first_slot; i < end_slot; ++i)
+    {
+      run = slab.used[i] ? 0 : run + 1;
+      if (run != num_slots)
+      {
+        continue;
+      }
+
+      std::size_t const run_beg = i + 1 - num_slots;
+      // The run has to fit before the last byte of the range, not just start
+      // before it.
+      std::uintptr_t const address = base + run_beg * slot_size_;
+      if (range_last - address < num_slots * slot_size_ - 1)
+      {
+        break;
+      }
+
+      CommitTo(base, slab, (run_beg + num_slots) * slot_size_);
+      for (std::size_t j = run_beg; j <= i; ++j)
+      {
+        slab.used[j] = true;
+      }
+      slab.num_used += num_slots;
+      if (run_beg == slab.first_free)
+      {
+        while (slab.first_free < slab_slots && slab.used[slab.first_free])
+        {
+          ++slab.first_free;
+        }
+      }
+
+      return address;
+    }
+
+    return 0;
+  }
+
+  void CommitTo(std::uintptr_t base, Slab& slab, std::uintptr_t end)
+  {
+    if (end <= slab.committed)
+    {
+      return;
+    }
+
+    std::uintptr_t const new_committed =
+      (end + page_size_ - 1) & ~(page_size_ - 1);
+    address_space_.Commit(base + slab.committed,
+                          static_cast<std::size_t>(new_committed -
+                                                   slab.committed));
+    slab.committed = new_committed;
+  }
+
+  std::uintptr_t AllocateInSlabs(std::size_t num_slots,
+                                 std::uintptr_t range_beg,
+                                 std::uintptr_t range_last)
+  {
+    auto iter = slabs_.upper_bound(range_beg);
+    if (iter != std::begin(slabs_))
+    {
+      --iter;
+    }
+
+    for (; iter != std::end(slabs_) && iter->first <= range_last; ++iter)
+    {
+      if (std::uintptr_t const address =
+            AllocateInSlab(*iter, num_slots, range_beg, range_last))
+      {
+        return address;
+      }
+    }
+
+    return 0;
+  }
+
+  std::uintptr_t TryAddSlab(std::size_t num_slots,
+                            std::uintptr_t base,
+                            std::uintptr_t range_beg,
+                            std::uintptr_t range_last)
+  {
+    std::uintptr_t const new_base = address_space_.TryReserve(
+      base, static_cast<std::size_t>(slab_size_));
+    if (!new_base)
+    {
+      return 0;
+    }
+
+    auto const slab = AddSlab(new_base);
+    return AllocateInSlab(*slab, num_slots, range_beg, range_last);
+  }
+
+  AddressSpace address_space_;
+  std::uintptr_t slab_size_;
+  std::uintptr_t page_size_;
+  std::uintptr_t slot_size_;
+  std::uintptr_t max_distance_;
+  SlabMap slabs_;
+};
+
+class ProcessTrampolineAddressSpace
+{
+public:
+  explicit ProcessTrampolineAddressSpace(Process const& process)
+    : process_(process), sys_info_(GetSystemInfo())
+  {
+  }
+
+  std::uintptr_t TryReserve(std::uintptr_t address, std::size_t size)
+  {
+    return reinterpret_cast<std::uintptr_t>(
+      ReserveImpl(reinterpret_cast<PVOID>(address), size));
+  }
+
+  std::uintptr_t Reserve(std::size_t size)
+  {
+    PVOID const address = ReserveImpl(nullptr, size);
+    if (!address)
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"VirtualAllocEx failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    return reinterpret_cast<std::uintptr_t>(address);
+  }
+
+  void Commit(std::uintptr_t address, std::size_t size)
+  {
+    if (!::VirtualAllocEx(process_.GetHandle(),
+                          reinterpret_cast<PVOID>(address),
+                          size,
+                          MEM_COMMIT,
+                          PAGE_EXECUTE_READWRITE))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"VirtualAllocEx failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    InvalidateRegionCache(process_, reinterpret_cast<PVOID>(address), size);
+  }
+
+  void Release(std::uintptr_t address)
+  {
+    hadesmem::Free(process_, reinterpret_cast<PVOID>(address));
+  }
+
+  std::uintptr_t GetMinimumAddress() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return reinterpret_cast<std::uintptr_t>(
+      sys_info_.lpMinimumApplicationAddress);
+  }
+
+  std::uintptr_t GetMaximumAddress() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return reinterpret_cast<std::uintptr_t>(
+      sys_info_.lpMaximumApplicationAddress);
+  }
+
+  // Walks the region map (through the region cache, if it's enabled).
+  std::vector<FreeRegion> GetFreeRegions(std::uintptr_t beg,
+                                         std::uintptr_t last)
+  {
+    std::vector<FreeRegion> free_regions;
+    std::uintptr_t address = beg;
+    while (address <= last)
+    {
+      MEMORY_BASIC_INFORMATION mbi{};
+      try
+      {
+        mbi = Query(process_, reinterpret_cast<LPCVOID>(address));
+      }
+      catch (std::exception const& /*e*/)
+      {
+        // Past the end of the address space.
+        break;
+      }
+
+      auto const region_base =
+        reinterpret_cast<std::uintptr_t>(mbi.BaseAddress);
+      std::uintptr_t const region_end = region_base + mbi.RegionSize;
+      if (mbi.State == MEM_FREE)
+      {
+        free_regions.push_back(FreeRegion{region_base, mbi.RegionSize});
+      }
+
+      if (region_end <= address)
+      {
+        break;
+      }
+
+      address = region_end;
+    }
+
+    return free_regions;
+  }
+
+private:
+  PVOID ReserveImpl(PVOID address, std::size_t size)
+  {
+    PVOID const new_address = ::VirtualAllocEx(
+      process_.GetHandle(), address, size, MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    if (new_address)
+    {
+      InvalidateRegionCache(process_, new_address, size);
+    }
+
+    return new_address;
+  }
+
+  Process process_;
+  SYSTEM_INFO sys_info_;
+};
+
+// One arena per process, shared by every hook in it. Slabs are one allocation
+// granule (so no part of a reservation is wasted) and committed a page at a
+// time. On x64 anything which has to be near an address is kept within the
+// reach of a rel32 displacement.
+class SharedTrampolineArena
+{
+public:
+  explicit SharedTrampolineArena(Process const& process)
+    : arena_{ProcessTrampolineAddressSpace{process},
+             GetSystemInfo().dwAllocationGranularity,
+             GetSystemInfo().dwPageSize,
+             kSlotSize,
+             kMaxDistance}
+  {
+  }
+
+  SharedTrampolineArena(SharedTrampolineArena const& other) = delete;
+
+  SharedTrampolineArena& operator=(SharedTrampolineArena const& other) =
+    delete;
+
+  PVOID Allocate(std::size_t size)
+  {
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+    return reinterpret_cast<PVOID>(arena_.Allocate(size));
+  }
+
+  PVOID AllocateNear(PVOID address, std::size_t size)
+  {
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+    return reinterpret_cast<PVOID>(
+      arena_.AllocateNear(reinterpret_cast<std::uintptr_t>(address), size));
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+    (void)address;
+    return Allocate(size);
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+  }
+
+  void Free(PVOID address, std::size_t size) HADESMEM_DETAIL_NOEXCEPT
+  {
+    AcquireSRWLock const lock{&lock_, SRWLockType::Exclusive};
+    arena_.Free(reinterpret_cast<std::uintptr_t>(address), size);
+  }
+
+private:
+  static std::uintptr_t const kSlotSize = 16;
+#if defined(HADESMEM_DETAIL_ARCH_X64)
+  static std::uintptr_t const kMaxDistance = 0x7FFFFF00ULL;
+#elif defined(HADESMEM_DETAIL_ARCH_X86)
+  static std::uintptr_t const kMaxDistance = 0xFFFFFFFFUL;
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+
+  TrampolineArena<ProcessTrampolineAddressSpace> arena_;
+  SRWLOCK lock_ = SRWLOCK_INIT;
+};
+
+// Arenas are only kept alive by the blocks allocated from them, so once the
+// last hook in a process goes away so does all of its trampoline memory.
+inline std::shared_ptr<SharedTrampolineArena>
+  GetSharedTrampolineArena(Process const& process)
+{
+  static SRWLOCK arenas_lock = SRWLOCK_INIT;
+  static std::map<DWORD, std::weak_ptr<SharedTrampolineArena>> arenas;
+
+  AcquireSRWLock const lock{&arenas_lock, SRWLockType::Exclusive};
+
+  for (auto iter = std::begin(arenas); iter != std::end(arenas);)
+  {
+    if (iter->second.expired())
+    {
+      iter = arenas.erase(iter);
+    }
+    else
+    {
+      ++iter;
+    }
+  }
+
+  std::weak_ptr<SharedTrampolineArena>& weak_arena = arenas[process.GetId()];
+  std::shared_ptr<SharedTrampolineArena> arena = weak_arena.lock();
+  if (!arena)
+  {
+    arena = std::make_shared<SharedTrampolineArena>(process);
+    weak_arena = arena;
+  }
+
+  return arena;
+}
+
+class TrampolineSlot
+{
+public:
+  explicit TrampolineSlot(std::shared_ptr<SharedTrampolineArena> const& arena,
+                          PVOID base,
+                          SIZE_T size) HADESMEM_DETAIL_NOEXCEPT
+    : arena_{arena},
+      base_{base},
+      size_{size}
+  {
+  }
+
+  TrampolineSlot(TrampolineSlot const& other) = delete;
+
+  TrampolineSlot& operator=(TrampolineSlot const& other) = delete;
+
+  ~TrampolineSlot()
+  {
+    arena_->Free(base_, size_);
+  }
+
+  PVOID GetBase() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return base_;
+  }
+
+  SIZE_T GetSize() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return size_;
+  }
+
+private:
+  std::shared_ptr<SharedTrampolineArena> arena_;
+  PVOID base_;
+  SIZE_T size_;
+};
+
+inline std::unique_ptr<TrampolineSlot>
+  AllocateTrampoline(Process const& process, SIZE_T size)
+{
+  auto const arena = GetSharedTrampolineArena(process);
+  return std::make_unique<TrampolineSlot>(arena, arena->Allocate(size), size);
+}
+
+inline std::unique_ptr<TrampolineSlot>
+  AllocateTrampolineNear(Process const& process, PVOID address, SIZE_T size)
+{
+  auto const arena = GetSharedTrampolineArena(process);
+  return std::make_unique<TrampolineSlot>(
+    arena, arena->AllocateNear(address, size), size);
+}
+}
+}
@@ -4,12 +4,11 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <iterator>
-#include <limits>
-#include <locale>
 #include <map>
-#include <sstream>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -23,15 +22,20 @@
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/parallel_for.hpp>
+#include <hadesmem/detail/pattern_cache.hpp>
+#include <hadesmem/detail/pattern_search.hpp>
 #include <hadesmem/detail/pugixml_helpers.hpp>
 #include <hadesmem/detail/static_assert.hpp>
 #include <hadesmem/detail/str_conv.hpp>
 #include <hadesmem/detail/to_upper_ordinal.hpp>
+#include <hadesmem/detail/trace.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/find_procedure.hpp>
 #include <hadesmem/module.hpp>
 #include <hadesmem/module_list.hpp>
 #include <hadesmem/pelib/dos_header.hpp>
+#include <hadesmem/pelib/export_index.hpp>
 #include <hadesmem/pelib/nt_headers.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
 #include <hadesmem/pelib/section.hpp>
@@ -49,7 +53,8 @@ struct PatternFlags
     kThrowOnUnmatch = 1 << 0,
     kRelativeAddress = 1 << 1,
     kScanData = 1 << 2,
-    kInvalidFlagMaxValue = 1 << 3
+    kParallel = 1 << 3,
+    kInvalidFlagMaxValue = 1 << 4
   };
 };
 
@@ -133,65 +138,247 @@ inline void* Rel(Process const& process,
   }
 }
 
-struct PatternDataByte
+inline bool IsPatternSpace(wchar_t c) HADESMEM_DETAIL_NOEXCEPT
 {
-  std::uint8_t data;
-  bool wildcard;
-};
+  return c == L' ' || c == L'\t' || c == L'\n' || c == L'\r';
+}
 
-inline std::vector<PatternDataByte> ConvertData(std::wstring const& data)
+inline int HexDigitToInt(wchar_t c) HADESMEM_DETAIL_NOEXCEPT
 {
-  HADESMEM_DETAIL_ASSERT(!data.empty());
-
-  std::wstring const data_trimmed{
-    data.substr(0, data.find_last_not_of(L" \n\r\t") + 1)};
+  if (c >= L'0' && c <= L'9')
+  {
+    return c - L'0';
+  }
+  else if (c >= L'a' && c <= L'f')
+  {
+    return c - L'a' + 10;
+  }
+  else if (c >= L'A' && c <= L'F')
+  {
+    return c - L'A' + 10;
+  }
+  else
+  {
+    return -1;
+  }
+}
+}
 
-  HADESMEM_DETAIL_ASSERT(!data_trimmed.empty());
+// A pattern parsed once up front into the packed form used by the search
+// kernels (including its anchors), so that it can be matched any number of
+// times without re-parsing.
+class CompiledPattern
+{
+public:
+  CompiledPattern() HADESMEM_DETAIL_NOEXCEPT : values_(),
+                                               masks_(),
+                                               anchor_first_{0},
+                                               anchor_second_{0}
+  {
+  }
 
-  std::wistringstream data_str{data_trimmed};
-  data_str.imbue(std::locale::classic());
-  std::vector<PatternDataByte> data_real;
-  do
+  explicit CompiledPattern(wchar_t const* data) : CompiledPattern{}
   {
-    std::wstring data_cur_str;
-    if (!(data_str >> data_cur_str))
+    HADESMEM_DETAIL_ASSERT(data != nullptr);
+
+    wchar_t const* cur = data;
+    for (;;)
+    {
+      while (detail::IsPatternSpace(*cur))
+      {
+        ++cur;
+      }
+
+      if (!*cur)
+      {
+        break;
+      }
+
+      wchar_t const* const token_beg = cur;
+      while (*cur && !detail::IsPatternSpace(*cur))
+      {
+        ++cur;
+      }
+
+      AppendToken(token_beg, cur);
+    }
+
+    if (values_.empty())
     {
       HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
                                       << ErrorString{"Data parsing failed."});
     }
 
-    bool const is_wildcard = (data_cur_str == L"??");
-    std::uint32_t current = 0U;
-    if (!is_wildcard)
+    detail::SelectPatternAnchors(masks_.data(),
+                                 values_.data(),
+                                 values_.size(),
+                                 anchor_first_,
+                                 anchor_second_);
+  }
+
+  explicit CompiledPattern(std::wstring const& data)
+    : CompiledPattern{data.c_str()}
+  {
+  }
+
+  std::size_t GetSize() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return values_.size();
+  }
+
+  detail::PackedPattern GetPacked() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return detail::PackedPattern{values_.data(),
+                                 masks_.data(),
+                                 values_.size(),
+                                 anchor_first_,
+                                 anchor_second_};
+  }
+
+private:
+  // Same rules as reading the token with std::hex: an optional 0x prefix,
+  // then as many hex digits as there are, with anything after them ignored
+  // (so "90XY" is 0x90).
+  void AppendToken(wchar_t const* beg, wchar_t const* end)
+  {
+    if (end - beg == 2 && beg[0] == L'?' && beg[1] == L'?')
+    {
+      values_.push_back(0);
+      masks_.push_back(0);
+      return;
+    }
+
+    if (end - beg > 2 && beg[0] == L'0' && (beg[1] == L'x' || beg[1] == L'X'))
     {
-      std::wistringstream conv{data_cur_str};
-      conv.imbue(std::locale::classic());
-      if (!(conv >> std::hex >> current))
-      {
-        HADESMEM_DETAIL_THROW_EXCEPTION(
-          Error{} << ErrorString{"Data conversion failed."});
-      }
+      beg += 2;
+    }
+
+    if (beg == end || detail::HexDigitToInt(*beg) < 0)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Data conversion failed."});
+    }
 
-      if (current > static_cast<std::uint8_t>(-1))
+    std::uint32_t value = 0;
+    for (wchar_t const* cur = beg;
+         cur != end && detail::HexDigitToInt(*cur) >= 0;
+         ++cur)
+    {
+      value = value * 16 + static_cast<std::uint32_t>(
+                             detail::HexDigitToInt(*cur));
+      if (value > static_cast<std::uint8_t>(-1))
       {
         HADESMEM_DETAIL_THROW_EXCEPTION(Error()
                                         << ErrorString("Invalid data."));
       }
     }
 
-    data_real.emplace_back(
-      PatternDataByte{static_cast<std::uint8_t>(current), is_wildcard});
-  } while (!data_str.eof());
+    values_.push_back(static_cast<std::uint8_t>(value));
+    masks_.push_back(0xFF);
+  }
+
+  std::vector<std::uint8_t> values_;
+  std::vector<std::uint8_t> masks_;
+  std::size_t anchor_first_;
+  std::size_t anchor_second_;
+};
+
+namespace detail
+{
+inline std::uint8_t const* FindRawLocal(std::uint8_t const* h_beg,
+                                        std::uint8_t const* h_end,
+                                        CompiledPattern const& pattern)
+{
+  HADESMEM_DETAIL_ASSERT(h_beg <= h_end);
+  HADESMEM_DETAIL_ASSERT(pattern.GetSize() != 0);
+
+  return FindPacked(h_beg, h_end, pattern.GetPacked());
+}
+
+inline std::size_t GetPatternThreadCount(std::uint32_t flags)
+{
+  return !!(flags & PatternFlags::kParallel) ? GetHardwareThreadCount() : 1;
+}
+
+// Buffers smaller than this are always scanned on the calling thread.
+std::size_t const kMinParallelScanChunkSize = 1 << 20;
+
+// Gets the size of the chunks a buffer is split into for a parallel scan
+// (by match starting position), or zero if it should be scanned serially.
+// Each chunk is scanned up to (pattern length - 1) bytes past its end, so
+// matches which straddle a chunk boundary are still found.
+inline std::size_t GetScanChunkSize(std::size_t size, std::size_t num_threads)
+{
+  if (num_threads <= 1 || size <= kMinParallelScanChunkSize)
+  {
+    return 0;
+  }
+
+  // Use a few chunks per thread, so that a thread which gets a quick chunk
+  // can pick up more work rather than sitting idle.
+  return (std::max)(kMinParallelScanChunkSize, size / (num_threads * 4) + 1);
+}
+
+// Same result as the serial version (the first match in the buffer), but
+// with the buffer split into chunks which are scanned on num_threads
+// threads.
+inline std::uint8_t const* FindRawLocal(std::uint8_t const* h_beg,
+                                        std::uint8_t const* h_end,
+                                        CompiledPattern const& pattern,
+                                        std::size_t num_threads)
+{
+  HADESMEM_DETAIL_ASSERT(h_beg <= h_end);
+
+  auto const h_size = static_cast<std::size_t>(h_end - h_beg);
+  std::size_t const chunk_size = GetScanChunkSize(h_size, num_threads);
+  if (!chunk_size)
+  {
+    return FindRawLocal(h_beg, h_end, pattern);
+  }
+
+  std::size_t const overlap = pattern.GetSize() - 1;
+  std::size_t const num_chunks = (h_size + chunk_size - 1) / chunk_size;
+  std::vector<std::uint8_t const*> results(num_chunks);
+  std::atomic<std::size_t> first_match_chunk{num_chunks};
+  ParallelFor(num_chunks,
+              num_threads,
+              [&](std::size_t i)
+              {
+    // A chunk after one which has already matched can't hold the first match.
+    if (i > first_match_chunk.load())
+    {
+      return;
+    }
+
+    auto const c_beg = h_beg + i * chunk_size;
+    auto const c_size =
+      (std::min)(static_cast<std::size_t>(h_end - c_beg), chunk_size + overlap);
+    results[i] = FindRawLocal(c_beg, c_beg + c_size, pattern);
+    if (results[i])
+    {
+      std::size_t cur = first_match_chunk.load();
+      while (i < cur && !first_match_chunk.compare_exchange_weak(cur, i))
+      {
+      }
+    }
+  });
+
+  for (auto const result : results)
+  {
+    if (result)
+    {
+      return result;
+    }
+  }
 
-  return data_real;
+  return nullptr;
 }
 
-template <typename NeedleIterator>
-void* FindRaw(Process const& process,
-              std::uint8_t* s_beg,
-              std::uint8_t* s_end,
-              NeedleIterator n_beg,
-              NeedleIterator n_end)
+inline void* FindRaw(Process const& process,
+                     std::uint8_t* s_beg,
+                     std::uint8_t* s_end,
+                     CompiledPattern const& pattern,
+                     std::size_t num_threads)
 {
   HADESMEM_DETAIL_ASSERT(s_beg < s_end);
 
@@ -199,19 +386,9 @@ void* FindRaw(Process const& process,
   std::vector<std::uint8_t> const haystack{ReadVector<std::uint8_t>(
     process, s_beg, static_cast<std::size_t>(mem_size))};
 
-  auto const h_beg = std::begin(haystack);
-  auto const h_end = std::end(haystack);
-  auto const iter =
-    std::search(h_beg,
-                h_end,
-                n_beg,
-                n_end,
-                [](std::uint8_t h_cur, detail::PatternDataByte const& n_cur)
-                {
-      return n_cur.wildcard || h_cur == n_cur.data;
-    });
-
-  if (iter != h_end)
+  auto const h_beg = haystack.data();
+  auto const h_end = haystack.data() + haystack.size();
+  if (auto const iter = FindRawLocal(h_beg, h_end, pattern, num_threads))
   {
     return s_beg + std::distance(h_beg, iter);
   }
@@ -219,6 +396,366 @@ void* FindRaw(Process const& process,
   return nullptr;
 }
 
+std::size_t const kPatternNoMatch = static_cast<std::size_t>(-1);
+
+// Matches a set of patterns against a buffer in a single pass. Each pattern
+// is indexed by an 'anchor' (a pair of adjacent non-wildcard bytes if it has
+// one, otherwise a single non-wildcard byte), so for every position in the
+// haystack only the patterns which could possibly match there are verified.
+class MultiPatternScanner
+{
+public:
+  explicit MultiPatternScanner(std::vector<PackedPattern> const& patterns)
+    : needle_offsets_(patterns.size() + 1),
+      values_(),
+      masks_(),
+      anchors_(patterns.size()),
+      pair_filter_(0x10000 / 64),
+      pair_offsets_(0x10000 + 1),
+      pair_entries_(),
+      byte_offsets_(0x100 + 1),
+      byte_entries_(),
+      wildcard_entries_()
+  {
+    std::vector<std::uint32_t> pair_counts(0x10000);
+    std::vector<std::uint32_t> byte_counts(0x100);
+    for (std::size_t i = 0; i < patterns.size(); ++i)
+    {
+      auto const& pattern = patterns[i];
+      HADESMEM_DETAIL_ASSERT(pattern.size != 0);
+
+      needle_offsets_[i] = values_.size();
+      values_.insert(
+        std::end(values_), pattern.values, pattern.values + pattern.size);
+      masks_.insert(
+        std::end(masks_), pattern.masks, pattern.masks + pattern.size);
+
+      anchors_[i] = GetAnchor(pattern);
+      Anchor const& anchor = anchors_[i];
+      if (anchor.type == AnchorType::kPair)
+      {
+        ++pair_counts[anchor.key];
+      }
+      else if (anchor.type == AnchorType::kByte)
+      {
+        ++byte_counts[anchor.key];
+      }
+      else
+      {
+        wildcard_entries_.push_back(i);
+      }
+    }
+    needle_offsets_[patterns.size()] = values_.size();
+
+    BuildIndex(pair_counts, pair_offsets_, pair_entries_, AnchorType::kPair);
+    BuildIndex(byte_counts, byte_offsets_, byte_entries_, AnchorType::kByte);
+
+    for (std::size_t key = 0; key < pair_counts.size(); ++key)
+    {
+      if (pair_counts[key])
+      {
+        pair_filter_[key / 64] |= (1ULL << (key % 64));
+      }
+    }
+  }
+
+  std::size_t GetSize() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return anchors_.size();
+  }
+
+  // For each pattern, min_offsets holds the lowest offset into the buffer at
+  // which a match is accepted (or kPatternNoMatch if the pattern should not
+  // be scanned for). On return, results holds the offset of the first match
+  // of each pattern (or kPatternNoMatch).
+  void Scan(std::uint8_t const* h_beg,
+            std::uint8_t const* h_end,
+            std::vector<std::size_t> const& min_offsets,
+            std::vector<std::size_t>& results) const
+  {
+    HADESMEM_DETAIL_ASSERT(h_beg <= h_end);
+    HADESMEM_DETAIL_ASSERT(min_offsets.size() == GetSize());
+
+    results.assign(GetSize(), kPatternNoMatch);
+
+    std::size_t const h_size = static_cast<std::size_t>(h_end - h_beg);
+    std::size_t remaining = static_cast<std::size_t>(
+      std::count_if(std::begin(min_offsets),
+                    std::end(min_offsets),
+                    [](std::size_t min_offset)
+                    {
+        return min_offset != kPatternNoMatch;
+      }));
+
+    for (auto const i : wildcard_entries_)
+    {
+      std::size_t const min_offset = min_offsets[i];
+      if (min_offset != kPatternNoMatch &&
+          min_offset + GetNeedleSize(i) <= h_size)
+      {
+        results[i] = min_offset;
+        --remaining;
+      }
+    }
+
+    for (std::size_t pos = 0; pos < h_size && remaining; ++pos)
+    {
+      std::uint8_t const cur = h_beg[pos];
+      for (std::uint32_t j = byte_offsets_[cur]; j != byte_offsets_[cur + 1];
+           ++j)
+      {
+        TryMatch(h_beg,
+                 h_size,
+                 pos,
+                 byte_entries_[j],
+                 min_offsets,
+                 results,
+                 remaining);
+      }
+
+      if (pos + 1 < h_size)
+      {
+        std::uint32_t const key =
+          cur | (static_cast<std::uint32_t>(h_beg[pos + 1]) << 8);
+        if (pair_filter_[key / 64] & (1ULL << (key % 64)))
+        {
+          for (std::uint32_t j = pair_offsets_[key];
+               j != pair_offsets_[key + 1];
+               ++j)
+          {
+            TryMatch(h_beg,
+                     h_size,
+                     pos,
+                     pair_entries_[j],
+                     min_offsets,
+                     results,
+                     remaining);
+          }
+        }
+      }
+    }
+  }
+
+  // Same results as the serial version, but with the buffer split into
+  // chunks which are scanned on num_threads threads. For each pattern the
+  // match from the lowest chunk wins, so results don't depend on timing.
+  void Scan(std::uint8_t const* h_beg,
+            std::uint8_t const* h_end,
+            std::vector<std::size_t> const& min_offsets,
+            std::vector<std::size_t>& results,
+            std::size_t num_threads) const
+  {
+    HADESMEM_DETAIL_ASSERT(h_beg <= h_end);
+    HADESMEM_DETAIL_ASSERT(min_offsets.size() == GetSize());
+
+    auto const h_size = static_cast<std::size_t>(h_end - h_beg);
+    std::size_t const chunk_size = GetScanChunkSize(h_size, num_threads);
+    if (!chunk_size)
+    {
+      Scan(h_beg, h_end, min_offsets, results);
+      return;
+    }
+
+    std::size_t max_needle_size = 0;
+    for (std::size_t i = 0; i < GetSize(); ++i)
+    {
+      max_needle_size = (std::max)(max_needle_size, GetNeedleSize(i));
+    }
+
+    std::size_t const overlap = max_needle_size - 1;
+    std::size_t const num_chunks = (h_size + chunk_size - 1) / chunk_size;
+    std::vector<std::vector<std::size_t>> chunk_results(num_chunks);
+    ParallelFor(num_chunks,
+                num_threads,
+                [&](std::size_t i)
+                {
+      std::size_t const c_offset = i * chunk_size;
+      std::size_t const c_size =
+        (std::min)(h_size - c_offset, chunk_size + overlap);
+      std::vector<std::size_t> c_min_offsets(GetSize());
+      for (std::size_t j = 0; j < GetSize(); ++j)
+      {
+        c_min_offsets[j] =
+          min_offsets[j] == kPatternNoMatch
+            ? kPatternNoMatch
+            : (std::max)(min_offsets[j], c_offset) - c_offset;
+      }
+
+      auto& c_results = chunk_results[i];
+      Scan(h_beg + c_offset,
+           h_beg + c_offset + c_size,
+           c_min_offsets,
+           c_results);
+      for (auto& c_result : c_results)
+      {
+        if (c_result != kPatternNoMatch)
+        {
+          c_result += c_offset;
+        }
+      }
+    });
+
+    results.assign(GetSize(), kPatternNoMatch);
+    for (auto const& c_results : chunk_results)
+    {
+      for (std::size_t j = 0; j < GetSize(); ++j)
+      {
+        if (results[j] == kPatternNoMatch)
+        {
+          results[j] = c_results[j];
+        }
+      }
+    }
+  }
+
+private:
+  enum class AnchorType
+  {
+    kPair,
+    kByte,
+    kNone
+  };
+
+  struct Anchor
+  {
+    AnchorType type;
+    std::size_t offset;
+    std::uint32_t key;
+  };
+
+  // Prefers the rarest pair of adjacent non-wildcard bytes, falling back to
+  // the rarest single byte, so that as few candidates as possible need to be
+  // verified.
+  static Anchor GetAnchor(PackedPattern const& pattern)
+  {
+    std::uint8_t const* const values = pattern.values;
+    std::uint8_t const* const masks = pattern.masks;
+
+    Anchor anchor{AnchorType::kNone, 0, 0};
+    std::size_t anchor_frequency = 0;
+    for (std::size_t i = 0; i + 1 < pattern.size; ++i)
+    {
+      if (!masks[i] || !masks[i + 1])
+      {
+        continue;
+      }
+
+      std::size_t const frequency =
+        GetByteFrequency(values[i]) + GetByteFrequency(values[i + 1]);
+      if (anchor.type == AnchorType::kNone || frequency < anchor_frequency)
+      {
+        std::uint32_t const key =
+          values[i] | (static_cast<std::uint32_t>(values[i + 1]) << 8);
+        anchor = Anchor{AnchorType::kPair, i, key};
+        anchor_frequency = frequency;
+      }
+    }
+
+    if (anchor.type != AnchorType::kNone)
+    {
+      return anchor;
+    }
+
+    for (std::size_t i = 0; i < pattern.size; ++i)
+    {
+      if (!masks[i])
+      {
+        continue;
+      }
+
+      std::size_t const frequency = GetByteFrequency(values[i]);
+      if (anchor.type == AnchorType::kNone || frequency < anchor_frequency)
+      {
+        anchor = Anchor{AnchorType::kByte, i, values[i]};
+        anchor_frequency = frequency;
+      }
+    }
+
+    return anchor;
+  }
+
+  void BuildIndex(std::vector<std::uint32_t> const& counts,
+                  std::vector<std::uint32_t>& offsets,
+                  std::vector<std::size_t>& entries,
+                  AnchorType type)
+  {
+    std::uint32_t total = 0;
+    for (std::size_t key = 0; key < counts.size(); ++key)
+    {
+      offsets[key] = total;
+      total += counts[key];
+    }
+    offsets[counts.size()] = total;
+
+    // Patterns are inserted in order, so when several patterns share an
+    // anchor they are still verified in the order they were given.
+    entries.resize(total);
+    std::vector<std::uint32_t> next(std::begin(offsets),
+                                    std::end(offsets) - 1);
+    for (std::size_t i = 0; i < anchors_.size(); ++i)
+    {
+      if (anchors_[i].type == type)
+      {
+        entries[next[anchors_[i].key]++] = i;
+      }
+    }
+  }
+
+  std::size_t GetNeedleSize(std::size_t i) const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return needle_offsets_[i + 1] - needle_offsets_[i];
+  }
+
+  void TryMatch(std::uint8_t const* h_beg,
+                std::size_t h_size,
+                std::size_t pos,
+                std::size_t i,
+                std::vector<std::size_t> const& min_offsets,
+                std::vector<std::size_t>& results,
+                std::size_t& remaining) const
+  {
+    std::size_t const min_offset = min_offsets[i];
+    std::size_t const anchor_offset = anchors_[i].offset;
+    if (results[i] != kPatternNoMatch || min_offset == kPatternNoMatch ||
+        pos < anchor_offset)
+    {
+      return;
+    }
+
+    std::size_t const match_offset = pos - anchor_offset;
+    std::size_t const needle_size = GetNeedleSize(i);
+    if (match_offset < min_offset || needle_size > h_size - match_offset)
+    {
+      return;
+    }
+
+    std::uint8_t const* const values = &values_[needle_offsets_[i]];
+    std::uint8_t const* const masks = &masks_[needle_offsets_[i]];
+    std::uint8_t const* const h_cur = h_beg + match_offset;
+    for (std::size_t k = 0; k < needle_size; ++k)
+    {
+      if ((h_cur[k] & masks[k]) != values[k])
+      {
+        return;
+      }
+    }
+
+    results[i] = match_offset;
+    --remaining;
+  }
+
+  std::vector<std::size_t> needle_offsets_;
+  std::vector<std::uint8_t> values_;
+  std::vector<std::uint8_t> masks_;
+  std::vector<Anchor> anchors_;
+  std::vector<std::uint64_t> pair_filter_;
+  std::vector<std::uint32_t> pair_offsets_;
+  std::vector<std::size_t> pair_entries_;
+  std::vector<std::uint32_t> byte_offsets_;
+  std::vector<std::size_t> byte_entries_;
+  std::vector<std::size_t> wildcard_entries_;
+};
+
 struct ModuleRegionInfo
 {
   std::shared_ptr<Module> module;
@@ -227,19 +764,24 @@ struct ModuleRegionInfo
   std::vector<ScanRegion> data_regions;
 };
 
-inline ModuleRegionInfo GetModuleInfo(Process const& process,
-                                      std::wstring const& module)
+inline std::shared_ptr<Module> GetPatternModule(Process const& process,
+                                                std::wstring const& module)
 {
-  ModuleRegionInfo mod_info;
-
   if (module.empty())
   {
-    mod_info.module = std::make_shared<Module>(process, nullptr);
+    return std::make_shared<Module>(process, nullptr);
   }
   else
   {
-    mod_info.module = std::make_shared<Module>(process, module);
+    return std::make_shared<Module>(process, module);
   }
+}
+
+inline ModuleRegionInfo GetModuleInfo(Process const& process,
+                                      std::shared_ptr<Module> const& module)
+{
+  ModuleRegionInfo mod_info;
+  mod_info.module = module;
 
   auto const base =
     reinterpret_cast<std::uint8_t*>(mod_info.module->GetHandle());
@@ -262,130 +804,407 @@ inline ModuleRegionInfo GetModuleInfo(Process const& process,
       RvaToVa(process, pe_file, s.GetVirtualAddress()));
     if (section_beg == nullptr)
     {
-      HADESMEM_DETAIL_THROW_EXCEPTION(
-        Error() << ErrorString("Could not get section base address."));
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error() << ErrorString("Could not get section base address."));
+    }
+
+    DWORD const section_size = s.GetVirtualSize();
+    if (!section_size)
+    {
+      continue;
+    }
+
+    auto const section_end = section_beg + section_size;
+
+    auto& regions =
+      is_code_section ? mod_info.code_regions : mod_info.data_regions;
+    regions.emplace_back(section_beg, section_end);
+  }
+
+  if (mod_info.code_regions.empty() && mod_info.data_regions.empty())
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error() << ErrorString("No valid sections to scan found."));
+  }
+
+  return mod_info;
+}
+
+inline ModuleRegionInfo GetModuleInfo(Process const& process,
+                                      std::wstring const& module)
+{
+  return GetModuleInfo(process, GetPatternModule(process, module));
+}
+
+// Local copy of a module's scan regions, so any number of patterns can be
+// matched against a single read of each section. Regions are read on first
+// use, so scanning only code never pays for reading data (and vice versa).
+class ModuleRegionCache
+{
+public:
+  explicit ModuleRegionCache(Process const& process,
+                             ModuleRegionInfo const& mod_info)
+    : process_{&process},
+      mod_info_{&mod_info},
+      code_buffers_(mod_info.code_regions.size()),
+      data_buffers_(mod_info.data_regions.size())
+  {
+  }
+
+  explicit ModuleRegionCache(Process&& process,
+                             ModuleRegionInfo const& mod_info) = delete;
+
+  explicit ModuleRegionCache(Process const& process,
+                             ModuleRegionInfo&& mod_info) = delete;
+
+  ModuleRegionInfo const& GetModuleInfo() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return *mod_info_;
+  }
+
+  std::vector<ModuleRegionInfo::ScanRegion> const&
+    GetRegions(bool scan_data) const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return scan_data ? mod_info_->data_regions : mod_info_->code_regions;
+  }
+
+  std::vector<std::uint8_t> const& GetBuffer(bool scan_data, std::size_t index)
+  {
+    auto& buffers = scan_data ? data_buffers_ : code_buffers_;
+    HADESMEM_DETAIL_ASSERT(index < buffers.size());
+
+    // Regions are never empty, so an empty buffer means it hasn't been read.
+    auto& buffer = buffers[index];
+    if (buffer.empty())
+    {
+      auto const& region = GetRegions(scan_data)[index];
+      buffer = ReadVector<std::uint8_t>(
+        *process_,
+        region.first,
+        static_cast<std::size_t>(region.second - region.first));
+    }
+
+    return buffer;
+  }
+
+private:
+  Process const* process_;
+  ModuleRegionInfo const* mod_info_;
+  std::vector<std::vector<std::uint8_t>> code_buffers_;
+  std::vector<std::vector<std::uint8_t>> data_buffers_;
+};
+
+// Gets the offset into the region to start scanning from, or kPatternNoMatch
+// if the region should be skipped.
+inline std::size_t GetScanOffset(ModuleRegionInfo::ScanRegion const& region,
+                                 void* start)
+{
+  if (!start)
+  {
+    return 0;
+  }
+
+  // Use specified starting address (plus one, so we don't
+  // just find the same thing again) if we're in the target
+  // region.
+  if (start >= region.first && start < region.second)
+  {
+    auto const s_beg = static_cast<std::uint8_t*>(start) + 1;
+    if (s_beg == region.second)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error()
+                                      << ErrorString("Invalid start address."));
+    }
+
+    return static_cast<std::size_t>(s_beg - region.first);
+  }
+
+  // Skip if we're not in the target region.
+  return kPatternNoMatch;
+}
+
+inline void* GetPatternAddress(std::uint8_t* address,
+                               std::uint8_t* base,
+                               std::uint32_t flags) HADESMEM_DETAIL_NOEXCEPT
+{
+  return !!(flags & PatternFlags::kRelativeAddress)
+           ? reinterpret_cast<void*>(address - base)
+           : address;
+}
+
+inline void HandlePatternUnmatched(std::uint32_t flags,
+                                   std::wstring const* name)
+{
+  if (!!(flags & PatternFlags::kThrowOnUnmatch))
+  {
+    auto const name_narrow = name ? WideCharToMultiByte(*name) : std::string();
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Could not match pattern."}
+                                    << ErrorStringOther{name_narrow});
+  }
+}
+
+inline void* Find(Process const& process,
+                  ModuleRegionInfo::ScanRegion const& region,
+                  void* start,
+                  CompiledPattern const& pattern,
+                  std::size_t num_threads)
+{
+  std::size_t const offset = GetScanOffset(region, start);
+  if (offset == kPatternNoMatch)
+  {
+    return nullptr;
+  }
+
+  return FindRaw(
+    process, region.first + offset, region.second, pattern, num_threads);
+}
+
+inline void* Find(ModuleRegionCache& cache,
+                  CompiledPattern const& pattern,
+                  std::uint32_t flags,
+                  void* start,
+                  std::wstring const* name,
+                  std::size_t num_threads)
+{
+  auto const base = reinterpret_cast<std::uint8_t*>(
+    cache.GetModuleInfo().module->GetHandle());
+  bool const scan_data_secs = !!(flags & PatternFlags::kScanData);
+  auto const& scan_regions = cache.GetRegions(scan_data_secs);
+  for (std::size_t i = 0; i < scan_regions.size(); ++i)
+  {
+    auto const& region = scan_regions[i];
+    std::size_t const offset = GetScanOffset(region, start);
+    if (offset == kPatternNoMatch)
+    {
+      continue;
+    }
+
+    auto const& buffer = cache.GetBuffer(scan_data_secs, i);
+    auto const h_beg = buffer.data();
+    auto const h_end = buffer.data() + buffer.size();
+    if (auto const iter =
+          FindRawLocal(h_beg + offset, h_end, pattern, num_threads))
+    {
+      return GetPatternAddress(
+        region.first + std::distance(h_beg, iter), base, flags);
+    }
+  }
+
+  HandlePatternUnmatched(flags, name);
+
+  return nullptr;
+}
+
+inline void* Find(Process const& process,
+                  ModuleRegionInfo const& mod_info,
+                  CompiledPattern const& pattern,
+                  std::uint32_t flags,
+                  void* start,
+                  std::wstring const* name)
+{
+  ModuleRegionCache cache{process, mod_info};
+  return Find(
+    cache, pattern, flags, start, name, GetPatternThreadCount(flags));
+}
+
+// Walks every match of a pattern in a module's scan regions in address
+// order, reading each region at most once. Matches may overlap. Only
+// [filter_beg, filter_end) is scanned (a null bound is unbounded), and the
+// walk stops after max_matches matches if it is non-zero.
+class PatternMatchCursor
+{
+public:
+  explicit PatternMatchCursor(ModuleRegionCache& cache,
+                              CompiledPattern const& pattern,
+                              std::uint32_t flags,
+                              std::uint8_t* filter_beg,
+                              std::uint8_t* filter_end,
+                              std::size_t max_matches)
+    : cache_{&cache},
+      pattern_(pattern),
+      flags_{flags},
+      filter_beg_{filter_beg},
+      filter_end_{filter_end},
+      max_matches_{max_matches},
+      num_matches_{0},
+      region_index_{0},
+      offset_{kPatternNoMatch}
+  {
+    HADESMEM_DETAIL_ASSERT(pattern.GetSize() != 0);
+  }
+
+  // Gets the next match, or returns false once there are no more.
+  bool Next(void*& address)
+  {
+    bool const scan_data_secs = !!(flags_ & PatternFlags::kScanData);
+    auto const& scan_regions = cache_->GetRegions(scan_data_secs);
+    while (region_index_ < scan_regions.size() &&
+           (!max_matches_ || num_matches_ < max_matches_))
+    {
+      auto const& region = scan_regions[region_index_];
+      std::uint8_t* const s_beg =
+        filter_beg_ ? (std::max)(region.first, filter_beg_) : region.first;
+      std::uint8_t* const s_end =
+        filter_end_ ? (std::min)(region.second, filter_end_) : region.second;
+      if (s_beg >= s_end)
+      {
+        ++region_index_;
+        continue;
+      }
+
+      if (offset_ == kPatternNoMatch)
+      {
+        offset_ = static_cast<std::size_t>(s_beg - region.first);
+      }
+
+      auto const& buffer = cache_->GetBuffer(scan_data_secs, region_index_);
+      auto const h_beg = buffer.data();
+      auto const h_end = buffer.data() + (s_end - region.first);
+      if (auto const iter = FindRawLocal(h_beg + offset_, h_end, pattern_))
+      {
+        auto const match_offset = static_cast<std::size_t>(iter - h_beg);
+        offset_ = match_offset + 1;
+        ++num_matches_;
+        auto const base = reinterpret_cast<std::uint8_t*>(
+          cache_->GetModuleInfo().module->GetHandle());
+        address = GetPatternAddress(region.first + match_offset, base, flags_);
+        return true;
+      }
+
+      ++region_index_;
+      offset_ = kPatternNoMatch;
     }
 
-    DWORD const section_size = s.GetVirtualSize();
-    if (!section_size)
+    if (!num_matches_)
     {
-      continue;
+      HandlePatternUnmatched(flags_, nullptr);
     }
 
-    auto const section_end = section_beg + section_size;
-
-    auto& regions =
-      is_code_section ? mod_info.code_regions : mod_info.data_regions;
-    regions.emplace_back(section_beg, section_end);
+    return false;
   }
 
-  if (mod_info.code_regions.empty() && mod_info.data_regions.empty())
+  std::size_t GetNumMatches() const HADESMEM_DETAIL_NOEXCEPT
   {
-    HADESMEM_DETAIL_THROW_EXCEPTION(
-      Error() << ErrorString("No valid sections to scan found."));
+    return num_matches_;
   }
 
-  return mod_info;
+private:
+  ModuleRegionCache* cache_;
+  CompiledPattern pattern_;
+  std::uint32_t flags_;
+  std::uint8_t* filter_beg_;
+  std::uint8_t* filter_end_;
+  std::size_t max_matches_;
+  std::size_t num_matches_;
+  std::size_t region_index_;
+  std::size_t offset_;
+};
+
+inline std::uint8_t* GetFilterAddress(ModuleRegionInfo const& mod_info,
+                                      std::uintptr_t rva)
+{
+  return rva ? reinterpret_cast<std::uint8_t*>(mod_info.module->GetHandle()) +
+                 rva
+             : nullptr;
 }
 
-template <typename NeedleIterator>
-void* Find(Process const& process,
-           ModuleRegionInfo::ScanRegion const& region,
-           void* start,
-           NeedleIterator n_beg,
-           NeedleIterator n_end)
+struct PatternRequest
 {
-  std::uint8_t* s_beg = region.first;
-  std::uint8_t* const s_end = region.second;
+  CompiledPattern pattern;
+  std::uint32_t flags;
+  void* start;
+};
 
-  // Support custom scan start address.
-  if (start)
-  {
-    // Use specified starting address (plus one, so we don't
-    // just find the same thing again) if we're in the target
-    // region.
-    if (start >= s_beg && start < s_end)
+// Finds the first match of every request, reading each region at most once
+// and scanning it in a single pass for all of the requests which target it.
+// The result for each request is the same as calling Find on it (except that
+// unmatched requests are always returned as nullptr, and handling
+// kThrowOnUnmatch is left to the caller).
+inline std::vector<void*> FindMany(ModuleRegionCache& cache,
+                                   std::vector<PatternRequest> const& requests,
+                                   std::size_t num_threads)
+{
+  auto const base = reinterpret_cast<std::uint8_t*>(
+    cache.GetModuleInfo().module->GetHandle());
+  std::vector<void*> results(requests.size());
+  for (bool const scan_data_secs : {false, true})
+  {
+    std::vector<std::size_t> indexes;
+    std::vector<PackedPattern> patterns;
+    for (std::size_t i = 0; i < requests.size(); ++i)
     {
-      s_beg = static_cast<std::uint8_t*>(start) + 1;
-      if (s_beg == s_end)
+      if (!!(requests[i].flags & PatternFlags::kScanData) == scan_data_secs)
       {
-        HADESMEM_DETAIL_THROW_EXCEPTION(
-          Error() << ErrorString("Invalid start address."));
+        HADESMEM_DETAIL_ASSERT(requests[i].pattern.GetSize() != 0);
+        indexes.push_back(i);
+        patterns.push_back(requests[i].pattern.GetPacked());
       }
     }
-    // Skip if we're not in the target region.
-    else
+
+    if (indexes.empty())
     {
-      return nullptr;
+      continue;
     }
-  }
 
-  return FindRaw(process, s_beg, s_end, n_beg, n_end);
-}
+    MultiPatternScanner const scanner{patterns};
+    std::vector<bool> done(indexes.size());
+    std::vector<std::size_t> min_offsets(indexes.size());
+    std::vector<std::size_t> offsets;
+    auto const& scan_regions = cache.GetRegions(scan_data_secs);
+    for (std::size_t i = 0; i < scan_regions.size(); ++i)
+    {
+      auto const& region = scan_regions[i];
+      bool scan_region = false;
+      for (std::size_t j = 0; j < indexes.size(); ++j)
+      {
+        min_offsets[j] = done[j]
+                           ? kPatternNoMatch
+                           : GetScanOffset(region, requests[indexes[j]].start);
+        scan_region = scan_region || min_offsets[j] != kPatternNoMatch;
+      }
 
-template <typename NeedleIterator>
-void* Find(Process const& process,
-           ModuleRegionInfo const& mod_info,
-           NeedleIterator n_beg,
-           NeedleIterator n_end,
-           std::uint32_t flags,
-           void* start,
-           std::wstring const* name)
-{
-  HADESMEM_DETAIL_ASSERT(n_beg != n_end);
+      if (!scan_region)
+      {
+        continue;
+      }
 
-  bool const scan_data_secs = !!(flags & PatternFlags::kScanData);
-  auto const& scan_regions =
-    scan_data_secs ? mod_info.data_regions : mod_info.code_regions;
-  for (auto const& region : scan_regions)
-  {
-    if (void* const address = Find(process, region, start, n_beg, n_end))
-    {
-      return !!(flags & PatternFlags::kRelativeAddress)
-               ? static_cast<std::uint8_t*>(address) -
-                   reinterpret_cast<std::uintptr_t>(
-                     mod_info.module->GetHandle())
-               : address;
+      auto const& buffer = cache.GetBuffer(scan_data_secs, i);
+      scanner.Scan(buffer.data(),
+                   buffer.data() + buffer.size(),
+                   min_offsets,
+                   offsets,
+                   num_threads);
+      for (std::size_t j = 0; j < indexes.size(); ++j)
+      {
+        if (offsets[j] != kPatternNoMatch)
+        {
+          done[j] = true;
+          results[indexes[j]] = GetPatternAddress(
+            region.first + offsets[j], base, requests[indexes[j]].flags);
+        }
+      }
     }
   }
 
-  if (!!(flags & PatternFlags::kThrowOnUnmatch))
-  {
-    auto const name_narrow = name ? WideCharToMultiByte(*name) : std::string();
-    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                    << ErrorString{"Could not match pattern."}
-                                    << ErrorStringOther{name_narrow});
-  }
-
-  return nullptr;
+  return results;
 }
 
-template <typename NeedleIterator>
-void* Find(Process const& process,
-           std::pair<std::uint8_t*, std::uint8_t*> const& region,
-           NeedleIterator n_beg,
-           NeedleIterator n_end,
-           std::uint32_t flags,
-           void* start,
-           std::wstring const* name)
+inline void* Find(Process const& process,
+                  std::pair<std::uint8_t*, std::uint8_t*> const& region,
+                  CompiledPattern const& pattern,
+                  std::uint32_t flags,
+                  void* start,
+                  std::wstring const* name)
 {
-  HADESMEM_DETAIL_ASSERT(n_beg != n_end);
-
-  if (void* const address = Find(process, region, start, n_beg, n_end))
+  if (void* const address = Find(
+        process, region, start, pattern, GetPatternThreadCount(flags)))
   {
-    return !!(flags & PatternFlags::kRelativeAddress)
-             ? static_cast<std::uint8_t*>(address) -
-                 reinterpret_cast<std::uintptr_t>(region.first)
-             : address;
+    return GetPatternAddress(
+      static_cast<std::uint8_t*>(address), region.first, flags);
   }
 
-  if (!!(flags & PatternFlags::kThrowOnUnmatch))
-  {
-    auto const name_narrow = name ? WideCharToMultiByte(*name) : std::string();
-    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                    << ErrorString{"Could not match pattern."}
-                                    << ErrorStringOther{name_narrow});
-  }
+  HandlePatternUnmatched(flags, name);
 
   return nullptr;
 }
@@ -393,7 +1212,7 @@ void* Find(Process const& process,
 
 inline void* Find(Process const& process,
                   std::wstring const& module,
-                  std::wstring const& data,
+                  CompiledPattern const& pattern,
                   std::uint32_t flags,
                   std::uintptr_t start,
                   std::wstring const* name = nullptr)
@@ -402,24 +1221,27 @@ inline void* Find(Process const& process,
     !(flags & ~(PatternFlags::kInvalidFlagMaxValue - 1UL)));
 
   auto const mod_info = detail::GetModuleInfo(process, module);
-  auto const needle = detail::ConvertData(data);
   void* const start_abs =
     start
       ? reinterpret_cast<std::uint8_t*>(mod_info.module->GetHandle()) + start
       : nullptr;
-  return detail::Find(process,
-                      mod_info,
-                      std::begin(needle),
-                      std::end(needle),
-                      flags,
-                      start_abs,
-                      name);
+  return detail::Find(process, mod_info, pattern, flags, start_abs, name);
+}
+
+inline void* Find(Process const& process,
+                  std::wstring const& module,
+                  std::wstring const& data,
+                  std::uint32_t flags,
+                  std::uintptr_t start,
+                  std::wstring const* name = nullptr)
+{
+  return Find(process, module, CompiledPattern{data}, flags, start, name);
 }
 
 inline void* Find(Process const& process,
                   void* base,
                   std::size_t size,
-                  std::wstring const& data,
+                  CompiledPattern const& pattern,
                   std::uint32_t flags,
                   std::uintptr_t start,
                   std::wstring const* name = nullptr)
@@ -429,15 +1251,269 @@ inline void* Find(Process const& process,
 
   auto const region = std::make_pair(static_cast<std::uint8_t*>(base),
                                      static_cast<std::uint8_t*>(base) + size);
-  auto const needle = detail::ConvertData(data);
   void* const start_abs = start ? region.first + start : nullptr;
-  return detail::Find(process,
-                      region,
-                      std::begin(needle),
-                      std::end(needle),
-                      flags,
-                      start_abs,
-                      name);
+  return detail::Find(process, region, pattern, flags, start_abs, name);
+}
+
+inline void* Find(Process const& process,
+                  void* base,
+                  std::size_t size,
+                  std::wstring const& data,
+                  std::uint32_t flags,
+                  std::uintptr_t start,
+                  std::wstring const* name = nullptr)
+{
+  return Find(
+    process, base, size, CompiledPattern{data}, flags, start, name);
+}
+
+// PatternMatchIterator satisfies the requirements of an input iterator
+// (C++ Standard, 24.2.1, Input Iterators [input.iterators]).
+class PatternMatchIterator
+  : public std::iterator<std::input_iterator_tag, void* const>
+{
+public:
+  using BaseIteratorT = std::iterator<std::input_iterator_tag, void* const>;
+  using value_type = BaseIteratorT::value_type;
+  using difference_type = BaseIteratorT::difference_type;
+  using pointer = BaseIteratorT::pointer;
+  using reference = BaseIteratorT::reference;
+  using iterator_category = BaseIteratorT::iterator_category;
+
+  HADESMEM_DETAIL_CONSTEXPR PatternMatchIterator() HADESMEM_DETAIL_NOEXCEPT
+  {
+  }
+
+  explicit PatternMatchIterator(Process const& process,
+                                std::wstring const& module,
+                                CompiledPattern const& pattern,
+                                std::uint32_t flags,
+                                std::size_t max_matches,
+                                std::uintptr_t start,
+                                std::uintptr_t end)
+    : impl_{std::make_shared<Impl>(
+        process, module, pattern, flags, max_matches, start, end)}
+  {
+    HADESMEM_DETAIL_ASSERT(impl_.get());
+
+    if (!impl_->cursor_.Next(impl_->address_))
+    {
+      impl_.reset();
+    }
+  }
+
+  explicit PatternMatchIterator(Process&& process,
+                                std::wstring const& module,
+                                CompiledPattern const& pattern,
+                                std::uint32_t flags,
+                                std::size_t max_matches,
+                                std::uintptr_t start,
+                                std::uintptr_t end) = delete;
+
+#if defined(HADESMEM_DETAIL_NO_RVALUE_REFERENCES_V3)
+
+  PatternMatchIterator(PatternMatchIterator const&) = default;
+
+  PatternMatchIterator& operator=(PatternMatchIterator const&) = default;
+
+  PatternMatchIterator(PatternMatchIterator&& other) HADESMEM_DETAIL_NOEXCEPT
+    : impl_{std::move(other.impl_)}
+  {
+  }
+
+  PatternMatchIterator& operator=(PatternMatchIterator&& other)
+    HADESMEM_DETAIL_NOEXCEPT
+  {
+    impl_ = std::move(other.impl_);
+
+    return *this;
+  }
+
+#endif // #if defined(HADESMEM_DETAIL_NO_RVALUE_REFERENCES_V3)
+
+  reference operator*() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    HADESMEM_DETAIL_ASSERT(impl_.get());
+    return impl_->address_;
+  }
+
+  pointer operator->() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    HADESMEM_DETAIL_ASSERT(impl_.get());
+    return &impl_->address_;
+  }
+
+  PatternMatchIterator& operator++()
+  {
+    HADESMEM_DETAIL_ASSERT(impl_.get());
+
+    if (!impl_->cursor_.Next(impl_->address_))
+    {
+      impl_.reset();
+    }
+
+    return *this;
+  }
+
+  PatternMatchIterator operator++(int)
+  {
+    PatternMatchIterator const iter{*this};
+    ++*this;
+    return iter;
+  }
+
+  bool operator==(PatternMatchIterator const& other) const
+    HADESMEM_DETAIL_NOEXCEPT
+  {
+    return impl_ == other.impl_;
+  }
+
+  bool operator!=(PatternMatchIterator const& other) const
+    HADESMEM_DETAIL_NOEXCEPT
+  {
+    return impl_ != other.impl_;
+  }
+
+private:
+  struct Impl
+  {
+    explicit Impl(Process const& process,
+                  std::wstring const& module,
+                  CompiledPattern const& pattern,
+                  std::uint32_t flags,
+                  std::size_t max_matches,
+                  std::uintptr_t start,
+                  std::uintptr_t end)
+      : mod_info_(detail::GetModuleInfo(process, module)),
+        cache_{process, mod_info_},
+        cursor_{cache_,
+                pattern,
+                flags,
+                detail::GetFilterAddress(mod_info_, start),
+                detail::GetFilterAddress(mod_info_, end),
+                max_matches},
+        address_{nullptr}
+    {
+    }
+
+    detail::ModuleRegionInfo mod_info_;
+    detail::ModuleRegionCache cache_;
+    detail::PatternMatchCursor cursor_;
+    void* address_;
+  };
+
+  // Shallow copy semantics, as required by InputIterator.
+  std::shared_ptr<Impl> impl_;
+};
+
+// Every match of a pattern in a module, streamed from a single read of each
+// section. Optionally limited to the first max_matches matches and to the
+// RVA range [start, end) (where an end of zero is the end of the module).
+class PatternMatchList
+{
+public:
+  using value_type = void*;
+  using iterator = PatternMatchIterator;
+  using const_iterator = PatternMatchIterator;
+
+  explicit PatternMatchList(Process const& process,
+                            std::wstring const& module,
+                            CompiledPattern const& pattern,
+                            std::uint32_t flags,
+                            std::size_t max_matches = 0,
+                            std::uintptr_t start = 0,
+                            std::uintptr_t end = 0)
+    : process_{&process},
+      module_(module),
+      pattern_(pattern),
+      flags_{flags},
+      max_matches_{max_matches},
+      start_{start},
+      end_{end}
+  {
+    HADESMEM_DETAIL_ASSERT(
+      !(flags & ~(PatternFlags::kInvalidFlagMaxValue - 1UL)));
+  }
+
+  explicit PatternMatchList(Process&& process,
+                            std::wstring const& module,
+                            CompiledPattern const& pattern,
+                            std::uint32_t flags,
+                            std::size_t max_matches = 0,
+                            std::uintptr_t start = 0,
+                            std::uintptr_t end = 0) = delete;
+
+  iterator begin() const
+  {
+    return iterator(
+      *process_, module_, pattern_, flags_, max_matches_, start_, end_);
+  }
+
+  const_iterator cbegin() const
+  {
+    return begin();
+  }
+
+  iterator end() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return iterator();
+  }
+
+  const_iterator cend() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return iterator();
+  }
+
+private:
+  Process const* process_;
+  std::wstring module_;
+  CompiledPattern pattern_;
+  std::uint32_t flags_;
+  std::size_t max_matches_;
+  std::uintptr_t start_;
+  std::uintptr_t end_;
+};
+
+// Calls callback with every match of a pattern in a module (see
+// PatternMatchList for the limits) and returns the number of matches.
+template <typename Callback>
+std::size_t FindAll(Process const& process,
+                    std::wstring const& module,
+                    CompiledPattern const& pattern,
+                    std::uint32_t flags,
+                    std::size_t max_matches,
+                    std::uintptr_t start,
+                    std::uintptr_t end,
+                    Callback callback)
+{
+  HADESMEM_DETAIL_ASSERT(
+    !(flags & ~(PatternFlags::kInvalidFlagMaxValue - 1UL)));
+
+  auto const mod_info = detail::GetModuleInfo(process, module);
+  detail::ModuleRegionCache cache{process, mod_info};
+  detail::PatternMatchCursor cursor{cache,
+                                    pattern,
+                                    flags,
+                                    detail::GetFilterAddress(mod_info, start),
+                                    detail::GetFilterAddress(mod_info, end),
+                                    max_matches};
+  void* address = nullptr;
+  while (cursor.Next(address))
+  {
+    callback(address);
+  }
+
+  return cursor.GetNumMatches();
+}
+
+template <typename Callback>
+std::size_t FindAll(Process const& process,
+                    std::wstring const& module,
+                    CompiledPattern const& pattern,
+                    std::uint32_t flags,
+                    Callback callback)
+{
+  return FindAll(process, module, pattern, flags, 0, 0, 0, callback);
 }
 
 class Pattern
@@ -659,24 +1735,33 @@ private:
 class FindPattern
 {
 public:
+  // Every module is scanned on num_threads threads (or all of them if the
+  // Parallel flag is set). If a cache path is given, results are saved to it
+  // and reused on later runs for any module whose build (and patterns)
+  // haven't changed since.
   explicit FindPattern(Process const& process,
                        std::wstring const& pattern_file,
-                       bool in_memory_file)
-    : process_{&process}, find_pattern_datas_{}
+                       bool in_memory_file,
+                       std::size_t num_threads = 1,
+                       std::wstring const& cache_path = std::wstring())
+    : process_{&process}, num_threads_{num_threads}, find_pattern_datas_{}
   {
     if (in_memory_file)
     {
-      LoadPatternFileMemory(pattern_file);
+      LoadPatternFileMemory(pattern_file, cache_path);
     }
     else
     {
-      LoadPatternFile(pattern_file);
+      LoadPatternFile(pattern_file, cache_path);
     }
   }
 
   explicit FindPattern(Process&& process,
                        std::wstring const& pattern,
-                       bool in_memory_file) = delete;
+                       bool in_memory_file,
+                       std::size_t num_threads = 1,
+                       std::wstring const& cache_path = std::wstring()) =
+    delete;
 
 #if defined(HADESMEM_DETAIL_NO_RVALUE_REFERENCES_V3)
 
@@ -686,6 +1771,7 @@ public:
 
   FindPattern(FindPattern&& other)
     : process_{other.process_},
+      num_threads_{other.num_threads_},
       find_pattern_datas_{std::move(other.find_pattern_datas_)}
   {
     other.process_ = nullptr;
@@ -696,6 +1782,8 @@ public:
     process_ = other.process_;
     other.process_ = nullptr;
 
+    num_threads_ = other.num_threads_;
+
     find_pattern_datas_ = std::move(other.find_pattern_datas_);
 
     return *this;
@@ -738,7 +1826,8 @@ public:
   }
 
 private:
-  void LoadPatternFile(std::wstring const& path)
+  void LoadPatternFile(std::wstring const& path,
+                       std::wstring const& cache_path)
   {
     pugi::xml_document doc;
     auto const load_result = doc.load_file(path.c_str());
@@ -750,10 +1839,11 @@ private:
                 << ErrorStringOther{load_result.description()});
     }
 
-    LoadPatternFileImpl(doc);
+    LoadPatternFileImpl(doc, cache_path);
   }
 
-  void LoadPatternFileMemory(std::wstring const& data)
+  void LoadPatternFileMemory(std::wstring const& data,
+                             std::wstring const& cache_path)
   {
     pugi::xml_document doc;
     auto const load_result = doc.load(data.c_str());
@@ -765,7 +1855,7 @@ private:
                 << ErrorStringOther{load_result.description()});
     }
 
-    LoadPatternFileImpl(doc);
+    LoadPatternFileImpl(doc, cache_path);
   }
 
   Pattern LookupEx(std::wstring const& module, std::wstring const& name) const
@@ -845,6 +1935,10 @@ private:
       {
         flags |= PatternFlags::kScanData;
       }
+      else if (flag_name == L"Parallel")
+      {
+        flags |= PatternFlags::kParallel;
+      }
       else
       {
         HADESMEM_DETAIL_THROW_EXCEPTION(
@@ -1060,6 +2154,7 @@ private:
   }
 
   std::uintptr_t GetStartRvaFromExport(Module const& module,
+                                       ExportIndex const& export_index,
                                        std::wstring const& start) const
   {
     std::uintptr_t start_rva = 0U;
@@ -1069,12 +2164,12 @@ private:
       {
         auto const ordinal_str = start.substr(1);
         start_rva = reinterpret_cast<std::uintptr_t>(FindProcedure(
-          *process_, module, detail::StrToNum<WORD>(ordinal_str)));
+          *process_, export_index, detail::StrToNum<WORD>(ordinal_str)));
       }
       else
       {
-        start_rva = reinterpret_cast<std::uintptr_t>(
-          FindProcedure(*process_, module, detail::WideCharToMultiByte(start)));
+        start_rva = reinterpret_cast<std::uintptr_t>(FindProcedure(
+          *process_, export_index, detail::WideCharToMultiByte(start)));
       }
 
       start_rva -= reinterpret_cast<std::uintptr_t>(module.GetHandle());
@@ -1083,8 +2178,91 @@ private:
     return start_rva;
   }
 
-  void LoadPatternFileImpl(pugi::xml_document const& doc)
+  static std::uint64_t
+    GetPatternDefinitionsHash(FindPatternInfo const& patterns_info_full)
+  {
+    std::uint64_t hash = detail::kFnvOffsetBasis;
+    hash = detail::HashPod(hash, patterns_info_full.flags);
+    for (auto const& p : patterns_info_full.patterns)
+    {
+      hash = detail::HashString(hash, p.pattern.name);
+      hash = detail::HashString(hash, p.pattern.data);
+      hash = detail::HashString(hash, p.pattern.start);
+      hash = detail::HashString(hash, p.pattern.start_rva);
+      hash = detail::HashString(hash, p.pattern.start_export);
+      hash = detail::HashPod(hash, p.pattern.flags);
+      hash = detail::HashPod(hash, p.manipulators.size());
+      for (auto const& m : p.manipulators)
+      {
+        hash = detail::HashPod(hash, m.type);
+        hash = detail::HashPod(hash, m.has_operand1);
+        hash = detail::HashPod(hash, m.operand1);
+        hash = detail::HashPod(hash, m.has_operand2);
+        hash = detail::HashPod(hash, m.operand2);
+      }
+    }
+
+    return hash;
+  }
+
+  static detail::PatternCacheModule
+    GetPatternCacheKey(NtHeaders const& nt_headers,
+                       FindPatternInfo const& patterns_info_full)
+  {
+    detail::PatternCacheModule cache_module;
+    cache_module.time_date_stamp = nt_headers.GetTimeDateStamp();
+    cache_module.check_sum = nt_headers.GetCheckSum();
+    cache_module.size_of_image = nt_headers.GetSizeOfImage();
+    cache_module.definitions_hash =
+      GetPatternDefinitionsHash(patterns_info_full);
+    return cache_module;
+  }
+
+  bool LoadCachedPatterns(std::wstring const& module,
+                          std::uintptr_t base,
+                          detail::PatternCacheModule const& key,
+                          detail::PatternCache const& cache)
+  {
+    auto const iter = cache.find(module);
+    if (iter == std::end(cache))
+    {
+      return false;
+    }
+
+    auto const& cache_module = iter->second;
+    if (cache_module.time_date_stamp != key.time_date_stamp ||
+        cache_module.check_sum != key.check_sum ||
+        cache_module.size_of_image != key.size_of_image ||
+        cache_module.definitions_hash != key.definitions_hash)
+    {
+      return false;
+    }
+
+    auto& pattern_map = find_pattern_datas_[module];
+    for (auto const& entry : cache_module.entries)
+    {
+      void* address = nullptr;
+      if (entry.matched)
+      {
+        auto const offset = static_cast<std::uintptr_t>(entry.offset);
+        address = reinterpret_cast<void*>(
+          !!(entry.flags & PatternFlags::kRelativeAddress) ? offset
+                                                           : base + offset);
+      }
+
+      pattern_map[entry.name] = Pattern{address, entry.flags};
+    }
+
+    return true;
+  }
+
+  void LoadPatternFileImpl(pugi::xml_document const& doc,
+                           std::wstring const& cache_path)
   {
+    auto cache = cache_path.empty() ? detail::PatternCache{}
+                                    : detail::ReadPatternCache(cache_path);
+    bool cache_dirty = false;
+
     auto const patterns_info_full_list = ReadPatternsFromXml(doc);
     for (auto const& patterns_info_full_pair : patterns_info_full_list)
     {
@@ -1092,36 +2270,110 @@ private:
         find_pattern_datas_.find(patterns_info_full_pair.first) ==
         std::end(find_pattern_datas_));
 
-      auto const mod_info =
-        detail::GetModuleInfo(*process_, patterns_info_full_pair.first);
+      auto const module_ptr =
+        detail::GetPatternModule(*process_, patterns_info_full_pair.first);
       auto const base =
-        reinterpret_cast<std::uintptr_t>(mod_info.module->GetHandle());
+        reinterpret_cast<std::uintptr_t>(module_ptr->GetHandle());
       auto const& module = patterns_info_full_pair.first;
       auto const& patterns_info_full = patterns_info_full_pair.second;
       auto const& pattern_infos = patterns_info_full.patterns;
-      for (auto const& p : pattern_infos)
+
+      detail::PatternCacheModule cache_module{};
+      if (!cache_path.empty())
+      {
+        PeFile const pe_file{*process_,
+                             reinterpret_cast<void*>(base),
+                             hadesmem::PeFileType::Image,
+                             0};
+        NtHeaders const nt_headers{*process_, pe_file};
+        cache_module = GetPatternCacheKey(nt_headers, patterns_info_full);
+        if (LoadCachedPatterns(module, base, cache_module, cache))
+        {
+          continue;
+        }
+      }
+
+      auto const mod_info = detail::GetModuleInfo(*process_, module_ptr);
+
+      // Every pattern which doesn't depend on the result of another pattern
+      // is matched up front, in a single pass over each section. Patterns
+      // using 'Start' are resolved afterwards in file order (against the same
+      // copy of each section), so they can only refer to earlier patterns.
+      detail::ModuleRegionCache region_cache{*process_, mod_info};
+      PeFile const pe_file{*process_,
+                           reinterpret_cast<void*>(base),
+                           hadesmem::PeFileType::Image,
+                           0};
+      // Only built if a pattern needs it, then shared by all of them.
+      std::unique_ptr<ExportIndex const> export_index;
+      std::vector<detail::PatternRequest> requests;
+      std::vector<std::size_t> request_indexes(pattern_infos.size(),
+                                               detail::kPatternNoMatch);
+      for (std::size_t i = 0; i < pattern_infos.size(); ++i)
       {
+        auto const& p = pattern_infos[i];
         std::uint32_t const flags = patterns_info_full.flags | p.pattern.flags;
-        void* address = nullptr;
-        std::uintptr_t const start_rva = [&]() -> std::uintptr_t
+        std::uintptr_t start_rva = 0U;
+        if (!p.pattern.start_rva.empty())
         {
-          if (!p.pattern.start_rva.empty())
-          {
-            return detail::HexStrToPtr(p.pattern.start_rva);
-          }
-          else if (!p.pattern.start_export.empty())
+          start_rva = detail::HexStrToPtr(p.pattern.start_rva);
+        }
+        else if (!p.pattern.start_export.empty())
+        {
+          if (!export_index)
           {
-            return GetStartRvaFromExport(*mod_info.module,
-                                         p.pattern.start_export);
+            export_index = std::make_unique<ExportIndex const>(*process_,
+                                                               pe_file);
           }
-          else
+          start_rva = GetStartRvaFromExport(
+            *mod_info.module, *export_index, p.pattern.start_export);
+        }
+        else if (!p.pattern.start.empty())
+        {
+          continue;
+        }
+
+        void* const start_abs =
+          start_rva ? reinterpret_cast<std::uint8_t*>(base) + start_rva
+                    : nullptr;
+        request_indexes[i] = requests.size();
+        requests.emplace_back(detail::PatternRequest{
+          CompiledPattern{p.pattern.data}, flags, start_abs});
+      }
+
+      std::size_t const num_threads = (std::max)(
+        num_threads_, detail::GetPatternThreadCount(patterns_info_full.flags));
+      auto const request_results =
+        detail::FindMany(region_cache, requests, num_threads);
+
+      for (std::size_t i = 0; i < pattern_infos.size(); ++i)
+      {
+        auto const& p = pattern_infos[i];
+        std::uint32_t const flags = patterns_info_full.flags | p.pattern.flags;
+        void* address = nullptr;
+        if (request_indexes[i] != detail::kPatternNoMatch)
+        {
+          address = request_results[request_indexes[i]];
+          if (!address)
           {
-            return GetStartRvaFromPattern(module, base, p.pattern.start);
+            detail::HandlePatternUnmatched(flags, &p.pattern.name);
           }
-        }();
-
-        address = ::hadesmem::Find(
-          *process_, module, p.pattern.data, flags, start_rva, &p.pattern.name);
+        }
+        else
+        {
+          std::uintptr_t const start_rva =
+            GetStartRvaFromPattern(module, base, p.pattern.start);
+          void* const start_abs =
+            start_rva ? reinterpret_cast<std::uint8_t*>(base) + start_rva
+                      : nullptr;
+          address = detail::Find(
+            region_cache,
+            CompiledPattern{p.pattern.data},
+            flags,
+            start_abs,
+            &p.pattern.name,
+            (std::max)(num_threads, detail::GetPatternThreadCount(flags)));
+        }
 
         if (address)
         {
@@ -1130,11 +2382,44 @@ private:
 
         find_pattern_datas_[patterns_info_full_pair.first][p.pattern.name] =
           Pattern{address, flags};
+
+        if (!cache_path.empty())
+        {
+          auto const address_raw = reinterpret_cast<std::uintptr_t>(address);
+          cache_module.entries.emplace_back(detail::PatternCacheEntry{
+            p.pattern.name,
+            flags,
+            address != nullptr,
+            !!(flags & PatternFlags::kRelativeAddress) ? address_raw
+                                                       : address_raw - base});
+        }
+      }
+
+      if (!cache_path.empty())
+      {
+        cache[module] = std::move(cache_module);
+        cache_dirty = true;
+      }
+    }
+
+    if (cache_dirty)
+    {
+      // Like a bad cache when reading, a failed write just means the next
+      // load has to scan again.
+      try
+      {
+        detail::WritePatternCache(cache_path, cache);
+      }
+      catch (...)
+      {
+        HADESMEM_DETAIL_TRACE_A(
+          boost::current_exception_diagnostic_information().c_str());
       }
     }
   }
 
   Process const* process_;
+  std::size_t num_threads_;
   ModuleMap find_pattern_datas_;
 };
 }
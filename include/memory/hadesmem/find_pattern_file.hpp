@@ -0,0 +1,447 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/find_pattern.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/pelib/section.hpp>
+#include <hadesmem/pelib/section_list.hpp>
+#include <hadesmem/process.hpp>
+
+// Pattern scanning of PE files which aren't loaded in a process, either
+// streamed from disk or from a view the caller has already mapped. Sections
+// are scanned in their on-disk layout. With kRelativeAddress results are
+// RVAs, otherwise they are file offsets (for a path) or pointers into the
+// view (for a view).
+
+namespace hadesmem
+{
+namespace detail
+{
+// Matches which cross a window boundary are found by carrying the last
+// (pattern length - 1) bytes of each window over to the next.
+std::size_t const kFileScanWindowSize = 1 << 20;
+
+struct FileScanRegion
+{
+  std::uint64_t file_beg;
+  std::uint64_t file_end;
+  DWORD rva;
+};
+
+inline std::vector<FileScanRegion> GetFileScanRegions(Process const& process,
+                                                      PeFile const& pe_file,
+                                                      std::uint64_t file_size,
+                                                      std::uint32_t flags)
+{
+  HADESMEM_DETAIL_ASSERT(pe_file.GetType() == PeFileType::Data);
+
+  bool const scan_data_secs = !!(flags & PatternFlags::kScanData);
+  std::vector<FileScanRegion> regions;
+  SectionList const sections{process, pe_file};
+  for (auto const& s : sections)
+  {
+    bool const is_code_section =
+      !!(s.GetCharacteristics() & IMAGE_SCN_CNT_CODE);
+    bool const is_data_section =
+      !!(s.GetCharacteristics() & IMAGE_SCN_CNT_INITIALIZED_DATA);
+    if ((!is_code_section && !is_data_section) ||
+        is_code_section == scan_data_secs)
+    {
+      continue;
+    }
+
+    // Only the raw data is on disk (the rest is zero-fill), and anything in
+    // the raw data past the virtual size is just padding. PointerToRawData
+    // is rounded down the same way as in RvaToVa.
+    DWORD const raw_size = s.GetSizeOfRawData();
+    DWORD const virtual_size = s.GetVirtualSize();
+    DWORD const size =
+      virtual_size ? (std::min)(raw_size, virtual_size) : raw_size;
+    std::uint64_t const file_beg = s.GetPointerToRawData() & ~(0x1FFUL);
+    if (!size || file_beg >= file_size)
+    {
+      continue;
+    }
+
+    std::uint64_t const file_end = (std::min)(file_beg + size, file_size);
+    regions.push_back(
+      FileScanRegion{file_beg, file_end, s.GetVirtualAddress()});
+  }
+
+  return regions;
+}
+
+inline void* GetFilePatternAddress(FileScanRegion const& region,
+                                   std::uint64_t file_offset,
+                                   std::uint8_t const* view,
+                                   std::uint32_t flags)
+{
+  if (!!(flags & PatternFlags::kRelativeAddress))
+  {
+    return reinterpret_cast<void*>(static_cast<std::uintptr_t>(
+      region.rva + (file_offset - region.file_beg)));
+  }
+
+  return view ? const_cast<std::uint8_t*>(view) +
+                  static_cast<std::uintptr_t>(file_offset)
+              : reinterpret_cast<void*>(
+                  static_cast<std::uintptr_t>(file_offset));
+}
+
+inline void ReadFileChunk(std::istream& file,
+                          std::uint64_t offset,
+                          std::uint8_t* buffer,
+                          std::size_t size)
+{
+  if (!file.seekg(static_cast<std::streamoff>(offset), std::ios::beg) ||
+      !file.read(reinterpret_cast<char*>(buffer),
+                 static_cast<std::streamsize>(size)))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Reading file failed."});
+  }
+}
+
+// Reads just enough of the start of the file to cover the DOS header, NT
+// headers and section table.
+inline std::vector<std::uint8_t> ReadPeFileHeaders(std::istream& file,
+                                                   std::uint64_t file_size)
+{
+  std::vector<std::uint8_t> headers;
+  auto const read_headers = [&](std::uint64_t size)
+  {
+    size = (std::min)(size, file_size);
+    if (size > headers.size())
+    {
+      std::size_t const old_size = headers.size();
+      headers.resize(static_cast<std::size_t>(size));
+      ReadFileChunk(
+        file, old_size, headers.data() + old_size, headers.size() - old_size);
+    }
+  };
+
+  read_headers(0x1000);
+  if (headers.size() < sizeof(IMAGE_DOS_HEADER))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Invalid DOS header."});
+  }
+
+  IMAGE_DOS_HEADER dos_header;
+  std::memcpy(&dos_header, headers.data(), sizeof(dos_header));
+  auto const nt_headers_offset = static_cast<DWORD>(dos_header.e_lfanew);
+  read_headers(static_cast<std::uint64_t>(nt_headers_offset) +
+               sizeof(IMAGE_NT_HEADERS));
+  if (headers.size() < nt_headers_offset + sizeof(IMAGE_NT_HEADERS))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Invalid NT headers."});
+  }
+
+  IMAGE_NT_HEADERS nt_headers;
+  std::memcpy(
+    &nt_headers, headers.data() + nt_headers_offset, sizeof(nt_headers));
+  read_headers(static_cast<std::uint64_t>(nt_headers_offset) +
+               offsetof(IMAGE_NT_HEADERS, OptionalHeader) +
+               nt_headers.FileHeader.SizeOfOptionalHeader +
+               nt_headers.FileHeader.NumberOfSections *
+                 sizeof(IMAGE_SECTION_HEADER));
+
+  return headers;
+}
+
+// Calls callback(file_offset) for every match in the region, in order, until
+// it returns false. Only one window (plus the carried over bytes) is ever in
+// memory. Returns false if the callback stopped the scan.
+template <typename Callback>
+bool ScanFileRegion(std::istream& file,
+                    FileScanRegion const& region,
+                    CompiledPattern const& pattern,
+                    std::vector<std::uint8_t>& window,
+                    Callback callback)
+{
+  std::size_t const overlap = pattern.GetSize() - 1;
+  window.resize(kFileScanWindowSize + overlap);
+
+  std::size_t carry = 0;
+  for (std::uint64_t pos = region.file_beg; pos < region.file_end;)
+  {
+    auto const size = static_cast<std::size_t>((std::min)(
+      static_cast<std::uint64_t>(kFileScanWindowSize), region.file_end - pos));
+    ReadFileChunk(file, pos, window.data() + carry, size);
+
+    // A match starting in the carried over bytes can't have fit in the
+    // previous window, so nothing is reported twice.
+    std::uint64_t const window_offset = pos - carry;
+    auto const h_beg = window.data();
+    auto const h_end = window.data() + carry + size;
+    for (std::uint8_t const* h_cur = h_beg;;)
+    {
+      auto const match = FindRawLocal(h_cur, h_end, pattern);
+      if (!match)
+      {
+        break;
+      }
+
+      if (!callback(window_offset + static_cast<std::uint64_t>(match - h_beg)))
+      {
+        return false;
+      }
+
+      h_cur = match + 1;
+    }
+
+    carry = (std::min)(overlap, carry + size);
+    std::copy(h_end - carry, h_end, window.data());
+    pos += size;
+  }
+
+  return true;
+}
+
+// Same as ScanFileRegion, but for a file which is already in memory.
+template <typename Callback>
+bool ScanViewRegion(std::uint8_t const* view,
+                    FileScanRegion const& region,
+                    CompiledPattern const& pattern,
+                    std::size_t num_threads,
+                    Callback callback)
+{
+  auto const h_beg = view + region.file_beg;
+  auto const h_end = view + region.file_end;
+  for (auto h_cur = h_beg;;)
+  {
+    auto const match = FindRawLocal(h_cur, h_end, pattern, num_threads);
+    if (!match)
+    {
+      return true;
+    }
+
+    if (!callback(static_cast<std::uint64_t>(match - view)))
+    {
+      return false;
+    }
+
+    h_cur = match + 1;
+  }
+}
+
+template <typename Callback>
+std::size_t FindAllInFile(std::wstring const& path,
+                          CompiledPattern const& pattern,
+                          std::uint32_t flags,
+                          Callback callback)
+{
+  auto const file =
+    OpenFile<char>(path, std::ios::in | std::ios::binary | std::ios::ate);
+  if (!*file)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Could not open file."});
+  }
+
+  std::streampos const end = file->tellg();
+  if (end <= 0)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"Empty or invalid file."});
+  }
+
+  auto const file_size = static_cast<std::uint64_t>(end);
+  auto headers = ReadPeFileHeaders(*file, file_size);
+
+  Process const process{::GetCurrentProcessId()};
+  PeFile const pe_file{process,
+                       headers.data(),
+                       PeFileType::Data,
+                       static_cast<DWORD>(headers.size())};
+  auto const regions = GetFileScanRegions(process, pe_file, file_size, flags);
+
+  std::size_t num_matches = 0;
+  std::vector<std::uint8_t> window;
+  for (auto const& region : regions)
+  {
+    if (!ScanFileRegion(*file,
+                        region,
+                        pattern,
+                        window,
+                        [&](std::uint64_t file_offset) -> bool
+                        {
+          ++num_matches;
+          return callback(
+            GetFilePatternAddress(region, file_offset, nullptr, flags));
+        }))
+    {
+      break;
+    }
+  }
+
+  return num_matches;
+}
+
+template <typename Callback>
+std::size_t FindAllInView(void const* view,
+                          std::size_t size,
+                          CompiledPattern const& pattern,
+                          std::uint32_t flags,
+                          Callback callback)
+{
+  HADESMEM_DETAIL_ASSERT(view != nullptr);
+
+  auto const view_beg = static_cast<std::uint8_t const*>(view);
+  Process const process{::GetCurrentProcessId()};
+  PeFile const pe_file{process,
+                       const_cast<std::uint8_t*>(view_beg),
+                       PeFileType::Data,
+                       static_cast<DWORD>(size)};
+  auto const regions = GetFileScanRegions(process, pe_file, size, flags);
+
+  std::size_t num_matches = 0;
+  for (auto const& region : regions)
+  {
+    if (!ScanViewRegion(view_beg,
+                        region,
+                        pattern,
+                        GetPatternThreadCount(flags),
+                        [&](std::uint64_t file_offset) -> bool
+                        {
+          ++num_matches;
+          return callback(
+            GetFilePatternAddress(region, file_offset, view_beg, flags));
+        }))
+    {
+      break;
+    }
+  }
+
+  return num_matches;
+}
+}
+
+// Calls callback with every match of the pattern in the PE file at path,
+// streaming the file rather than reading it into memory, and returns the
+// number of matches.
+template <typename Callback>
+std::size_t FindAll(std::wstring const& path,
+                    CompiledPattern const& pattern,
+                    std::uint32_t flags,
+                    Callback callback)
+{
+  HADESMEM_DETAIL_ASSERT(
+    !(flags & ~(PatternFlags::kInvalidFlagMaxValue - 1UL)));
+
+  std::size_t const num_matches =
+    detail::FindAllInFile(path,
+                          pattern,
+                          flags,
+                          [&](void* address) -> bool
+                          {
+      callback(address);
+      return true;
+    });
+  if (!num_matches)
+  {
+    detail::HandlePatternUnmatched(flags, nullptr);
+  }
+
+  return num_matches;
+}
+
+inline void* Find(std::wstring const& path,
+                  CompiledPattern const& pattern,
+                  std::uint32_t flags,
+                  std::wstring const* name = nullptr)
+{
+  HADESMEM_DETAIL_ASSERT(
+    !(flags & ~(PatternFlags::kInvalidFlagMaxValue - 1UL)));
+
+  void* result = nullptr;
+  if (!detail::FindAllInFile(path,
+                             pattern,
+                             flags,
+                             [&](void* address) -> bool
+                             {
+        result = address;
+        return false;
+      }))
+  {
+    detail::HandlePatternUnmatched(flags, name);
+  }
+
+  return result;
+}
+
+// Calls callback with every match of the pattern in a PE file which has
+// been mapped (or read) into memory as a flat file, and returns the number
+// of matches.
+template <typename Callback>
+std::size_t FindAll(void const* view,
+                    std::size_t size,
+                    CompiledPattern const& pattern,
+                    std::uint32_t flags,
+                    Callback callback)
+{
+  HADESMEM_DETAIL_ASSERT(
+    !(flags & ~(PatternFlags::kInvalidFlagMaxValue - 1UL)));
+
+  std::size_t const num_matches =
+    detail::FindAllInView(view,
+                          size,
+                          pattern,
+                          flags,
+                          [&](void* address) -> bool
+                          {
+      callback(address);
+      return true;
+    });
+  if (!num_matches)
+  {
+    detail::HandlePatternUnmatched(flags, nullptr);
+  }
+
+  return num_matches;
+}
+
+inline void* Find(void const* view,
+                  std::size_t size,
+                  CompiledPattern const& pattern,
+                  std::uint32_t flags,
+                  std::wstring const* name = nullptr)
+{
+  HADESMEM_DETAIL_ASSERT(
+    !(flags & ~(PatternFlags::kInvalidFlagMaxValue - 1UL)));
+
+  void* result = nullptr;
+  if (!detail::FindAllInView(view,
+                             size,
+                             pattern,
+                             flags,
+                             [&](void* address) -> bool
+                             {
+        result = address;
+        return false;
+      }))
+  {
+    detail::HandlePatternUnmatched(flags, name);
+  }
+
+  return result;
+}
+}
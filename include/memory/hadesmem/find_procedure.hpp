@@ -9,6 +9,7 @@
 
 #include <hadesmem/detail/find_procedure.hpp>
 #include <hadesmem/module.hpp>
+#include <hadesmem/pelib/export_index.hpp>
 #include <hadesmem/process.hpp>
 
 namespace hadesmem
@@ -41,4 +42,36 @@ inline FARPROC
 
   return remote_func;
 }
+
+// Overloads for looking up many exports from the same module, which only need
+// to read its export tables once.
+inline FARPROC FindProcedure(Process const& process,
+                             ExportIndex const& export_index,
+                             std::string const& name)
+{
+  FARPROC const remote_func =
+    detail::GetProcAddressInternal(process, export_index, name);
+  if (!remote_func)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"GetProcAddressInternal failed."});
+  }
+
+  return remote_func;
+}
+
+inline FARPROC FindProcedure(Process const& process,
+                             ExportIndex const& export_index,
+                             WORD ordinal)
+{
+  FARPROC const remote_func =
+    detail::GetProcAddressInternal(process, export_index, ordinal);
+  if (!remote_func)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"GetProcAddressInternal failed."});
+  }
+
+  return remote_func;
+}
 }
@@ -0,0 +1,381 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/alias_cast.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/detail/to_upper_ordinal.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_list.hpp>
+#include <hadesmem/pelib/export_index.hpp>
+#include <hadesmem/pelib/import_dir.hpp>
+#include <hadesmem/pelib/import_dir_list.hpp>
+#include <hadesmem/pelib/import_thunk.hpp>
+#include <hadesmem/pelib/import_thunk_list.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/write.hpp>
+
+namespace hadesmem
+{
+// Every import address table of a file, resolved and laid out exactly as it
+// is in the image (from the lowest FirstThunk to the end of the last entry),
+// so it can be written back with a single WriteVector. Anything in between
+// which isn't an import (e.g. the terminating entries) keeps its current
+// value, as do imports which couldn't be resolved.
+struct ImportAddressTable
+{
+  DWORD rva;
+  std::vector<std::uint8_t> data;
+  std::size_t num_resolved;
+  // "module!name" or "module!#ordinal" for each import left as it was.
+  std::vector<std::string> unresolved;
+};
+
+// Resolves imports against the modules loaded in a process. The module list
+// is taken once (a single Toolhelp snapshot, on first use), each module's
+// exports are indexed once, and every lookup (including each step of a
+// forwarder chain) is remembered, so rebuilding the imports of many files
+// which share dependencies only does the work for each export once.
+//
+// Lookups by ordinal find any export with that ordinal, the same as the
+// loader (unlike FindProcedure, which only finds exports without a name).
+// Forwarders to modules which aren't loaded (including API sets) can't be
+// resolved, and neither can forwarder chains which loop back on themselves.
+class ImportResolver
+{
+public:
+  explicit ImportResolver(Process const& process) : process_{&process}
+  {
+  }
+
+  explicit ImportResolver(Process&& process) = delete;
+
+  ImportResolver(ImportResolver const&) = delete;
+
+  ImportResolver& operator=(ImportResolver const&) = delete;
+
+  // Returns null if the import can't be resolved.
+  FARPROC Resolve(std::string const& module_name, std::string const& name)
+  {
+    HMODULE const module = FindModule(module_name);
+    return module ? ResolveImpl(module, name) : nullptr;
+  }
+
+  FARPROC Resolve(std::string const& module_name, WORD ordinal)
+  {
+    HMODULE const module = FindModule(module_name);
+    return module ? ResolveImpl(module, ordinal) : nullptr;
+  }
+
+  // Imports are read through OriginalFirstThunk where there is one,
+  // otherwise through FirstThunk (which only works if the loader hasn't
+  // already overwritten it). For a remote image it's worth taking a
+  // snapshot of the PeFile first, as every thunk and name is read from it.
+  ImportAddressTable BuildImportAddressTable(PeFile const& pe_file)
+  {
+    struct ImportEntry
+    {
+      DWORD iat_rva;
+      FARPROC address;
+    };
+
+    ImportAddressTable iat{};
+    std::vector<ImportEntry> entries;
+    ImportDirList const import_dirs{*process_, pe_file};
+    for (auto const& import_dir : import_dirs)
+    {
+      std::string const module_name = import_dir.GetName();
+      HMODULE const module = FindModule(module_name);
+      DWORD const first_thunk = import_dir.GetFirstThunk();
+      DWORD const lookup_thunk = import_dir.GetOriginalFirstThunk()
+                                   ? import_dir.GetOriginalFirstThunk()
+                                   : first_thunk;
+
+      DWORD iat_rva = first_thunk;
+      ImportThunkList const thunks{*process_, pe_file, lookup_thunk};
+      for (auto const& thunk : thunks)
+      {
+        FARPROC address = nullptr;
+        std::string import_name;
+        if (thunk.ByOrdinal())
+        {
+          WORD const ordinal = thunk.GetOrdinal();
+          import_name = "#" + std::to_string(ordinal);
+          address = module ? ResolveImpl(module, ordinal) : nullptr;
+        }
+        else
+        {
+          try
+          {
+            import_name = thunk.GetName();
+            address = module ? ResolveImpl(module, import_name) : nullptr;
+          }
+          catch (std::exception const& /*e*/)
+          {
+            import_name = "<invalid>";
+          }
+        }
+
+        if (address)
+        {
+          entries.push_back(ImportEntry{iat_rva, address});
+        }
+        else
+        {
+          iat.unresolved.push_back(module_name + "!" + import_name);
+        }
+
+        iat_rva += static_cast<DWORD>(sizeof(IMAGE_THUNK_DATA));
+      }
+    }
+
+    if (entries.empty())
+    {
+      return iat;
+    }
+
+    auto const by_rva = [](ImportEntry const& lhs, ImportEntry const& rhs)
+    {
+      return lhs.iat_rva < rhs.iat_rva;
+    };
+    iat.rva = std::min_element(std::begin(entries), std::end(entries), by_rva)
+                ->iat_rva;
+    DWORD const end_rva =
+      std::max_element(std::begin(entries), std::end(entries), by_rva)
+        ->iat_rva +
+      static_cast<DWORD>(sizeof(IMAGE_THUNK_DATA));
+
+    // Tables scattered across the image would make for a huge (and mostly
+    // pointless) write, which is almost certainly a malformed file.
+    NtHeaders const nt_headers{*process_, pe_file};
+    if (end_rva < iat.rva || end_rva - iat.rva > nt_headers.GetSizeOfImage())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Import address tables span too much of the "
+                               "image."});
+    }
+
+    void* const iat_va = RvaToVa(*process_, pe_file, iat.rva);
+    if (!iat_va)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid import address table RVA."});
+    }
+
+    iat.data = detail::ReadPeFileVector<std::uint8_t>(
+      *process_, pe_file, iat_va, end_rva - iat.rva);
+    for (auto const& entry : entries)
+    {
+      auto const function = reinterpret_cast<DWORD_PTR>(entry.address);
+      std::memcpy(iat.data.data() + (entry.iat_rva - iat.rva),
+                  &function,
+                  sizeof(function));
+    }
+    iat.num_resolved = entries.size();
+
+    return iat;
+  }
+
+  // Takes a new snapshot of the module list on the next lookup, and forgets
+  // everything resolved so far (e.g. after modules have been loaded or
+  // unloaded).
+  void Refresh()
+  {
+    modules_loaded_ = false;
+    modules_.clear();
+    exports_.clear();
+    by_name_.clear();
+    by_ordinal_.clear();
+  }
+
+private:
+  struct ModuleExports
+  {
+    explicit ModuleExports(Process const& process, HMODULE module)
+      : pe_file{process, module, PeFileType::Image, 0},
+        export_index{process, pe_file}
+    {
+    }
+
+    PeFile pe_file;
+    ExportIndex export_index;
+  };
+
+  // A lookup which is still being resolved is marked as pending, so a
+  // forwarder chain which comes back to it is caught rather than followed
+  // forever.
+  struct Resolution
+  {
+    FARPROC address;
+    bool pending;
+  };
+
+  static std::string GetModuleKey(std::string const& module_name)
+  {
+    return detail::ToUpperOrdinal(module_name);
+  }
+
+  HMODULE FindModule(std::string const& module_name)
+  {
+    if (!modules_loaded_)
+    {
+      ModuleList const modules{*process_};
+      for (auto const& module : modules)
+      {
+        std::string const key =
+          GetModuleKey(detail::WideCharToMultiByte(module.GetName()));
+        modules_.insert(std::make_pair(key, module.GetHandle()));
+      }
+      modules_loaded_ = true;
+    }
+
+    auto const iter = modules_.find(GetModuleKey(module_name));
+    return iter != std::end(modules_) ? iter->second : nullptr;
+  }
+
+  ModuleExports const* GetModuleExports(HMODULE module)
+  {
+    auto iter = exports_.find(module);
+    if (iter == std::end(exports_))
+    {
+      std::unique_ptr<ModuleExports> module_exports;
+      try
+      {
+        module_exports.reset(new ModuleExports{*process_, module});
+      }
+      catch (std::exception const& /*e*/)
+      {
+        // Leave it null so it isn't tried again.
+      }
+      iter = exports_.insert(std::make_pair(module, std::move(module_exports)))
+               .first;
+    }
+
+    return iter->second.get();
+  }
+
+  std::map<std::pair<HMODULE, std::string>, Resolution>&
+    GetResolutions(std::string const& /*name*/)
+  {
+    return by_name_;
+  }
+
+  std::map<std::pair<HMODULE, WORD>, Resolution>&
+    GetResolutions(WORD /*ordinal*/)
+  {
+    return by_ordinal_;
+  }
+
+  template <typename NameOrOrdinal>
+  FARPROC ResolveImpl(HMODULE module, NameOrOrdinal const& name_or_ordinal)
+  {
+    auto& resolutions = GetResolutions(name_or_ordinal);
+    auto const key = std::make_pair(module, name_or_ordinal);
+    auto const iter = resolutions.find(key);
+    if (iter != std::end(resolutions))
+    {
+      // A pending lookup means we're in a forwarder cycle.
+      return iter->second.pending ? nullptr : iter->second.address;
+    }
+
+    resolutions[key] = Resolution{nullptr, true};
+    FARPROC address = nullptr;
+    try
+    {
+      address = ResolveExport(module, name_or_ordinal);
+    }
+    catch (std::exception const& /*e*/)
+    {
+    }
+    resolutions[key] = Resolution{address, false};
+
+    return address;
+  }
+
+  template <typename NameOrOrdinal>
+  FARPROC ResolveExport(HMODULE module, NameOrOrdinal const& name_or_ordinal)
+  {
+    ModuleExports const* const module_exports = GetModuleExports(module);
+    if (!module_exports)
+    {
+      return nullptr;
+    }
+
+    ExportIndex const& export_index = module_exports->export_index;
+    ExportIndexEntry const* const entry = export_index.Find(name_or_ordinal);
+    if (!entry)
+    {
+      return nullptr;
+    }
+
+    if (!entry->forwarded)
+    {
+      return detail::AliasCast<FARPROC>(export_index.GetVa(*entry));
+    }
+
+    detail::ExportForwarder const forwarder =
+      detail::ParseExportForwarder(export_index.GetForwarder(*entry));
+
+    // Forwarders leave off the extension, which the loader takes to be .dll.
+    std::string forwarder_module_name = forwarder.module;
+    if (forwarder_module_name.find('.') == std::string::npos)
+    {
+      forwarder_module_name += ".dll";
+    }
+    HMODULE const forwarder_module = FindModule(forwarder_module_name);
+    if (!forwarder_module)
+    {
+      return nullptr;
+    }
+
+    return forwarder.by_ordinal
+             ? ResolveImpl(forwarder_module, forwarder.ordinal)
+             : ResolveImpl(forwarder_module, forwarder.function);
+  }
+
+  Process const* process_;
+  bool modules_loaded_{false};
+  std::map<std::string, HMODULE> modules_;
+  std::map<HMODULE, std::unique_ptr<ModuleExports>> exports_;
+  std::map<std::pair<HMODULE, std::string>, Resolution> by_name_;
+  std::map<std::pair<HMODULE, WORD>, Resolution> by_ordinal_;
+};
+
+inline void WriteImportAddressTable(Process const& process,
+                                    PeFile const& pe_file,
+                                    ImportAddressTable const& iat)
+{
+  if (iat.data.empty())
+  {
+    return;
+  }
+
+  void* const iat_va = RvaToVa(process, pe_file, iat.rva);
+  if (!iat_va)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"Invalid import address table RVA."});
+  }
+
+  WriteVector(process, iat_va, iat.data);
+}
+}
@@ -0,0 +1,179 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/detail/type_traits.hpp>
+#include <hadesmem/error.hpp>
+
+// Reads from a LocalBuffer are plain memory accesses (bounds checked against
+// the buffer) rather than going through VirtualQuery/VirtualProtect/
+// ReadProcessMemory, so the caller is responsible for the buffer being valid
+// and readable for as long as it is in use.
+//
+// Nothing here calls the Windows API, but errors are the same Error as the
+// rest of the Read API and the type traits are shared with it, both of which
+// need windows.h. So this header still only builds where windows.h does.
+
+namespace hadesmem
+{
+class LocalBuffer
+{
+public:
+  explicit LocalBuffer(void const* base, std::size_t size)
+    : base_{static_cast<std::uint8_t const*>(base)}, size_{size}
+  {
+    HADESMEM_DETAIL_ASSERT(size ? base != nullptr : true);
+  }
+
+  void const* GetBase() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return base_;
+  }
+
+  std::size_t GetSize() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return size_;
+  }
+
+  bool Contains(void const* address, std::size_t len) const
+    HADESMEM_DETAIL_NOEXCEPT
+  {
+    // Done on integers so that nothing here can overflow a pointer.
+    auto const beg = reinterpret_cast<std::uintptr_t>(base_);
+    auto const cur = reinterpret_cast<std::uintptr_t>(address);
+    return cur >= beg && cur - beg <= size_ && len <= size_ - (cur - beg);
+  }
+
+private:
+  std::uint8_t const* base_;
+  std::size_t size_;
+};
+
+namespace detail
+{
+inline void ReadLocalImpl(LocalBuffer const& buffer,
+                          void const* address,
+                          void* data,
+                          std::size_t len)
+{
+  HADESMEM_DETAIL_ASSERT(data != nullptr);
+
+  if (!buffer.Contains(address, len))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Read out of bounds."});
+  }
+
+  if (len)
+  {
+    std::memcpy(data, address, len);
+  }
+}
+
+template <typename T>
+T ReadLocalImpl(LocalBuffer const& buffer, void const* address)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_default_constructible<T>::value);
+
+  HADESMEM_DETAIL_ASSERT(address != nullptr);
+
+  T data;
+  ReadLocalImpl(buffer, address, std::addressof(data), sizeof(data));
+  return data;
+}
+}
+
+template <typename T>
+inline T Read(LocalBuffer const& buffer, void const* address)
+{
+  HADESMEM_DETAIL_ASSERT(address != nullptr);
+
+  return detail::ReadLocalImpl<T>(buffer, address);
+}
+
+template <typename T, std::size_t N>
+inline std::array<T, N> Read(LocalBuffer const& buffer, void const* address)
+{
+  HADESMEM_DETAIL_ASSERT(address != nullptr);
+
+  return detail::ReadLocalImpl<std::array<T, N>>(buffer, address);
+}
+
+template <typename T, typename Alloc = std::allocator<T>>
+inline std::vector<T, Alloc>
+  ReadVector(LocalBuffer const& buffer, void const* address, std::size_t count)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(detail::IsTriviallyCopyable<T>::value);
+  HADESMEM_DETAIL_STATIC_ASSERT(std::is_default_constructible<T>::value);
+
+  HADESMEM_DETAIL_ASSERT(count ? address != nullptr : true);
+
+  if (!count)
+  {
+    return {};
+  }
+
+  // Check the size before allocating anything, a bogus count is far more
+  // likely than a genuinely huge read.
+  if (count > buffer.GetSize() / sizeof(T))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Read out of bounds."});
+  }
+
+  std::vector<T, Alloc> data(count);
+  detail::ReadLocalImpl(buffer, address, data.data(), sizeof(T) * count);
+  return data;
+}
+
+// The string is terminated by either a null or the end of the buffer,
+// whichever comes first (matching ReadStringBounded).
+template <typename T,
+          typename Traits = std::char_traits<T>,
+          typename Alloc = std::allocator<T>>
+std::basic_string<T, Traits, Alloc> ReadString(LocalBuffer const& buffer,
+                                               void const* address)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(detail::IsCharType<T>::value);
+
+  if (!buffer.Contains(address, sizeof(T)))
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                    << ErrorString{"Read out of bounds."});
+  }
+
+  auto cur = static_cast<std::uint8_t const*>(address);
+  auto const end =
+    static_cast<std::uint8_t const*>(buffer.GetBase()) + buffer.GetSize();
+  std::basic_string<T, Traits, Alloc> data;
+  for (; static_cast<std::size_t>(end - cur) >= sizeof(T); cur += sizeof(T))
+  {
+    // The address is not necessarily aligned for T.
+    T c;
+    std::memcpy(&c, cur, sizeof(T));
+    if (c == T())
+    {
+      break;
+    }
+
+    data.push_back(c);
+  }
+
+  return data;
+}
+}
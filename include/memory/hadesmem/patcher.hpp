@@ -3,30 +3,32 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
-#include <climits>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <iterator>
+#include <limits>
 #include <locale>
 #include <map>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
-#include <hadesmem/detail/warning_disable_prefix.hpp>
-#include <udis86.h>
-#include <hadesmem/detail/warning_disable_suffix.hpp>
-
 #include <windows.h>
 
-#include <hadesmem/alloc.hpp>
 #include <hadesmem/detail/alias_cast.hpp>
 #include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/instruction_relocator.hpp>
+#include <hadesmem/detail/patch_plan.hpp>
 #include <hadesmem/detail/scope_warden.hpp>
 #include <hadesmem/detail/srw_lock.hpp>
 #include <hadesmem/detail/thread_aux.hpp>
+#include <hadesmem/detail/trampoline_arena.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/type_traits.hpp>
 #include <hadesmem/detail/winternl.hpp>
@@ -43,8 +45,22 @@ namespace hadesmem
 {
 namespace detail
 {
-inline void VerifyPatchThreads(DWORD pid, void* target, std::size_t len)
+struct PatchRange
 {
+  void* target;
+  std::size_t len;
+};
+
+// One thread snapshot, and one context per thread, however many ranges there
+// are.
+inline void VerifyPatchThreads(DWORD pid,
+                               std::vector<PatchRange> const& ranges)
+{
+  if (ranges.empty())
+  {
+    return;
+  }
+
   ThreadList threads{pid};
   for (auto const& thread_entry : threads)
   {
@@ -53,16 +69,171 @@ inline void VerifyPatchThreads(DWORD pid, void* target, std::size_t len)
       continue;
     }
 
-    if (IsExecutingInRange(
-          thread_entry, target, static_cast<std::uint8_t*>(target) + len))
+    Thread const thread{thread_entry.GetId()};
+    auto const context = GetThreadContext(thread, CONTEXT_CONTROL);
+    auto const ip =
+      reinterpret_cast<std::uint8_t const*>(GetThreadContextIp(context));
+    HADESMEM_DETAIL_ASSERT(ip);
+    for (auto const& range : ranges)
     {
-      HADESMEM_DETAIL_THROW_EXCEPTION(
-        Error{} << ErrorString{"Thread is currently executing patch target."});
+      auto const beg = static_cast<std::uint8_t const*>(range.target);
+      if (ip >= beg && ip < beg + range.len)
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{
+            "Thread is currently executing patch target."});
+      }
     }
   }
 }
+
+inline void VerifyPatchThreads(DWORD pid, void* target, std::size_t len)
+{
+  VerifyPatchThreads(pid, std::vector<PatchRange>{PatchRange{target, len}});
+}
+
+// Code writes which are done together. Writes to overlapping or adjacent
+// ranges are merged (where they overlap the one added last wins), and each
+// merged range is written once and has its instruction cache flushed once. If
+// a write fails, the ranges which were already written are put back the way
+// they were.
+class PatchWriteBatch
+{
+public:
+  void Add(void* address, std::vector<std::uint8_t> const& data)
+  {
+    if (!data.empty())
+    {
+      writes_.push_back(PendingWrite{address, data});
+    }
+  }
+
+  bool IsEmpty() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return writes_.empty();
+  }
+
+  // Returns the number of ranges written.
+  std::size_t Commit(Process const& process)
+  {
+    std::vector<PendingWrite> ranges = Merge();
+
+    std::vector<PendingWrite> written;
+    try
+    {
+      for (auto const& range : ranges)
+      {
+        auto old_data =
+          ReadVector<std::uint8_t>(process, range.address, range.data.size());
+        WriteVector(process, range.address, range.data);
+        written.push_back(PendingWrite{range.address, std::move(old_data)});
+      }
+    }
+    catch (...)
+    {
+      for (auto iter = written.rbegin(); iter != written.rend(); ++iter)
+      {
+        try
+        {
+          WriteVector(process, iter->address, iter->data);
+        }
+        catch (...)
+        {
+          // WARNING: Code is left partially patched if this fails.
+          HADESMEM_DETAIL_TRACE_A(
+            boost::current_exception_diagnostic_information().c_str());
+          HADESMEM_DETAIL_ASSERT(false);
+        }
+      }
+
+      throw;
+    }
+
+    for (auto const& range : ranges)
+    {
+      FlushInstructionCache(process, range.address, range.data.size());
+    }
+
+    writes_.clear();
+
+    return ranges.size();
+  }
+
+private:
+  struct PendingWrite
+  {
+    void* address;
+    std::vector<std::uint8_t> data;
+  };
+
+  std::vector<PendingWrite> Merge() const
+  {
+    auto const get_beg = [](PendingWrite const& write)
+    {
+      return reinterpret_cast<std::uintptr_t>(write.address);
+    };
+
+    std::vector<PendingWrite const*> sorted;
+    for (auto const& write : writes_)
+    {
+      sorted.push_back(&write);
+    }
+    std::sort(std::begin(sorted),
+              std::end(sorted),
+              [&](PendingWrite const* lhs, PendingWrite const* rhs)
+              {
+      return get_beg(*lhs) < get_beg(*rhs);
+    });
+
+    std::vector<PendingWrite> ranges;
+    std::uintptr_t range_end = 0;
+    for (auto const write : sorted)
+    {
+      std::uintptr_t const beg = get_beg(*write);
+      std::uintptr_t const end = beg + write->data.size();
+      if (ranges.empty() || beg > range_end)
+      {
+        ranges.push_back(PendingWrite{write->address, {}});
+        range_end = end;
+      }
+      else
+      {
+        range_end = (std::max)(range_end, end);
+      }
+
+      ranges.back().data.resize(
+        static_cast<std::size_t>(range_end - get_beg(ranges.back())));
+    }
+
+    // Fill them in in the order the writes were added, so later writes win.
+    for (auto const& write : writes_)
+    {
+      std::uintptr_t const beg = get_beg(write);
+      auto range = std::upper_bound(
+        std::begin(ranges),
+        std::end(ranges),
+        beg,
+        [&](std::uintptr_t address, PendingWrite const& candidate)
+        {
+        return address < get_beg(candidate);
+      });
+      HADESMEM_DETAIL_ASSERT(range != std::begin(ranges));
+      --range;
+      std::copy(std::begin(write.data),
+                std::end(write.data),
+                std::begin(range->data) +
+                  static_cast<std::ptrdiff_t>(beg - get_beg(*range)));
+    }
+
+    return ranges;
+  }
+
+  std::vector<PendingWrite> writes_;
+};
 }
 
+class PatchTransaction;
+
 class PatchRaw
 {
 public:
@@ -175,6 +346,8 @@ public:
   }
 
 private:
+  friend class PatchTransaction;
+
   void RemoveUnchecked() HADESMEM_DETAIL_NOEXCEPT
   {
     try
@@ -239,6 +412,7 @@ public:
       trampoline_{std::move(other.trampoline_)},
       orig_(std::move(other.orig_)),
       trampolines_(std::move(other.trampolines_)),
+      plan_(other.plan_),
       ref_count_{other.ref_count_.load()}
   {
     other.process_ = nullptr;
@@ -269,6 +443,8 @@ public:
 
     trampolines_ = std::move(other.trampolines_);
 
+    plan_ = other.plan_;
+
     ref_count_ = other.ref_count_.load();
 
     return *this;
@@ -297,146 +473,15 @@ public:
       return;
     }
 
-    // Reset the trampolines here because we don't do it in remove, otherwise
-    // there's a potential race condition where we want to unhook and unload
-    // safely, so we unhook the function, then try waiting on our ref count to
-    // become zero, but we haven't actually called the trampoline yet, so we end
-    // up jumping to the memory we just free'd!
-    trampoline_ = nullptr;
-    trampolines_.clear();
-
     SuspendedProcess const suspended_process{process_->GetId()};
 
-    std::uint32_t const kMaxInstructionLen = 15;
-    std::uint32_t const kTrampSize = kMaxInstructionLen * 3;
+    PrepareApply();
 
-    trampoline_ = std::make_unique<Allocator>(*process_, kTrampSize);
-    auto tramp_cur = static_cast<std::uint8_t*>(trampoline_->GetBase());
-
-    HADESMEM_DETAIL_TRACE_FORMAT_A("Target = %p, Detour = %p, Trampoline = %p.",
-                                   target_,
-                                   detour_,
-                                   trampoline_->GetBase());
-
-    auto const buffer =
-      ReadVector<std::uint8_t>(*process_, target_, kTrampSize);
-
-    ud_t ud_obj;
-    ud_init(&ud_obj);
-    ud_set_input_buffer(&ud_obj, buffer.data(), buffer.size());
-    ud_set_syntax(&ud_obj, UD_SYN_INTEL);
-    ud_set_pc(&ud_obj, reinterpret_cast<std::uint64_t>(target_));
-#if defined(HADESMEM_DETAIL_ARCH_X64)
-    ud_set_mode(&ud_obj, 64);
-#elif defined(HADESMEM_DETAIL_ARCH_X86)
-    ud_set_mode(&ud_obj, 32);
-#else
-#error "[HadesMem] Unsupported architecture."
-#endif
-
-    std::size_t const patch_size = GetPatchSize();
-
-    std::uint32_t instr_size = 0;
-    do
-    {
-      std::uint32_t const len = ud_disassemble(&ud_obj);
-      if (len == 0)
-      {
-        HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
-                                        << ErrorString{"Disassembly failed."});
-      }
-
-#if !defined(HADESMEM_NO_TRACE)
-      char const* const asm_str = ud_insn_asm(&ud_obj);
-      char const* const asm_bytes_str = ud_insn_hex(&ud_obj);
-      HADESMEM_DETAIL_TRACE_FORMAT_A(
-        "%s. [%s].",
-        (asm_str ? asm_str : "Invalid."),
-        (asm_bytes_str ? asm_bytes_str : "Invalid."));
-#endif
-
-      ud_operand_t const* const op = ud_insn_opr(&ud_obj, 0);
-      bool is_jimm = op && op->type == UD_OP_JIMM;
-      // Handle JMP QWORD PTR [RIP+Rel32]. Necessary for hook chain support.
-      bool is_jmem = op && op->type == UD_OP_MEM && op->base == UD_R_RIP &&
-                     op->index == UD_NONE && op->scale == 0 && op->size == 0x40;
-      if ((ud_obj.mnemonic == UD_Ijmp || ud_obj.mnemonic == UD_Icall) && op &&
-          (is_jimm || is_jmem))
-      {
-        std::uint16_t const size = is_jimm ? op->size : op->offset;
-        HADESMEM_DETAIL_TRACE_FORMAT_A("Operand/offset size is %hu.", size);
-        std::int64_t const insn_target = [&]() -> std::int64_t
-        {
-          switch (size)
-          {
-          case sizeof(std::int8_t) * CHAR_BIT:
-            return op->lval.sbyte;
-          case sizeof(std::int16_t) * CHAR_BIT:
-            return op->lval.sword;
-          case sizeof(std::int32_t) * CHAR_BIT:
-            return op->lval.sdword;
-          case sizeof(std::int64_t) * CHAR_BIT:
-            return op->lval.sqword;
-          default:
-            HADESMEM_DETAIL_ASSERT(false);
-            HADESMEM_DETAIL_THROW_EXCEPTION(
-              Error{} << ErrorString{"Unknown instruction size."});
-          }
-        }();
-
-        auto const resolve_rel =
-          [](std::uint64_t base, std::int64_t target, std::uint32_t insn_len)
-        {
-          return reinterpret_cast<std::uint8_t*>(
-                   static_cast<std::uintptr_t>(base)) +
-                 target + insn_len;
-        };
-
-        std::uint64_t const insn_base = ud_insn_off(&ud_obj);
-        std::uint32_t const insn_len = ud_insn_len(&ud_obj);
-
-        auto const resolved_target =
-          resolve_rel(insn_base, insn_target, insn_len);
-        void* const jump_target =
-          is_jimm ? resolved_target : Read<void*>(*process_, resolved_target);
-        HADESMEM_DETAIL_TRACE_FORMAT_A("Jump/call target = %p.", jump_target);
-        if (ud_obj.mnemonic == UD_Ijmp)
-        {
-          HADESMEM_DETAIL_TRACE_A("Writing resolved jump.");
-          tramp_cur += WriteJump(tramp_cur, jump_target, true);
-        }
-        else
-        {
-          HADESMEM_DETAIL_ASSERT(ud_obj.mnemonic == UD_Icall);
-          HADESMEM_DETAIL_TRACE_A("Writing resolved call.");
-          tramp_cur += WriteCall(tramp_cur, jump_target);
-        }
-      }
-      else
-      {
-        std::uint8_t const* const raw = ud_insn_ptr(&ud_obj);
-        Write(*process_, tramp_cur, raw, raw + len);
-        tramp_cur += len;
-      }
-
-      instr_size += len;
-    } while (instr_size < patch_size);
-
-    HADESMEM_DETAIL_TRACE_A("Writing jump back to original code.");
-
-    tramp_cur += WriteJump(
-      tramp_cur, static_cast<std::uint8_t*>(target_) + instr_size, true);
-
-    FlushInstructionCache(
-      *process_, trampoline_->GetBase(), trampoline_->GetSize());
-
-    orig_ = ReadVector<std::uint8_t>(*process_, target_, patch_size);
-
-    detail::VerifyPatchThreads(process_->GetId(), target_, orig_.size());
+    detail::VerifyPatchThreads(process_->GetId(), GetPatchBase(), orig_.size());
 
     WritePatch();
 
-    FlushInstructionCache(*process_, target_, instr_size);
+    FlushInstructionCache(*process_, GetPatchBase(), orig_.size());
 
     applied_ = true;
   }
@@ -450,14 +495,12 @@ public:
 
     SuspendedProcess const suspended_process{process_->GetId()};
 
-    detail::VerifyPatchThreads(process_->GetId(), target_, orig_.size());
-    detail::VerifyPatchThreads(
-      process_->GetId(), trampoline_->GetBase(), trampoline_->GetSize());
+    detail::VerifyPatchThreads(process_->GetId(), GetRemoveRanges());
 
     RemovePatch();
 
     // Don't free trampolines here. Do it in Apply/destructor. See comments in
-    // Apply for the rationale.
+    // PrepareApply for the rationale.
 
     applied_ = false;
   }
@@ -498,25 +541,217 @@ public:
   }
 
 protected:
+  friend class PatchTransaction;
+
+  // Builds the trampoline and saves the original code, but doesn't touch the
+  // target. The process must already be suspended.
+  void PrepareApply()
+  {
+    // Reset the trampolines here because we don't do it in remove, otherwise
+    // there's a potential race condition where we want to unhook and unload
+    // safely, so we unhook the function, then try waiting on our ref count to
+    // become zero, but we haven't actually called the trampoline yet, so we end
+    // up jumping to the memory we just free'd!
+    trampoline_ = nullptr;
+    trampolines_.clear();
+
+    plan_ = GetPatchPlan();
+    std::size_t const patch_size = plan_.patch_size;
+    HADESMEM_DETAIL_TRACE_FORMAT_A(
+      "Patch size = %u, Padding size = %u, Relocate = %u.",
+      static_cast<std::uint32_t>(patch_size),
+      static_cast<std::uint32_t>(plan_.padding_size),
+      static_cast<std::uint32_t>(plan_.relocate));
+
+    // Enough for the worst case of every instruction we move (at most one per
+    // byte of the patch), plus the jump back.
+    std::size_t const tramp_size =
+      ((plan_.relocate ? patch_size : 0) + 1) *
+      detail::kMaxRelocatedInstructionSize;
+
+    // Near the target if possible, so RIP-relative operands still reach.
+    try
+    {
+      trampoline_ =
+        detail::AllocateTrampolineNear(*process_, target_, tramp_size);
+    }
+    catch (std::exception const& /*e*/)
+    {
+      trampoline_ = detail::AllocateTrampoline(*process_, tramp_size);
+    }
+    auto tramp_cur = static_cast<std::uint8_t*>(trampoline_->GetBase());
+
+    HADESMEM_DETAIL_TRACE_FORMAT_A("Target = %p, Detour = %p, Trampoline = %p.",
+                                   target_,
+                                   detour_,
+                                   trampoline_->GetBase());
+
+    std::size_t resume_offset = patch_size;
+    if (plan_.relocate)
+    {
+      auto const buffer = ReadVector<std::uint8_t>(
+        *process_, target_, patch_size + kMaxInstructionLen - 1);
+
+      // The relocator doesn't depend on anything Windows specific, so it
+      // reports errors with std::runtime_error rather than Error.
+      detail::RelocatedCode relocated{};
+      try
+      {
+        relocated = detail::RelocateInstructions(
+          buffer.data(),
+          buffer.size(),
+          reinterpret_cast<std::uintptr_t>(target_),
+          reinterpret_cast<std::uintptr_t>(trampoline_->GetBase()),
+          patch_size,
+          detail::GetNativeCodeMode());
+      }
+      catch (std::runtime_error const& e)
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{e.what()});
+      }
+
+      HADESMEM_DETAIL_TRACE_FORMAT_A(
+        "Relocated %u bytes of code to %u bytes.",
+        static_cast<std::uint32_t>(relocated.source_size),
+        static_cast<std::uint32_t>(relocated.code.size()));
+
+      WriteVector(*process_, tramp_cur, relocated.code);
+      tramp_cur += relocated.code.size();
+      resume_offset = relocated.source_size;
+    }
+
+    HADESMEM_DETAIL_TRACE_A("Writing jump back to original code.");
+
+    tramp_cur += WriteJump(
+      tramp_cur, static_cast<std::uint8_t*>(target_) + resume_offset, true);
+    HADESMEM_DETAIL_ASSERT(tramp_cur <=
+                           static_cast<std::uint8_t*>(trampoline_->GetBase()) +
+                             tramp_size);
+
+    FlushInstructionCache(
+      *process_, trampoline_->GetBase(), trampoline_->GetSize());
+
+    orig_ = ReadVector<std::uint8_t>(
+      *process_, GetPatchBase(), plan_.padding_size + patch_size);
+  }
+
+  // Where the patch starts, which is in front of the target if the jump goes
+  // in padding.
+  void* GetPatchBase() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return static_cast<std::uint8_t*>(target_) - plan_.padding_size;
+  }
+
+  // Nothing can be executing in the trampoline either when the patch is
+  // removed.
+  std::vector<detail::PatchRange> GetRemoveRanges() const
+  {
+    return std::vector<detail::PatchRange>{
+      detail::PatchRange{GetPatchBase(), orig_.size()},
+      detail::PatchRange{trampoline_->GetBase(), trampoline_->GetSize()}};
+  }
+
+  // Patches write code to their target through here, so that a transaction
+  // can collect the writes instead of them being done straight away.
+  void WriteCode(void* address, std::vector<std::uint8_t> const& data)
+  {
+    if (write_batch_)
+    {
+      write_batch_->Add(address, data);
+    }
+    else
+    {
+      WriteVector(*process_, address, data);
+    }
+  }
+
   virtual std::size_t GetPatchSize() const
   {
     bool detour_near = IsNear(target_, detour_);
     HADESMEM_DETAIL_TRACE_A(detour_near ? "Detour near." : "Detour far.");
-    return detour_near ? kJmpSize32 : kJmpSize64;
+    return GetJumpSize(target_);
+  }
+
+  // Size of the jump to the detour which WriteJump writes at the address.
+  std::size_t GetJumpSize(void* address) const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return IsNear(address, detour_) ? kJmpSize32 : kJmpSize64;
+  }
+
+  virtual detail::PatchPlan GetPatchPlan() const
+  {
+    std::size_t const jump_size = GetPatchSize();
+
+    // The target could be at the start of a region, in which case there's
+    // no padding to use.
+    std::vector<std::uint8_t> code;
+    try
+    {
+      code = ReadVector<std::uint8_t>(
+        *process_, static_cast<std::uint8_t*>(target_) - jump_size, jump_size);
+    }
+    catch (std::exception const& /*e*/)
+    {
+    }
+
+    std::size_t const target_offset = code.size();
+    auto const target_code = ReadVector<std::uint8_t>(
+      *process_, target_, jump_size + kMaxInstructionLen - 1);
+    code.insert(std::end(code), std::begin(target_code), std::end(target_code));
+
+    detail::PatchPlan const plan =
+      detail::PlanDetourPatch(code.data(),
+                              code.size(),
+                              target_offset,
+                              jump_size,
+                              detail::GetNativeCodeMode());
+
+    // The jump size was worked out for the target, but the jump goes at the
+    // start of the padding, which could be on the other side of the point
+    // where the detour stops being in range. Patch in place if so.
+    if (plan.padding_size &&
+        GetJumpSize(static_cast<std::uint8_t*>(target_) - plan.padding_size) !=
+          plan.padding_size)
+    {
+      return detail::PlanDetourPatch(code.data() + target_offset,
+                                     code.size() - target_offset,
+                                     0,
+                                     jump_size,
+                                     detail::GetNativeCodeMode());
+    }
+
+    return plan;
   }
 
   virtual void WritePatch()
   {
-    HADESMEM_DETAIL_TRACE_A("Writing jump to detour.");
+    if (plan_.padding_size)
+    {
+      HADESMEM_DETAIL_TRACE_A("Writing jump to detour in padding.");
 
-    WriteJump(target_, detour_, false);
+      WriteJump(GetPatchBase(), detour_, false, plan_.padding_size);
+
+      HADESMEM_DETAIL_TRACE_A("Writing short jump to padding.");
+
+      std::vector<std::uint8_t> const jmp_short = {
+        0xEB,
+        static_cast<std::uint8_t>(0x100 - plan_.padding_size -
+                                  detail::kJmpShortSize)};
+      WriteCode(target_, jmp_short);
+    }
+    else
+    {
+      HADESMEM_DETAIL_TRACE_A("Writing jump to detour.");
+
+      WriteJump(target_, detour_, false, plan_.patch_size);
+    }
   }
 
   virtual void RemovePatch()
   {
     HADESMEM_DETAIL_TRACE_A("Restoring original bytes.");
 
-    WriteVector(*process_, target_, orig_);
+    WriteCode(GetPatchBase(), orig_);
   }
 
   virtual bool CanHookChainImpl() const
@@ -548,89 +783,6 @@ protected:
     }
   }
 
-  // Inspired by EasyHook.
-  std::unique_ptr<Allocator> AllocatePageNear(PVOID address)
-  {
-    SYSTEM_INFO sys_info{};
-    GetSystemInfo(&sys_info);
-    DWORD const page_size = sys_info.dwPageSize;
-
-#if defined(HADESMEM_DETAIL_ARCH_X64)
-    std::intptr_t const search_beg = (std::max)(
-      reinterpret_cast<std::intptr_t>(address) - 0x7FFFFF00LL,
-      reinterpret_cast<std::intptr_t>(sys_info.lpMinimumApplicationAddress));
-    std::intptr_t const search_end = (std::min)(
-      reinterpret_cast<std::intptr_t>(address) + 0x7FFFFF00LL,
-      reinterpret_cast<std::intptr_t>(sys_info.lpMaximumApplicationAddress));
-
-    std::unique_ptr<Allocator> trampoline;
-
-    auto const allocate_tramp =
-      [](Process const& process, PVOID addr, SIZE_T size)
-        -> std::unique_ptr<Allocator>
-    {
-      auto const new_addr = detail::TryAlloc(process, size, addr);
-      return new_addr
-               ? std::make_unique<Allocator>(process, size, new_addr, true)
-               : std::unique_ptr<Allocator>();
-    };
-
-    // Do two separate passes when looking for trampolines, ensuring to scan
-    // forwards first. This is because there is a bug in Steam's overlay (last
-    // checked and confirmed in SteamOverlayRender64.dll v2.50.25.37) where
-    // negative displacements are not correctly sign-extended when cast to
-    // 64-bits, resulting in a crash when they attempt to resolve the jump.
-
-    // .text:0000000180082956                 cmp     al, 0FFh
-    // .text:0000000180082958                 jnz     short loc_180082971
-    // .text:000000018008295A                 cmp     byte ptr [r13+1], 25h
-    // .text:000000018008295F                 jnz     short loc_180082971
-    // ; Notice how the displacement is not being sign extended.
-    // .text:0000000180082961                 mov     eax, [r13+2]
-    // .text:0000000180082965                 lea     rcx, [rax+r13]
-    // .text:0000000180082969                 mov     r13, [rcx+6]
-
-    for (std::intptr_t base = reinterpret_cast<std::intptr_t>(address),
-                       index = 0;
-         base + index < search_end && !trampoline;
-         index += page_size)
-    {
-      trampoline = allocate_tramp(
-        *process_, reinterpret_cast<void*>(base + index), page_size);
-    }
-
-    if (!trampoline)
-    {
-      HADESMEM_DETAIL_TRACE_A(
-        "WARNING! Failed to find a viable trampoline "
-        "page in forward scan, falling back to backward scan. This may cause "
-        "incompatibilty with some other overlays.");
-    }
-
-    for (std::intptr_t base = reinterpret_cast<std::intptr_t>(address),
-                       index = 0;
-         base - index > search_beg && !trampoline;
-         index += page_size)
-    {
-      trampoline = allocate_tramp(
-        *process_, reinterpret_cast<void*>(base - index), page_size);
-    }
-
-    if (!trampoline)
-    {
-      HADESMEM_DETAIL_THROW_EXCEPTION(
-        Error{} << ErrorString{"Failed to find trampoline memory block."});
-    }
-
-    return trampoline;
-#elif defined(HADESMEM_DETAIL_ARCH_X86)
-    (void)address;
-    return std::make_unique<Allocator>(*process_, page_size);
-#else
-#error "[HadesMem] Unsupported architecture."
-#endif
-  }
-
   bool IsNear(void* address, void* target) const HADESMEM_DETAIL_NOEXCEPT
   {
 #if defined(HADESMEM_DETAIL_ARCH_X64)
@@ -747,7 +899,13 @@ protected:
     return buf;
   }
 
-  std::size_t WriteJump(void* address, void* target, bool push_ret_fallback)
+  // Throws rather than writing anything if the jump would be bigger than
+  // max_size.
+  std::size_t WriteJump(void* address,
+                        void* target,
+                        bool push_ret_fallback,
+                        std::size_t max_size =
+                          (std::numeric_limits<std::size_t>::max)())
   {
     (void)push_ret_fallback;
     HADESMEM_DETAIL_TRACE_FORMAT_A(
@@ -767,10 +925,11 @@ protected:
     }
     else
     {
-      std::unique_ptr<Allocator> trampoline;
+      std::unique_ptr<detail::TrampolineSlot> trampoline;
       try
       {
-        trampoline = AllocatePageNear(address);
+        trampoline =
+          detail::AllocateTrampolineNear(*process_, address, sizeof(void*));
       }
       catch (std::exception const& /*e*/)
       {
@@ -827,7 +986,13 @@ protected:
 #error "[HadesMem] Unsupported architecture."
 #endif
 
-    WriteVector(*process_, address, jump_buf);
+    if (jump_buf.size() > max_size)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Jump is too big for the space available."});
+    }
+
+    WriteCode(address, jump_buf);
 
     return jump_buf.size();
   }
@@ -840,7 +1005,8 @@ protected:
     std::vector<std::uint8_t> call_buf;
 
 #if defined(HADESMEM_DETAIL_ARCH_X64)
-    std::unique_ptr<Allocator> trampoline = AllocatePageNear(address);
+    std::unique_ptr<detail::TrampolineSlot> trampoline =
+      detail::AllocateTrampolineNear(*process_, address, sizeof(void*));
 
     PVOID tramp_addr = trampoline->GetBase();
 
@@ -861,11 +1027,12 @@ protected:
 #error "[HadesMem] Unsupported architecture."
 #endif
 
-    WriteVector(*process_, address, call_buf);
+    WriteCode(address, call_buf);
 
     return call_buf.size();
   }
 
+  static std::size_t const kMaxInstructionLen = 15;
   static std::size_t const kJmpSize32 = 5;
   static std::size_t const kCallSize32 = 5;
 #if defined(HADESMEM_DETAIL_ARCH_X64)
@@ -885,10 +1052,12 @@ protected:
   bool detached_{false};
   PVOID target_;
   PVOID detour_;
-  std::unique_ptr<Allocator> trampoline_;
+  std::unique_ptr<detail::TrampolineSlot> trampoline_;
   std::vector<BYTE> orig_;
-  std::vector<std::unique_ptr<Allocator>> trampolines_;
+  std::vector<std::unique_ptr<detail::TrampolineSlot>> trampolines_;
+  detail::PatchPlan plan_{};
   std::atomic<std::uint32_t> ref_count_;
+  detail::PatchWriteBatch* write_batch_{nullptr};
 };
 
 class PatchVeh : public PatchDetour
@@ -940,6 +1109,13 @@ protected:
     HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{"Unimplemented."});
   }
 
+  // The patch is always at the target, as that's where the exception has to
+  // come from.
+  virtual detail::PatchPlan GetPatchPlan() const override
+  {
+    return detail::PatchPlan{0, GetPatchSize(), true};
+  }
+
   virtual void WritePatch() override
   {
     HADESMEM_DETAIL_THROW_EXCEPTION(Error{} << ErrorString{"Unimplemented."});
@@ -1151,7 +1327,7 @@ protected:
     HADESMEM_DETAIL_TRACE_A("Writing breakpoint.");
 
     std::vector<std::uint8_t> const buf = {0xCC};
-    WriteVector(*process_, target_, buf);
+    WriteCode(target_, buf);
 
     scope_cleanup_hook.Dismiss();
   }
@@ -1160,7 +1336,7 @@ protected:
   {
     HADESMEM_DETAIL_TRACE_A("Restoring original bytes.");
 
-    WriteVector(*process_, target_, orig_);
+    WriteCode(target_, orig_);
 
     {
       hadesmem::detail::AcquireSRWLock const lock(
@@ -1350,4 +1526,271 @@ protected:
     return false;
   }
 };
+
+// Applies or removes a set of patches together. The process is suspended
+// once, the threads are checked once against every patch, and the code writes
+// are merged so that each range is written and flushed once. If anything
+// fails, none of the patches are applied (or removed).
+//
+// The patches must all be for the same process, must not overlap, and must
+// outlive the transaction. As a target can only be hooked once per
+// transaction, hooks which chain onto each other need separate ones.
+class PatchTransaction
+{
+public:
+  explicit PatchTransaction(Process const& process) : process_{&process}
+  {
+  }
+
+  explicit PatchTransaction(Process&& process) = delete;
+
+  PatchTransaction(PatchTransaction const& other) = delete;
+
+  PatchTransaction& operator=(PatchTransaction const& other) = delete;
+
+  void Add(PatchRaw& patch)
+  {
+    VerifyProcess(*patch.process_);
+    raw_patches_.push_back(&patch);
+  }
+
+  void Add(PatchDetour& patch)
+  {
+    VerifyProcess(*patch.process_);
+    detours_.push_back(&patch);
+  }
+
+  void Apply()
+  {
+    std::vector<PatchRaw*> raw_patches;
+    for (auto const patch : raw_patches_)
+    {
+      if (!patch->applied_ && !patch->detached_)
+      {
+        raw_patches.push_back(patch);
+      }
+    }
+
+    std::vector<PatchDetour*> detours;
+    for (auto const patch : detours_)
+    {
+      if (!patch->applied_ && !patch->detached_)
+      {
+        detours.push_back(patch);
+      }
+    }
+
+    if (raw_patches.empty() && detours.empty())
+    {
+      return;
+    }
+
+    SuspendedProcess const suspended_process{process_->GetId()};
+
+    std::vector<detail::PatchRange> ranges;
+    for (auto const patch : raw_patches)
+    {
+      patch->orig_ = ReadVector<std::uint8_t>(
+        *process_, patch->target_, patch->data_.size());
+      ranges.push_back(detail::PatchRange{patch->target_, patch->data_.size()});
+    }
+
+    for (auto const patch : detours)
+    {
+      patch->PrepareApply();
+      ranges.push_back(
+        detail::PatchRange{patch->GetPatchBase(), patch->orig_.size()});
+    }
+
+    VerifyNoOverlap(ranges);
+
+    detail::VerifyPatchThreads(process_->GetId(), ranges);
+
+    detail::PatchWriteBatch batch;
+    for (auto const patch : raw_patches)
+    {
+      batch.Add(patch->target_, patch->data_);
+    }
+
+    std::vector<PatchDetour*> written;
+    try
+    {
+      for (auto const patch : detours)
+      {
+        WriteThrough(*patch, batch, &PatchDetour::WritePatch);
+        written.push_back(patch);
+      }
+
+      batch.Commit(*process_);
+    }
+    catch (...)
+    {
+      Undo(written, &PatchDetour::RemovePatch);
+      throw;
+    }
+
+    for (auto const patch : raw_patches)
+    {
+      patch->applied_ = true;
+    }
+
+    for (auto const patch : detours)
+    {
+      patch->applied_ = true;
+    }
+  }
+
+  void Remove()
+  {
+    std::vector<PatchRaw*> raw_patches;
+    for (auto const patch : raw_patches_)
+    {
+      if (patch->applied_)
+      {
+        raw_patches.push_back(patch);
+      }
+    }
+
+    std::vector<PatchDetour*> detours;
+    for (auto const patch : detours_)
+    {
+      if (patch->applied_)
+      {
+        detours.push_back(patch);
+      }
+    }
+
+    if (raw_patches.empty() && detours.empty())
+    {
+      return;
+    }
+
+    SuspendedProcess const suspended_process{process_->GetId()};
+
+    std::vector<detail::PatchRange> ranges;
+    for (auto const patch : raw_patches)
+    {
+      ranges.push_back(detail::PatchRange{patch->target_, patch->orig_.size()});
+    }
+
+    for (auto const patch : detours)
+    {
+      auto const detour_ranges = patch->GetRemoveRanges();
+      ranges.insert(
+        std::end(ranges), std::begin(detour_ranges), std::end(detour_ranges));
+    }
+
+    detail::VerifyPatchThreads(process_->GetId(), ranges);
+
+    detail::PatchWriteBatch batch;
+    for (auto const patch : raw_patches)
+    {
+      batch.Add(patch->target_, patch->orig_);
+    }
+
+    std::vector<PatchDetour*> written;
+    try
+    {
+      for (auto const patch : detours)
+      {
+        WriteThrough(*patch, batch, &PatchDetour::RemovePatch);
+        written.push_back(patch);
+      }
+
+      batch.Commit(*process_);
+    }
+    catch (...)
+    {
+      Undo(written, &PatchDetour::WritePatch);
+      throw;
+    }
+
+    for (auto const patch : raw_patches)
+    {
+      patch->applied_ = false;
+    }
+
+    // Trampolines are kept until the detours are applied again or destroyed,
+    // the same as PatchDetour::Remove.
+    for (auto const patch : detours)
+    {
+      patch->applied_ = false;
+    }
+  }
+
+private:
+  void VerifyProcess(Process const& process) const
+  {
+    if (process != *process_)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Patch is for a different process."});
+    }
+  }
+
+  static void VerifyNoOverlap(std::vector<detail::PatchRange> ranges)
+  {
+    auto const get_beg = [](detail::PatchRange const& range)
+    {
+      return reinterpret_cast<std::uintptr_t>(range.target);
+    };
+    std::sort(std::begin(ranges),
+              std::end(ranges),
+              [&](detail::PatchRange const& lhs, detail::PatchRange const& rhs)
+              {
+      return get_beg(lhs) < get_beg(rhs);
+    });
+
+    for (std::size_t i = 1; i < ranges.size(); ++i)
+    {
+      if (get_beg(ranges[i - 1]) + ranges[i - 1].len > get_beg(ranges[i]))
+      {
+        HADESMEM_DETAIL_THROW_EXCEPTION(
+          Error{} << ErrorString{"Patches in a transaction overlap."});
+      }
+    }
+  }
+
+  // Runs one of the detour's virtual write functions with its code writes
+  // going to the batch.
+  static void WriteThrough(PatchDetour& patch,
+                           detail::PatchWriteBatch& batch,
+                           void (PatchDetour::*write)())
+  {
+    patch.write_batch_ = &batch;
+    auto const reset_batch = [&]()
+    {
+      patch.write_batch_ = nullptr;
+    };
+    auto scope_reset_batch = detail::MakeScopeWarden(reset_batch);
+
+    (patch.*write)();
+  }
+
+  // Code writes were never committed, so this only has to undo anything else
+  // the write functions did (e.g. registering VEH hooks or setting debug
+  // registers).
+  static void Undo(std::vector<PatchDetour*> const& written,
+                   void (PatchDetour::*undo)()) HADESMEM_DETAIL_NOEXCEPT
+  {
+    for (auto iter = written.rbegin(); iter != written.rend(); ++iter)
+    {
+      try
+      {
+        detail::PatchWriteBatch discard;
+        WriteThrough(**iter, discard, undo);
+      }
+      catch (...)
+      {
+        HADESMEM_DETAIL_TRACE_A(
+          boost::current_exception_diagnostic_information().c_str());
+        HADESMEM_DETAIL_ASSERT(false);
+      }
+    }
+  }
+
+  Process const* process_;
+  std::vector<PatchRaw*> raw_patches_;
+  std::vector<PatchDetour*> detours_;
+};
 }
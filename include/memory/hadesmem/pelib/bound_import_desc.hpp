@@ -101,7 +101,8 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_BOUND_IMPORT_DESCRIPTOR>(*process_, base_);
+    data_ = detail::ReadPeFile<IMAGE_BOUND_IMPORT_DESCRIPTOR>(
+      *process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
@@ -62,7 +62,8 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_BOUND_FORWARDER_REF>(*process_, base_);
+    data_ = detail::ReadPeFile<IMAGE_BOUND_FORWARDER_REF>(
+      *process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
@@ -27,7 +27,9 @@ class DosHeader
 {
 public:
   explicit DosHeader(Process const& process, PeFile const& pe_file)
-    : process_{&process}, base_{static_cast<std::uint8_t*>(pe_file.GetBase())}
+    : process_{&process},
+      pe_file_{&pe_file},
+      base_{static_cast<std::uint8_t*>(pe_file.GetBase())}
   {
     UpdateRead();
 
@@ -61,12 +63,13 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_DOS_HEADER>(*process_, base_);
+    data_ = detail::ReadPeFile<IMAGE_DOS_HEADER>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
   {
     Write(*process_, base_, data_);
+    pe_file_->Refresh();
   }
 
   WORD GetMagic() const
@@ -270,6 +273,7 @@ public:
 
 private:
   Process const* process_;
+  PeFile const* pe_file_;
   PBYTE base_;
   IMAGE_DOS_HEADER data_ = IMAGE_DOS_HEADER{};
 };
@@ -58,16 +58,19 @@ public:
       if (ptr_ordinals && ptr_names)
       {
         std::vector<WORD> const name_ordinals =
-          ReadVector<WORD>(process, ptr_ordinals, num_names);
+          detail::ReadPeFileVector<WORD>(
+            process, pe_file, ptr_ordinals, num_names);
         auto const name_ord_iter = std::find(
           std::begin(name_ordinals), std::end(name_ordinals), ordinal_number_);
         if (name_ord_iter != std::end(name_ordinals))
         {
           by_name_ = true;
           DWORD const name_rva =
-            Read<DWORD>(process,
-                        ptr_names + std::distance(std::begin(name_ordinals),
-                                                  name_ord_iter));
+            detail::ReadPeFile<DWORD>(process,
+                                      pe_file,
+                                      ptr_names +
+                                        std::distance(std::begin(name_ordinals),
+                                                      name_ord_iter));
           name_ = detail::CheckedReadString<char>(
             process, pe_file, RvaToVa(process, pe_file, name_rva));
         }
@@ -82,7 +85,8 @@ public:
         Error{} << ErrorString{"AddressOfFunctions invalid."});
     }
     DWORD const func_rva =
-      Read<DWORD>(process, ptr_functions + ordinal_number_);
+      detail::ReadPeFile<DWORD>(
+        process, pe_file, ptr_functions + ordinal_number_);
 
     NtHeaders const nt_headers{process, pe_file};
 
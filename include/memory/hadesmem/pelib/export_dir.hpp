@@ -65,7 +65,8 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_EXPORT_DIRECTORY>(*process_, base_);
+    data_ =
+      detail::ReadPeFile<IMAGE_EXPORT_DIRECTORY>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
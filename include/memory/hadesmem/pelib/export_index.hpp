@@ -0,0 +1,524 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <windows.h>
+#include <winnt.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/str_conv.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/export_dir.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+
+namespace hadesmem
+{
+struct ExportIndexEntry
+{
+  WORD procedure_number;
+  WORD ordinal_number;
+  // RVA of the function, or of the forwarder string if the export is
+  // forwarded. Zero if there is no export with this ordinal.
+  DWORD rva;
+  bool by_name;
+  bool forwarded;
+};
+
+namespace detail
+{
+inline PVOID GetExportVa(Process const& process,
+                         PeFile const& pe_file,
+                         ExportIndexEntry const& entry)
+{
+  HADESMEM_DETAIL_ASSERT(!entry.forwarded);
+  return RvaToVa(process, pe_file, entry.rva);
+}
+
+inline std::string GetExportForwarder(Process const& process,
+                                      PeFile const& pe_file,
+                                      ExportIndexEntry const& entry)
+{
+  HADESMEM_DETAIL_ASSERT(entry.forwarded);
+  return CheckedReadString<char>(
+    process, pe_file, RvaToVa(process, pe_file, entry.rva));
+}
+
+// A forwarder string split into the module it names and the export in that
+// module, which is either a name or (written as "#123") an ordinal.
+struct ExportForwarder
+{
+  std::string module;
+  std::string function;
+  bool by_ordinal;
+  WORD ordinal;
+};
+
+inline ExportForwarder ParseExportForwarder(std::string const& forwarder)
+{
+  std::string::size_type const split_pos = forwarder.rfind('.');
+  if (split_pos == std::string::npos || split_pos + 1 == forwarder.size())
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"Invalid forwarder string format."});
+  }
+
+  ExportForwarder result{};
+  result.module = forwarder.substr(0, split_pos);
+  result.function = forwarder.substr(split_pos + 1);
+  result.by_ordinal = result.function[0] == '#';
+  if (result.by_ordinal)
+  {
+    try
+    {
+      result.ordinal = StrToNum<WORD>(result.function.substr(1));
+    }
+    catch (std::exception const& /*e*/)
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Invalid forwarder ordinal detected."});
+    }
+  }
+
+  return result;
+}
+
+// How much of the file or image lies at or after the given RVA (and its VA).
+inline std::size_t GetExportAvailable(PeFile const& pe_file,
+                                      NtHeaders const& nt_headers,
+                                      DWORD rva,
+                                      void* va)
+{
+  if (pe_file.GetType() == PeFileType::Data)
+  {
+    auto const beg = reinterpret_cast<std::uintptr_t>(pe_file.GetBase());
+    auto const cur = reinterpret_cast<std::uintptr_t>(va);
+    return cur >= beg && cur - beg < pe_file.GetSize()
+             ? pe_file.GetSize() - (cur - beg)
+             : 0;
+  }
+
+  DWORD const size_of_image = nt_headers.GetSizeOfImage();
+  return rva < size_of_image ? size_of_image - rva : 0;
+}
+
+// The count is clamped to what can actually lie inside the file or image, so
+// a bogus count can't turn into a huge allocation.
+template <typename T>
+std::vector<T> ReadExportArray(Process const& process,
+                               PeFile const& pe_file,
+                               NtHeaders const& nt_headers,
+                               DWORD rva,
+                               DWORD count)
+{
+  if (!count)
+  {
+    return {};
+  }
+
+  void* const va = RvaToVa(process, pe_file, rva);
+  if (!va)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"Export array RVA invalid."});
+  }
+
+  std::size_t const available =
+    GetExportAvailable(pe_file, nt_headers, rva, va);
+  std::size_t const clamped_count =
+    (std::min)(static_cast<std::size_t>(count), available / sizeof(T));
+  return ReadPeFileVector<T>(process, pe_file, va, clamped_count);
+}
+
+// Compares the export name at the given RVA with the given name (the same way
+// strcmp would), reading no more of it than is needed to tell them apart.
+inline int CompareExportName(Process const& process,
+                             PeFile const& pe_file,
+                             NtHeaders const& nt_headers,
+                             DWORD name_rva,
+                             std::string const& name)
+{
+  void* const name_va = RvaToVa(process, pe_file, name_rva);
+  if (!name_va)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"Export name RVA invalid."});
+  }
+
+  // One character more than the name is enough to compare against it. If
+  // that much can't be read in one go (e.g. the name is right at the end of
+  // the file) it's read the slow way instead.
+  if (GetExportAvailable(pe_file, nt_headers, name_rva, name_va) > name.size())
+  {
+    try
+    {
+      std::vector<char> const data =
+        ReadPeFileVector<char>(process, pe_file, name_va, name.size() + 1);
+      std::string const probe(
+        std::begin(data), std::find(std::begin(data), std::end(data), '\0'));
+      return probe.compare(name);
+    }
+    catch (Error const& /*e*/)
+    {
+    }
+  }
+
+  return CheckedReadString<char>(process, pe_file, name_va).compare(name);
+}
+
+// Looks up an export by binary searching AddressOfNames, which the spec
+// requires to be sorted, so only a handful of names need to be read. Returns
+// false if the name isn't found, or if the table turns out not to be sane
+// enough to trust the result (duplicate names, an invalid ordinal, etc.). A
+// miss could also mean the table isn't sorted, so the caller is expected to
+// fall back to a linear search (i.e. ExportIndex) whenever this fails. (If
+// the table isn't sorted a hit may not be the export ExportIndex would pick,
+// but it is the one the loader's own binary search would.)
+inline bool FindExportByNameSorted(Process const& process,
+                                   PeFile const& pe_file,
+                                   std::string const& name,
+                                   ExportIndexEntry& entry)
+{
+  try
+  {
+    ExportDir const export_dir{process, pe_file};
+    NtHeaders const nt_headers{process, pe_file};
+
+    std::vector<DWORD> const names =
+      ReadExportArray<DWORD>(process,
+                             pe_file,
+                             nt_headers,
+                             export_dir.GetAddressOfNames(),
+                             export_dir.GetNumberOfNames());
+    std::vector<WORD> const name_ordinals =
+      ReadExportArray<WORD>(process,
+                            pe_file,
+                            nt_headers,
+                            export_dir.GetAddressOfNameOrdinals(),
+                            static_cast<DWORD>(names.size()));
+
+    auto const compare = [&](std::size_t i)
+    {
+      return CompareExportName(process, pe_file, nt_headers, names[i], name);
+    };
+
+    std::size_t lo = 0;
+    std::size_t hi = name_ordinals.size();
+    std::size_t found = hi;
+    while (lo < hi)
+    {
+      std::size_t const mid = lo + (hi - lo) / 2;
+      int const result = compare(mid);
+      if (result < 0)
+      {
+        lo = mid + 1;
+      }
+      else if (result > 0)
+      {
+        hi = mid;
+      }
+      else
+      {
+        found = mid;
+        break;
+      }
+    }
+
+    // Duplicates of a name would be next to each other, and ExportIndex
+    // would need to pick between them.
+    if (found == name_ordinals.size() || (found && !compare(found - 1)) ||
+        (found + 1 < name_ordinals.size() && !compare(found + 1)))
+    {
+      return false;
+    }
+
+    // An export only takes the first name which refers to it.
+    WORD const ordinal_number = name_ordinals[found];
+    auto const name_ordinals_found = std::begin(name_ordinals) + found;
+    if (std::find(std::begin(name_ordinals),
+                  name_ordinals_found,
+                  ordinal_number) != name_ordinals_found ||
+        ordinal_number >= export_dir.GetNumberOfFunctions())
+    {
+      return false;
+    }
+
+    DWORD* const ptr_functions = static_cast<DWORD*>(
+      RvaToVa(process, pe_file, export_dir.GetAddressOfFunctions()));
+    if (!ptr_functions)
+    {
+      return false;
+    }
+
+    DWORD const func_rva =
+      ReadPeFile<DWORD>(process, pe_file, ptr_functions + ordinal_number);
+    if (!func_rva)
+    {
+      return false;
+    }
+
+    DWORD const export_dir_start =
+      nt_headers.GetDataDirectoryVirtualAddress(PeDataDir::Export);
+    DWORD const export_dir_end =
+      export_dir_start + nt_headers.GetDataDirectorySize(PeDataDir::Export);
+
+    entry.ordinal_number = ordinal_number;
+    entry.procedure_number =
+      static_cast<WORD>(export_dir.GetOrdinalBase() + ordinal_number);
+    entry.rva = func_rva;
+    entry.by_name = true;
+    entry.forwarded = func_rva > export_dir_start && func_rva < export_dir_end;
+    return true;
+  }
+  catch (std::exception const& /*e*/)
+  {
+    return false;
+  }
+}
+}
+
+// Lookup tables for the exports of a module, so finding an export by name or
+// ordinal doesn't need to walk an ExportList (which re-reads the export
+// directory and the name ordinal table for every export). Each of the export
+// arrays is read in a single go, as are the names which lie inside the export
+// directory (which is almost always all of them). Forwarder strings are only
+// read when asked for.
+//
+// Lookups give the same export that searching an ExportList would. Exports
+// with a zero RVA are skipped, and an export takes the first name in the name
+// table which refers to it. A file with no (or an invalid) export directory
+// gives an empty index, just as it gives an empty ExportList.
+class ExportIndex
+{
+public:
+  explicit ExportIndex(Process const& process, PeFile const& pe_file)
+    : process_{&process}, pe_file_{&pe_file}
+  {
+    try
+    {
+      Build();
+    }
+    catch (std::exception const& /*e*/)
+    {
+      entries_.clear();
+      names_.clear();
+    }
+  }
+
+  explicit ExportIndex(Process&& process, PeFile const& pe_file) = delete;
+
+  explicit ExportIndex(Process const& process, PeFile&& pe_file) = delete;
+
+  explicit ExportIndex(Process&& process, PeFile&& pe_file) = delete;
+
+  ExportIndexEntry const* Find(std::string const& name) const
+  {
+    auto const iter = names_.find(name);
+    return iter != std::end(names_) ? &entries_[iter->second] : nullptr;
+  }
+
+  ExportIndexEntry const* Find(WORD procedure_number) const
+  {
+    if (static_cast<DWORD>(procedure_number) < ordinal_base_)
+    {
+      return nullptr;
+    }
+
+    DWORD const ordinal_number = procedure_number - ordinal_base_;
+    if (ordinal_number >= entries_.size() || !entries_[ordinal_number].rva)
+    {
+      return nullptr;
+    }
+
+    return &entries_[ordinal_number];
+  }
+
+  PVOID GetVa(ExportIndexEntry const& entry) const
+  {
+    return detail::GetExportVa(*process_, *pe_file_, entry);
+  }
+
+  std::string GetForwarder(ExportIndexEntry const& entry) const
+  {
+    return detail::GetExportForwarder(*process_, *pe_file_, entry);
+  }
+
+  PeFile const& GetPeFile() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return *pe_file_;
+  }
+
+  std::size_t GetNumberOfNames() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return names_.size();
+  }
+
+private:
+  void Build()
+  {
+    ExportDir const export_dir{*process_, *pe_file_};
+    NtHeaders const nt_headers{*process_, *pe_file_};
+
+    ordinal_base_ = export_dir.GetOrdinalBase();
+
+    DWORD const export_dir_start =
+      nt_headers.GetDataDirectoryVirtualAddress(PeDataDir::Export);
+    DWORD const export_dir_end =
+      export_dir_start + nt_headers.GetDataDirectorySize(PeDataDir::Export);
+
+    // Ordinal numbers are only 16 bits.
+    std::vector<DWORD> const functions = detail::ReadExportArray<DWORD>(
+      *process_,
+      *pe_file_,
+      nt_headers,
+      export_dir.GetAddressOfFunctions(),
+      (std::min)(export_dir.GetNumberOfFunctions(),
+                 static_cast<DWORD>(0x10000)));
+    entries_.resize(functions.size());
+    for (std::size_t i = 0; i < functions.size(); ++i)
+    {
+      ExportIndexEntry& entry = entries_[i];
+      entry.ordinal_number = static_cast<WORD>(i);
+      entry.procedure_number = static_cast<WORD>(ordinal_base_ + i);
+      entry.rva = functions[i];
+      entry.by_name = false;
+      // If the RVA lies inside the export dir region then it's a forwarded
+      // export. Otherwise it's a regular RVA.
+      entry.forwarded =
+        entry.rva > export_dir_start && entry.rva < export_dir_end;
+    }
+
+    // Without a valid name table everything is exported by ordinal.
+    std::vector<DWORD> names;
+    std::vector<WORD> name_ordinals;
+    try
+    {
+      names = detail::ReadExportArray<DWORD>(*process_,
+                                             *pe_file_,
+                                             nt_headers,
+                                             export_dir.GetAddressOfNames(),
+                                             export_dir.GetNumberOfNames());
+      name_ordinals = detail::ReadExportArray<WORD>(
+        *process_,
+        *pe_file_,
+        nt_headers,
+        export_dir.GetAddressOfNameOrdinals(),
+        static_cast<DWORD>(names.size()));
+    }
+    catch (std::exception const& /*e*/)
+    {
+      name_ordinals.clear();
+    }
+
+    std::vector<DWORD> name_rvas(entries_.size());
+    for (std::size_t i = 0; i < name_ordinals.size(); ++i)
+    {
+      WORD const ordinal_number = name_ordinals[i];
+      if (ordinal_number < entries_.size() && !entries_[ordinal_number].by_name)
+      {
+        entries_[ordinal_number].by_name = true;
+        name_rvas[ordinal_number] = names[i];
+      }
+    }
+
+    ReadExportDirData(nt_headers, export_dir_start, export_dir_end);
+
+    names_.reserve(name_ordinals.size());
+    for (std::size_t i = 0; i < entries_.size(); ++i)
+    {
+      if (!entries_[i].by_name || !entries_[i].rva)
+      {
+        continue;
+      }
+
+      // A name which can't be read only makes that export unreachable by
+      // name, rather than the whole index.
+      try
+      {
+        names_.emplace(ReadName(name_rvas[i]), i);
+      }
+      catch (std::exception const& /*e*/)
+      {
+      }
+    }
+
+    // Only needed while building.
+    export_dir_data_ = std::vector<char>();
+  }
+
+  // Best effort. If the export dir can't be read in one go the names are
+  // just read individually.
+  void ReadExportDirData(NtHeaders const& nt_headers,
+                         DWORD export_dir_start,
+                         DWORD export_dir_end)
+  {
+    try
+    {
+      export_dir_va_ = RvaToVa(*process_, *pe_file_, export_dir_start);
+      if (export_dir_va_ && export_dir_end > export_dir_start)
+      {
+        std::size_t const available =
+          detail::GetExportAvailable(
+            *pe_file_, nt_headers, export_dir_start, export_dir_va_);
+        std::size_t const size = (std::min)(
+          static_cast<std::size_t>(export_dir_end - export_dir_start),
+          available);
+        export_dir_data_ = detail::ReadPeFileVector<char>(
+          *process_, *pe_file_, export_dir_va_, size);
+        export_dir_rva_ = export_dir_start;
+      }
+    }
+    catch (std::exception const& /*e*/)
+    {
+      export_dir_data_.clear();
+    }
+  }
+
+  std::string ReadName(DWORD name_rva) const
+  {
+    void* const name_va = RvaToVa(*process_, *pe_file_, name_rva);
+
+    // Only use the copy of the export dir if the name maps to the same place
+    // in it as it would when read directly.
+    if (name_rva >= export_dir_rva_ &&
+        name_rva - export_dir_rva_ < export_dir_data_.size() &&
+        name_va == static_cast<char*>(export_dir_va_) +
+                     (name_rva - export_dir_rva_))
+    {
+      char const* const beg = export_dir_data_.data() + name_rva -
+                              export_dir_rva_;
+      char const* const end =
+        export_dir_data_.data() + export_dir_data_.size();
+      char const* const null = std::find(beg, end, '\0');
+      if (null != end)
+      {
+        return std::string(beg, null);
+      }
+    }
+
+    return detail::CheckedReadString<char>(*process_, *pe_file_, name_va);
+  }
+
+  Process const* process_;
+  PeFile const* pe_file_;
+  DWORD ordinal_base_{};
+  // Indexed by ordinal number.
+  std::vector<ExportIndexEntry> entries_;
+  // Name to ordinal number.
+  std::unordered_map<std::string, std::size_t> names_;
+  DWORD export_dir_rva_{};
+  void* export_dir_va_{};
+  std::vector<char> export_dir_data_;
+};
+}
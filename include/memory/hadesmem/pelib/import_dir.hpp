@@ -76,7 +76,8 @@ public:
           auto const offset = sizeof(DWORD) * (i + 1);
           auto const len = sizeof(IMAGE_IMPORT_DESCRIPTOR) - offset;
           auto const buf =
-            ReadVector<std::uint8_t>(*process_, desc_raw_beg, len);
+            detail::ReadPeFileVector<std::uint8_t>(
+              *process_, *pe_file_, desc_raw_beg, len);
           auto const data_beg =
             reinterpret_cast<std::uint8_t*>(&data_) + offset;
           ::ZeroMemory(&data_, sizeof(data_));
@@ -114,7 +115,8 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_IMPORT_DESCRIPTOR>(*process_, base_);
+    data_ =
+      detail::ReadPeFile<IMAGE_IMPORT_DESCRIPTOR>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
@@ -233,7 +235,8 @@ public:
   void SetName(std::string const& name)
   {
     DWORD name_rva =
-      Read<DWORD>(*process_, base_ + offsetof(IMAGE_IMPORT_DESCRIPTOR, Name));
+      detail::ReadPeFile<DWORD>(
+        *process_, *pe_file_, base_ + offsetof(IMAGE_IMPORT_DESCRIPTOR, Name));
     if (!name_rva)
     {
       HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
@@ -56,7 +56,7 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_THUNK_DATA>(*process_, base_);
+    data_ = detail::ReadPeFile<IMAGE_THUNK_DATA>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
@@ -98,8 +98,8 @@ public:
       HADESMEM_DETAIL_THROW_EXCEPTION(
         Error{} << ErrorString{"Invalid import name and hint."});
     }
-    return Read<WORD>(*process_,
-                      name_import + offsetof(IMAGE_IMPORT_BY_NAME, Hint));
+    return detail::ReadPeFile<WORD>(
+      *process_, *pe_file_, name_import + offsetof(IMAGE_IMPORT_BY_NAME, Hint));
   }
 
   std::string GetName() const
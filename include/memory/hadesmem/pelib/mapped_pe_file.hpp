@@ -0,0 +1,155 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/smart_handle.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+
+namespace hadesmem
+{
+// A PE file on disk, mapped read-only into the current process and exposed as
+// a PeFileType::Data PeFile. Reads come straight from the page cache instead
+// of reading (and copying) the whole file up front, and pages which are never
+// touched are never read at all. The mapping lives as long as this object, so
+// it must outlive any pelib objects created from GetPeFile.
+//
+// The view is read-only, so the setters of the pelib classes can't be used on
+// it. The file is opened with full sharing (like std::fstream), and as with
+// any file mapping reading a page can fault if someone else truncates the
+// file while it is mapped.
+class MappedPeFile
+{
+public:
+  explicit MappedPeFile(Process const& process, std::wstring const& path)
+  {
+    if (process.GetId() != ::GetCurrentProcessId())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"Files can only be mapped locally."});
+    }
+
+    file_ = ::CreateFileW(path.c_str(),
+                          GENERIC_READ,
+                          FILE_SHARE_DELETE | FILE_SHARE_READ |
+                            FILE_SHARE_WRITE,
+                          nullptr,
+                          OPEN_EXISTING,
+                          FILE_ATTRIBUTE_NORMAL,
+                          nullptr);
+    if (!file_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"CreateFileW failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    LARGE_INTEGER file_size{};
+    if (!::GetFileSizeEx(file_.GetHandle(), &file_size))
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"GetFileSizeEx failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    // Empty files can't be mapped, and PeFile sizes are 32-bit.
+    if (file_size.QuadPart <= 0 ||
+        static_cast<std::uint64_t>(file_size.QuadPart) >
+          (std::numeric_limits<DWORD>::max)())
+    {
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"Invalid file size."});
+    }
+
+    mapping_ = ::CreateFileMappingW(
+      file_.GetHandle(), nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(
+        Error{} << ErrorString{"CreateFileMappingW failed."}
+                << ErrorCodeWinLast{last_error});
+    }
+
+    view_ = ::MapViewOfFile(mapping_.GetHandle(), FILE_MAP_READ, 0, 0, 0);
+    if (!view_.IsValid())
+    {
+      DWORD const last_error = ::GetLastError();
+      HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
+                                      << ErrorString{"MapViewOfFile failed."}
+                                      << ErrorCodeWinLast{last_error});
+    }
+
+    // Heap allocated so that the PeFile (which pelib objects point to) stays
+    // put when this is moved.
+    pe_file_ =
+      std::make_unique<PeFile>(process,
+                               view_.GetHandle(),
+                               PeFileType::Data,
+                               static_cast<DWORD>(file_size.QuadPart));
+  }
+
+  explicit MappedPeFile(Process&& process, std::wstring const& path) = delete;
+
+  MappedPeFile(MappedPeFile const& other) = delete;
+
+  MappedPeFile& operator=(MappedPeFile const& other) = delete;
+
+  MappedPeFile(MappedPeFile&& other)
+    : file_(std::move(other.file_)),
+      mapping_(std::move(other.mapping_)),
+      view_(std::move(other.view_)),
+      pe_file_(std::move(other.pe_file_))
+  {
+  }
+
+  MappedPeFile& operator=(MappedPeFile&& other)
+  {
+    pe_file_ = std::move(other.pe_file_);
+    view_ = std::move(other.view_);
+    mapping_ = std::move(other.mapping_);
+    file_ = std::move(other.file_);
+
+    return *this;
+  }
+
+  PeFile const& GetPeFile() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    HADESMEM_DETAIL_ASSERT(pe_file_);
+    return *pe_file_;
+  }
+
+  void const* GetBase() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return view_.GetHandle();
+  }
+
+  DWORD GetSize() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    HADESMEM_DETAIL_ASSERT(pe_file_);
+    return pe_file_->GetSize();
+  }
+
+private:
+  // Declared in the order they need to be created, so they are destroyed in
+  // the opposite order.
+  detail::SmartFileHandle file_;
+  detail::SmartHandle mapping_;
+  detail::SmartMapViewHandle view_;
+  std::unique_ptr<PeFile> pe_file_;
+};
+}
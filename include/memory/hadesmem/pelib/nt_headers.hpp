@@ -72,12 +72,13 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_NT_HEADERS>(*process_, base_);
+    data_ = detail::ReadPeFile<IMAGE_NT_HEADERS>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
   {
     Write(*process_, base_, data_);
+    pe_file_->Refresh();
   }
 
   bool IsValid() const
@@ -616,8 +617,16 @@ inline ULONG_PTR GetRuntimeBase(Process const& process, PeFile const& pe_file)
   case PeFileType::Image:
     return reinterpret_cast<ULONG_PTR>(pe_file.GetBase());
   case PeFileType::Data:
+  {
+    // Fall back to NtHeaders for invalid headers so the error is the same.
+    detail::PeFileHeaders const* const headers = pe_file.GetHeaders();
+    if (headers && !headers->error && headers->image_base_valid)
+    {
+      return headers->image_base;
+    }
     return NtHeaders(process, pe_file).GetImageBase();
   }
+  }
 
   HADESMEM_DETAIL_ASSERT(false);
   return 0;
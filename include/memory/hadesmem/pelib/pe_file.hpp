@@ -3,20 +3,29 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <exception>
 #include <iosfwd>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
 #include <ostream>
 #include <utility>
+#include <vector>
 
 #include <windows.h>
 #include <winnt.h>
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/query_region.hpp>
+#include <hadesmem/detail/read_impl.hpp>
 #include <hadesmem/detail/region_alloc_size.hpp>
 #include <hadesmem/error.hpp>
+#include <hadesmem/local_buffer.hpp>
 #include <hadesmem/module.hpp>
 #include <hadesmem/process.hpp>
 #include <hadesmem/region.hpp>
@@ -31,6 +40,107 @@ enum class PeFileType
   Data
 };
 
+namespace detail
+{
+// Part of the virtual range of a section. Where sections overlap the earlier
+// one in the section table wins, so each piece is the part of a section not
+// already covered by an earlier one.
+struct PeFileSectionPiece
+{
+  DWORD beg;
+  DWORD end;
+  DWORD virtual_address;
+  DWORD size_of_raw_data;
+  DWORD pointer_to_raw_data;
+};
+
+// Everything RvaToVa needs to know about a data file, read once up front.
+struct PeFileHeaders
+{
+  // Set if the DOS or NT headers couldn't be read or are invalid, in which
+  // case it is rethrown by anything that needs the headers.
+  std::exception_ptr error;
+  ULONG_PTR image_base;
+  // Whether the NT headers are valid for the current architecture (i.e.
+  // NtHeaders would accept them).
+  bool image_base_valid;
+  WORD number_of_sections;
+  DWORD size_of_headers;
+  DWORD file_alignment;
+  DWORD size_of_image;
+  // The section table starts at or past the end of the file.
+  bool virtual_section_table;
+  // Some, but not all, of the section table lies past the end of the file.
+  // Only the sections before that point are in the table below.
+  bool truncated_section_table;
+  DWORD lowest_virtual_address;
+  // Sorted by address.
+  std::vector<PeFileSectionPiece> sections;
+};
+
+// A local copy of an image, taken in one go. Anything which couldn't be read
+// at the time is left out, and reads touching it go to the process as usual.
+class PeFileSnapshot
+{
+public:
+  explicit PeFileSnapshot(std::size_t size) : data_(size)
+  {
+  }
+
+  std::uint8_t* GetData() HADESMEM_DETAIL_NOEXCEPT
+  {
+    return data_.data();
+  }
+
+  std::size_t GetSize() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return data_.size();
+  }
+
+  void AddRange(std::size_t beg, std::size_t end)
+  {
+    HADESMEM_DETAIL_ASSERT(beg < end && end <= data_.size());
+    HADESMEM_DETAIL_ASSERT(ranges_.empty() || ranges_.back().second <= beg);
+    if (!ranges_.empty() && ranges_.back().second == beg)
+    {
+      ranges_.back().second = end;
+    }
+    else
+    {
+      ranges_.emplace_back(beg, end);
+    }
+  }
+
+  // The captured data from the given offset up to the end of its range (i.e.
+  // as much as can be read locally in one go), or null if the offset wasn't
+  // captured.
+  std::uint8_t const* Find(std::size_t offset, std::size_t& available) const
+    HADESMEM_DETAIL_NOEXCEPT
+  {
+    auto iter = std::upper_bound(
+      std::begin(ranges_),
+      std::end(ranges_),
+      offset,
+      [](std::size_t lhs, std::pair<std::size_t, std::size_t> const& rhs)
+      {
+        return lhs < rhs.first;
+      });
+    if (iter == std::begin(ranges_) || offset >= (--iter)->second)
+    {
+      return nullptr;
+    }
+
+    available = iter->second - offset;
+    return data_.data() + offset;
+  }
+
+private:
+  std::vector<std::uint8_t> data_;
+  // Sorted, non-overlapping and non-adjacent [beg, end) offsets into data_.
+  std::vector<std::pair<std::size_t, std::size_t>> ranges_;
+};
+}
+
 class PeFile
 {
 public:
@@ -66,6 +176,8 @@ public:
         size_ = static_cast<DWORD>(region_alloc_size);
       }
     }
+
+    Refresh();
   }
 
   explicit PeFile(Process&& process,
@@ -88,11 +200,45 @@ public:
     return size_;
   }
 
+  // Data files have their headers parsed and cached on construction (see
+  // RvaToVa). DosHeader, NtHeaders and Section call this from UpdateWrite, so
+  // it only needs to be called directly if the headers are modified some
+  // other way (e.g. with Write). Nothing is cached for image files, because
+  // RVAs map directly to VAs.
+  void Refresh() const;
+
+  // Null for image files.
+  detail::PeFileHeaders const* GetHeaders() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return headers_.get();
+  }
+
+  // Image files only. Copies the whole image out of the process in one go
+  // (or as close to it as possible) and serves all reads made through the
+  // pelib classes from the copy instead, so walking large structures in
+  // another process (relocations, imports, etc.) doesn't cost a read per
+  // element. Writes still go to the process and aren't reflected in the
+  // snapshot, so take a new one (or discard it) after modifying the image.
+  void TakeSnapshot();
+
+  void DiscardSnapshot() HADESMEM_DETAIL_NOEXCEPT
+  {
+    snapshot_.reset();
+  }
+
+  // Null if no snapshot has been taken.
+  detail::PeFileSnapshot const* GetSnapshot() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return snapshot_.get();
+  }
+
 private:
   Process const* process_;
   PBYTE base_;
   PeFileType type_;
   DWORD size_;
+  mutable std::shared_ptr<detail::PeFileHeaders const> headers_;
+  std::shared_ptr<detail::PeFileSnapshot const> snapshot_;
 };
 
 inline bool operator==(PeFile const& lhs,
@@ -147,37 +293,329 @@ inline std::wostream& operator<<(std::wostream& lhs, PeFile const& rhs)
   return lhs;
 }
 
-inline PVOID RvaToVa(Process const& process, PeFile const& pe_file, DWORD rva)
+namespace detail
 {
-  PeFileType const type = pe_file.GetType();
-  PBYTE base = static_cast<PBYTE>(pe_file.GetBase());
+// A data file in our own address space is just a buffer owned by the caller,
+// so reads which fall inside it don't need to go through the OS at all.
+// Anything outside the buffer (e.g. structures truncated by the end of the
+// file) still takes the normal path, so behaviour for malformed files is
+// unchanged.
+inline bool IsLocalPeFile(Process const& process, PeFile const& pe_file)
+{
+  return pe_file.GetType() == PeFileType::Data &&
+         process.GetId() == ::GetCurrentProcessId();
+}
 
-  if (type == PeFileType::Data)
+// The local copy of the file (either the file itself, or its snapshot) from
+// the given address onwards, as far as it can be read in one go.
+inline LocalBuffer GetPeFileLocalBuffer(Process const& process,
+                                        PeFile const& pe_file,
+                                        void const* address)
+{
+  auto const beg = reinterpret_cast<std::uintptr_t>(pe_file.GetBase());
+  auto const cur = reinterpret_cast<std::uintptr_t>(address);
+  if (IsLocalPeFile(process, pe_file))
   {
-    if (!rva)
+    if (cur >= beg && cur - beg < pe_file.GetSize())
     {
-      return nullptr;
+      return LocalBuffer{address, pe_file.GetSize() - (cur - beg)};
+    }
+  }
+  else if (auto const snapshot = pe_file.GetSnapshot())
+  {
+    std::size_t available = 0;
+    if (cur >= beg && cur - beg < snapshot->GetSize())
+    {
+      if (auto const data = snapshot->Find(cur - beg, available))
+      {
+        return LocalBuffer{data, available};
+      }
+    }
+  }
+
+  return LocalBuffer{nullptr, 0};
+}
+
+template <typename T>
+T ReadPeFile(Process const& process, PeFile const& pe_file, void* address)
+{
+  LocalBuffer const buffer = GetPeFileLocalBuffer(process, pe_file, address);
+  if (buffer.GetSize() >= sizeof(T))
+  {
+    return Read<T>(buffer, buffer.GetBase());
+  }
+
+  return Read<T>(process, address);
+}
+
+template <typename T>
+std::vector<T> ReadPeFileVector(Process const& process,
+                                PeFile const& pe_file,
+                                void* address,
+                                std::size_t count)
+{
+  LocalBuffer const buffer = GetPeFileLocalBuffer(process, pe_file, address);
+  if (count <= buffer.GetSize() / sizeof(T))
+  {
+    return ReadVector<T>(buffer, buffer.GetBase(), count);
+  }
+
+  return ReadVector<T>(process, address, count);
+}
+
+inline std::shared_ptr<PeFileSnapshot const> CreatePeFileSnapshot(
+  Process const& process, void* base, std::size_t size)
+{
+  auto const snapshot = std::make_shared<PeFileSnapshot>(size);
+  if (!size)
+  {
+    return snapshot;
+  }
+
+  try
+  {
+    ReadImpl(process, base, snapshot->GetData(), size);
+    snapshot->AddRange(0, size);
+    return snapshot;
+  }
+  catch (Error const& /*e*/)
+  {
+  }
+
+  // Something in the image couldn't be read (e.g. a guard page), so go
+  // region by region and leave out whatever fails.
+  std::size_t offset = 0;
+  while (offset < size)
+  {
+    std::uint8_t* const cur = static_cast<std::uint8_t*>(base) + offset;
+    MEMORY_BASIC_INFORMATION mbi{};
+    try
+    {
+      mbi = Query(process, cur);
+    }
+    catch (Error const& /*e*/)
+    {
+      break;
+    }
+
+    std::size_t const region_left =
+      reinterpret_cast<std::uintptr_t>(mbi.BaseAddress) + mbi.RegionSize -
+      reinterpret_cast<std::uintptr_t>(cur);
+    std::size_t const len = (std::min)(region_left, size - offset);
+    try
+    {
+      ReadImpl(process, cur, snapshot->GetData() + offset, len);
+      snapshot->AddRange(offset, offset + len);
+    }
+    catch (Error const& /*e*/)
+    {
+    }
+
+    offset += len;
+  }
+
+  return snapshot;
+}
+}
+
+namespace detail
+{
+inline void AddPeFileSection(std::map<DWORD, PeFileSectionPiece>& pieces,
+                             IMAGE_SECTION_HEADER const& section_header)
+{
+  DWORD const virtual_beg = section_header.VirtualAddress;
+  DWORD const virtual_size = section_header.Misc.VirtualSize;
+  DWORD const raw_size = section_header.SizeOfRawData;
+  // If VirtualSize is zero then SizeOfRawData is used.
+  DWORD const virtual_end =
+    virtual_beg + (virtual_size ? virtual_size : raw_size);
+
+  DWORD beg = virtual_beg;
+  auto const next = pieces.upper_bound(beg);
+  if (next != std::begin(pieces))
+  {
+    auto const prev = std::prev(next);
+    if (prev->second.end > beg)
+    {
+      beg = prev->second.end;
+    }
+  }
+
+  // Fill in the gaps between the pieces already claimed by earlier sections.
+  while (beg < virtual_end)
+  {
+    auto const iter = pieces.lower_bound(beg);
+    if (iter != std::end(pieces) && iter->first == beg)
+    {
+      beg = iter->second.end;
+      continue;
     }
 
-    IMAGE_DOS_HEADER dos_header = Read<IMAGE_DOS_HEADER>(process, base);
+    DWORD const gap_end = iter == std::end(pieces)
+                            ? virtual_end
+                            : (std::min)(virtual_end, iter->first);
+    pieces[beg] = PeFileSectionPiece{beg,
+                                     gap_end,
+                                     virtual_beg,
+                                     raw_size,
+                                     section_header.PointerToRawData};
+    beg = gap_end;
+  }
+}
+
+inline std::shared_ptr<PeFileHeaders const>
+  ParsePeFileHeaders(Process const& process, PeFile const& pe_file)
+{
+  auto const headers = std::make_shared<PeFileHeaders>();
+  PBYTE const base = static_cast<PBYTE>(pe_file.GetBase());
+
+  try
+  {
+    IMAGE_DOS_HEADER const dos_header =
+      ReadPeFile<IMAGE_DOS_HEADER>(process, pe_file, base);
     if (dos_header.e_magic != IMAGE_DOS_SIGNATURE)
     {
       HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
                                       << ErrorString{"Invalid DOS header."});
     }
 
-    BYTE* ptr_nt_headers = base + dos_header.e_lfanew;
-    IMAGE_NT_HEADERS nt_headers =
-      Read<IMAGE_NT_HEADERS>(process, ptr_nt_headers);
+    BYTE* const ptr_nt_headers = base + dos_header.e_lfanew;
+    IMAGE_NT_HEADERS const nt_headers =
+      ReadPeFile<IMAGE_NT_HEADERS>(process, pe_file, ptr_nt_headers);
     if (nt_headers.Signature != IMAGE_NT_SIGNATURE)
     {
       HADESMEM_DETAIL_THROW_EXCEPTION(Error{}
                                       << ErrorString{"Invalid NT headers."});
     }
 
+    headers->image_base = nt_headers.OptionalHeader.ImageBase;
+    headers->image_base_valid =
+      nt_headers.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR_MAGIC &&
+#if defined(HADESMEM_DETAIL_ARCH_X86)
+      nt_headers.FileHeader.Machine == IMAGE_FILE_MACHINE_I386;
+#elif defined(HADESMEM_DETAIL_ARCH_X64)
+      nt_headers.FileHeader.Machine == IMAGE_FILE_MACHINE_AMD64;
+#else
+#error "[HadesMem] Unsupported architecture."
+#endif
+    headers->number_of_sections = nt_headers.FileHeader.NumberOfSections;
+    headers->size_of_headers = nt_headers.OptionalHeader.SizeOfHeaders;
+    headers->file_alignment = nt_headers.OptionalHeader.FileAlignment;
+    headers->size_of_image = nt_headers.OptionalHeader.SizeOfImage;
+    headers->lowest_virtual_address = (std::numeric_limits<DWORD>::max)();
+
+    auto const ptr_section_header = reinterpret_cast<PIMAGE_SECTION_HEADER>(
+      ptr_nt_headers + offsetof(IMAGE_NT_HEADERS, OptionalHeader) +
+      nt_headers.FileHeader.SizeOfOptionalHeader);
+    auto const section_table_beg =
+      reinterpret_cast<std::uintptr_t>(ptr_section_header);
+    auto const file_end =
+      reinterpret_cast<std::uintptr_t>(base) + pe_file.GetSize();
+    if (section_table_beg >= file_end)
+    {
+      headers->virtual_section_table = true;
+      return headers;
+    }
+
+    // Section headers past the end of the file are 'virtual', and any RVA
+    // not in a section before them is invalid.
+    std::size_t const num_in_file = static_cast<std::size_t>(
+      (file_end - section_table_beg) / sizeof(IMAGE_SECTION_HEADER));
+    std::size_t const num_sections =
+      (std::min)(num_in_file,
+                 static_cast<std::size_t>(headers->number_of_sections));
+    headers->truncated_section_table =
+      num_sections < headers->number_of_sections;
+
+    std::vector<IMAGE_SECTION_HEADER> const section_headers =
+      ReadPeFileVector<IMAGE_SECTION_HEADER>(
+        process, pe_file, ptr_section_header, num_sections);
+    std::map<DWORD, PeFileSectionPiece> pieces;
+    for (auto const& section_header : section_headers)
+    {
+      headers->lowest_virtual_address = (std::min)(
+        headers->lowest_virtual_address, section_header.VirtualAddress);
+      AddPeFileSection(pieces, section_header);
+    }
+
+    headers->sections.reserve(pieces.size());
+    for (auto const& piece : pieces)
+    {
+      headers->sections.push_back(piece.second);
+    }
+  }
+  catch (...)
+  {
+    headers->error = std::current_exception();
+  }
+
+  return headers;
+}
+
+inline PVOID RvaToVaHeaderRegion(PeFileHeaders const& headers,
+                                 PBYTE base,
+                                 DWORD rva)
+{
+  // Only applies in low alignment, otherwise it's invalid?
+  if (headers.file_alignment < 200)
+  {
+    return base + rva;
+  }
+  // Also only applies if the RVA is smaller than file alignment?
+  else if (rva < headers.file_alignment)
+  {
+    return base + rva;
+  }
+  else
+  {
+    return nullptr;
+  }
+}
+}
+
+inline void PeFile::TakeSnapshot()
+{
+  if (type_ != PeFileType::Image)
+  {
+    HADESMEM_DETAIL_THROW_EXCEPTION(
+      Error{} << ErrorString{"Snapshots are only supported for images."});
+  }
+
+  snapshot_ = detail::CreatePeFileSnapshot(*process_, base_, size_);
+}
+
+inline void PeFile::Refresh() const
+{
+  if (type_ == PeFileType::Data)
+  {
+    headers_ = detail::ParsePeFileHeaders(*process_, *this);
+  }
+}
+
+// For data files this only uses the headers cached in the PeFile, and finding
+// the containing section is a binary search.
+inline PVOID
+  RvaToVa(Process const& /*process*/, PeFile const& pe_file, DWORD rva)
+{
+  PeFileType const type = pe_file.GetType();
+  PBYTE base = static_cast<PBYTE>(pe_file.GetBase());
+
+  if (type == PeFileType::Data)
+  {
+    if (!rva)
+    {
+      return nullptr;
+    }
+
+    detail::PeFileHeaders const* const headers = pe_file.GetHeaders();
+    HADESMEM_DETAIL_ASSERT(headers);
+    if (headers->error)
+    {
+      std::rethrow_exception(headers->error);
+    }
+
     // Windows will load specially crafted images with no sections.
-    WORD num_sections = nt_headers.FileHeader.NumberOfSections;
-    if (!num_sections)
+    if (!headers->number_of_sections)
     {
       // In cases where the PE file has no sections it can apparently also have
       // all sorts of messed up RVAs for data dirs etc... Make sure that none of
@@ -196,36 +634,18 @@ inline PVOID RvaToVa(Process const& process, PeFile const& pe_file, DWORD rva)
     // SizeOfHeaders can be arbitrarily large, including the size of the
     // entire file. RVAs inside the headers are treated as an offset from
     // zero, rather than finding the 'true' location in a section.
-    if (rva < nt_headers.OptionalHeader.SizeOfHeaders)
+    if (rva < headers->size_of_headers)
     {
-      // Only applies in low alignment, otherwise it's invalid?
-      if (nt_headers.OptionalHeader.FileAlignment < 200)
-      {
-        return base + rva;
-      }
-      // Also only applies if the RVA is smaller than file alignment?
-      else if (rva < nt_headers.OptionalHeader.FileAlignment)
-      {
-        return base + rva;
-      }
-      else
-      {
-        return nullptr;
-      }
+      return detail::RvaToVaHeaderRegion(*headers, base, rva);
     }
 
-    if (rva > nt_headers.OptionalHeader.SizeOfImage)
+    if (rva > headers->size_of_image)
     {
       return nullptr;
     }
 
-    auto ptr_section_header = reinterpret_cast<PIMAGE_SECTION_HEADER>(
-      ptr_nt_headers + offsetof(IMAGE_NT_HEADERS, OptionalHeader) +
-      nt_headers.FileHeader.SizeOfOptionalHeader);
-    void const* const file_end =
-      static_cast<std::uint8_t*>(pe_file.GetBase()) + pe_file.GetSize();
     // Virtual section table.
-    if (ptr_section_header >= file_end)
+    if (headers->virtual_section_table)
     {
       if (rva > pe_file.GetSize())
       {
@@ -237,91 +657,67 @@ inline PVOID RvaToVa(Process const& process, PeFile const& pe_file, DWORD rva)
       }
     }
 
-    bool in_header = true;
-    for (WORD i = 0; i < num_sections; ++i)
+    auto const& sections = headers->sections;
+    auto iter =
+      std::upper_bound(std::begin(sections),
+                       std::end(sections),
+                       rva,
+                       [](DWORD lhs, detail::PeFileSectionPiece const& rhs)
+                       {
+        return lhs < rhs.beg;
+      });
+    if (iter != std::begin(sections) && rva < (--iter)->end)
     {
-      // For a virtual section header, simply return nullptr. (Similar to above,
-      // except this time only the Nth entry onwards is virtual, rather than all
-      // the headers.)
-      if (ptr_section_header + 1 > file_end)
+      rva -= iter->virtual_address;
+
+      // If the RVA is outside the raw data (which would put it in the
+      // zero-fill of the virtual data) just return nullptr because it's
+      // invalid. Technically files like this will work when loaded by the
+      // PE loader due to the sections being mapped differention in memory
+      // to on disk, but if you want to inspect the file in that manner you
+      // should just use LoadLibrary with the appropriate flags for your
+      // scenario and then use PeFileType::Image.
+      if (rva > iter->size_of_raw_data)
       {
         return nullptr;
       }
 
-      auto const section_header =
-        Read<IMAGE_SECTION_HEADER>(process, ptr_section_header);
+      // If PointerToRawData is less than 0x200 it is rounded
+      // down to 0. Safe to mask it off unconditionally because
+      // it must be a multiple of FileAlignment.
+      rva += iter->pointer_to_raw_data & ~(0x1FFUL);
 
-      DWORD const virtual_beg = section_header.VirtualAddress;
-      DWORD const virtual_size = section_header.Misc.VirtualSize;
-      DWORD const raw_size = section_header.SizeOfRawData;
-      // If VirtualSize is zero then SizeOfRawData is used.
-      DWORD const virtual_end =
-        virtual_beg + (virtual_size ? virtual_size : raw_size);
-      if (virtual_beg <= rva && rva < virtual_end)
+      // If the RVA now lies outside the actual file just return nullptr
+      // because it's invalid.
+      if (rva >= pe_file.GetSize())
       {
-        rva -= virtual_beg;
-
-        // If the RVA is outside the raw data (which would put it in the
-        // zero-fill of the virtual data) just return nullptr because it's
-        // invalid. Technically files like this will work when loaded by the
-        // PE loader due to the sections being mapped differention in memory
-        // to on disk, but if you want to inspect the file in that manner you
-        // should just use LoadLibrary with the appropriate flags for your
-        // scenario and then use PeFileType::Image.
-        if (rva > raw_size)
-        {
-          return nullptr;
-        }
-
-        // If PointerToRawData is less than 0x200 it is rounded
-        // down to 0. Safe to mask it off unconditionally because
-        // it must be a multiple of FileAlignment.
-        rva += section_header.PointerToRawData & ~(0x1FFUL);
-
-        // If the RVA now lies outside the actual file just return nullptr
-        // because it's invalid.
-        if (rva >= pe_file.GetSize())
-        {
-          return nullptr;
-        }
-
-        return base + rva;
+        return nullptr;
       }
 
-      // This should be the 'normal' case. However sometimes the RVA is at a
-      // lower address than any of the sections, so we want to detect this so we
-      // can just treat the RVA as an offset from the module base (similar to
-      // when the image is loaded).
-      if (virtual_beg <= rva)
-      {
-        in_header = false;
-      }
+      return base + rva;
+    }
 
-      ++ptr_section_header;
+    // For a virtual section header, simply return nullptr. (Similar to above,
+    // except this time only the Nth entry onwards is virtual, rather than all
+    // the headers.)
+    if (headers->truncated_section_table)
+    {
+      return nullptr;
     }
 
+    // This should be the 'normal' case. However sometimes the RVA is at a
+    // lower address than any of the sections, so we want to detect this so we
+    // can just treat the RVA as an offset from the module base (similar to
+    // when the image is loaded).
     // Doing the same thing as in the SizeOfHeaders check above because we're
     // not sure of better criteria to base it off. Perhaps it's correct now?
-    if (in_header && rva < pe_file.GetSize())
+    if (rva < headers->lowest_virtual_address && rva < pe_file.GetSize())
     {
-      // Only applies in low alignment, otherwise it's invalid?
-      if (nt_headers.OptionalHeader.FileAlignment < 200)
-      {
-        return base + rva;
-      }
-      // Also only applies if the RVA is smaller than file alignment?
-      else if (rva < nt_headers.OptionalHeader.FileAlignment)
-      {
-        return base + rva;
-      }
-      else
-      {
-        return nullptr;
-      }
+      return detail::RvaToVaHeaderRegion(*headers, base, rva);
     }
 
     // Sample: nullSOH-XP (Corkami PE Corpus)
-    if (rva < nt_headers.OptionalHeader.SizeOfImage && rva < pe_file.GetSize())
+    if (rva < headers->size_of_image && rva < pe_file.GetSize())
     {
       return base + rva;
     }
@@ -348,6 +744,18 @@ std::basic_string<CharT> CheckedReadString(Process const& process,
 {
   if (pe_file.GetType() == PeFileType::Image)
   {
+    // Only use the snapshot if the whole string (including the terminator)
+    // was captured.
+    LocalBuffer const buffer = GetPeFileLocalBuffer(process, pe_file, address);
+    if (buffer.GetSize())
+    {
+      std::basic_string<CharT> str =
+        ReadString<CharT>(buffer, buffer.GetBase());
+      if ((str.size() + 1) * sizeof(CharT) <= buffer.GetSize())
+      {
+        return str;
+      }
+    }
     return ReadString<CharT>(process, address);
   }
   else if (pe_file.GetType() == PeFileType::Data)
@@ -360,6 +768,11 @@ std::basic_string<CharT> CheckedReadString(Process const& process,
     }
     // Handle EOF termination.
     // Sample: maxsecXP.exe (Corkami PE Corpus)
+    if (IsLocalPeFile(process, pe_file) && address >= pe_file.GetBase())
+    {
+      LocalBuffer const buffer{pe_file.GetBase(), pe_file.GetSize()};
+      return ReadString<CharT>(buffer, address);
+    }
     return ReadStringBounded<CharT>(process, address, file_end);
   }
   else
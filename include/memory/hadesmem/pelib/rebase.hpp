@@ -0,0 +1,448 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include <windows.h>
+#include <winnt.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/pattern_search.hpp>
+#include <hadesmem/detail/static_assert.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+
+namespace hadesmem
+{
+// A fixup which isn't a plain 32 or 64-bit add. Only HIGH, LOW and HIGHADJ
+// end up here (HIGHADJ takes the low half of the target from the entry after
+// it, which is kept in 'adj').
+struct RelocationFixup
+{
+  std::uint8_t type;
+  std::uint16_t offset;
+  std::uint16_t adj;
+};
+
+// All the fixups which land in one block's page, split up by kind. The
+// offsets of the 32 and 64-bit fixups are sorted so runs of consecutive
+// pointers (vtables, jump tables, etc.) can be patched in one go.
+struct RelocationPage
+{
+  DWORD rva;
+  std::vector<std::uint16_t> offsets_32;
+  std::vector<std::uint16_t> offsets_64;
+  std::vector<RelocationFixup> other;
+};
+
+// The whole relocation directory of a file, decoded up front from a single
+// read. Blocks for the same page are merged. ABSOLUTE entries (padding) are
+// dropped, and entries of types which don't apply to x86 or x64 are counted
+// but otherwise ignored. Decoding stops at the first invalid block, the same
+// as RelocationBlockList.
+class RelocationPlan
+{
+public:
+  explicit RelocationPlan(Process const& process, PeFile const& pe_file)
+  {
+    NtHeaders const nt_headers{process, pe_file};
+    image_base_ = nt_headers.GetImageBase();
+
+    DWORD const data_dir_va =
+      nt_headers.GetDataDirectoryVirtualAddress(PeDataDir::BaseReloc);
+    DWORD size = nt_headers.GetDataDirectorySize(PeDataDir::BaseReloc);
+    if (!data_dir_va || !size)
+    {
+      return;
+    }
+
+    void* const base = RvaToVa(process, pe_file, data_dir_va);
+    if (!base)
+    {
+      return;
+    }
+
+    // Sample: virtrelocXP.exe
+    if (pe_file.GetType() == PeFileType::Data)
+    {
+      auto const file_beg =
+        reinterpret_cast<std::uintptr_t>(pe_file.GetBase());
+      auto const dir_beg = reinterpret_cast<std::uintptr_t>(base);
+      if (dir_beg < file_beg || dir_beg - file_beg >= pe_file.GetSize())
+      {
+        return;
+      }
+      std::uintptr_t const available = pe_file.GetSize() - (dir_beg - file_beg);
+      size = static_cast<DWORD>((std::min)(
+        static_cast<std::uintptr_t>(size), available));
+    }
+
+    std::vector<std::uint8_t> const data =
+      detail::ReadPeFileVector<std::uint8_t>(process, pe_file, base, size);
+    Decode(data.data(), data.size());
+  }
+
+  explicit RelocationPlan(Process&& process, PeFile const& pe_file) = delete;
+
+  explicit RelocationPlan(Process const& process, PeFile&& pe_file) = delete;
+
+  explicit RelocationPlan(Process&& process, PeFile&& pe_file) = delete;
+
+  // From a copy of the relocation directory (e.g. out of a dump).
+  explicit RelocationPlan(void const* reloc_dir,
+                          std::size_t size,
+                          ULONGLONG image_base)
+    : image_base_{image_base}
+  {
+    Decode(static_cast<std::uint8_t const*>(reloc_dir), size);
+  }
+
+  // The base the file was linked at, which is what a freshly mapped image is
+  // relocated from.
+  ULONGLONG GetImageBase() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return image_base_;
+  }
+
+  std::vector<RelocationPage> const& GetPages() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return pages_;
+  }
+
+  std::size_t GetNumberOfFixups() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return num_fixups_;
+  }
+
+  std::size_t GetNumberOfUnsupported() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return num_unsupported_;
+  }
+
+private:
+  void Decode(std::uint8_t const* data, std::size_t size)
+  {
+    std::map<DWORD, std::size_t> page_indexes;
+    std::size_t pos = 0;
+    while (size - pos >= sizeof(IMAGE_BASE_RELOCATION))
+    {
+      IMAGE_BASE_RELOCATION block;
+      std::memcpy(&block, data + pos, sizeof(block));
+      if (block.SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION) ||
+          block.SizeOfBlock > size - pos)
+      {
+        break;
+      }
+
+      auto const iter = page_indexes.find(block.VirtualAddress);
+      std::size_t const index =
+        iter != std::end(page_indexes) ? iter->second : pages_.size();
+      if (index == pages_.size())
+      {
+        page_indexes[block.VirtualAddress] = index;
+        pages_.emplace_back();
+        pages_.back().rva = block.VirtualAddress;
+      }
+
+      std::size_t const count =
+        (block.SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(WORD);
+      DecodeBlock(data + pos + sizeof(IMAGE_BASE_RELOCATION),
+                  count,
+                  pages_[index]);
+      pos += block.SizeOfBlock;
+    }
+
+    for (auto& page : pages_)
+    {
+      std::sort(std::begin(page.offsets_32), std::end(page.offsets_32));
+      std::sort(std::begin(page.offsets_64), std::end(page.offsets_64));
+    }
+  }
+
+  void DecodeBlock(std::uint8_t const* entries,
+                   std::size_t count,
+                   RelocationPage& page)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      WORD entry;
+      std::memcpy(&entry, entries + i * sizeof(WORD), sizeof(entry));
+      auto const type = static_cast<std::uint8_t>(entry >> 12);
+      auto const offset = static_cast<std::uint16_t>(entry & 0x0FFF);
+      switch (type)
+      {
+      case IMAGE_REL_BASED_ABSOLUTE:
+        continue;
+
+      case IMAGE_REL_BASED_HIGHLOW:
+        page.offsets_32.push_back(offset);
+        break;
+
+      case IMAGE_REL_BASED_DIR64:
+        page.offsets_64.push_back(offset);
+        break;
+
+      case IMAGE_REL_BASED_HIGH:
+      case IMAGE_REL_BASED_LOW:
+        page.other.push_back(RelocationFixup{type, offset, 0});
+        break;
+
+      case IMAGE_REL_BASED_HIGHADJ:
+        if (i + 1 >= count)
+        {
+          ++num_unsupported_;
+          continue;
+        }
+        {
+          WORD adj;
+          std::memcpy(&adj, entries + ++i * sizeof(WORD), sizeof(adj));
+          page.other.push_back(RelocationFixup{type, offset, adj});
+        }
+        break;
+
+      default:
+        ++num_unsupported_;
+        continue;
+      }
+
+      ++num_fixups_;
+    }
+  }
+
+  ULONGLONG image_base_{};
+  std::vector<RelocationPage> pages_;
+  std::size_t num_fixups_{};
+  std::size_t num_unsupported_{};
+};
+
+namespace detail
+{
+template <typename T>
+inline void AddRelocationDelta(std::uint8_t* target, T delta)
+{
+  T value;
+  std::memcpy(&value, target, sizeof(value));
+  value = static_cast<T>(value + delta);
+  std::memcpy(target, &value, sizeof(value));
+}
+
+// Applies the fixups at the given offsets (sorted) from page. The caller
+// has already dropped any which don't fit in the buffer.
+template <typename T>
+inline void AddRelocationsScalar(std::uint8_t* page,
+                                 std::uint16_t const* offsets,
+                                 std::size_t count,
+                                 T delta)
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    AddRelocationDelta(page + offsets[i], delta);
+  }
+}
+
+// Fixups are scattered, so there's nothing to gain from SIMD except where
+// a run of them covers consecutive pointers (one 16 byte add replaces four
+// or two scalar ones). Everything else takes the scalar path.
+template <typename T>
+HADESMEM_DETAIL_TARGET_SSE2 inline void
+  AddRelocationsSse2(std::uint8_t* page,
+                     std::uint16_t const* offsets,
+                     std::size_t count,
+                     T delta)
+{
+  HADESMEM_DETAIL_STATIC_ASSERT(sizeof(T) == 4 || sizeof(T) == 8);
+
+  std::size_t const kLanes = 16 / sizeof(T);
+  auto const delta_lo = static_cast<int>(delta & 0xFFFFFFFF);
+  auto const delta_hi =
+    static_cast<int>((static_cast<std::uint64_t>(delta) >> 16) >> 16);
+  __m128i const delta_vec =
+    sizeof(T) == 4 ? _mm_set1_epi32(delta_lo)
+                   : _mm_set_epi32(delta_hi, delta_lo, delta_hi, delta_lo);
+
+  std::size_t i = 0;
+  while (i + kLanes <= count)
+  {
+    bool consecutive = true;
+    for (std::size_t j = 1; j < kLanes; ++j)
+    {
+      consecutive =
+        consecutive && offsets[i + j] == offsets[i] + j * sizeof(T);
+    }
+
+    if (!consecutive)
+    {
+      AddRelocationDelta(page + offsets[i], delta);
+      ++i;
+      continue;
+    }
+
+    auto const p = reinterpret_cast<__m128i*>(page + offsets[i]);
+    __m128i const value = _mm_loadu_si128(p);
+    _mm_storeu_si128(p,
+                     sizeof(T) == 4 ? _mm_add_epi32(value, delta_vec)
+                                    : _mm_add_epi64(value, delta_vec));
+    i += kLanes;
+  }
+
+  AddRelocationsScalar(page, offsets + i, count - i, delta);
+}
+
+template <typename T>
+inline void AddRelocations(std::uint8_t* page,
+                           std::uint16_t const* offsets,
+                           std::size_t count,
+                           T delta,
+                           SimdLevel level)
+{
+  if (level != SimdLevel::kScalar)
+  {
+    AddRelocationsSse2(page, offsets, count, delta);
+  }
+  else
+  {
+    AddRelocationsScalar(page, offsets, count, delta);
+  }
+}
+
+// How many of the (sorted) offsets leave room for a T within avail bytes.
+inline std::size_t CountRelocationsInBounds(
+  std::vector<std::uint16_t> const& offsets,
+  std::size_t avail,
+  std::size_t width)
+{
+  if (avail < width)
+  {
+    return 0;
+  }
+
+  auto const iter = std::upper_bound(
+    std::begin(offsets), std::end(offsets), avail - width);
+  return static_cast<std::size_t>(std::distance(std::begin(offsets), iter));
+}
+
+inline bool ApplyOtherRelocation(std::uint8_t* page,
+                                 std::size_t avail,
+                                 RelocationFixup const& fixup,
+                                 ULONGLONG delta)
+{
+  if (avail < sizeof(WORD) || fixup.offset > avail - sizeof(WORD))
+  {
+    return false;
+  }
+
+  std::uint8_t* const target = page + fixup.offset;
+  switch (fixup.type)
+  {
+  case IMAGE_REL_BASED_HIGH:
+    AddRelocationDelta(target,
+                       static_cast<std::uint16_t>((delta >> 16) & 0xFFFF));
+    break;
+
+  case IMAGE_REL_BASED_LOW:
+    AddRelocationDelta(target, static_cast<std::uint16_t>(delta & 0xFFFF));
+    break;
+
+  case IMAGE_REL_BASED_HIGHADJ:
+  {
+    // The target is the high half of a 32-bit value whose low half is in
+    // the next entry, so carry from the low half is accounted for (the
+    // 0x8000 rounds it, as the loader does).
+    WORD high;
+    std::memcpy(&high, target, sizeof(high));
+    std::uint32_t value = (static_cast<std::uint32_t>(high) << 16) +
+                          static_cast<std::int16_t>(fixup.adj);
+    value += static_cast<std::uint32_t>(delta);
+    value += 0x8000;
+    high = static_cast<WORD>(value >> 16);
+    std::memcpy(target, &high, sizeof(high));
+    break;
+  }
+
+  default:
+    HADESMEM_DETAIL_ASSERT(false);
+    return false;
+  }
+
+  return true;
+}
+}
+
+// Adds new_base - old_base to every fixup in an image laid out as it is in
+// memory (i.e. the buffer is indexed by RVA, as in a dump or a manually
+// mapped image). For a freshly mapped image old_base is
+// plan.GetImageBase(), but an image which has already been relocated can be
+// moved again by passing the base it is currently relocated for. Fixups
+// which don't fit in the buffer are skipped, and the number skipped is
+// returned. The headers (including ImageBase) are left as they are.
+inline std::size_t ApplyRelocations(RelocationPlan const& plan,
+                                    void* image,
+                                    std::size_t size,
+                                    ULONGLONG old_base,
+                                    ULONGLONG new_base,
+                                    detail::SimdLevel level)
+{
+  ULONGLONG const delta = new_base - old_base;
+  if (!delta)
+  {
+    return 0;
+  }
+
+  auto const image_beg = static_cast<std::uint8_t*>(image);
+  std::size_t skipped = 0;
+  for (auto const& page : plan.GetPages())
+  {
+    std::size_t const avail = page.rva < size ? size - page.rva : 0;
+    std::uint8_t* const page_beg = image_beg + (avail ? page.rva : 0);
+
+    std::size_t const count_32 =
+      detail::CountRelocationsInBounds(page.offsets_32, avail, 4);
+    detail::AddRelocations(page_beg,
+                           page.offsets_32.data(),
+                           count_32,
+                           static_cast<std::uint32_t>(delta),
+                           level);
+    skipped += page.offsets_32.size() - count_32;
+
+    std::size_t const count_64 =
+      detail::CountRelocationsInBounds(page.offsets_64, avail, 8);
+    detail::AddRelocations(page_beg,
+                           page.offsets_64.data(),
+                           count_64,
+                           static_cast<std::uint64_t>(delta),
+                           level);
+    skipped += page.offsets_64.size() - count_64;
+
+    for (auto const& fixup : page.other)
+    {
+      if (!detail::ApplyOtherRelocation(page_beg, avail, fixup, delta))
+      {
+        ++skipped;
+      }
+    }
+  }
+
+  return skipped;
+}
+
+inline std::size_t ApplyRelocations(RelocationPlan const& plan,
+                                    void* image,
+                                    std::size_t size,
+                                    ULONGLONG old_base,
+                                    ULONGLONG new_base)
+{
+  return ApplyRelocations(
+    plan, image, size, old_base, new_base, detail::GetSimdLevel());
+}
+}
@@ -53,7 +53,8 @@ public:
 
   void UpdateRead()
   {
-    auto const data_tmp = Read<std::uint16_t>(*process_, base_);
+    auto const data_tmp =
+      detail::ReadPeFile<std::uint16_t>(*process_, *pe_file_, base_);
     type_ = static_cast<std::uint8_t>(data_tmp >> 12);
     offset_ = data_tmp & 0x0FFF;
   }
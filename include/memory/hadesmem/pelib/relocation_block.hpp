@@ -57,7 +57,8 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_BASE_RELOCATION>(*process_, base_);
+    data_ =
+      detail::ReadPeFile<IMAGE_BASE_RELOCATION>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
@@ -80,12 +80,14 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_SECTION_HEADER>(*process_, base_);
+    data_ =
+      detail::ReadPeFile<IMAGE_SECTION_HEADER>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
   {
     Write(*process_, base_, data_);
+    pe_file_->Refresh();
   }
 
   std::string GetName() const
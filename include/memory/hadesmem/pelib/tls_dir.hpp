@@ -60,7 +60,8 @@ public:
 
   void UpdateRead()
   {
-    data_ = Read<IMAGE_TLS_DIRECTORY>(*process_, base_);
+    data_ =
+      detail::ReadPeFile<IMAGE_TLS_DIRECTORY>(*process_, *pe_file_, base_);
   }
 
   void UpdateWrite()
@@ -107,9 +108,11 @@ public:
         Error{} << ErrorString{"TLS callbacks are invalid."});
     }
 
-    for (auto callback = Read<PIMAGE_TLS_CALLBACK>(*process_, callbacks_raw);
+    for (auto callback = detail::ReadPeFile<PIMAGE_TLS_CALLBACK>(
+           *process_, *pe_file_, callbacks_raw);
          callback;
-         callback = Read<PIMAGE_TLS_CALLBACK>(*process_, ++callbacks_raw))
+         callback = detail::ReadPeFile<PIMAGE_TLS_CALLBACK>(
+           *process_, *pe_file_, ++callbacks_raw))
     {
       DWORD_PTR const callback_offset =
         reinterpret_cast<DWORD_PTR>(callback) - image_base;
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <ostream>
 #include <string>
@@ -13,6 +14,7 @@
 
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/region_cache.hpp>
 #include <hadesmem/detail/smart_handle.hpp>
 #include <hadesmem/detail/trace.hpp>
 #include <hadesmem/detail/winapi.hpp>
@@ -28,9 +30,11 @@ public:
     CheckWoW64();
   }
 
+  // Copies refer to the same address space, so they share the region cache.
   Process(Process const& other)
     : handle_{DuplicateHandle(other.id_, other.handle_.GetHandle())},
-      id_{other.id_}
+      id_{other.id_},
+      region_cache_{other.region_cache_}
   {
   }
 
@@ -44,7 +48,8 @@ public:
 
   Process(Process&& other) HADESMEM_DETAIL_NOEXCEPT
     : handle_{std::move(other.handle_)},
-      id_{other.id_}
+      id_{other.id_},
+      region_cache_{std::move(other.region_cache_)}
   {
     other.id_ = 0;
   }
@@ -55,6 +60,7 @@ public:
 
     handle_ = std::move(other.handle_);
     id_ = other.id_;
+    region_cache_ = std::move(other.region_cache_);
 
     other.id_ = 0;
 
@@ -76,6 +82,37 @@ public:
     return handle_.GetHandle();
   }
 
+  // Opt-in cache of the region layout of the process, used to skip repeated
+  // VirtualQueryEx calls when reading and writing. Changes made through
+  // hadesmem (Protect, Alloc, Free) are invalidated automatically, but anything
+  // else changing the layout (including the process itself) is only picked up
+  // once the entries expire or the cache is invalidated explicitly. A TTL of
+  // zero means entries never expire.
+  void EnableRegionCache(std::uint64_t ttl_ms = 0)
+  {
+    SYSTEM_INFO const sys_info = detail::GetSystemInfo();
+    region_cache_ =
+      std::make_shared<detail::RegionCache>(ttl_ms, sys_info.dwPageSize);
+  }
+
+  void DisableRegionCache() HADESMEM_DETAIL_NOEXCEPT
+  {
+    region_cache_.reset();
+  }
+
+  void InvalidateRegionCache() const
+  {
+    if (region_cache_)
+    {
+      region_cache_->Invalidate();
+    }
+  }
+
+  detail::RegionCache* GetRegionCache() const HADESMEM_DETAIL_NOEXCEPT
+  {
+    return region_cache_.get();
+  }
+
   void Cleanup()
   {
     if (id_ != ::GetCurrentProcessId())
@@ -88,6 +125,7 @@ public:
     }
 
     id_ = 0;
+    region_cache_.reset();
   }
 
 private:
@@ -117,6 +155,7 @@ private:
 
       id_ = 0;
       handle_ = nullptr;
+      region_cache_.reset();
     }
   }
 
@@ -136,6 +175,7 @@ private:
 
   detail::SmartHandle handle_;
   DWORD id_;
+  std::shared_ptr<detail::RegionCache> region_cache_;
 };
 
 inline bool operator==(Process const& lhs,
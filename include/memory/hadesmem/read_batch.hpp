@@ -0,0 +1,190 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include <windows.h>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/assert.hpp>
+#include <hadesmem/detail/read_impl.hpp>
+#include <hadesmem/detail/winapi.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/process.hpp>
+
+namespace hadesmem
+{
+struct ReadBatchRequest
+{
+  PVOID address;
+  std::size_t size;
+  void* data;
+  // Set by ReadBatch.
+  bool succeeded;
+};
+
+namespace detail
+{
+// A single read covering one or more requests. The requests are
+// order[order_beg, order_end) in the plan.
+struct ReadBatchSpan
+{
+  std::uintptr_t beg;
+  std::uintptr_t size;
+  std::size_t order_beg;
+  std::size_t order_end;
+};
+
+struct ReadBatchPlan
+{
+  // Indexes of the requests to read, sorted by address.
+  std::vector<std::size_t> order;
+  std::vector<ReadBatchSpan> spans;
+};
+
+// Each request is widened to the pages it touches, and requests whose pages
+// overlap or are adjacent are merged into a single span. Widening never pulls
+// in a page the request didn't already touch, and protection is per-page, so
+// a span can only fail to read if one of its own requests would. Empty
+// requests and requests which wrap around the end of the address space are
+// left out of the plan.
+inline ReadBatchPlan
+  PlanReadBatch(std::vector<ReadBatchRequest> const& requests,
+                std::uintptr_t page_size)
+{
+  HADESMEM_DETAIL_ASSERT(page_size && !(page_size & (page_size - 1)));
+
+  ReadBatchPlan plan;
+  for (std::size_t i = 0; i < requests.size(); ++i)
+  {
+    auto const beg = reinterpret_cast<std::uintptr_t>(requests[i].address);
+    std::uintptr_t const last = beg + requests[i].size - 1;
+    if (requests[i].size && last >= beg)
+    {
+      plan.order.push_back(i);
+    }
+  }
+
+  auto const get_beg = [&](std::size_t i)
+  {
+    return reinterpret_cast<std::uintptr_t>(requests[i].address);
+  };
+  std::sort(std::begin(plan.order),
+            std::end(plan.order),
+            [&](std::size_t lhs, std::size_t rhs)
+            {
+    return get_beg(lhs) < get_beg(rhs);
+  });
+
+  std::uintptr_t const page_mask = ~(page_size - 1);
+  for (std::size_t i = 0; i < plan.order.size(); ++i)
+  {
+    auto const& request = requests[plan.order[i]];
+    std::uintptr_t const beg = get_beg(plan.order[i]) & page_mask;
+    // Work with the last page rather than the end so the top page of the
+    // address space doesn't overflow.
+    std::uintptr_t const last_page =
+      (get_beg(plan.order[i]) + request.size - 1) & page_mask;
+
+    if (!plan.spans.empty())
+    {
+      ReadBatchSpan& span = plan.spans.back();
+      std::uintptr_t const span_last_page = span.beg + span.size - page_size;
+      if (beg <= span_last_page || beg - span_last_page == page_size)
+      {
+        span.size =
+          (std::max)(span_last_page, last_page) + page_size - span.beg;
+        span.order_end = i + 1;
+        continue;
+      }
+    }
+
+    plan.spans.push_back(
+      ReadBatchSpan{beg, last_page + page_size - beg, i, i + 1});
+  }
+
+  return plan;
+}
+}
+
+// Performs many small reads with as few round trips as possible. Requests
+// are merged into page-aligned spans (see PlanReadBatch) which are each read
+// in one go. If a span can't be read in full its requests are retried
+// individually, so one bad request doesn't fail the others. Each request's
+// 'succeeded' member reports its result, and the return value is whether all
+// of them succeeded.
+inline bool ReadBatch(Process const& process,
+                      std::vector<ReadBatchRequest>& requests,
+                      std::uint32_t flags = ReadFlags::kNone)
+{
+  for (auto& request : requests)
+  {
+    HADESMEM_DETAIL_ASSERT(request.size ? request.data != nullptr : true);
+    request.succeeded = !request.size;
+  }
+
+  SYSTEM_INFO const sys_info = detail::GetSystemInfo();
+  detail::ReadBatchPlan const plan =
+    detail::PlanReadBatch(requests, sys_info.dwPageSize);
+
+  std::vector<std::uint8_t> buf;
+  for (auto const& span : plan.spans)
+  {
+    auto const order_beg = std::begin(plan.order) + span.order_beg;
+    auto const order_end = std::begin(plan.order) + span.order_end;
+
+    buf.resize(span.size);
+    bool span_succeeded = true;
+    try
+    {
+      detail::ReadImpl(process,
+                       reinterpret_cast<void*>(span.beg),
+                       buf.data(),
+                       buf.size(),
+                       flags);
+    }
+    catch (Error const& /*e*/)
+    {
+      span_succeeded = false;
+    }
+
+    for (auto iter = order_beg; iter != order_end; ++iter)
+    {
+      auto& request = requests[*iter];
+      if (span_succeeded)
+      {
+        std::size_t const offset =
+          reinterpret_cast<std::uintptr_t>(request.address) - span.beg;
+        std::memcpy(request.data, buf.data() + offset, request.size);
+        request.succeeded = true;
+        continue;
+      }
+
+      try
+      {
+        detail::ReadImpl(
+          process, request.address, request.data, request.size, flags);
+        request.succeeded = true;
+      }
+      catch (Error const& /*e*/)
+      {
+        request.succeeded = false;
+      }
+    }
+  }
+
+  return std::all_of(std::begin(requests),
+                     std::end(requests),
+                     [](ReadBatchRequest const& request)
+                     {
+    return request.succeeded;
+  });
+}
+}
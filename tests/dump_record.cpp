@@ -0,0 +1,427 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include "../examples/dump/record.hpp"
+#include "../examples/dump/record.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ios>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+
+namespace
+{
+// The text printer has to match what print.hpp printed before it went through
+// records, so these are copies of the old functions.
+template <typename T>
+std::wstring OldNamedHex(std::wstring const& name, T num, std::size_t tabs)
+{
+  std::wostringstream out;
+  out << std::wstring(tabs, '\t') << name << ": 0x" << std::hex
+      << std::setw(sizeof(num) * 2) << std::setfill(L'0') << num << '\n';
+  return out.str();
+}
+
+template <typename C>
+std::wstring
+  OldNamedHexContainer(std::wstring const& name, C const& c, std::size_t tabs)
+{
+  std::wostringstream out;
+  out << std::wstring(tabs, '\t') << name << ": " << std::hex
+      << std::setw(sizeof(typename C::value_type) * 2) << std::setfill(L'0');
+  for (auto const& e : c)
+  {
+    out << " 0x" << e;
+  }
+  out << '\n';
+  return out.str();
+}
+
+template <typename T> std::wstring NewNamedHex(T num)
+{
+  Record record{};
+  record.type = RecordType::kNamedHex;
+  record.tabs = 2;
+  record.name = MakeRecordString(L"Field");
+  SetRecordNum(record, num);
+  std::wostringstream out;
+  WriteRecordText(out, record);
+  return out.str();
+}
+
+template <typename C> std::wstring NewNamedHexContainer(C const& c)
+{
+  Record record{};
+  record.type = RecordType::kNamedHexList;
+  record.tabs = 1;
+  record.name = MakeRecordString(L"List");
+  SetRecordList(record, c);
+  std::wostringstream out;
+  WriteRecordText(out, record);
+  return out.str();
+}
+
+template <typename T> void TestNamedHexText(T num)
+{
+  BOOST_TEST(NewNamedHex(num) == OldNamedHex(L"Field", num, 2));
+}
+
+template <typename C> void TestNamedHexContainerText(C const& c)
+{
+  BOOST_TEST(NewNamedHexContainer(c) == OldNamedHexContainer(L"List", c, 1));
+}
+
+std::wstring WriteText(Record const& record)
+{
+  std::wostringstream out;
+  WriteRecordText(out, record);
+  return out.str();
+}
+
+std::string AppendJson(Record const& record)
+{
+  std::vector<char> buffer;
+  AppendRecordJson(buffer, record);
+  return std::string(buffer.begin(), buffer.end());
+}
+
+class BinaryWriter
+{
+public:
+  template <typename T> BinaryWriter& Int(T num)
+  {
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+      data.push_back(static_cast<char>((num >> (i * 8)) & 0xFF));
+    }
+    return *this;
+  }
+
+  BinaryWriter& Str(std::string const& s)
+  {
+    Int(static_cast<std::uint32_t>(s.size()));
+    data.insert(data.end(), s.begin(), s.end());
+    return *this;
+  }
+
+  std::vector<char> data;
+};
+}
+
+void TestRecordText()
+{
+  // Characters are streamed as characters, everything else (including BYTE)
+  // as a number.
+  TestNamedHexText(static_cast<std::uint8_t>(0x4C));
+  TestNamedHexText('A');
+  TestNamedHexText(static_cast<signed char>(-1));
+  TestNamedHexText(L'Z');
+  TestNamedHexText(static_cast<std::uint16_t>(0xABC));
+  TestNamedHexText(static_cast<short>(-2));
+  TestNamedHexText(static_cast<std::uint32_t>(0x1234));
+  TestNamedHexText(-3);
+  TestNamedHexText(static_cast<long>(-4));
+  TestNamedHexText(static_cast<std::uint64_t>(0x123456789ABCDEF0ULL));
+  TestNamedHexText(true);
+  BOOST_TEST(NewNamedHex(static_cast<std::uint8_t>(0x4C)) ==
+             L"\t\tField: 0x4c\n");
+  BOOST_TEST(NewNamedHex('A') == L"\t\tField: 0x0A\n");
+
+  // The width only applies to the first separator.
+  TestNamedHexContainerText(std::vector<std::uint16_t>{1, 0xABCD});
+  TestNamedHexContainerText(std::vector<std::uint32_t>{0, 0x10});
+  TestNamedHexContainerText(std::vector<std::uint8_t>{0x41, 0x7});
+  TestNamedHexContainerText(std::string("AB"));
+  BOOST_TEST(NewNamedHexContainer(std::vector<std::uint16_t>{1, 0xABCD}) ==
+             L"\tList: 0 0x1 0xabcd\n");
+
+  Record record{};
+  record.type = RecordType::kNamedHexSuffix;
+  record.tabs = 1;
+  record.name = MakeRecordString("Machine");
+  record.value = MakeRecordString("x86");
+  SetRecordNum(record, static_cast<std::uint16_t>(0x14C));
+  BOOST_TEST(WriteText(record) == L"\tMachine: 0x014c (x86)\n");
+
+  record = Record{};
+  record.type = RecordType::kNamedBool;
+  record.name = MakeRecordString(L"IsForwarded");
+  record.value_bool = true;
+  BOOST_TEST(WriteText(record) == L"IsForwarded: 1\n");
+
+  // Narrow strings are widened the same way as inserting a char const*.
+  std::string const narrow = std::string(100, 'x') + "Foo\xE9";
+  record = Record{};
+  record.type = RecordType::kNamedText;
+  record.tabs = 3;
+  record.name = MakeRecordString(L"Name");
+  record.value = MakeRecordString(narrow);
+  std::wostringstream expected;
+  expected << L"\t\t\tName: " << narrow.c_str() << L'\n';
+  BOOST_TEST(WriteText(record) == expected.str());
+
+  // The offset of a string isn't printed.
+  record = Record{};
+  record.type = RecordType::kString;
+  record.tabs = 1;
+  record.name = MakeRecordString(L"String");
+  record.value = MakeRecordString(L"Bar");
+  SetRecordNum(record, static_cast<std::uint32_t>(0x400));
+  BOOST_TEST(WriteText(record) == L"\tString: Bar\n");
+
+  record = Record{};
+  record.type = RecordType::kText;
+  record.tabs = 1;
+  record.value = MakeRecordString(L"Text");
+  BOOST_TEST(WriteText(record) == L"\tText\n");
+
+  record = Record{};
+  record.type = RecordType::kNewline;
+  BOOST_TEST(WriteText(record) == L"\n");
+
+  record = Record{};
+  record.type = RecordType::kFile;
+  record.value = MakeRecordString(L"C:\\Foo.exe");
+  BOOST_TEST(WriteText(record) == L"");
+
+  // The stream's formatting is left the way it was.
+  std::wostringstream out;
+  record = Record{};
+  record.type = RecordType::kNamedHex;
+  record.name = MakeRecordString(L"Field");
+  SetRecordNum(record, static_cast<std::uint32_t>(0xFF));
+  WriteRecordText(out, record);
+  out << 255;
+  BOOST_TEST(out.str() == L"Field: 0x000000ff\n255");
+}
+
+void TestRecordJson()
+{
+  // Fields come out in a fixed order.
+  Record record{};
+  record.type = RecordType::kString;
+  record.tabs = 2;
+  record.name = MakeRecordString(L"String");
+  record.value = MakeRecordString(L"hello");
+  SetRecordNum(record, static_cast<std::uint32_t>(0x400));
+  BOOST_TEST_EQ(AppendJson(record),
+                "{\"type\":\"string\",\"depth\":2,\"name\":\"String\","
+                "\"offset\":\"0x00000400\",\"length\":5,\"value\":\"hello\"}"
+                "\n");
+
+  record = Record{};
+  record.type = RecordType::kNamedHexSuffix;
+  record.tabs = 1;
+  record.name = MakeRecordString(L"Machine");
+  record.value = MakeRecordString("x86");
+  SetRecordNum(record, static_cast<std::uint16_t>(0x14C));
+  BOOST_TEST_EQ(AppendJson(record),
+                "{\"type\":\"hex\",\"depth\":1,\"name\":\"Machine\","
+                "\"value\":\"0x014c\",\"note\":\"x86\"}\n");
+
+  // Characters are numbers like anything else.
+  record = Record{};
+  record.type = RecordType::kNamedHex;
+  record.name = MakeRecordString(L"Char");
+  SetRecordNum(record, 'A');
+  BOOST_TEST_EQ(AppendJson(record),
+                "{\"type\":\"hex\",\"depth\":0,\"name\":\"Char\","
+                "\"value\":\"0x41\"}\n");
+
+  std::vector<std::uint16_t> const list = {1, 0xABCD};
+  record = Record{};
+  record.type = RecordType::kNamedHexList;
+  record.tabs = 2;
+  record.name = MakeRecordString(L"List");
+  SetRecordList(record, list);
+  BOOST_TEST_EQ(AppendJson(record),
+                "{\"type\":\"hex_list\",\"depth\":2,\"name\":\"List\","
+                "\"value\":[\"0x0001\",\"0xabcd\"]}\n");
+
+  record = Record{};
+  record.type = RecordType::kNamedBool;
+  record.tabs = 3;
+  record.name = MakeRecordString(L"Bool");
+  BOOST_TEST_EQ(AppendJson(record),
+                "{\"type\":\"field\",\"depth\":3,\"name\":\"Bool\","
+                "\"value\":false}\n");
+
+  record = Record{};
+  record.type = RecordType::kText;
+  record.tabs = 1;
+  record.value = MakeRecordString(L"Text");
+  BOOST_TEST_EQ(AppendJson(record),
+                "{\"type\":\"text\",\"depth\":1,\"value\":\"Text\"}\n");
+
+  record = Record{};
+  record.type = RecordType::kNewline;
+  BOOST_TEST_EQ(AppendJson(record), "");
+
+  // Escaping, and conversion to UTF-8.
+  record = Record{};
+  record.type = RecordType::kFile;
+  record.value = MakeRecordString(L"C:\\\"Foo\"\n\x1F\x7F\xE9\x20AC");
+  BOOST_TEST_EQ(AppendJson(record),
+                "{\"type\":\"file\",\"path\":"
+                "\"C:\\\\\\\"Foo\\\"\\u000a\\u001f\x7F\xC3\xA9\xE2\x82\xAC\"}"
+                "\n");
+
+  // Narrow strings are widened a char at a time, and invalid UTF-16 is
+  // replaced.
+  wchar_t const bad_utf16[] = {static_cast<wchar_t>(0xDC00),
+                               L'a',
+                               static_cast<wchar_t>(0xD800)};
+  record = Record{};
+  record.type = RecordType::kNamedText;
+  record.name = MakeRecordString("N\xE9");
+  record.value = RecordString{bad_utf16, 3, true};
+  BOOST_TEST_EQ(AppendJson(record),
+                "{\"type\":\"field\",\"depth\":0,\"name\":\"N\xC3\xA9\","
+                "\"value\":\"\xEF\xBF\xBD"
+                "a\xEF\xBF\xBD\"}\n");
+
+  // Wide strings don't need to be aligned.
+  std::vector<char> unaligned(1 + sizeof(wchar_t) * 2);
+  wchar_t const ab[] = {L'a', L'b'};
+  std::copy(reinterpret_cast<char const*>(ab),
+            reinterpret_cast<char const*>(ab) + sizeof(ab),
+            unaligned.begin() + 1);
+  record = Record{};
+  record.type = RecordType::kText;
+  record.value = RecordString{unaligned.data() + 1, 2, true};
+  BOOST_TEST_EQ(AppendJson(record),
+                "{\"type\":\"text\",\"depth\":0,\"value\":\"ab\"}\n");
+
+  if (sizeof(wchar_t) == 2)
+  {
+    wchar_t const pair[] = {static_cast<wchar_t>(0xD83D),
+                            static_cast<wchar_t>(0xDE00)};
+    record.value = RecordString{pair, 2, true};
+    BOOST_TEST_EQ(AppendJson(record),
+                  "{\"type\":\"text\",\"depth\":0,"
+                  "\"value\":\"\xF0\x9F\x98\x80\"}\n");
+  }
+}
+
+void TestRecordBinary()
+{
+  std::vector<char> buffer;
+  BinaryWriter expected;
+
+  Record record{};
+  record.type = RecordType::kNewline;
+  AppendRecordBinary(buffer, record);
+  expected.Int<std::uint8_t>(0).Int<std::uint8_t>(0);
+
+  record = Record{};
+  record.type = RecordType::kText;
+  record.tabs = 1;
+  record.value = MakeRecordString(L"\xE9t\xE9");
+  AppendRecordBinary(buffer, record);
+  expected.Int<std::uint8_t>(1).Int<std::uint8_t>(1).Str("\xC3\xA9t\xC3\xA9");
+
+  record = Record{};
+  record.type = RecordType::kNamedText;
+  record.tabs = 2;
+  record.name = MakeRecordString("Name");
+  record.value = MakeRecordString(L"");
+  AppendRecordBinary(buffer, record);
+  expected.Int<std::uint8_t>(2).Int<std::uint8_t>(2).Str("Name").Str("");
+
+  record = Record{};
+  record.type = RecordType::kNamedBool;
+  record.name = MakeRecordString(L"Bool");
+  record.value_bool = true;
+  AppendRecordBinary(buffer, record);
+  expected.Int<std::uint8_t>(3).Int<std::uint8_t>(0).Str("Bool").Int<
+    std::uint8_t>(1);
+
+  record = Record{};
+  record.type = RecordType::kNamedHex;
+  record.tabs = 2;
+  record.name = MakeRecordString(L"Hex");
+  SetRecordNum(record, static_cast<std::uint16_t>(0xABCD));
+  AppendRecordBinary(buffer, record);
+  expected.Int<std::uint8_t>(4)
+    .Int<std::uint8_t>(2)
+    .Str("Hex")
+    .Int<std::uint8_t>(2)
+    .Int<std::uint64_t>(0xABCD);
+
+  record = Record{};
+  record.type = RecordType::kNamedHexSuffix;
+  record.tabs = 1;
+  record.name = MakeRecordString(L"Machine");
+  record.value = MakeRecordString("x86");
+  SetRecordNum(record, static_cast<std::uint32_t>(0x14C));
+  AppendRecordBinary(buffer, record);
+  expected.Int<std::uint8_t>(5)
+    .Int<std::uint8_t>(1)
+    .Str("Machine")
+    .Int<std::uint8_t>(4)
+    .Int<std::uint64_t>(0x14C)
+    .Str("x86");
+
+  std::vector<std::uint16_t> const list = {1, 0xABCD, 0xFFFF};
+  record = Record{};
+  record.type = RecordType::kNamedHexList;
+  record.tabs = 2;
+  record.name = MakeRecordString(L"List");
+  SetRecordList(record, list);
+  AppendRecordBinary(buffer, record);
+  expected.Int<std::uint8_t>(6)
+    .Int<std::uint8_t>(2)
+    .Str("List")
+    .Int<std::uint8_t>(2)
+    .Int<std::uint32_t>(3)
+    .Int<std::uint64_t>(1)
+    .Int<std::uint64_t>(0xABCD)
+    .Int<std::uint64_t>(0xFFFF);
+
+  record = Record{};
+  record.type = RecordType::kFile;
+  record.value = MakeRecordString(L"C:\\Foo.exe");
+  AppendRecordBinary(buffer, record);
+  expected.Int<std::uint8_t>(7).Int<std::uint8_t>(0).Str("C:\\Foo.exe");
+
+  record = Record{};
+  record.type = RecordType::kString;
+  record.tabs = 1;
+  record.name = MakeRecordString(L"String");
+  record.value = MakeRecordString("hello");
+  SetRecordNum(record, static_cast<std::uint64_t>(0x123456789ULL));
+  AppendRecordBinary(buffer, record);
+  expected.Int<std::uint8_t>(8)
+    .Int<std::uint8_t>(1)
+    .Str("String")
+    .Int<std::uint8_t>(8)
+    .Int<std::uint64_t>(0x123456789ULL)
+    .Str("hello");
+
+  // Depth is clamped to a byte.
+  record = Record{};
+  record.type = RecordType::kNewline;
+  record.tabs = 0x100;
+  AppendRecordBinary(buffer, record);
+  expected.Int<std::uint8_t>(0).Int<std::uint8_t>(0xFF);
+
+  BOOST_TEST(buffer == expected.data);
+}
+
+int main()
+{
+  TestRecordText();
+  TestRecordJson();
+  TestRecordBinary();
+  return boost::report_errors();
+}
@@ -3,12 +3,22 @@
 
 #include <hadesmem/find_pattern.hpp>
 #include <hadesmem/find_pattern.hpp>
+#include <hadesmem/find_pattern_file.hpp>
+#include <hadesmem/find_pattern_file.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/self_path.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
 
@@ -64,6 +74,120 @@ void TestFindPattern()
                    0U),
     hadesmem::Error);
 
+  hadesmem::CompiledPattern const find_pattern_compiled{
+    L"46 ?? 6E 64 50 61 74 74 65 72 6E"};
+  BOOST_TEST_EQ(find_pattern_compiled.GetSize(), 11UL);
+  BOOST_TEST_EQ(hadesmem::Find(process,
+                               L"",
+                               find_pattern_compiled,
+                               hadesmem::PatternFlags::kScanData,
+                               0U),
+                find_pattern_string);
+  BOOST_TEST_EQ(hadesmem::Find(process,
+                               L"",
+                               find_pattern_compiled,
+                               hadesmem::PatternFlags::kScanData |
+                                 hadesmem::PatternFlags::kParallel,
+                               0U),
+                find_pattern_string);
+  // Same match when streaming the image from disk, or scanning a flat copy
+  // of it, rather than scanning the loaded module.
+  void* const find_pattern_string_rva = reinterpret_cast<void*>(
+    reinterpret_cast<std::uintptr_t>(find_pattern_string) - process_base);
+  std::wstring const self_path = hadesmem::detail::GetSelfPath();
+  BOOST_TEST_EQ(hadesmem::Find(self_path,
+                               find_pattern_compiled,
+                               hadesmem::PatternFlags::kScanData |
+                                 hadesmem::PatternFlags::kRelativeAddress),
+                find_pattern_string_rva);
+  auto const self_file = hadesmem::detail::OpenFile<char>(
+    self_path, std::ios::in | std::ios::binary);
+  std::vector<char> const self_data{std::istreambuf_iterator<char>(*self_file),
+                                    std::istreambuf_iterator<char>()};
+  BOOST_TEST_EQ(hadesmem::Find(self_data.data(),
+                               self_data.size(),
+                               find_pattern_compiled,
+                               hadesmem::PatternFlags::kScanData |
+                                 hadesmem::PatternFlags::kRelativeAddress),
+                find_pattern_string_rva);
+  BOOST_TEST_THROWS(
+    hadesmem::Find(self_path,
+                   hadesmem::CompiledPattern{
+                     L"11 22 33 44 55 66 77 88 99 AA BB CC DD EE FF"},
+                   hadesmem::PatternFlags::kThrowOnUnmatch),
+    hadesmem::Error);
+  BOOST_TEST_EQ(hadesmem::CompiledPattern{L"0x90 ?? ff"}.GetSize(), 3UL);
+  BOOST_TEST_THROWS(hadesmem::CompiledPattern{L""}, hadesmem::Error);
+  BOOST_TEST_THROWS(hadesmem::CompiledPattern{L"90 ?"}, hadesmem::Error);
+  BOOST_TEST_THROWS(hadesmem::CompiledPattern{L"90 XY"}, hadesmem::Error);
+  BOOST_TEST_THROWS(hadesmem::CompiledPattern{L"90 100"}, hadesmem::Error);
+  // Same token rules as the old std::hex based parser.
+  hadesmem::CompiledPattern const old_tokens{L"90XY 0X0f 0x0 a"};
+  std::vector<std::uint8_t> const old_tokens_data = {0x90, 0x0F, 0x00, 0x0A};
+  BOOST_TEST_EQ(old_tokens.GetSize(), 4UL);
+  BOOST_TEST_EQ(hadesmem::detail::FindRawLocal(
+                  old_tokens_data.data(),
+                  old_tokens_data.data() + old_tokens_data.size(),
+                  old_tokens),
+                old_tokens_data.data());
+  // No limit on the pattern length.
+  std::wstring long_pattern_data;
+  std::vector<std::uint8_t> long_pattern_haystack(0x1000, 0x41);
+  for (std::size_t i = 0; i < 0x300; ++i)
+  {
+    long_pattern_data += i % 3 == 1 ? L"?? " : L"42 ";
+    long_pattern_haystack[0x800 + i] = 0x42;
+  }
+  hadesmem::CompiledPattern const long_pattern{long_pattern_data};
+  BOOST_TEST_EQ(long_pattern.GetSize(), 0x300UL);
+  BOOST_TEST_EQ(hadesmem::detail::FindRawLocal(
+                  long_pattern_haystack.data(),
+                  long_pattern_haystack.data() + long_pattern_haystack.size(),
+                  long_pattern),
+                long_pattern_haystack.data() + 0x800);
+
+  hadesmem::CompiledPattern const nop_compiled{L"90"};
+  hadesmem::PatternMatchList const nops{
+    process, L"", nop_compiled, hadesmem::PatternFlags::kNone};
+  std::vector<void*> const nops_vec{std::begin(nops), std::end(nops)};
+  BOOST_TEST(nops_vec.size() >= 2);
+  BOOST_TEST_EQ(nops_vec[0], nop);
+  BOOST_TEST_EQ(nops_vec[1], nop_second);
+  BOOST_TEST(std::is_sorted(std::begin(nops_vec), std::end(nops_vec)));
+  std::vector<void*> nops_callback;
+  BOOST_TEST_EQ(hadesmem::FindAll(process,
+                                  L"",
+                                  nop_compiled,
+                                  hadesmem::PatternFlags::kNone,
+                                  [&](void* address)
+                                  {
+                  nops_callback.push_back(address);
+                }),
+                nops_vec.size());
+  BOOST_TEST(nops_callback == nops_vec);
+  hadesmem::PatternMatchList const nops_limited{
+    process,
+    L"",
+    nop_compiled,
+    hadesmem::PatternFlags::kRelativeAddress,
+    1,
+    reinterpret_cast<std::uintptr_t>(nop_second) - process_base};
+  BOOST_TEST_EQ(std::distance(std::begin(nops_limited), std::end(nops_limited)),
+                1);
+  BOOST_TEST_EQ(*std::begin(nops_limited),
+                reinterpret_cast<void*>(
+                  reinterpret_cast<std::uintptr_t>(nop_second) - process_base));
+  BOOST_TEST_THROWS(
+    hadesmem::FindAll(process,
+                      L"",
+                      hadesmem::CompiledPattern{
+                        L"11 22 33 44 55 66 77 88 99 AA BB CC DD EE FF"},
+                      hadesmem::PatternFlags::kThrowOnUnmatch,
+                      [](void*)
+                      {
+                      }),
+    hadesmem::Error);
+
   HMODULE const ntdll_mod = ::GetModuleHandleW(L"ntdll");
   BOOST_TEST_NE(ntdll_mod, static_cast<HMODULE>(nullptr));
   std::uintptr_t const ntdll_base = reinterpret_cast<std::uintptr_t>(ntdll_mod);
@@ -121,6 +245,53 @@ void TestFindPattern()
 )";
   hadesmem::FindPattern find_pattern{process, pattern_file_data, true};
   find_pattern = hadesmem::FindPattern{process, pattern_file_data, true};
+  hadesmem::FindPattern const find_pattern_parallel{
+    process, pattern_file_data, true, 4};
+  BOOST_TEST(find_pattern_parallel == find_pattern);
+
+  // First run populates the cache, second run is served from it.
+  std::wstring const cache_path = L"find_pattern_cache.bin";
+  ::DeleteFileW(cache_path.c_str());
+  hadesmem::FindPattern const find_pattern_uncached{
+    process, pattern_file_data, true, 1, cache_path};
+  BOOST_TEST(find_pattern_uncached == find_pattern);
+  BOOST_TEST(hadesmem::detail::DoesFileExist(cache_path));
+  BOOST_TEST(!hadesmem::detail::DoesFileExist(cache_path + L".tmp"));
+  hadesmem::FindPattern const find_pattern_cached{
+    process, pattern_file_data, true, 1, cache_path};
+  BOOST_TEST(find_pattern_cached == find_pattern);
+  // Move one of the cached results, so a hit can be told apart from a rescan.
+  auto cache = hadesmem::detail::ReadPatternCache(cache_path);
+  BOOST_TEST_EQ(cache.size(), 2UL);
+  auto& cache_module = cache[L""];
+  auto const cache_entry =
+    std::find_if(std::begin(cache_module.entries),
+                 std::end(cache_module.entries),
+                 [](hadesmem::detail::PatternCacheEntry const& e)
+                 {
+    return e.name == L"Nop Other";
+  });
+  BOOST_TEST(cache_entry != std::end(cache_module.entries));
+  ++cache_entry->offset;
+  hadesmem::detail::WritePatternCache(cache_path, cache);
+  hadesmem::FindPattern const find_pattern_hit{
+    process, pattern_file_data, true, 1, cache_path};
+  void* const nop_other_moved =
+    static_cast<std::uint8_t*>(find_pattern.Lookup(L"", L"Nop Other")) + 1;
+  BOOST_TEST_EQ(find_pattern_hit.Lookup(L"", L"Nop Other"), nop_other_moved);
+  BOOST_TEST_EQ(find_pattern_hit.Lookup(L"", L"First Call"),
+                find_pattern.Lookup(L"", L"First Call"));
+  // A different build of the module is a miss, so it's scanned again.
+  ++cache_module.time_date_stamp;
+  hadesmem::detail::WritePatternCache(cache_path, cache);
+  hadesmem::FindPattern const find_pattern_miss{
+    process, pattern_file_data, true, 1, cache_path};
+  BOOST_TEST(find_pattern_miss == find_pattern);
+  // Failing to write the cache isn't an error.
+  hadesmem::FindPattern const find_pattern_unwritable{
+    process, pattern_file_data, true, 1, L"does_not_exist\\cache.bin"};
+  BOOST_TEST(find_pattern_unwritable == find_pattern);
+  BOOST_TEST(::DeleteFileW(cache_path.c_str()) != FALSE);
   BOOST_TEST_EQ(find_pattern.GetModuleMap().size(), 2UL);
   BOOST_TEST_EQ(find_pattern.GetPatternMap(L"").size(), 5UL);
 
@@ -255,9 +426,100 @@ void TestFindPattern()
     hadesmem::Error);
 }
 
+void TestFindPatternParallel()
+{
+  // Big enough to be split into several chunks, and not a multiple of the
+  // chunk size, so the last chunk is a short one.
+  std::size_t const num_threads = 4;
+  std::size_t const size =
+    hadesmem::detail::kMinParallelScanChunkSize * 4 + 123;
+  std::size_t const chunk_size =
+    hadesmem::detail::GetScanChunkSize(size, num_threads);
+  BOOST_TEST(chunk_size != 0);
+  BOOST_TEST(chunk_size < size);
+
+  // One match straddling each chunk boundary, and one at the very end.
+  hadesmem::CompiledPattern const pattern{L"DE AD ?? EF 13 37 C0 DE"};
+  std::vector<std::uint8_t> const match = {
+    0xDE, 0xAD, 0x00, 0xEF, 0x13, 0x37, 0xC0, 0xDE};
+  std::vector<std::size_t> expected;
+  for (std::size_t i = chunk_size; i < size; i += chunk_size)
+  {
+    expected.push_back(i - 3);
+  }
+  expected.push_back(size - match.size());
+
+  std::vector<std::uint8_t> haystack(size);
+  auto const h_beg = haystack.data();
+  auto const h_end = haystack.data() + haystack.size();
+  auto const plant = [&](std::size_t offset, bool present)
+  {
+    for (std::size_t i = 0; i < match.size(); ++i)
+    {
+      haystack[offset + i] = present ? match[i] : 0;
+    }
+  };
+
+  // Each one on its own, so it's the first match with the chunks laid out
+  // from the start of the buffer.
+  for (auto const offset : expected)
+  {
+    plant(offset, true);
+    BOOST_TEST_EQ(
+      hadesmem::detail::FindRawLocal(h_beg, h_end, pattern, num_threads),
+      h_beg + offset);
+    plant(offset, false);
+  }
+
+  // All of them, found once each and in order.
+  for (auto const offset : expected)
+  {
+    plant(offset, true);
+  }
+  std::vector<std::size_t> found;
+  for (std::uint8_t const* cur = h_beg;;)
+  {
+    auto const iter =
+      hadesmem::detail::FindRawLocal(cur, h_end, pattern, num_threads);
+    if (!iter)
+    {
+      break;
+    }
+
+    found.push_back(static_cast<std::size_t>(iter - h_beg));
+    cur = iter + 1;
+  }
+  BOOST_TEST(found == expected);
+
+  // Same again through the public interface, reading from the buffer as if
+  // it were in another process.
+  hadesmem::Process const process{::GetCurrentProcessId()};
+  std::vector<void*> found_process;
+  std::uintptr_t start = 0;
+  while (void* const address =
+           hadesmem::Find(process,
+                          haystack.data(),
+                          haystack.size(),
+                          pattern,
+                          hadesmem::PatternFlags::kRelativeAddress |
+                            hadesmem::PatternFlags::kParallel,
+                          start))
+  {
+    found_process.push_back(address);
+    start = reinterpret_cast<std::uintptr_t>(address);
+  }
+  BOOST_TEST_EQ(found_process.size(), expected.size());
+  for (std::size_t i = 0; i < found_process.size() && i < expected.size(); ++i)
+  {
+    BOOST_TEST_EQ(reinterpret_cast<std::uintptr_t>(found_process[i]),
+                  expected[i]);
+  }
+}
+
 int main()
 {
   TestFindPattern();
+  TestFindPatternParallel();
   return boost::report_errors();
 }
 
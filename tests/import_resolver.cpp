@@ -0,0 +1,74 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include <hadesmem/import_resolver.hpp>
+#include <hadesmem/import_resolver.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+void TestImportResolver()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  hadesmem::ImportResolver resolver(process);
+
+  HMODULE const kernel32_mod = ::GetModuleHandleW(L"kernel32.dll");
+  FARPROC const get_proc_address =
+    ::GetProcAddress(kernel32_mod, "GetProcAddress");
+  BOOST_TEST_EQ(resolver.Resolve("kernel32.dll", "GetProcAddress"),
+                get_proc_address);
+  // Module names are case insensitive, and repeat lookups come from the
+  // cache.
+  BOOST_TEST_EQ(resolver.Resolve("KERNEL32.DLL", "GetProcAddress"),
+                get_proc_address);
+  BOOST_TEST(resolver.Resolve("kernel32.dll", "non_existant_export") ==
+             nullptr);
+  BOOST_TEST(resolver.Resolve("non_existant_module.dll", "GetProcAddress") ==
+             nullptr);
+
+  // Forwarded in every version of Windows we support.
+  BOOST_TEST_EQ(resolver.Resolve("kernel32.dll", "HeapAlloc"),
+                ::GetProcAddress(kernel32_mod, "HeapAlloc"));
+
+  // The loader has already filled in our IAT, so rebuilding it should give
+  // the same thing (imports which can't be resolved are left as they are).
+  hadesmem::PeFile const pe_file(
+    process, ::GetModuleHandleW(nullptr), hadesmem::PeFileType::Image, 0);
+  hadesmem::ImportAddressTable const iat =
+    resolver.BuildImportAddressTable(pe_file);
+  BOOST_TEST(iat.num_resolved > 0);
+  BOOST_TEST(!iat.data.empty());
+  std::vector<std::uint8_t> const current = hadesmem::ReadVector<std::uint8_t>(
+    process,
+    static_cast<std::uint8_t*>(pe_file.GetBase()) + iat.rva,
+    iat.data.size());
+  BOOST_TEST(iat.data == current);
+
+  // Writing it back shouldn't change anything either.
+  hadesmem::WriteImportAddressTable(process, pe_file, iat);
+  BOOST_TEST(hadesmem::ReadVector<std::uint8_t>(
+               process,
+               static_cast<std::uint8_t*>(pe_file.GetBase()) + iat.rva,
+               iat.data.size()) == current);
+
+  resolver.Refresh();
+  BOOST_TEST_EQ(resolver.Resolve("kernel32.dll", "GetProcAddress"),
+                get_proc_address);
+}
+
+int main()
+{
+  TestImportResolver();
+  return boost::report_errors();
+}
@@ -0,0 +1,205 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/instruction_relocator.hpp>
+#include <hadesmem/detail/instruction_relocator.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+void TestInstructionRelocator()
+{
+  using hadesmem::detail::RelocateInstructions;
+  using hadesmem::detail::RelocatedCode;
+
+  auto const relocate = [](std::vector<std::uint8_t> const& source,
+                           std::uint64_t source_address,
+                           std::uint64_t destination_address,
+                           std::size_t min_size,
+                           std::uint8_t mode)
+  {
+    return RelocateInstructions(source.data(),
+                                source.size(),
+                                source_address,
+                                destination_address,
+                                min_size,
+                                mode);
+  };
+  auto const append = [](std::vector<std::uint8_t>& code,
+                         std::uint64_t value,
+                         std::size_t size)
+  {
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      code.push_back(static_cast<std::uint8_t>(value >> (i * 8)));
+    }
+  };
+
+  std::uint64_t const source = 0x140001000ULL;
+  std::uint64_t const near_dest = source + 0x10000;
+  std::uint64_t const far_dest = source + 0x100000000ULL;
+
+  // Everything else is copied as is, a whole instruction at a time.
+  std::vector<std::uint8_t> const prologue = {
+    // MOV QWORD PTR [RSP+8], RBX
+    0x48, 0x89, 0x5C, 0x24, 0x08,
+    // PUSH RDI
+    0x57,
+    // SUB RSP, 0x20
+    0x48, 0x83, 0xEC, 0x20};
+  RelocatedCode relocated = relocate(prologue, source, far_dest, 6, 64);
+  BOOST_TEST_EQ(relocated.source_size, 6UL);
+  BOOST_TEST(relocated.code == std::vector<std::uint8_t>(
+                                 prologue.begin(), prologue.begin() + 6));
+
+  // Short Jcc is widened, or skips an absolute jump if that won't reach.
+  std::vector<std::uint8_t> const jz_short = {0x74, 0x10};
+  std::uint64_t const jz_target = source + 2 + 0x10;
+  std::vector<std::uint8_t> expected = {0x0F, 0x84};
+  append(expected, jz_target - (near_dest + 6), 4);
+  BOOST_TEST(relocate(jz_short, source, near_dest, 1, 64).code == expected);
+  expected = {0x75, 0x0E, 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+  append(expected, jz_target, 8);
+  BOOST_TEST(relocate(jz_short, source, far_dest, 1, 64).code == expected);
+
+  // Calls too.
+  std::vector<std::uint8_t> const call = {0xE8, 0x00, 0x01, 0x00, 0x00};
+  std::uint64_t const call_target = source + 5 + 0x100;
+  expected = {0xE8};
+  append(expected, call_target - (near_dest + 5), 4);
+  BOOST_TEST(relocate(call, source, near_dest, 1, 64).code == expected);
+  expected = {0xFF, 0x15, 0x02, 0x00, 0x00, 0x00, 0xEB, 0x08};
+  append(expected, call_target, 8);
+  BOOST_TEST(relocate(call, source, far_dest, 1, 64).code == expected);
+
+  // JRCXZ only has a short form, so it branches to a jump instead.
+  std::vector<std::uint8_t> const jrcxz = {0xE3, 0x05};
+  std::uint64_t const jrcxz_target = source + 2 + 5;
+  expected = {0xE3, 0x02, 0xEB, 0x05, 0xE9};
+  append(expected, jrcxz_target - (near_dest + 9), 4);
+  BOOST_TEST(relocate(jrcxz, source, near_dest, 1, 64).code == expected);
+  expected = {0xE3, 0x02, 0xEB, 0x0E, 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+  append(expected, jrcxz_target, 8);
+  BOOST_TEST(relocate(jrcxz, source, far_dest, 1, 64).code == expected);
+
+  // RIP-relative operands are fixed up (leaving any immediate alone), and
+  // are an error if they won't reach.
+  std::vector<std::uint8_t> const mov_rip = {
+    // MOV DWORD PTR [RIP+0x1000], 0x12345678
+    0xC7, 0x05, 0x00, 0x10, 0x00, 0x00, 0x78, 0x56, 0x34, 0x12};
+  expected = {0xC7, 0x05};
+  append(expected, source + 10 + 0x1000 - (near_dest + 10), 4);
+  append(expected, 0x12345678, 4);
+  BOOST_TEST(relocate(mov_rip, source, near_dest, 1, 64).code == expected);
+  BOOST_TEST_THROWS(relocate(mov_rip, source, far_dest, 1, 64),
+                    std::runtime_error);
+  std::vector<std::uint8_t> const mov_rax_rip = {
+    // MOV RAX, QWORD PTR [RIP+0x1000]
+    0x48, 0x8B, 0x05, 0x00, 0x10, 0x00, 0x00};
+  expected = {0x48, 0x8B, 0x05};
+  append(expected, source + 7 + 0x1000 - (near_dest + 7), 4);
+  BOOST_TEST(relocate(mov_rax_rip, source, near_dest, 1, 64).code ==
+             expected);
+  BOOST_TEST_THROWS(relocate(mov_rax_rip, source, far_dest, 1, 64),
+                    std::runtime_error);
+  // Right at the edge of the range, and just past it.
+  std::uint64_t const mov_rax_rip_target = source + 7 + 0x1000;
+  std::uint64_t const edge_dest = mov_rax_rip_target + 0x80000000ULL - 7;
+  expected = {0x48, 0x8B, 0x05, 0x00, 0x00, 0x00, 0x80};
+  BOOST_TEST(relocate(mov_rax_rip, source, edge_dest, 1, 64).code ==
+             expected);
+  BOOST_TEST_THROWS(relocate(mov_rax_rip, source, edge_dest + 1, 1, 64),
+                    std::runtime_error);
+
+  // Unless they're a LEA...
+  std::vector<std::uint8_t> const lea_rip = {
+    // LEA R8, [RIP]
+    0x4C, 0x8D, 0x05, 0x00, 0x00, 0x00, 0x00};
+  expected = {0x49, 0xB8};
+  append(expected, source + 7, 8);
+  BOOST_TEST(relocate(lea_rip, source, far_dest, 1, 64).code == expected);
+
+  // ... or an indirect jump or call (e.g. a hook which is already there).
+  std::vector<std::uint8_t> const jmp_rip = {
+    // JMP QWORD PTR [RIP]
+    0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+  std::vector<std::uint8_t> thunk = {0x50, 0x48, 0xB8};
+  append(thunk, source + 6, 8);
+  thunk.insert(thunk.end(), {0x48, 0x8B, 0x00, 0x48, 0x87, 0x04, 0x24, 0xC3});
+  BOOST_TEST(relocate(jmp_rip, source, far_dest, 1, 64).code == thunk);
+  std::vector<std::uint8_t> const call_rip = {
+    // CALL QWORD PTR [RIP]
+    0xFF, 0x15, 0x00, 0x00, 0x00, 0x00};
+  expected = {0xE8, 0x02, 0x00, 0x00, 0x00, 0xEB, 0x13};
+  expected.insert(expected.end(), thunk.begin(), thunk.end());
+  BOOST_TEST(relocate(call_rip, source, far_dest, 1, 64).code == expected);
+
+  // Branches to something which is being moved go to the copy of it.
+  std::vector<std::uint8_t> const internal = {
+    // JMP SHORT +0
+    0xEB, 0x00,
+    // NOP
+    0x90,
+    // JNZ SHORT -3
+    0x75, 0xFD};
+  expected = {0xE9, 0x00, 0x00, 0x00, 0x00, 0x90, 0x0F, 0x85};
+  append(expected, static_cast<std::uint64_t>(-7), 4);
+  relocated = relocate(internal, source, far_dest, 4, 64);
+  BOOST_TEST_EQ(relocated.source_size, 5UL);
+  BOOST_TEST(relocated.code == expected);
+  // But not to the middle of it.
+  std::vector<std::uint8_t> const into_insn = {0xEB, 0xFF, 0xC0};
+  BOOST_TEST_THROWS(relocate(into_insn, source, near_dest, 1, 64),
+                    std::runtime_error);
+  std::vector<std::uint8_t> const into_next_insn = {
+    // JMP SHORT +1
+    0xEB, 0x01,
+    // MOV RAX, RAX
+    0x48, 0x89, 0xC0};
+  BOOST_TEST_THROWS(relocate(into_next_insn, source, far_dest, 5, 64),
+                    std::runtime_error);
+  // Branching to the end of what's moved is fine though, that's back in the
+  // original code.
+  std::vector<std::uint8_t> const to_end = {
+    // JMP SHORT +3
+    0xEB, 0x03,
+    // MOV RAX, RAX
+    0x48, 0x89, 0xC0};
+  expected = {0xE9};
+  append(expected, source + 5 - (near_dest + 5), 4);
+  expected.insert(expected.end(), {0x48, 0x89, 0xC0});
+  BOOST_TEST(relocate(to_end, source, near_dest, 5, 64).code == expected);
+
+  // Everything is in range on x86.
+  std::uint64_t const source_32 = 0x00401000;
+  std::uint64_t const dest_32 = 0x7FF00000;
+  expected = {0xE9};
+  append(expected, source_32 + 2 + 0x10 - (dest_32 + 5), 4);
+  BOOST_TEST(relocate(std::vector<std::uint8_t>{0xEB, 0x10},
+                      source_32,
+                      dest_32,
+                      1,
+                      32).code == expected);
+
+  // Running out of code is an error.
+  BOOST_TEST_THROWS(relocate(prologue, source, near_dest, 11, 64),
+                    std::runtime_error);
+  BOOST_TEST_THROWS(relocate(std::vector<std::uint8_t>{0x48},
+                             source,
+                             near_dest,
+                             1,
+                             64),
+                    std::runtime_error);
+}
+
+int main()
+{
+  TestInstructionRelocator();
+  return boost::report_errors();
+}
@@ -4,11 +4,17 @@
 #include <hadesmem/patcher.hpp>
 #include <hadesmem/patcher.hpp>
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
@@ -18,10 +24,15 @@
 #include <asmjit/asmjit.h>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
+#include <hadesmem/alloc.hpp>
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/alias_cast.hpp>
+#include <hadesmem/detail/patch_plan.hpp>
+#include <hadesmem/detail/trampoline_arena.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+#include <hadesmem/write.hpp>
 
 namespace
 {
@@ -37,6 +48,12 @@ std::unique_ptr<hadesmem::PatchDetour>& GetDetour2()
   return detour;
 }
 
+std::unique_ptr<hadesmem::PatchDetour>& GetHotPatchDetour()
+{
+  static std::unique_ptr<hadesmem::PatchDetour> detour;
+  return detour;
+}
+
 hadesmem::Process& GetThisProcess()
 {
   static hadesmem::Process process(::GetCurrentProcessId());
@@ -127,6 +144,58 @@ void TestPatchRaw()
   BOOST_TEST(data == apply);
 }
 
+void TestPatchTransactionRaw()
+{
+  hadesmem::Process const& process = GetThisProcess();
+
+  hadesmem::Allocator const test_mem{process, 0x1000};
+  auto const base = static_cast<BYTE*>(test_mem.GetBase());
+  auto const orig = hadesmem::ReadVector<BYTE>(process, base, 0x20);
+
+  // Two adjacent patches (which are written together) and one on its own.
+  std::vector<BYTE> const data_1 = {0x00, 0x11, 0x22};
+  std::vector<BYTE> const data_2 = {0x33, 0x44};
+  std::vector<BYTE> const data_3 = {0x55, 0x66, 0x77};
+  hadesmem::PatchRaw patch_1{process, base, data_1};
+  hadesmem::PatchRaw patch_2{process, base + 3, data_2};
+  hadesmem::PatchRaw patch_3{process, base + 0x10, data_3};
+
+  hadesmem::PatchTransaction transaction{process};
+  transaction.Add(patch_1);
+  transaction.Add(patch_2);
+  transaction.Add(patch_3);
+  transaction.Apply();
+
+  BOOST_TEST(patch_1.IsApplied());
+  BOOST_TEST(patch_2.IsApplied());
+  BOOST_TEST(patch_3.IsApplied());
+  auto expected = orig;
+  std::copy(std::begin(data_1), std::end(data_1), std::begin(expected));
+  std::copy(std::begin(data_2), std::end(data_2), std::begin(expected) + 3);
+  std::copy(std::begin(data_3), std::end(data_3), std::begin(expected) + 0x10);
+  BOOST_TEST(hadesmem::ReadVector<BYTE>(process, base, 0x20) == expected);
+
+  // Overlapping patches are rejected without anything being written.
+  std::vector<BYTE> const data_4 = {0x88, 0x99};
+  hadesmem::PatchRaw patch_4{process, base + 0x18, data_4};
+  hadesmem::PatchRaw patch_5{process, base + 0x19, data_4};
+  hadesmem::PatchTransaction overlapping{process};
+  overlapping.Add(patch_4);
+  overlapping.Add(patch_5);
+  BOOST_TEST_THROWS(overlapping.Apply(), hadesmem::Error);
+  BOOST_TEST(!patch_4.IsApplied());
+  BOOST_TEST(!patch_5.IsApplied());
+  BOOST_TEST(hadesmem::ReadVector<BYTE>(process, base, 0x20) == expected);
+
+  // Patches which were removed on their own are skipped.
+  patch_3.Remove();
+  transaction.Remove();
+
+  BOOST_TEST(!patch_1.IsApplied());
+  BOOST_TEST(!patch_2.IsApplied());
+  BOOST_TEST(hadesmem::ReadVector<BYTE>(process, base, 0x20) == orig);
+}
+
 void GenerateBasicCall(asmjit::host::Compiler& c)
 {
   using HookMeFuncBuilderT = asmjit::FuncBuilder8<std::uint32_t,
@@ -255,6 +324,19 @@ void TestPatchDetourCommon(WrapperFunc hook_me_wrapper,
 
   BOOST_TEST_EQ(hook_me_packaged(), 0x1234UL);
 
+  hadesmem::PatchTransaction transaction{process};
+  transaction.Add(*detour_1);
+
+  transaction.Apply();
+
+  BOOST_TEST(detour_1->IsApplied());
+  BOOST_TEST_EQ(hook_me_packaged(), 0x1337UL);
+
+  transaction.Remove();
+
+  BOOST_TEST(!detour_1->IsApplied());
+  BOOST_TEST_EQ(hook_me_packaged(), 0x1234UL);
+
   detour_2 = nullptr;
   detour_1 = nullptr;
 }
@@ -397,11 +479,434 @@ void TestPatchDr()
   TestPatchDetourJmp<hadesmem::PatchDr>();
 }
 
+using HookMeHotPatchFn = std::uint32_t(__cdecl*)();
+
+extern "C" std::uint32_t __cdecl HookMeHotPatchHk()
+{
+  auto& detour = GetHotPatchDetour();
+  BOOST_TEST(detour->GetTrampoline() != nullptr);
+  auto const orig = detour->GetTrampoline<HookMeHotPatchFn>();
+  return orig() + 1;
+}
+
+void TestPatchDetourHotPatch()
+{
+  hadesmem::Process const& process = GetThisProcess();
+
+  // A hot-patchable function which returns 0x1234, with int3 padding in
+  // front of it.
+  hadesmem::Allocator const test_mem{process, 0x1000};
+  auto const base = static_cast<BYTE*>(test_mem.GetBase());
+  std::vector<BYTE> const code = {
+    0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC,
+    // XCHG AX, AX
+    0x66, 0x90,
+    // MOV EAX, 0x1234
+    0xB8, 0x34, 0x12, 0x00, 0x00,
+    // RET
+    0xC3};
+  hadesmem::WriteVector(process, base, code);
+  auto const hook_me = hadesmem::detail::AliasCast<HookMeHotPatchFn>(base + 6);
+  BOOST_TEST_EQ(hook_me(), 0x1234UL);
+
+  auto& detour = GetHotPatchDetour();
+  detour = std::make_unique<hadesmem::PatchDetour>(
+    process, hook_me, &HookMeHotPatchHk);
+  detour->Apply();
+
+  // Only the NOP is overwritten, with a JMP SHORT to the jump in the
+  // padding.
+  auto const patched = hadesmem::ReadVector<BYTE>(process, base, code.size());
+  BOOST_TEST_EQ(patched[6], 0xEB);
+  BOOST_TEST(
+    std::equal(std::begin(code) + 8, std::end(code), std::begin(patched) + 8));
+  BOOST_TEST_EQ(hook_me(), 0x1235UL);
+
+  detour->Remove();
+  BOOST_TEST(hadesmem::ReadVector<BYTE>(process, base, code.size()) == code);
+  BOOST_TEST_EQ(hook_me(), 0x1234UL);
+
+  detour = nullptr;
+}
+
+namespace
+{
+// Simulated address space for testing the trampoline arena. Addresses are
+// made up, and nothing is ever touched, so this works the same way on both
+// architectures.
+class SimulatedAddressSpace
+{
+public:
+  struct State
+  {
+    // Base and size of everything which is taken, whether by the arena or
+    // not.
+    std::map<std::uintptr_t, std::size_t> taken;
+    std::map<std::uintptr_t, std::size_t> committed;
+    std::size_t num_reserves;
+  };
+
+  explicit SimulatedAddressSpace(std::shared_ptr<State> const& state)
+    : state_{state}
+  {
+  }
+
+  std::uintptr_t TryReserve(std::uintptr_t address, std::size_t size)
+  {
+    ++state_->num_reserves;
+    if (address < GetMinimumAddress() || address > GetMaximumAddress() ||
+        GetMaximumAddress() - address < size - 1 || IsTaken(address, size))
+    {
+      return 0;
+    }
+
+    state_->taken[address] = size;
+    return address;
+  }
+
+  std::uintptr_t Reserve(std::size_t size)
+  {
+    for (std::uintptr_t address = GetMinimumAddress();
+         address < GetMaximumAddress();
+         address += 0x10000)
+    {
+      if (std::uintptr_t const new_address = TryReserve(address, size))
+      {
+        return new_address;
+      }
+    }
+
+    HADESMEM_DETAIL_THROW_EXCEPTION(hadesmem::Error{}
+                                    << hadesmem::ErrorString{"Out of memory."});
+  }
+
+  void Commit(std::uintptr_t address, std::size_t size)
+  {
+    auto const iter = state_->taken.upper_bound(address);
+    BOOST_TEST(iter != std::begin(state_->taken));
+    auto const reservation = std::prev(iter);
+    BOOST_TEST(address + size <= reservation->first + reservation->second);
+    state_->committed[reservation->first] += size;
+  }
+
+  void Release(std::uintptr_t address)
+  {
+    BOOST_TEST_EQ(state_->taken.erase(address), 1UL);
+    state_->committed.erase(address);
+  }
+
+  std::uintptr_t GetMinimumAddress() const
+  {
+    return 0x10000;
+  }
+
+  std::uintptr_t GetMaximumAddress() const
+  {
+    return 0x7FFEFFFF;
+  }
+
+  std::vector<hadesmem::detail::FreeRegion>
+    GetFreeRegions(std::uintptr_t beg, std::uintptr_t last)
+  {
+    std::vector<hadesmem::detail::FreeRegion> free_regions;
+    std::uintptr_t free_beg = GetMinimumAddress();
+    for (auto const& taken : state_->taken)
+    {
+      if (taken.first > free_beg)
+      {
+        free_regions.push_back(
+          hadesmem::detail::FreeRegion{free_beg, taken.first - free_beg});
+      }
+      free_beg = (std::max)(free_beg, taken.first + taken.second);
+    }
+    free_regions.push_back(hadesmem::detail::FreeRegion{
+      free_beg, GetMaximumAddress() - free_beg + 1});
+
+    // Only what overlaps the range, but without trimming any of it.
+    free_regions.erase(
+      std::remove_if(std::begin(free_regions),
+                     std::end(free_regions),
+                     [&](hadesmem::detail::FreeRegion const& region)
+                     {
+                       return region.base > last ||
+                              region.base + region.size <= beg;
+                     }),
+      std::end(free_regions));
+    return free_regions;
+  }
+
+private:
+  bool IsTaken(std::uintptr_t address, std::size_t size) const
+  {
+    auto iter = state_->taken.upper_bound(address);
+    if (iter != std::end(state_->taken) && iter->first < address + size)
+    {
+      return true;
+    }
+
+    if (iter == std::begin(state_->taken))
+    {
+      return false;
+    }
+
+    --iter;
+    return iter->first + iter->second > address;
+  }
+
+  std::shared_ptr<State> state_;
+};
+
+using SimulatedTrampolineArena =
+  hadesmem::detail::TrampolineArena<SimulatedAddressSpace>;
+}
+
+void TestNearAllocationCandidates()
+{
+  using hadesmem::detail::FreeRegion;
+
+  std::uintptr_t const near_address = 0x500000;
+  std::uintptr_t const range_beg = 0x400000;
+  std::uintptr_t const range_last = 0x5FFFFF;
+  std::vector<FreeRegion> const free_regions = {
+    // Runs past the end of the range.
+    FreeRegion{0x560000, 0x100000},
+    // Too small.
+    FreeRegion{0x530000, 0x8000},
+    // Has room after the address, but not (once aligned) before it.
+    FreeRegion{0x4F8000, 0x20000},
+    // Out of range.
+    FreeRegion{0x700000, 0x10000},
+    // Only just big enough.
+    FreeRegion{0x480000, 0x10001},
+    // Runs past the start of the range.
+    FreeRegion{0x3F0000, 0x30000},
+    FreeRegion{0x600000, 0},
+  };
+  std::vector<std::uintptr_t> const expected = {
+    0x500000, 0x560000, 0x480000, 0x410000};
+  BOOST_TEST(hadesmem::detail::GetNearAllocationCandidates(free_regions,
+                                                            near_address,
+                                                            range_beg,
+                                                            range_last,
+                                                            0x10000,
+                                                            0x10000) ==
+             expected);
+
+  // A region around the address gives one candidate each way.
+  std::vector<FreeRegion> const around = {FreeRegion{0x400000, 0x200000}};
+  std::vector<std::uintptr_t> const expected_around = {0x500000, 0x4F0000};
+  BOOST_TEST(hadesmem::detail::GetNearAllocationCandidates(around,
+                                                            near_address,
+                                                            range_beg,
+                                                            range_last,
+                                                            0x10000,
+                                                            0x10000) ==
+             expected_around);
+
+  BOOST_TEST(hadesmem::detail::GetNearAllocationCandidates(
+               std::vector<FreeRegion>{},
+               near_address,
+               range_beg,
+               range_last,
+               0x10000,
+               0x10000).empty());
+}
+
+void TestTrampolineArena()
+{
+  auto const state = std::make_shared<SimulatedAddressSpace::State>();
+  // Something to hook, with a "module" taking up the space after it.
+  std::uintptr_t const target = 0x10001234;
+  state->taken[0x10000000] = 0x40000;
+
+  std::uintptr_t const slab_size = 0x10000;
+  std::uintptr_t const max_distance = 0x100000;
+  auto const is_near = [&](std::uintptr_t address, std::size_t size)
+  {
+    return address >= target - max_distance &&
+           address + size - 1 <= target + max_distance;
+  };
+
+  {
+    SimulatedTrampolineArena arena{
+      SimulatedAddressSpace{state}, slab_size, 0x1000, 16, max_distance};
+
+    // Lots of small blocks only cost one slab, and only as many pages of it
+    // as they cover. Forwards is preferred.
+    std::vector<std::uintptr_t> slots;
+    for (std::size_t i = 0; i < 300; ++i)
+    {
+      std::uintptr_t const slot = arena.AllocateNear(target, 8);
+      BOOST_TEST(is_near(slot, 8));
+      BOOST_TEST(slot > target);
+      BOOST_TEST_EQ(slot % 16, 0UL);
+      slots.push_back(slot);
+    }
+    BOOST_TEST_EQ(arena.GetNumberOfSlabs(), 1UL);
+    BOOST_TEST_EQ(arena.GetNumberOfUsedSlots(), 300UL);
+    BOOST_TEST_EQ(arena.GetCommittedSize(), 0x2000UL);
+    BOOST_TEST_EQ(state->taken.size(), 2UL);
+    // Straight past the module, rather than trying each slab of it first.
+    BOOST_TEST_EQ(state->num_reserves, 1UL);
+    std::sort(std::begin(slots), std::end(slots));
+    BOOST_TEST(std::adjacent_find(std::begin(slots), std::end(slots)) ==
+               std::end(slots));
+
+    // Freed slots are reused, and bigger blocks take a run of slots.
+    arena.Free(slots[10], 8);
+    arena.Free(slots[11], 8);
+    BOOST_TEST_EQ(arena.AllocateNear(target, 8), slots[10]);
+    std::uintptr_t const big = arena.AllocateNear(target, 45);
+    BOOST_TEST(big > slots.back());
+    BOOST_TEST_EQ(arena.AllocateNear(target, 16), slots[11]);
+    BOOST_TEST_EQ(arena.GetNumberOfUsedSlots(), 303UL);
+
+    // Blocks which don't need to be near anything go wherever there's room.
+    std::uintptr_t const far_slot = arena.Allocate(45);
+    BOOST_TEST(far_slot > big);
+    BOOST_TEST_EQ(arena.GetNumberOfSlabs(), 1UL);
+    arena.Free(far_slot, 45);
+    arena.Free(big, 45);
+
+    // Something out of range of the first slab gets a slab of its own.
+    std::uintptr_t const other_target = 0x30000000;
+    std::uintptr_t const other_slot = arena.AllocateNear(other_target, 8);
+    BOOST_TEST(other_slot >= other_target &&
+               other_slot - other_target < max_distance);
+    BOOST_TEST_EQ(arena.GetNumberOfSlabs(), 2UL);
+
+    // Once there's no room in front of the target it falls back to searching
+    // backwards, and once there's no room at all it fails.
+    std::uintptr_t const blocked_target = 0x50000000;
+    state->taken[blocked_target] = max_distance + 0x10000;
+    std::uintptr_t const back_slot = arena.AllocateNear(blocked_target, 8);
+    BOOST_TEST(back_slot < blocked_target &&
+               blocked_target - back_slot <= max_distance);
+    state->taken[blocked_target - max_distance - 0x10000] = max_distance;
+    for (std::size_t i = 1; i < slab_size / 16; ++i)
+    {
+      arena.AllocateNear(blocked_target, 8);
+    }
+    BOOST_TEST_EQ(arena.GetNumberOfSlabs(), 3UL);
+    BOOST_TEST_THROWS(arena.AllocateNear(blocked_target, 8), hadesmem::Error);
+
+    // Trimming only gives back slabs with nothing left in them.
+    arena.Free(other_slot, 8);
+    arena.Trim();
+    BOOST_TEST_EQ(arena.GetNumberOfSlabs(), 2UL);
+  }
+
+  // Everything else is given back when the arena goes away.
+  BOOST_TEST_EQ(state->taken.size(), 3UL);
+  BOOST_TEST(state->committed.empty());
+}
+
+void TestPatchPlan()
+{
+  using hadesmem::detail::PatchPlan;
+
+  auto const plan = [](std::vector<std::uint8_t> const& code,
+                       std::size_t target_offset,
+                       std::size_t jump_size,
+                       std::uint8_t mode)
+  {
+    return hadesmem::detail::PlanDetourPatch(
+      code.data(), code.size(), target_offset, jump_size, mode);
+  };
+  auto const check = [](PatchPlan const& actual,
+                        std::size_t padding_size,
+                        std::size_t patch_size,
+                        bool relocate)
+  {
+    BOOST_TEST_EQ(actual.padding_size, padding_size);
+    BOOST_TEST_EQ(actual.patch_size, patch_size);
+    BOOST_TEST_EQ(actual.relocate, relocate);
+  };
+
+  // MSVC hot-patchable function. The MOV EDI, EDI doesn't do anything, so
+  // nothing needs relocating.
+  std::vector<std::uint8_t> const hot_patch = {
+    0xCC, 0xCC, 0xCC, 0xCC, 0xCC,
+    // MOV EDI, EDI
+    0x8B, 0xFF,
+    // PUSH EBP
+    0x55,
+    // MOV EBP, ESP
+    0x8B, 0xEC};
+  check(plan(hot_patch, 5, 5, 32), 5, 2, false);
+  // Unless it's x64, where it clears the top of RDI.
+  check(plan(hot_patch, 5, 5, 64), 5, 2, true);
+  // The padding has to be big enough for the jump.
+  check(plan(hot_patch, 5, 6, 64), 0, 6, true);
+  check(plan(hot_patch, 0, 5, 32), 0, 5, true);
+
+  // NOPs are only padding in front of a hot-patchable function.
+  std::vector<std::uint8_t> const nop_padding = {
+    0x90, 0x90, 0x90, 0x90, 0x90, 0x90,
+    // XCHG AX, AX
+    0x66, 0x90,
+    // RET
+    0xC3};
+  check(plan(nop_padding, 6, 6, 64), 6, 2, false);
+  std::vector<std::uint8_t> const nop_fall_through = {
+    0x90, 0x90, 0x90, 0x90, 0x90, 0x90,
+    // MOV QWORD PTR [RSP+8], RBX
+    0x48, 0x89, 0x5C, 0x24, 0x08,
+    // PUSH RDI
+    0x57};
+  check(plan(nop_fall_through, 6, 6, 64), 0, 6, true);
+
+  // Any function with int3 padding in front of it only needs the JMP SHORT
+  // moved.
+  std::vector<std::uint8_t> int3_padding = nop_fall_through;
+  std::fill(std::begin(int3_padding), std::begin(int3_padding) + 6, 0xCC);
+  check(plan(int3_padding, 6, 6, 64), 6, 2, true);
+  check(plan(int3_padding, 6, 5, 64), 5, 2, true);
+
+  // Functions which start with a NOP big enough for the jump don't need
+  // anything relocated either.
+  std::vector<std::uint8_t> const long_nop = {
+    // NOP DWORD PTR [RAX+RAX*1+0x0]
+    0x0F, 0x1F, 0x44, 0x00, 0x00,
+    // RET
+    0xC3};
+  check(plan(long_nop, 0, 5, 64), 0, 5, false);
+  check(plan(long_nop, 0, 6, 64), 0, 6, true);
+
+  // Nothing to gain from a JMP SHORT to a jump which is no bigger.
+  check(plan(int3_padding, 6, 1, 64), 0, 1, true);
+
+  // XCHG AX, AX is the 2-byte hot-patch NOP, and decodes as a NOP.
+  auto const is_no_op = [](std::vector<std::uint8_t> const& code,
+                           std::size_t size,
+                           std::uint8_t mode)
+  {
+    return hadesmem::detail::IsNoOpCode(code.data(), code.size(), size, mode);
+  };
+  std::vector<std::uint8_t> const xchg_ax_ax = {0x66, 0x90};
+  BOOST_TEST(is_no_op(xchg_ax_ax, 2, 32));
+  BOOST_TEST(is_no_op(xchg_ax_ax, 2, 64));
+  // XCHG EAX, EAX (87 C0) decodes as a NOP as well, but it clears the top of
+  // RAX on x64.
+  std::vector<std::uint8_t> const xchg_eax_eax = {0x87, 0xC0};
+  BOOST_TEST(is_no_op(xchg_eax_eax, 2, 32));
+  BOOST_TEST(!is_no_op(xchg_eax_eax, 2, 64));
+  BOOST_TEST(!is_no_op(std::vector<std::uint8_t>{0x40, 0x87, 0xC0}, 3, 64));
+  BOOST_TEST(is_no_op(std::vector<std::uint8_t>{0x66, 0x87, 0xC0}, 3, 64));
+  // The size has to end on an instruction boundary.
+  BOOST_TEST(!is_no_op(xchg_ax_ax, 1, 64));
+}
+
 int main()
 {
+  TestNearAllocationCandidates();
+  TestTrampolineArena();
+  TestPatchPlan();
   TestPatchRaw();
+  TestPatchTransactionRaw();
   TestPatchDetour();
   TestPatchInt3();
   TestPatchDr();
+  TestPatchDetourHotPatch();
   return boost::report_errors();
 }
@@ -0,0 +1,192 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/pattern_search.hpp>
+#include <hadesmem/detail/pattern_search.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+namespace
+{
+struct TestPattern
+{
+  std::vector<std::uint8_t> values;
+  std::vector<std::uint8_t> masks;
+
+  hadesmem::detail::PackedPattern GetPacked() const
+  {
+    hadesmem::detail::PackedPattern packed{
+      values.data(), masks.data(), values.size(), 0, 0};
+    hadesmem::detail::SelectPatternAnchors(masks.data(),
+                                           values.data(),
+                                           values.size(),
+                                           packed.anchor_first,
+                                           packed.anchor_second);
+    return packed;
+  }
+};
+
+std::uint8_t const* FindReference(std::vector<std::uint8_t> const& haystack,
+                                  TestPattern const& pattern)
+{
+  std::vector<std::size_t> indices(pattern.values.size());
+  for (std::size_t i = 0; i < indices.size(); ++i)
+  {
+    indices[i] = i;
+  }
+
+  auto const iter = std::search(
+    haystack.begin(),
+    haystack.end(),
+    indices.begin(),
+    indices.end(),
+    [&](std::uint8_t h_cur, std::size_t i)
+    {
+      return (h_cur & pattern.masks[i]) == pattern.values[i];
+    });
+  return iter == haystack.end() ? nullptr : haystack.data() +
+                                              (iter - haystack.begin());
+}
+
+std::vector<hadesmem::detail::SimdLevel> GetSupportedSimdLevels()
+{
+  std::vector<hadesmem::detail::SimdLevel> levels;
+  for (auto const level : {hadesmem::detail::SimdLevel::kScalar,
+                           hadesmem::detail::SimdLevel::kSse2,
+                           hadesmem::detail::SimdLevel::kAvx2})
+  {
+    if (level <= hadesmem::detail::GetSimdLevel())
+    {
+      levels.push_back(level);
+    }
+  }
+
+  return levels;
+}
+
+void CheckAllLevels(std::vector<std::uint8_t> const& haystack,
+                    TestPattern const& pattern)
+{
+  // The haystack is exactly the size of the data, so any read past the end
+  // of it shows up under a memory checker.
+  std::uint8_t const* const expected = FindReference(haystack, pattern);
+  for (auto const level : GetSupportedSimdLevels())
+  {
+    BOOST_TEST_EQ(hadesmem::detail::FindPacked(haystack.data(),
+                                               haystack.data() +
+                                                 haystack.size(),
+                                               pattern.GetPacked(),
+                                               level),
+                  expected);
+  }
+}
+
+TestPattern MakePattern(std::vector<std::uint8_t> const& data,
+                        std::size_t offset,
+                        std::size_t size,
+                        std::size_t wildcard_prefix)
+{
+  TestPattern pattern;
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    bool const wildcard = i < wildcard_prefix;
+    pattern.values.push_back(wildcard ? 0 : data[offset + i]);
+    pattern.masks.push_back(wildcard ? 0 : 0xFF);
+  }
+
+  return pattern;
+}
+}
+
+void TestPatternSearchEdges()
+{
+  // Patterns shorter and longer than a vector, taken from the very start and
+  // very end of haystacks which aren't a multiple of the vector size (so the
+  // scalar tail is always hit).
+  for (std::size_t size = 1; size <= 100; ++size)
+  {
+    std::vector<std::uint8_t> haystack(size);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      haystack[i] = static_cast<std::uint8_t>(i * 7 + 1);
+    }
+
+    std::size_t const pattern_sizes[] = {1, 2, 15, 16, 17, 31, 32, 33, 70};
+    for (auto const pattern_size : pattern_sizes)
+    {
+      if (pattern_size > size)
+      {
+        continue;
+      }
+
+      std::size_t const wildcard_prefixes[] = {0, 1, 3};
+      for (auto const wildcard_prefix : wildcard_prefixes)
+      {
+        if (wildcard_prefix >= pattern_size)
+        {
+          continue;
+        }
+
+        TestPattern const first =
+          MakePattern(haystack, 0, pattern_size, wildcard_prefix);
+        CheckAllLevels(haystack, first);
+        TestPattern const last = MakePattern(
+          haystack, size - pattern_size, pattern_size, wildcard_prefix);
+        CheckAllLevels(haystack, last);
+      }
+    }
+  }
+
+  // All wildcards matches at the start, unless the haystack is too short.
+  std::vector<std::uint8_t> const short_haystack(3, 0x41);
+  TestPattern all_wildcards;
+  all_wildcards.values.assign(4, 0);
+  all_wildcards.masks.assign(4, 0);
+  CheckAllLevels(short_haystack, all_wildcards);
+  all_wildcards.values.resize(3);
+  all_wildcards.masks.resize(3);
+  CheckAllLevels(short_haystack, all_wildcards);
+}
+
+void TestPatternSearchRandom()
+{
+  // Small alphabet, so the anchors match often and most of the work is in
+  // verification and the block/tail handoff.
+  std::mt19937 engine{0x1337};
+  for (std::size_t n = 0; n < 2000; ++n)
+  {
+    std::vector<std::uint8_t> haystack(engine() % 200);
+    for (auto& b : haystack)
+    {
+      b = static_cast<std::uint8_t>(0x41 + engine() % 3);
+    }
+
+    TestPattern pattern;
+    std::size_t const pattern_size = 1 + engine() % 40;
+    std::size_t const wildcard_prefix = engine() % 4;
+    for (std::size_t i = 0; i < pattern_size; ++i)
+    {
+      bool const wildcard = i < wildcard_prefix || engine() % 4 == 0;
+      pattern.values.push_back(
+        wildcard ? 0 : static_cast<std::uint8_t>(0x41 + engine() % 3));
+      pattern.masks.push_back(wildcard ? 0 : 0xFF);
+    }
+
+    CheckAllLevels(haystack, pattern);
+  }
+}
+
+int main()
+{
+  TestPatternSearchEdges();
+  TestPatternSearchRandom();
+  return boost::report_errors();
+}
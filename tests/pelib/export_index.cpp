@@ -0,0 +1,158 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include <hadesmem/pelib/export_index.hpp>
+#include <hadesmem/pelib/export_index.hpp>
+
+#include <set>
+#include <string>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/alias_cast.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/find_procedure.hpp>
+#include <hadesmem/module.hpp>
+#include <hadesmem/module_list.hpp>
+#include <hadesmem/pelib/export.hpp>
+#include <hadesmem/pelib/export_list.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/process.hpp>
+
+// Export something to ensure tests pass...
+extern "C" HADESMEM_DETAIL_DLLEXPORT void Dummy();
+extern "C" HADESMEM_DETAIL_DLLEXPORT void Dummy()
+{
+}
+
+void TestExportIndex()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  bool processed_one_export_index = false;
+
+  // Every lookup should give the same export as searching the ExportList.
+  hadesmem::ModuleList modules(process);
+  for (auto const& mod : modules)
+  {
+    hadesmem::PeFile const cur_pe_file(
+      process, mod.GetHandle(), hadesmem::PeFileType::Image, 0);
+
+    hadesmem::ExportList cur_export_list(process, cur_pe_file);
+    hadesmem::ExportIndex const cur_export_index(process, cur_pe_file);
+    if (std::begin(cur_export_list) == std::end(cur_export_list))
+    {
+      BOOST_TEST_EQ(cur_export_index.GetNumberOfNames(), 0U);
+      continue;
+    }
+
+    processed_one_export_index = true;
+
+    std::set<std::string> names;
+    for (auto const& e : cur_export_list)
+    {
+      hadesmem::ExportIndexEntry const* entry = nullptr;
+      if (e.ByName())
+      {
+        // Only the first export with a given name can be found by it.
+        if (!names.insert(e.GetName()).second)
+        {
+          continue;
+        }
+        entry = cur_export_index.Find(e.GetName());
+
+        // System modules have sorted name tables, so the binary search
+        // should always find the same export.
+        hadesmem::ExportIndexEntry sorted_entry{};
+        BOOST_TEST(hadesmem::detail::FindExportByNameSorted(
+          process, cur_pe_file, e.GetName(), sorted_entry));
+        BOOST_TEST_EQ(sorted_entry.procedure_number, e.GetProcedureNumber());
+      }
+      else
+      {
+        entry = cur_export_index.Find(e.GetProcedureNumber());
+      }
+
+      BOOST_TEST(entry != nullptr);
+      if (!entry)
+      {
+        continue;
+      }
+
+      BOOST_TEST_EQ(entry->procedure_number, e.GetProcedureNumber());
+      BOOST_TEST_EQ(entry->ordinal_number, e.GetOrdinalNumber());
+      BOOST_TEST_EQ(entry->by_name, e.ByName());
+      BOOST_TEST_EQ(entry->forwarded, e.IsForwarded());
+      if (e.IsForwarded())
+      {
+        BOOST_TEST_EQ(cur_export_index.GetForwarder(*entry),
+                      e.GetForwarder());
+        hadesmem::detail::ExportForwarder const forwarder =
+          hadesmem::detail::ParseExportForwarder(e.GetForwarder());
+        BOOST_TEST_EQ(forwarder.module, e.GetForwarderModule());
+        BOOST_TEST_EQ(forwarder.function, e.GetForwarderFunction());
+        BOOST_TEST_EQ(forwarder.by_ordinal, e.IsForwardedByOrdinal());
+        if (forwarder.by_ordinal)
+        {
+          BOOST_TEST_EQ(forwarder.ordinal, e.GetForwarderOrdinal());
+        }
+      }
+      else
+      {
+        BOOST_TEST_EQ(entry->rva, e.GetRva());
+        BOOST_TEST_EQ(cur_export_index.GetVa(*entry), e.GetVa());
+      }
+    }
+
+    BOOST_TEST_EQ(cur_export_index.GetNumberOfNames(), names.size());
+  }
+
+  BOOST_TEST(processed_one_export_index);
+
+  hadesmem::PeFile const pe_file(
+    process, ::GetModuleHandleW(nullptr), hadesmem::PeFileType::Image, 0);
+  hadesmem::ExportIndex const export_index(process, pe_file);
+  BOOST_TEST_EQ(hadesmem::detail::AliasCast<void*>(
+                  FindProcedure(process, export_index, "Dummy")),
+                hadesmem::detail::AliasCast<void*>(&Dummy));
+  BOOST_TEST(export_index.Find("non_existant_export") == nullptr);
+  hadesmem::ExportIndexEntry entry{};
+  BOOST_TEST(!hadesmem::detail::FindExportByNameSorted(
+    process, pe_file, "non_existant_export", entry));
+  BOOST_TEST_THROWS(FindProcedure(process, export_index, "non_existant_export"),
+                    hadesmem::Error);
+}
+
+void TestParseExportForwarder()
+{
+  hadesmem::detail::ExportForwarder const by_name =
+    hadesmem::detail::ParseExportForwarder("NTDLL.RtlAllocateHeap");
+  BOOST_TEST_EQ(by_name.module, "NTDLL");
+  BOOST_TEST_EQ(by_name.function, "RtlAllocateHeap");
+  BOOST_TEST(!by_name.by_ordinal);
+
+  // Only the last dot splits the module from the function.
+  hadesmem::detail::ExportForwarder const by_ordinal =
+    hadesmem::detail::ParseExportForwarder("api-ms-win-core-1.0.#42");
+  BOOST_TEST_EQ(by_ordinal.module, "api-ms-win-core-1.0");
+  BOOST_TEST_EQ(by_ordinal.function, "#42");
+  BOOST_TEST(by_ordinal.by_ordinal);
+  BOOST_TEST_EQ(by_ordinal.ordinal, 42);
+
+  BOOST_TEST_THROWS(hadesmem::detail::ParseExportForwarder("NTDLL"),
+                    hadesmem::Error);
+  BOOST_TEST_THROWS(hadesmem::detail::ParseExportForwarder("NTDLL."),
+                    hadesmem::Error);
+  BOOST_TEST_THROWS(hadesmem::detail::ParseExportForwarder("NTDLL.#abc"),
+                    hadesmem::Error);
+}
+
+int main()
+{
+  TestExportIndex();
+  TestParseExportForwarder();
+  return boost::report_errors();
+}
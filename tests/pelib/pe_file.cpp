@@ -4,17 +4,30 @@
 #include <hadesmem/pelib/pe_file.hpp>
 #include <hadesmem/pelib/pe_file.hpp>
 
+#include <algorithm>
+#include <ios>
+#include <iterator>
 #include <sstream>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include <hadesmem/detail/warning_disable_prefix.hpp>
 #include <boost/detail/lightweight_test.hpp>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/filesystem.hpp>
+#include <hadesmem/detail/self_path.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/module.hpp>
+#include <hadesmem/pelib/mapped_pe_file.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/section.hpp>
+#include <hadesmem/pelib/section_list.hpp>
 #include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+#include <hadesmem/write.hpp>
 
 void TestPeFile()
 {
@@ -77,8 +90,157 @@ void TestPeFile()
   BOOST_TEST_NE(test_str_1.str(), test_str_3.str());
 }
 
+namespace
+{
+int g_snapshot_test = 1;
+}
+
+void TestPeFileSnapshot()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  hadesmem::PeFile pe_file(
+    process, ::GetModuleHandleW(nullptr), hadesmem::PeFileType::Image, 0);
+  BOOST_TEST(pe_file.GetSnapshot() == nullptr);
+  pe_file.TakeSnapshot();
+  BOOST_TEST(pe_file.GetSnapshot() != nullptr);
+  BOOST_TEST_EQ(pe_file.GetSnapshot()->GetSize(), pe_file.GetSize());
+
+  hadesmem::NtHeaders const nt_headers(process, pe_file);
+  BOOST_TEST_EQ(nt_headers.GetSizeOfImage(), pe_file.GetSize());
+
+  // Reads come from the snapshot until it's discarded.
+  g_snapshot_test = 2;
+  BOOST_TEST_EQ(
+    hadesmem::detail::ReadPeFile<int>(process, pe_file, &g_snapshot_test), 1);
+  pe_file.DiscardSnapshot();
+  BOOST_TEST_EQ(
+    hadesmem::detail::ReadPeFile<int>(process, pe_file, &g_snapshot_test), 2);
+
+  hadesmem::PeFile pe_file_data(process,
+                                &g_snapshot_test,
+                                hadesmem::PeFileType::Data,
+                                sizeof(g_snapshot_test));
+  BOOST_TEST_THROWS(pe_file_data.TakeSnapshot(), hadesmem::Error);
+}
+
+void TestPeFileData()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  std::wstring const self_path = hadesmem::detail::GetSelfPath();
+  auto const self_file = hadesmem::detail::OpenFile<char>(
+    self_path, std::ios::in | std::ios::binary);
+  std::vector<char> self_data{std::istreambuf_iterator<char>(*self_file),
+                              std::istreambuf_iterator<char>()};
+
+  hadesmem::PeFile pe_file(process,
+                           self_data.data(),
+                           hadesmem::PeFileType::Data,
+                           static_cast<DWORD>(self_data.size()));
+  BOOST_TEST(pe_file.GetHeaders() != nullptr);
+
+  hadesmem::NtHeaders const nt_headers(process, pe_file);
+  BOOST_TEST_EQ(hadesmem::GetRuntimeBase(process, pe_file),
+                nt_headers.GetImageBase());
+  BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file, 0),
+                static_cast<void*>(nullptr));
+  BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file, 1),
+                static_cast<void*>(self_data.data() + 1));
+
+  // Every RVA in the raw data of a section maps to the same offset into the
+  // section's raw data in the file.
+  hadesmem::SectionList const sections(process, pe_file);
+  for (auto const& section : sections)
+  {
+    DWORD const rva = section.GetVirtualAddress();
+    DWORD const virtual_size = section.GetVirtualSize();
+    DWORD const size = virtual_size ? (std::min)(virtual_size,
+                                                 section.GetSizeOfRawData())
+                                    : section.GetSizeOfRawData();
+    if (!size)
+    {
+      continue;
+    }
+
+    char* const raw = self_data.data() + section.GetPointerToRawData();
+    BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file, rva),
+                  static_cast<void*>(raw));
+    BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file, rva + size / 2),
+                  static_cast<void*>(raw + size / 2));
+    BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file, rva + size - 1),
+                  static_cast<void*>(raw + size - 1));
+  }
+
+  BOOST_TEST_EQ(
+    hadesmem::RvaToVa(process, pe_file, nt_headers.GetSizeOfImage() + 1),
+    static_cast<void*>(nullptr));
+
+  // The headers are cached, but writing them through the pelib classes
+  // refreshes the cache.
+  hadesmem::Section section = *std::begin(sections);
+  DWORD const rva = section.GetVirtualAddress();
+  void* const va = hadesmem::RvaToVa(process, pe_file, rva);
+  void* const va_moved = static_cast<char*>(va) + 0x200;
+  DWORD const pointer_to_raw_data = section.GetPointerToRawData();
+  section.SetPointerToRawData(pointer_to_raw_data + 0x200);
+  section.UpdateWrite();
+  BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file, rva), va_moved);
+  hadesmem::NtHeaders nt_headers_new(process, pe_file);
+  nt_headers_new.SetSizeOfImage(rva - 1);
+  nt_headers_new.UpdateWrite();
+  BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file, rva),
+                static_cast<void*>(nullptr));
+  nt_headers_new.SetSizeOfImage(nt_headers.GetSizeOfImage());
+  nt_headers_new.UpdateWrite();
+  BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file, rva), va_moved);
+
+  // Anything else needs an explicit refresh.
+  IMAGE_SECTION_HEADER section_header =
+    hadesmem::Read<IMAGE_SECTION_HEADER>(process, section.GetBase());
+  section_header.PointerToRawData = pointer_to_raw_data;
+  hadesmem::Write(process, section.GetBase(), section_header);
+  BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file, rva), va_moved);
+  pe_file.Refresh();
+  BOOST_TEST_EQ(hadesmem::RvaToVa(process, pe_file, rva), va);
+}
+
+void TestMappedPeFile()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  std::wstring const self_path = hadesmem::detail::GetSelfPath();
+  auto const self_file = hadesmem::detail::OpenFile<char>(
+    self_path, std::ios::in | std::ios::binary);
+  std::vector<char> const self_data{std::istreambuf_iterator<char>(*self_file),
+                                    std::istreambuf_iterator<char>()};
+
+  hadesmem::MappedPeFile mapped_file(process, self_path);
+  BOOST_TEST_EQ(mapped_file.GetSize(), self_data.size());
+  BOOST_TEST(std::equal(std::begin(self_data),
+                        std::end(self_data),
+                        static_cast<char const*>(mapped_file.GetBase())));
+
+  // The PeFile stays put when the mapping is moved.
+  hadesmem::PeFile const* const pe_file = &mapped_file.GetPeFile();
+  hadesmem::MappedPeFile const mapped_file_moved(std::move(mapped_file));
+  BOOST_TEST_EQ(&mapped_file_moved.GetPeFile(), pe_file);
+  BOOST_TEST(pe_file->GetType() == hadesmem::PeFileType::Data);
+  BOOST_TEST_EQ(pe_file->GetBase(), mapped_file_moved.GetBase());
+
+  hadesmem::NtHeaders const nt_headers(process, *pe_file);
+  BOOST_TEST_EQ(nt_headers.GetImageBase(),
+                hadesmem::GetRuntimeBase(process, *pe_file));
+
+  BOOST_TEST_THROWS(hadesmem::MappedPeFile(process, self_path + L".missing"),
+                    hadesmem::Error);
+}
+
 int main()
 {
   TestPeFile();
+  TestPeFileData();
+  TestPeFileSnapshot();
+  TestMappedPeFile();
   return boost::report_errors();
 }
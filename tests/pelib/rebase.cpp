@@ -0,0 +1,167 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include <hadesmem/pelib/rebase.hpp>
+#include <hadesmem/pelib/rebase.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/pattern_search.hpp>
+#include <hadesmem/error.hpp>
+#include <hadesmem/pelib/nt_headers.hpp>
+#include <hadesmem/pelib/pe_file.hpp>
+#include <hadesmem/pelib/relocation.hpp>
+#include <hadesmem/pelib/relocation_block.hpp>
+#include <hadesmem/pelib/relocation_block_list.hpp>
+#include <hadesmem/pelib/relocation_list.hpp>
+#include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+
+void TestRebaseSynthetic()
+{
+  // One block covering RVA 0x1000, with a run of pointers (for the SIMD
+  // path), a 64-bit pointer, HIGH, LOW, HIGHADJ (plus its parameter) and
+  // ABSOLUTE padding.
+  WORD const entries[] = {0x3010, 0x3014, 0x3018, 0x301C, 0x3020, 0xA030,
+                          0x1040, 0x2042, 0x4044, 0x9000, 0x0000, 0x0000};
+  std::vector<std::uint8_t> dir(sizeof(IMAGE_BASE_RELOCATION) +
+                                sizeof(entries));
+  IMAGE_BASE_RELOCATION const block{
+    0x1000, static_cast<DWORD>(dir.size())};
+  std::memcpy(dir.data(), &block, sizeof(block));
+  std::memcpy(dir.data() + sizeof(block), entries, sizeof(entries));
+
+  hadesmem::RelocationPlan const plan(dir.data(), dir.size(), 0x00400000);
+  BOOST_TEST_EQ(plan.GetImageBase(), 0x00400000ULL);
+  BOOST_TEST_EQ(plan.GetNumberOfFixups(), 9UL);
+  BOOST_TEST_EQ(plan.GetNumberOfUnsupported(), 0UL);
+  BOOST_TEST_EQ(plan.GetPages().size(), 1UL);
+
+  std::vector<std::uint8_t> image(0x2000);
+  auto const write = [&](std::size_t rva, void const* data, std::size_t size)
+  {
+    std::memcpy(image.data() + rva, data, size);
+  };
+  for (DWORD i = 0; i < 5; ++i)
+  {
+    DWORD const ptr = 0x00401000 + i * 0x10;
+    write(0x1010 + i * 4, &ptr, sizeof(ptr));
+  }
+  ULONGLONG const ptr_64 = 0x00401234;
+  write(0x1030, &ptr_64, sizeof(ptr_64));
+  WORD const high = 0x0040;
+  WORD const low = 0x1000;
+  write(0x1040, &high, sizeof(high));
+  write(0x1042, &low, sizeof(low));
+  write(0x1044, &high, sizeof(high));
+  std::vector<std::uint8_t> const original = image;
+
+  hadesmem::detail::SimdLevel const levels[] = {
+    hadesmem::detail::SimdLevel::kScalar, hadesmem::detail::GetSimdLevel()};
+  for (auto const level : levels)
+  {
+    image = original;
+    BOOST_TEST_EQ(hadesmem::ApplyRelocations(
+                    plan, image.data(), image.size(), 0x00400000, 0x10018000,
+                    level),
+                  0UL);
+
+    auto const read = [&](std::size_t rva, void* data, std::size_t size)
+    {
+      std::memcpy(data, image.data() + rva, size);
+    };
+    for (DWORD i = 0; i < 5; ++i)
+    {
+      DWORD ptr = 0;
+      read(0x1010 + i * 4, &ptr, sizeof(ptr));
+      BOOST_TEST_EQ(ptr, 0x10019000UL + i * 0x10);
+    }
+    ULONGLONG new_ptr_64 = 0;
+    read(0x1030, &new_ptr_64, sizeof(new_ptr_64));
+    BOOST_TEST_EQ(new_ptr_64, 0x10019234ULL);
+    WORD new_high = 0;
+    read(0x1040, &new_high, sizeof(new_high));
+    BOOST_TEST_EQ(new_high, 0x1001);
+    WORD new_low = 0;
+    read(0x1042, &new_low, sizeof(new_low));
+    BOOST_TEST_EQ(new_low, 0x9000);
+    // 0x0040 << 16 + (short)0x9000 + delta + 0x8000, high half.
+    WORD new_high_adj = 0;
+    read(0x1044, &new_high_adj, sizeof(new_high_adj));
+    BOOST_TEST_EQ(new_high_adj, 0x1001);
+
+    // Moving it again (and back to where it started) only needs the delta.
+    BOOST_TEST_EQ(hadesmem::ApplyRelocations(
+                    plan, image.data(), image.size(), 0x10018000, 0x00400000,
+                    level),
+                  0UL);
+    BOOST_TEST(image == original);
+  }
+
+  // Fixups past the end of the buffer are skipped rather than applied.
+  image.resize(0x1032);
+  BOOST_TEST_EQ(
+    hadesmem::ApplyRelocations(
+      plan, image.data(), image.size(), 0x00400000, 0x10018000),
+    4UL);
+}
+
+void TestRebaseSelf()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  hadesmem::PeFile const pe_file(
+    process, ::GetModuleHandleW(nullptr), hadesmem::PeFileType::Image, 0);
+  hadesmem::NtHeaders const nt_headers(process, pe_file);
+  hadesmem::RelocationPlan const plan(process, pe_file);
+  BOOST_TEST_EQ(plan.GetImageBase(), nt_headers.GetImageBase());
+
+  // Every entry the lists see (other than padding) should be in the plan.
+  std::size_t num_relocations = 0;
+  hadesmem::RelocationBlockList const blocks(process, pe_file);
+  for (auto const& block : blocks)
+  {
+    hadesmem::RelocationList const relocs(process,
+                                          pe_file,
+                                          block.GetRelocationDataStart(),
+                                          block.GetNumberOfRelocations());
+    for (auto const& reloc : relocs)
+    {
+      if (reloc.GetType() != IMAGE_REL_BASED_ABSOLUTE)
+      {
+        ++num_relocations;
+      }
+    }
+  }
+  BOOST_TEST_EQ(plan.GetNumberOfFixups() + plan.GetNumberOfUnsupported(),
+                num_relocations);
+
+  // Our own image is already relocated for wherever it was loaded, so a copy
+  // of it can be moved somewhere else and back again.
+  auto const base = reinterpret_cast<ULONGLONG>(pe_file.GetBase());
+  std::vector<std::uint8_t> const original = hadesmem::ReadVector<std::uint8_t>(
+    process, pe_file.GetBase(), nt_headers.GetSizeOfImage());
+  std::vector<std::uint8_t> image = original;
+  BOOST_TEST_EQ(hadesmem::ApplyRelocations(
+                  plan, image.data(), image.size(), base, base + 0x10000000),
+                0UL);
+  BOOST_TEST(plan.GetNumberOfFixups() == 0 || image != original);
+  BOOST_TEST_EQ(hadesmem::ApplyRelocations(
+                  plan, image.data(), image.size(), base + 0x10000000, base),
+                0UL);
+  BOOST_TEST(image == original);
+}
+
+int main()
+{
+  TestRebaseSynthetic();
+  TestRebaseSelf();
+  return boost::report_errors();
+}
@@ -0,0 +1,178 @@
+// Copyright (C) 2010-2014 Joshua Boyce.
+// See the file COPYING for copying permission.
+
+#include <hadesmem/detail/printable_runs.hpp>
+#include <hadesmem/detail/printable_runs.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <hadesmem/detail/warning_disable_prefix.hpp>
+#include <boost/detail/lightweight_test.hpp>
+#include <hadesmem/detail/warning_disable_suffix.hpp>
+
+#include <hadesmem/config.hpp>
+#include <hadesmem/detail/pattern_search.hpp>
+
+namespace
+{
+typedef std::vector<std::pair<std::size_t, std::size_t>> RunList;
+
+// One character at a time, no tracker.
+RunList FindRunsReference(std::uint8_t const* beg,
+                          std::size_t size,
+                          bool wide,
+                          std::size_t min_length)
+{
+  std::size_t const char_size = wide ? 2 : 1;
+  std::size_t const count = size / char_size;
+  RunList runs;
+  std::size_t length = 0;
+  for (std::size_t i = 0; i <= count; ++i)
+  {
+    bool printable = false;
+    if (i < count)
+    {
+      std::uint32_t const c =
+        wide ? static_cast<std::uint32_t>(beg[i * 2] | (beg[i * 2 + 1] << 8))
+             : beg[i];
+      printable = c >= 0x20 && c <= 0x7E;
+    }
+
+    if (printable)
+    {
+      ++length;
+      continue;
+    }
+
+    if (length && length >= min_length)
+    {
+      runs.emplace_back((i - length) * char_size, length);
+    }
+    length = 0;
+  }
+
+  return runs;
+}
+
+void CheckAllLevels(std::uint8_t const* beg,
+                    std::size_t size,
+                    bool wide,
+                    std::size_t min_length)
+{
+  RunList const expected = FindRunsReference(beg, size, wide, min_length);
+  for (auto const level : {hadesmem::detail::SimdLevel::kScalar,
+                           hadesmem::detail::SimdLevel::kSse2,
+                           hadesmem::detail::SimdLevel::kAvx2})
+  {
+    if (level > hadesmem::detail::GetSimdLevel())
+    {
+      continue;
+    }
+
+    RunList runs;
+    hadesmem::detail::FindPrintableRuns(
+      beg,
+      size,
+      wide,
+      min_length,
+      [&](std::size_t offset, std::size_t length)
+      {
+        runs.emplace_back(offset, length);
+      },
+      level);
+    BOOST_TEST(runs == expected);
+  }
+}
+
+void CheckAllLevels(std::vector<std::uint8_t> const& data,
+                    bool wide,
+                    std::size_t min_length)
+{
+  CheckAllLevels(data.data(), data.size(), wide, min_length);
+}
+}
+
+void TestPrintableRunsBoundaries()
+{
+  // A single run of every length at every offset, in buffers of odd and
+  // even sizes either side of the 16 and 32 character blocks. Each run is
+  // checked with a minimum length of exactly its own length (so it's found)
+  // and one more (so it isn't).
+  for (std::size_t size = 1; size <= 100; ++size)
+  {
+    for (std::size_t beg = 0; beg < size; beg += 3)
+    {
+      for (std::size_t end = beg + 1; end <= size; end += 5)
+      {
+        std::vector<std::uint8_t> narrow(size, 0x00);
+        std::vector<std::uint8_t> wide(size * 2, 0x00);
+        for (std::size_t i = beg; i < end; ++i)
+        {
+          narrow[i] = static_cast<std::uint8_t>('A' + i % 26);
+          wide[i * 2] = narrow[i];
+        }
+
+        CheckAllLevels(narrow, false, end - beg);
+        CheckAllLevels(narrow, false, end - beg + 1);
+        CheckAllLevels(wide, true, end - beg);
+        CheckAllLevels(wide, true, end - beg + 1);
+      }
+    }
+  }
+
+  // Characters either side of the printable range, for both widths.
+  std::vector<std::uint8_t> const edges = {
+    0x1F, 0x20, 0x7E, 0x7F, 0x80, 0xFF, 0x20, 0x20, 0x7E, 0x7E};
+  CheckAllLevels(edges, false, 1);
+  std::vector<std::uint8_t> wide_edges;
+  std::uint16_t const wide_chars[] = {
+    0x001F, 0x0020, 0x007E, 0x007F, 0x0120, 0x2041, 0x8041, 0xFFFF, 0x0041};
+  for (std::size_t n = 0; n < 8; ++n)
+  {
+    for (auto const c : wide_chars)
+    {
+      wide_edges.push_back(static_cast<std::uint8_t>(c & 0xFF));
+      wide_edges.push_back(static_cast<std::uint8_t>(c >> 8));
+    }
+  }
+  CheckAllLevels(wide_edges, true, 1);
+}
+
+void TestPrintableRunsRandom()
+{
+  // Mostly printable, so runs are long and often span several blocks.
+  std::mt19937 engine{0x1337};
+  for (std::size_t n = 0; n < 2000; ++n)
+  {
+    std::vector<std::uint8_t> data(engine() % 300);
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+      // Wide strings at the other alignment, i.e. with the high bytes at
+      // even offsets.
+      bool const high_byte = n % 3 == 2 && i % 2 == 0;
+      data[i] = engine() % 16 == 0 || high_byte
+                  ? static_cast<std::uint8_t>(engine() % 4 ? 0 : 0x90)
+                  : static_cast<std::uint8_t>(0x20 + engine() % 0x5F);
+    }
+
+    std::size_t const min_length = engine() % 8;
+    CheckAllLevels(data, false, min_length);
+    CheckAllLevels(data, true, min_length);
+    // Odd offset (and so usually an odd size).
+    if (!data.empty())
+    {
+      CheckAllLevels(data.data() + 1, data.size() - 1, true, min_length);
+    }
+  }
+}
+
+int main()
+{
+  TestPrintableRunsBoundaries();
+  TestPrintableRunsRandom();
+  return boost::report_errors();
+}
@@ -8,9 +8,13 @@
 #include <boost/detail/lightweight_test.hpp>
 #include <hadesmem/detail/warning_disable_suffix.hpp>
 
+#include <hadesmem/alloc.hpp>
 #include <hadesmem/config.hpp>
+#include <hadesmem/detail/query_region.hpp>
 #include <hadesmem/error.hpp>
 #include <hadesmem/process.hpp>
+#include <hadesmem/read.hpp>
+#include <hadesmem/write.hpp>
 
 void TestQuery()
 {
@@ -68,10 +72,79 @@ void QueryAndProtectInvalid()
                     hadesmem::Error);
 }
 
+void TestRegionCache()
+{
+  hadesmem::Process process(::GetCurrentProcessId());
+  process.EnableRegionCache();
+  hadesmem::detail::RegionCache* const cache = process.GetRegionCache();
+  BOOST_TEST(cache != nullptr);
+
+  PVOID const address = hadesmem::Alloc(process, 0x2000);
+  PVOID const address_second = static_cast<PBYTE>(address) + 0x1000;
+  MEMORY_BASIC_INFORMATION const mbi =
+    hadesmem::detail::Query(process, address);
+  BOOST_TEST_EQ(cache->GetSize(), 1UL);
+
+  // Hits must look exactly like a real query at the same address.
+  MEMORY_BASIC_INFORMATION const mbi_second =
+    hadesmem::detail::Query(process, address_second);
+  MEMORY_BASIC_INFORMATION const mbi_second_real =
+    hadesmem::detail::QueryUncached(process, address_second);
+  BOOST_TEST_EQ(cache->GetSize(), 1UL);
+  BOOST_TEST_EQ(mbi_second.BaseAddress, mbi_second_real.BaseAddress);
+  BOOST_TEST_EQ(mbi_second.RegionSize, mbi_second_real.RegionSize);
+  BOOST_TEST_EQ(mbi_second.Protect, mbi_second_real.Protect);
+  BOOST_TEST_EQ(mbi_second.RegionSize + 0x1000, mbi.RegionSize);
+
+  // Protection changes made through hadesmem invalidate the cache.
+  BOOST_TEST(CanWrite(process, address));
+  Protect(process, address, PAGE_READONLY);
+  BOOST_TEST(!CanWrite(process, address));
+  BOOST_TEST(CanRead(process, address));
+
+  // Anything else needs explicit invalidation.
+  DWORD old_protect = 0;
+  BOOST_TEST(
+    !!::VirtualProtect(address, 0x2000, PAGE_READWRITE, &old_protect));
+  BOOST_TEST(!CanWrite(process, address));
+  std::uint64_t const epoch = cache->GetEpoch();
+  process.InvalidateRegionCache();
+  BOOST_TEST_EQ(cache->GetEpoch(), epoch + 1);
+  BOOST_TEST_EQ(cache->GetSize(), 0UL);
+  BOOST_TEST(CanWrite(process, address));
+
+  // Guarded reads and writes put the protection back as it was, so they
+  // leave the cache alone.
+  Protect(process, address, PAGE_NOACCESS);
+  BOOST_TEST(!CanRead(process, address));
+  std::size_t const cache_size = cache->GetSize();
+  hadesmem::Write(process, address, 0x12345678);
+  BOOST_TEST_EQ(hadesmem::Read<int>(process, address), 0x12345678);
+  BOOST_TEST_EQ(cache->GetSize(), cache_size);
+  MEMORY_BASIC_INFORMATION mbi_cached{};
+  BOOST_TEST(cache->Lookup(address, 0, mbi_cached));
+  BOOST_TEST_EQ(mbi_cached.Protect, static_cast<DWORD>(PAGE_NOACCESS));
+  BOOST_TEST_EQ(hadesmem::detail::QueryUncached(process, address).Protect,
+                static_cast<DWORD>(PAGE_NOACCESS));
+
+  // Copies share the cache.
+  hadesmem::Process const process_copy(process);
+  BOOST_TEST_EQ(process_copy.GetRegionCache(), cache);
+
+  hadesmem::Free(process, address);
+  BOOST_TEST_EQ(cache->GetSize(), 0UL);
+  BOOST_TEST_EQ(hadesmem::detail::Query(process, address).State,
+                static_cast<DWORD>(MEM_FREE));
+
+  process.DisableRegionCache();
+  BOOST_TEST(process.GetRegionCache() == nullptr);
+}
+
 int main()
 {
   TestQuery();
   TestProtect();
   QueryAndProtectInvalid();
+  TestRegionCache();
   return boost::report_errors();
 }
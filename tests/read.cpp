@@ -17,7 +17,9 @@
 #include <hadesmem/config.hpp>
 #include <hadesmem/detail/winapi.hpp>
 #include <hadesmem/error.hpp>
+#include <hadesmem/local_buffer.hpp>
 #include <hadesmem/process.hpp>
+#include <hadesmem/read_batch.hpp>
 
 void TestReadPod()
 {
@@ -142,11 +144,93 @@ void TestReadCrossRegion()
   BOOST_TEST(buf == zero_buf);
 }
 
+void TestReadLocalBuffer()
+{
+  char const data[] = "Narrow\0test\0string";
+  hadesmem::LocalBuffer const buffer(data, sizeof(data) - 1);
+
+  BOOST_TEST_EQ(hadesmem::Read<char>(buffer, &data[7]), 't');
+  auto const data_array = hadesmem::Read<char, 6>(buffer, &data[0]);
+  BOOST_TEST_EQ(std::memcmp(&data_array[0], "Narrow", 6), 0);
+  auto const data_vec = hadesmem::ReadVector<char>(buffer, &data[7], 4);
+  BOOST_TEST(data_vec == std::vector<char>({'t', 'e', 's', 't'}));
+  BOOST_TEST(hadesmem::ReadVector<char>(buffer, &data[0], 0).empty());
+
+  BOOST_TEST_EQ(hadesmem::ReadString<char>(buffer, &data[0]), "Narrow");
+  BOOST_TEST_EQ(hadesmem::ReadString<char>(buffer, &data[7]), "test");
+  // No terminator before the end of the buffer.
+  BOOST_TEST_EQ(hadesmem::ReadString<char>(buffer, &data[12]), "string");
+
+  BOOST_TEST_THROWS(hadesmem::Read<std::uint32_t>(buffer, &data[16]),
+                    hadesmem::Error);
+  BOOST_TEST_THROWS(hadesmem::ReadVector<char>(buffer, &data[12], 7),
+                    hadesmem::Error);
+  BOOST_TEST_THROWS(hadesmem::ReadString<char>(buffer, &data[18]),
+                    hadesmem::Error);
+  BOOST_TEST_THROWS(
+    hadesmem::ReadVector<std::uint32_t>(buffer, &data[0], ~std::size_t(0) / 4),
+    hadesmem::Error);
+}
+
+void TestReadBatch()
+{
+  hadesmem::Process const process(::GetCurrentProcessId());
+
+  SYSTEM_INFO const sys_info = hadesmem::detail::GetSystemInfo();
+  DWORD const page_size = sys_info.dwPageSize;
+
+  // Second page is reserved but not committed, so reads from it fail.
+  auto const address = static_cast<std::uint8_t*>(
+    VirtualAlloc(nullptr, page_size * 2, MEM_RESERVE, PAGE_READWRITE));
+  BOOST_TEST(address != nullptr);
+  BOOST_TEST(VirtualAlloc(address, page_size, MEM_COMMIT, PAGE_READWRITE) ==
+             address);
+  for (DWORD i = 0; i < page_size; ++i)
+  {
+    address[i] = static_cast<std::uint8_t>(i);
+  }
+
+  std::uint32_t first = 0;
+  std::uint32_t overlapping = 0;
+  std::uint32_t last = 0;
+  std::uint32_t reserved = 0;
+  std::vector<int> int_list = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::vector<int> int_list_read(int_list.size());
+  std::vector<hadesmem::ReadBatchRequest> requests = {
+    {address + page_size - sizeof(last), sizeof(last), &last, false},
+    {address, sizeof(first), &first, false},
+    {address + 2, sizeof(overlapping), &overlapping, false},
+    {&int_list[0], int_list.size() * sizeof(int), &int_list_read[0], false},
+    {address + page_size, sizeof(reserved), &reserved, false},
+    {address, 0, nullptr, false}};
+  BOOST_TEST(!hadesmem::ReadBatch(process, requests));
+  BOOST_TEST(requests[0].succeeded);
+  BOOST_TEST(requests[1].succeeded);
+  BOOST_TEST(requests[2].succeeded);
+  BOOST_TEST(requests[3].succeeded);
+  BOOST_TEST(!requests[4].succeeded);
+  BOOST_TEST(requests[5].succeeded);
+  BOOST_TEST_EQ(std::memcmp(&first, address, sizeof(first)), 0);
+  BOOST_TEST_EQ(std::memcmp(&overlapping, address + 2, sizeof(overlapping)),
+                0);
+  BOOST_TEST_EQ(
+    std::memcmp(&last, address + page_size - sizeof(last), sizeof(last)), 0);
+  BOOST_TEST(int_list_read == int_list);
+
+  requests.pop_back();
+  requests.pop_back();
+  BOOST_TEST(hadesmem::ReadBatch(process, requests));
+
+  BOOST_TEST(!!VirtualFree(address, 0, MEM_RELEASE));
+}
+
 int main()
 {
   TestReadPod();
   TestReadString();
   TestReadVector();
   TestReadCrossRegion();
+  TestReadLocalBuffer();
+  TestReadBatch();
   return boost::report_errors();
 }